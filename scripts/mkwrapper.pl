@@ -58,8 +58,12 @@ void ::Murmur::${class}I::${func}_async('. join(", ", @{$wrapargs}).qq') {
 		}
 	}
 #endif
+#ifdef DIRECT_${class}_${func}
+	impl_${class}_$func(' . join(", ", @${callargs}).qq');
+#else
 	ExecEvent *ie = new ExecEvent(boost::bind(&impl_${class}_$func, ' . join(", ", @${callargs}).qq'));
 	QCoreApplication::instance()->postEvent(mi, ie);
+#endif
 }
 ';
 
@@ -0,0 +1,153 @@
+#!/usr/bin/env python
+# -*- coding: utf-8
+#
+# Checks a listener handover from the outside, like a client would see it.
+#
+# Starts murmurd with a handoversocket, keeps pinging it over UDP and
+# opening TLS connections, starts a second murmurd on the same
+# configuration and waits for the first one to exit. Fails if a connection
+# attempt was refused, a ping was never answered, or the second instance
+# doesn't serve. A client that was connected across the restart is dropped,
+# as only the listening sockets are handed over; that is reported, not
+# checked.
+#
+# Usage: handovertest.py /path/to/murmurd [port]
+
+from __future__ import print_function
+
+import os, shutil, socket, ssl, struct, subprocess, sys, tempfile, threading, time
+
+murmurd = sys.argv[1]
+port = int(sys.argv[2]) if len(sys.argv) > 2 else 64738
+workdir = tempfile.mkdtemp(prefix = 'handover')
+
+ini = os.path.join(workdir, 'murmur.ini')
+with open(ini, 'w') as f:
+  f.write('database=%s\n' % os.path.join(workdir, 'murmur.sqlite'))
+  f.write('logfile=%s\n' % os.path.join(workdir, 'murmur.log'))
+  f.write('host=127.0.0.1\nport=%d\n' % port)
+  f.write('handoversocket=%s\n' % os.path.join(workdir, 'handover.sock'))
+  f.write('allowping=true\nice=\n')
+
+def start():
+  return subprocess.Popen([murmurd, '-fg', '-ini', ini])
+
+def tls_connect(timeout = 2.0):
+  ctx = ssl.SSLContext(getattr(ssl, 'PROTOCOL_TLS_CLIENT', ssl.PROTOCOL_SSLv23))
+  ctx.check_hostname = False
+  ctx.verify_mode = ssl.CERT_NONE
+  s = socket.create_connection(('127.0.0.1', port), timeout)
+  return ctx.wrap_socket(s)
+
+def wait_serving(deadline):
+  while time.time() < deadline:
+    try:
+      tls_connect().close()
+      return True
+    except (socket.error, ssl.SSLError):
+      time.sleep(0.1)
+  return False
+
+class Pinger(threading.Thread):
+  def __init__(self):
+    threading.Thread.__init__(self)
+    self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    self.sock.settimeout(0.01)
+    self.sent = {}
+    self.answered = {}
+    self.unreachable = 0
+    self.running = True
+
+  def run(self):
+    ident = 0
+    while self.running:
+      ident += 1
+      self.sent[ident] = time.time()
+      self.sock.sendto(struct.pack('>IQ', 0, ident), ('127.0.0.1', port))
+      try:
+        while True:
+          data = self.sock.recv(64)
+          if len(data) == 24:
+            self.answered[struct.unpack('>Q', data[4:12])[0]] = time.time()
+      except socket.timeout:
+        pass
+      except socket.error:
+        # ICMP port unreachable: nobody had the port.
+        self.unreachable += 1
+
+class Connector(threading.Thread):
+  def __init__(self):
+    threading.Thread.__init__(self)
+    self.attempts = 0
+    self.refused = 0
+    self.slowest = 0.0
+    self.running = True
+
+  def run(self):
+    while self.running:
+      t = time.time()
+      self.attempts += 1
+      try:
+        tls_connect(10.0).close()
+        self.slowest = max(self.slowest, time.time() - t)
+      except socket.error as e:
+        if getattr(e, 'errno', None) == 111:
+          self.refused += 1
+      time.sleep(0.05)
+
+failures = []
+old = start()
+new = None
+try:
+  if not wait_serving(time.time() + 20):
+    sys.exit('First instance did not start')
+
+  established = tls_connect()
+  pinger = Pinger()
+  connector = Connector()
+  pinger.start()
+  connector.start()
+  time.sleep(1)
+
+  t = time.time()
+  new = start()
+  old.wait()
+  switched = time.time() - t
+  if not wait_serving(time.time() + 20):
+    failures.append('second instance does not serve')
+  time.sleep(1)
+
+  pinger.running = False
+  connector.running = False
+  pinger.join()
+  connector.join()
+
+  # Allow the last pings a moment to come back.
+  unanswered = [i for i in pinger.sent if i not in pinger.answered and pinger.sent[i] < time.time() - 1.5]
+  gaps = [pinger.answered[i] - pinger.sent[i] for i in pinger.answered]
+
+  established.settimeout(5)
+  try:
+    dropped = (established.recv(1) == b'')
+  except (socket.error, ssl.SSLError):
+    dropped = True
+
+  print('Old instance exited %.2fs after the new one started' % switched)
+  print('Pings: %d sent, %d unanswered, slowest answer %.0fms' % (len(pinger.sent), len(unanswered), 1000 * max(gaps or [0])))
+  print('Connections: %d attempts, %d refused, slowest %.0fms' % (connector.attempts, connector.refused, 1000 * connector.slowest))
+  print('Established connection %s' % ('dropped, as expected' if dropped else 'still open'))
+
+  if connector.refused:
+    failures.append('%d connection attempts refused' % connector.refused)
+  if unanswered or pinger.unreachable:
+    failures.append('%d pings lost, %d unreachable' % (len(unanswered), pinger.unreachable))
+finally:
+  for p in (old, new):
+    if p and p.poll() is None:
+      p.terminate()
+      p.wait()
+  shutil.rmtree(workdir)
+
+if failures:
+  sys.exit('FAILED: ' + ', '.join(failures))
+print('OK')
@@ -36,6 +36,7 @@
 #include "User.h"
 
 #ifdef MURMUR
+#include "Metrics.h"
 #include "ServerUser.h"
 #endif
 
@@ -80,9 +81,13 @@ QFlags<ChanACL::Perm> ChanACL::effectivePermissions(ServerUser *p, Channel *chan
 	}
 
 	if (granted & Cached) {
+		MetricsServer::mcAclCacheHits.add();
 		return granted;
 	}
 
+	if (cache)
+		MetricsServer::mcAclCacheMisses.add();
+
 	QStack<Channel *> chanstack;
 	Channel *ch = chan;
 
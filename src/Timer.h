@@ -38,8 +38,8 @@
 class Timer {
 	protected:
 		quint64 uiStart;
-		static quint64 now();
 	public:
+		static quint64 now();
 		Timer(bool start = true);
 		bool isElapsed(quint64 us);
 		quint64 elapsed() const;
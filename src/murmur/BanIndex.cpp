@@ -0,0 +1,126 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "BanIndex.h"
+
+BanIndex::BanIndex() : qlBans(NULL) {
+}
+
+// Null for bans that never expire.
+QDateTime BanIndex::expiry(const Ban &ban) {
+	if (ban.iDuration == 0)
+		return QDateTime();
+	return ban.qdtStart.addSecs(ban.iDuration);
+}
+
+// Several bans for the same prefix or hash only need the one lasting longest.
+void BanIndex::setBan(int &slot, int ban) {
+	if (slot >= 0) {
+		const QDateTime &current = expiry(qlBans->at(slot));
+		const QDateTime &candidate = expiry(qlBans->at(ban));
+		if (current.isNull() || (! candidate.isNull() && (candidate <= current)))
+			return;
+	}
+	slot = ban;
+}
+
+void BanIndex::rebuild(const QList<Ban> &bans) {
+	qlBans = &bans;
+	qvNodes.clear();
+	qhHashes.clear();
+
+	Node root;
+	root.iChild[0] = root.iChild[1] = -1;
+	root.iBan = -1;
+	qvNodes.append(root);
+
+	for (int i=0;i<bans.count();++i) {
+		const Ban &ban = bans.at(i);
+
+		if (! ban.qsHash.isEmpty()) {
+			QHash<QString, int>::iterator it = qhHashes.find(ban.qsHash);
+			if (it == qhHashes.end())
+				qhHashes.insert(ban.qsHash, i);
+			else
+				setBan(*it, i);
+		}
+
+		if (! ban.isValid())
+			continue;
+
+		int node = 0;
+		for (int bit=0;bit<ban.iMask;++bit) {
+			int dir = (ban.haAddress.qip6.c[bit >> 3] >> (7 - (bit & 7))) & 1;
+			int next = qvNodes.at(node).iChild[dir];
+			if (next < 0) {
+				Node n;
+				n.iChild[0] = n.iChild[1] = -1;
+				n.iBan = -1;
+				next = qvNodes.count();
+				qvNodes.append(n);
+				qvNodes[node].iChild[dir] = next;
+			}
+			node = next;
+		}
+		setBan(qvNodes[node].iBan, i);
+	}
+
+	qvNodes.squeeze();
+}
+
+// Walks the address from the most significant bit and returns the first
+// unexpired ban on the way, i.e. the shortest matching prefix.
+const Ban *BanIndex::match(const HostAddress &ha) const {
+	if (qvNodes.isEmpty())
+		return NULL;
+
+	const Node *nodes = qvNodes.constData();
+	int node = 0;
+	for (int bit=0;;++bit) {
+		const Node &n = nodes[node];
+		if ((n.iBan >= 0) && ! qlBans->at(n.iBan).isExpired())
+			return & qlBans->at(n.iBan);
+		if (bit == 128)
+			return NULL;
+		node = n.iChild[(ha.qip6.c[bit >> 3] >> (7 - (bit & 7))) & 1];
+		if (node < 0)
+			return NULL;
+	}
+}
+
+const Ban *BanIndex::matchHash(const QString &hash) const {
+	QHash<QString, int>::const_iterator it = qhHashes.constFind(hash);
+	if ((it == qhHashes.constEnd()) || qlBans->at(*it).isExpired())
+		return NULL;
+	return & qlBans->at(*it);
+}
@@ -0,0 +1,111 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "BandwidthRecord.h"
+
+#define BANDWIDTH_WINDOW 1000000ULL
+
+BandwidthRecord::BandwidthRecord() {
+	uiLastFrame = uiRefill = uiWindow = Timer::now();
+	iTokens = -1;
+	iWindowBytes = iPrevWindowBytes = 0;
+}
+
+bool BandwidthRecord::addFrame(int size, int maxpersec, int burstms) {
+	return addFrame(size, maxpersec, burstms, Timer::now());
+}
+
+bool BandwidthRecord::addFrame(int size, int maxpersec, int burstms, quint64 now) {
+	const qint64 cost = static_cast<qint64>(size) * 1000000LL;
+	qint64 capacity = static_cast<qint64>(maxpersec) * static_cast<qint64>(burstms) * 1000LL;
+
+	// A bucket smaller than a single frame would never let anything through.
+	if (capacity < cost)
+		capacity = cost;
+
+	// Start out full, and refill on every call, accepted or not.
+	quint64 elapsed = (now > uiRefill) ? now - uiRefill : 0ULL;
+	uiRefill = now;
+	if ((iTokens < 0) || (elapsed >= static_cast<quint64>(qMax(burstms, 1)) * 1000ULL))
+		iTokens = capacity;
+	else
+		iTokens = qMin(iTokens + static_cast<qint64>(elapsed) * maxpersec, capacity);
+
+	if (iTokens < cost)
+		return false;
+
+	iTokens -= cost;
+	uiLastFrame = now;
+
+	quint64 age = (now > uiWindow) ? now - uiWindow : 0ULL;
+	if (age >= BANDWIDTH_WINDOW) {
+		iPrevWindowBytes = (age < 2 * BANDWIDTH_WINDOW) ? iWindowBytes : 0;
+		iWindowBytes = 0;
+		uiWindow = (age < 2 * BANDWIDTH_WINDOW) ? uiWindow + BANDWIDTH_WINDOW : now;
+	}
+	iWindowBytes += size;
+
+	return true;
+}
+
+int BandwidthRecord::onlineSeconds() const {
+	return static_cast<int>(tFirst.elapsed() / 1000000LL);
+}
+
+int BandwidthRecord::idleSeconds() const {
+	quint64 now = Timer::now();
+	quint64 iIdle = (now > uiLastFrame) ? now - uiLastFrame : 0ULL;
+	if (tIdleControl.elapsed() < iIdle)
+		iIdle = tIdleControl.elapsed();
+
+	return static_cast<int>(iIdle / 1000000LL);
+}
+
+void BandwidthRecord::resetIdleSeconds() {
+	tIdleControl.restart();
+}
+
+int BandwidthRecord::bandwidth() const {
+	return bandwidth(Timer::now());
+}
+
+int BandwidthRecord::bandwidth(quint64 now) const {
+	quint64 age = (now > uiWindow) ? now - uiWindow : 0ULL;
+
+	if (age >= 2 * BANDWIDTH_WINDOW)
+		return 0;
+	if (age >= BANDWIDTH_WINDOW)
+		return static_cast<int>((iWindowBytes * (2 * BANDWIDTH_WINDOW - age)) / BANDWIDTH_WINDOW);
+
+	return static_cast<int>(iWindowBytes + (iPrevWindowBytes * (BANDWIDTH_WINDOW - age)) / BANDWIDTH_WINDOW);
+}
@@ -0,0 +1,67 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_BANDWIDTHRECORD_H_
+#define MUMBLE_MURMUR_BANDWIDTHRECORD_H_
+
+#include "Timer.h"
+
+// Token bucket voice rate limiter. The bucket fills at the allowed rate and
+// holds at most burstms worth of it, so a user may exceed the limit briefly
+// (e.g. when starting to talk) but never on average. Tokens are kept in
+// byte-microseconds so refilling needs no division.
+//
+// The bandwidth estimate uses two one-second windows, weighting the previous
+// one by how much of it still overlaps the last second.
+//
+// All functions taking a timestamp expect Timer::now() values.
+
+struct BandwidthRecord {
+	Timer tFirst;
+	Timer tIdleControl;
+	quint64 uiLastFrame;
+	quint64 uiRefill;
+	qint64 iTokens;
+	quint64 uiWindow;
+	int iWindowBytes;
+	int iPrevWindowBytes;
+
+	BandwidthRecord();
+	bool addFrame(int size, int maxpersec, int burstms);
+	bool addFrame(int size, int maxpersec, int burstms, quint64 now);
+	int onlineSeconds() const;
+	int idleSeconds() const;
+	void resetIdleSeconds();
+	int bandwidth() const;
+	int bandwidth(quint64 now) const;
+};
+
+#endif
@@ -0,0 +1,155 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "BlobStore.h"
+
+BlobStore::BlobStore(int bytes) : iPinnedBytes(0) {
+	uiHits = uiMisses = uiShared = 0ULL;
+	setBudget(bytes);
+}
+
+void BlobStore::setBudget(int bytes) {
+	qcCache.setMaxCost(qMax(bytes, 0));
+}
+
+void BlobStore::clear() {
+	qhPinned.clear();
+	qcCache.clear();
+	iPinnedBytes = 0;
+}
+
+QByteArray BlobStore::hash(const QByteArray &data) {
+	return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+// Adds data to the store without referring to it, and returns its hash.
+// If the blob is already there, the existing copy is kept and shared.
+QByteArray BlobStore::insert(const QByteArray &data) {
+	const QByteArray &h = hash(data);
+
+	QHash<QByteArray, Blob>::iterator i = qhPinned.find(h);
+	if (i != qhPinned.end()) {
+		if (i->bLoaded) {
+			++uiShared;
+		} else {
+			i->bLoaded = true;
+			i->qbaData = data;
+			iPinnedBytes += data.size();
+		}
+	} else if (qcCache.contains(h)) {
+		++uiShared;
+	} else {
+		// Drops the blob right away if it exceeds the whole budget.
+		qcCache.insert(h, new QByteArray(data), data.size());
+	}
+	return h;
+}
+
+void BlobStore::acquire(const QByteArray &h) {
+	QHash<QByteArray, Blob>::iterator i = qhPinned.find(h);
+	if (i != qhPinned.end()) {
+		++i->iRefs;
+		return;
+	}
+
+	Blob b;
+	b.iRefs = 1;
+	QByteArray *cached = qcCache.take(h);
+	if (cached) {
+		b.bLoaded = true;
+		b.qbaData = *cached;
+		iPinnedBytes += b.qbaData.size();
+		delete cached;
+	}
+	qhPinned.insert(h, b);
+}
+
+void BlobStore::release(const QByteArray &h) {
+	QHash<QByteArray, Blob>::iterator i = qhPinned.find(h);
+	if (i == qhPinned.end())
+		return;
+	if (--i->iRefs > 0)
+		return;
+
+	if (i->bLoaded) {
+		iPinnedBytes -= i->qbaData.size();
+		qcCache.insert(h, new QByteArray(i->qbaData), i->qbaData.size());
+	}
+	qhPinned.erase(i);
+}
+
+bool BlobStore::get(const QByteArray &h, QByteArray &data) {
+	QHash<QByteArray, Blob>::const_iterator i = qhPinned.constFind(h);
+	if ((i != qhPinned.constEnd()) && i->bLoaded) {
+		data = i->qbaData;
+		++uiHits;
+		return true;
+	}
+
+	const QByteArray *cached = qcCache.object(h);
+	if (cached) {
+		data = *cached;
+		++uiHits;
+		return true;
+	}
+
+	++uiMisses;
+	return false;
+}
+
+bool BlobStore::contains(const QByteArray &h) const {
+	QHash<QByteArray, Blob>::const_iterator i = qhPinned.constFind(h);
+	if (i != qhPinned.constEnd())
+		return i->bLoaded;
+	return qcCache.contains(h);
+}
+
+int BlobStore::refs(const QByteArray &h) const {
+	return qhPinned.value(h).iRefs;
+}
+
+int BlobStore::count() const {
+	return qhPinned.count() + qcCache.count();
+}
+
+qint64 BlobStore::pinnedBytes() const {
+	return iPinnedBytes;
+}
+
+int BlobStore::cachedBytes() const {
+	return qcCache.totalCost();
+}
+
+int BlobStore::budget() const {
+	return qcCache.maxCost();
+}
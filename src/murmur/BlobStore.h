@@ -0,0 +1,90 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_BLOBSTORE_H_
+#define MUMBLE_MURMUR_BLOBSTORE_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtCore/QHash>
+
+// Textures and comments of all servers, addressed by the SHA1 hash clients
+// use to ask for them, so identical ones are only held once.
+//
+// A blob is pinned while any user refers to it. A user may refer to a blob
+// whose data has not been loaded yet; whoever has it at hand (usually the
+// database) can fill it in later. Once nobody refers to a blob it moves to a
+// least recently used cache, which never holds more than the byte budget.
+//
+// Not thread safe; only used from the main thread.
+
+class BlobStore {
+	private:
+		Q_DISABLE_COPY(BlobStore)
+	public:
+		// Anything shorter is sent to clients directly instead of by hash.
+		static const int iMinimumSize = 128;
+
+		struct Blob {
+			int iRefs;
+			bool bLoaded;
+			QByteArray qbaData;
+			Blob() : iRefs(0), bLoaded(false) {}
+		};
+	protected:
+		QHash<QByteArray, Blob> qhPinned;
+		QCache<QByteArray, QByteArray> qcCache;
+		qint64 iPinnedBytes;
+	public:
+		quint64 uiHits;
+		quint64 uiMisses;
+		// Blobs that were already present when inserted again.
+		quint64 uiShared;
+
+		BlobStore(int bytes = 8 * 1024 * 1024);
+		void setBudget(int bytes);
+		void clear();
+
+		static QByteArray hash(const QByteArray &data);
+		QByteArray insert(const QByteArray &data);
+		void acquire(const QByteArray &hash);
+		void release(const QByteArray &hash);
+		bool get(const QByteArray &hash, QByteArray &data);
+		bool contains(const QByteArray &hash) const;
+		int refs(const QByteArray &hash) const;
+
+		int count() const;
+		qint64 pinnedBytes() const;
+		int cachedBytes() const;
+		int budget() const;
+};
+
+#endif
@@ -0,0 +1,160 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "FloodLimiter.h"
+#include "Timer.h"
+
+FloodLimiter::FloodLimiter(int entries) {
+	int buckets = 1;
+	while (buckets * Ways < entries)
+		buckets <<= 1;
+
+	Entry e;
+	e.uiSeen = e.uiWindow = e.uiBanned = 0;
+	e.usCount = e.usPrevCount = 0;
+	qvEntries.fill(e, buckets * Ways);
+	uiMask = static_cast<quint32>(buckets - 1);
+
+	RAND_bytes(reinterpret_cast<unsigned char *>(&uiSeed), sizeof(uiSeed));
+	uiEpoch = Timer::now();
+
+	uiChecks = uiRejected = uiBans = uiEvictions = 0ULL;
+}
+
+HostAddress FloodLimiter::key(const HostAddress &ha) {
+	HostAddress k = ha;
+	if (k.isV6())
+		k.addr[1] = 0ULL;
+	return k;
+}
+
+quint32 FloodLimiter::bucket(const HostAddress &k) const {
+	// 64 bit finalizer from MurmurHash3.
+	quint64 h = uiSeed ^ k.addr[0] ^ (k.addr[1] * 0x9e3779b97f4a7c15ULL);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return static_cast<quint32>(h) & uiMask;
+}
+
+bool FloodLimiter::check(const QHostAddress &addr, int tries, int timeframe, int bantime) {
+	return check(HostAddress(addr), tries, timeframe, bantime, Timer::now());
+}
+
+// Counts an attempt from the given address and returns true if it should be
+// refused.
+bool FloodLimiter::check(const HostAddress &addr, int tries, int timeframe, int bantime, quint64 now) {
+	const HostAddress &k = key(addr);
+	const quint32 t = static_cast<quint32>((now - uiEpoch) / 1000000ULL) + 1;
+	const quint32 tf = static_cast<quint32>(qMax(timeframe, 1));
+
+	++uiChecks;
+
+	Entry *first = qvEntries.data() + bucket(k) * Ways;
+	Entry *e = NULL;
+	for (int i=0;i<Ways;++i) {
+		if (first[i].uiSeen && (first[i].haKey == k)) {
+			e = first + i;
+			break;
+		}
+	}
+
+	if (! e) {
+		// Take a free entry, or the one seen least recently, sparing bans.
+		e = first;
+		for (int i=1;i<Ways;++i) {
+			Entry *c = first + i;
+			bool cbanned = c->uiBanned > t;
+			bool ebanned = e->uiBanned > t;
+			if (! e->uiSeen)
+				break;
+			if (! c->uiSeen || (cbanned != ebanned ? ebanned : (c->uiSeen < e->uiSeen)))
+				e = c;
+		}
+		if (e->uiSeen)
+			++uiEvictions;
+
+		e->haKey = k;
+		e->uiSeen = t;
+		e->uiWindow = t;
+		e->uiBanned = 0;
+		e->usCount = 1;
+		e->usPrevCount = 0;
+		return false;
+	}
+
+	e->uiSeen = t;
+
+	if (e->uiBanned > t) {
+		++uiRejected;
+		return true;
+	}
+
+	quint32 age = t - e->uiWindow;
+	if (age >= 2 * tf) {
+		e->usPrevCount = 0;
+		e->usCount = 0;
+		e->uiWindow = t;
+	} else if (age >= tf) {
+		e->usPrevCount = e->usCount;
+		e->usCount = 0;
+		e->uiWindow += tf;
+	}
+	age = t - e->uiWindow;
+
+	if (e->usCount < 0xffff)
+		++e->usCount;
+
+	quint32 estimate = e->usCount + (e->usPrevCount * (tf - age)) / tf;
+	if (estimate > static_cast<quint32>(tries)) {
+		e->uiBanned = t + static_cast<quint32>(qMax(bantime, 0));
+		++uiBans;
+		++uiRejected;
+		return true;
+	}
+	return false;
+}
+
+int FloodLimiter::tracked() const {
+	int n = 0;
+	foreach(const Entry &e, qvEntries)
+		if (e.uiSeen)
+			++n;
+	return n;
+}
+
+int FloodLimiter::capacity() const {
+	return qvEntries.count();
+}
@@ -0,0 +1,86 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_FLOODLIMITER_H_
+#define MUMBLE_MURMUR_FLOODLIMITER_H_
+
+#include <QtCore/QVector>
+
+#include "Net.h"
+
+class QHostAddress;
+
+// Fixed memory connection attempt limiter. Sources are tracked in a hash
+// table of 4-way buckets that never grows; when a bucket is full, the entry
+// seen least recently (preferring ones that are not banned) is evicted. The
+// hash is seeded at random so remote hosts cannot aim for a bucket.
+//
+// Attempts are counted with a sliding window approximation: the count of
+// the current timeframe plus the count of the previous one, weighted by how
+// much of it still overlaps. IPv6 sources are aggregated per /64, since a
+// single host usually has the whole prefix to itself.
+
+class FloodLimiter {
+	private:
+		Q_DISABLE_COPY(FloodLimiter)
+	public:
+		struct Entry {
+			HostAddress haKey;
+			// Seconds since uiEpoch, 0 means unused.
+			quint32 uiSeen;
+			quint32 uiWindow;
+			quint32 uiBanned;
+			quint16 usCount;
+			quint16 usPrevCount;
+		};
+	protected:
+		enum { Ways = 4 };
+		QVector<Entry> qvEntries;
+		quint32 uiMask;
+		quint64 uiSeed;
+		quint64 uiEpoch;
+
+		quint32 bucket(const HostAddress &) const;
+	public:
+		quint64 uiChecks;
+		quint64 uiRejected;
+		quint64 uiBans;
+		quint64 uiEvictions;
+
+		FloodLimiter(int entries = 65536);
+		static HostAddress key(const HostAddress &);
+		bool check(const QHostAddress &, int tries, int timeframe, int bantime);
+		bool check(const HostAddress &, int tries, int timeframe, int bantime, quint64 now);
+		int tracked() const;
+		int capacity() const;
+};
+
+#endif
@@ -0,0 +1,322 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "Handover.h"
+#include "Meta.h"
+#include "Server.h"
+
+#include <sys/un.h>
+
+#define HANDOVER_REQUEST 'H'
+
+QHash<QString, QPair<int, int> > Handover::qhReceived;
+
+QString Handover::key(int server, const QHostAddress &address, unsigned short port) {
+	return QString::fromLatin1("%1 %2 %3").arg(server).arg(address.toString()).arg(port);
+}
+
+static bool unixAddress(const QString &path, struct sockaddr_un &addr) {
+	const QByteArray name = QFile::encodeName(path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (name.size() >= static_cast<int>(sizeof(addr.sun_path))) {
+		qWarning("Handover: Socket path %s is too long", name.constData());
+		return false;
+	}
+	memcpy(addr.sun_path, name.constData(), name.size());
+	return true;
+}
+
+static void setTimeout(int fd, int seconds) {
+	struct timeval tv;
+	tv.tv_sec = seconds;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+bool Handover::sendRecord(int fd, const Record &r, int tcp, int udp) {
+	struct msghdr msg;
+	struct iovec iov;
+	char control[CMSG_SPACE(2 * sizeof(int))];
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = const_cast<Record *>(&r);
+	iov.iov_len = sizeof(r);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if ((tcp >= 0) && (udp >= 0)) {
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+		int fds[2] = { tcp, udp };
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	}
+
+	return (::sendmsg(fd, &msg, 0) == static_cast<ssize_t>(sizeof(r)));
+}
+
+// Returns 1 for a record, 0 at the end of the stream and -1 on errors.
+// Both descriptors are -1 if the record carried none.
+int Handover::recvRecord(int fd, Record &r, int fds[2]) {
+	struct msghdr msg;
+	struct iovec iov;
+	char control[CMSG_SPACE(2 * sizeof(int))];
+
+	fds[0] = fds[1] = -1;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &r;
+	iov.iov_len = sizeof(r);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	const ssize_t len = ::recvmsg(fd, &msg, MSG_WAITALL);
+	if (len == 0)
+		return 0;
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS) && (cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))))
+			memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+	}
+
+	if ((len != static_cast<ssize_t>(sizeof(r))) || (msg.msg_flags & MSG_CTRUNC)) {
+		if (fds[0] >= 0)
+			close(fds[0]);
+		if (fds[1] >= 0)
+			close(fds[1]);
+		return -1;
+	}
+
+	r.cAddress[sizeof(r.cAddress) - 1] = 0;
+	return 1;
+}
+
+// Called before booting. Returns true if a running instance handed over its
+// sockets and has exited.
+bool Handover::receive(const QString &path) {
+	struct sockaddr_un addr;
+	if (! unixAddress(path, addr))
+		return false;
+
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return false;
+
+	// Nobody listening is the normal case of a plain start.
+	if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+		close(fd);
+		return false;
+	}
+
+	qWarning("Handover: Taking over sockets from the running instance");
+
+	setTimeout(fd, 10);
+	const char request = HANDOVER_REQUEST;
+	if (::write(fd, &request, 1) != 1) {
+		close(fd);
+		return false;
+	}
+
+	QHash<QString, QPair<int, int> > received;
+	bool complete = false;
+
+	forever {
+		Record r;
+		int fds[2];
+		if (recvRecord(fd, r, fds) <= 0)
+			break;
+		if (r.iServer == 0) {
+			complete = true;
+			break;
+		}
+		if ((fds[0] < 0) || (fds[1] < 0))
+			break;
+		received.insert(QString::fromLatin1("%1 %2 %3").arg(r.iServer).arg(QString::fromLatin1(r.cAddress)).arg(r.usPort), qMakePair(fds[0], fds[1]));
+	}
+
+	if (! complete) {
+		qWarning("Handover: Incomplete, starting normally");
+		QPair<int, int> p;
+		foreach(p, received) {
+			close(p.first);
+			close(p.second);
+		}
+		close(fd);
+		return false;
+	}
+
+	qhReceived = received;
+
+	// The old instance keeps the connection open until it exits.
+	setTimeout(fd, 30);
+	char c;
+	while (::read(fd, &c, 1) > 0) {
+	}
+	close(fd);
+
+	qWarning("Handover: Received %d listening sockets", qhReceived.count());
+	return true;
+}
+
+bool Handover::take(int server, const QHostAddress &address, unsigned short port, int &tcp, int &udp) {
+	const QString &k = key(server, address, port);
+	if (! qhReceived.contains(k))
+		return false;
+
+	const QPair<int, int> p = qhReceived.take(k);
+	tcp = p.first;
+	udp = p.second;
+	return true;
+}
+
+// Sockets of servers or addresses that no longer exist in this configuration.
+void Handover::closeUnused() {
+	QPair<int, int> p;
+	foreach(p, qhReceived) {
+		close(p.first);
+		close(p.second);
+	}
+	qhReceived.clear();
+}
+
+Handover::Handover(const QString &path, QObject *p) : QObject(p) {
+	qsPath = path;
+	iListen = iPeer = -1;
+	qsnListen = NULL;
+
+	struct sockaddr_un addr;
+	if (! unixAddress(path, addr))
+		return;
+
+	iListen = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (iListen < 0)
+		return;
+
+	// Whoever had the path before has exited or handed over to us.
+	unlink(addr.sun_path);
+
+	if ((::bind(iListen, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) || (::listen(iListen, 1) != 0)) {
+		qWarning("Handover: Failed to listen on %s: %s", addr.sun_path, strerror(errno));
+		close(iListen);
+		iListen = -1;
+		return;
+	}
+	chmod(addr.sun_path, S_IRUSR | S_IWUSR);
+
+	qsnListen = new QSocketNotifier(iListen, QSocketNotifier::Read, this);
+	connect(qsnListen, SIGNAL(activated(int)), this, SLOT(newConnection()));
+}
+
+Handover::~Handover() {
+	if (iListen >= 0) {
+		close(iListen);
+		// After a handover, the path belongs to the new instance.
+		if (iPeer < 0)
+			QFile::remove(qsPath);
+	}
+}
+
+void Handover::newConnection() {
+	int fd = ::accept(iListen, NULL, NULL);
+	if (fd < 0)
+		return;
+
+#ifdef Q_OS_LINUX
+	struct ucred cred;
+	socklen_t credlen = sizeof(cred);
+	if ((getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) != 0) || (cred.uid != getuid())) {
+		qWarning("Handover: Refusing request from another user");
+		close(fd);
+		return;
+	}
+#endif
+
+	setTimeout(fd, 5);
+	char request = 0;
+	if ((::read(fd, &request, 1) != 1) || (request != HANDOVER_REQUEST) || (iPeer >= 0)) {
+		close(fd);
+		return;
+	}
+
+	int count = 0;
+	foreach(Server *s, meta->qhServers) {
+		for (int i=0;(i < s->qlServer.count()) && (i < s->qlUdpSocket.count());++i) {
+			SslServer *ss = s->qlServer.at(i);
+			Record r;
+			memset(&r, 0, sizeof(r));
+			r.iServer = s->iServerNum;
+			r.usPort = s->usPort;
+			qstrncpy(r.cAddress, ss->serverAddress().toString().toLatin1().constData(), sizeof(r.cAddress));
+
+			if (! sendRecord(fd, r, ss->socketDescriptor(), s->qlUdpSocket.at(i))) {
+				qWarning("Handover: Failed to send sockets: %s", strerror(errno));
+				close(fd);
+				return;
+			}
+			++count;
+		}
+	}
+
+	Record end;
+	memset(&end, 0, sizeof(end));
+	if (! sendRecord(fd, end, -1, -1)) {
+		close(fd);
+		return;
+	}
+
+	qWarning("Handover: Handed %d listening sockets to the new instance, shutting down", count);
+
+	// Kept open until we exit, which is what the new instance waits for.
+	iPeer = fd;
+	qsnListen->setEnabled(false);
+
+	// Stop accepting right away; connections queue up for the new instance.
+	foreach(Server *s, meta->qhServers)
+		foreach(SslServer *ss, s->qlServer)
+			ss->close();
+
+	// The pid file is the new instance's now.
+	Meta::mp.qsPid = QString();
+
+	QCoreApplication::instance()->quit();
+}
@@ -0,0 +1,90 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_HANDOVER_H_
+#define MUMBLE_MURMUR_HANDOVER_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+
+class QHostAddress;
+class QSocketNotifier;
+
+// Listener handover: restarts without closing the listening sockets, and
+// nothing more. A running murmurd listens
+// on handoversocket; a new one started with the same configuration connects
+// there before booting and is passed the TCP and UDP sockets of every
+// virtual server with SCM_RIGHTS. The old process then stops accepting and
+// shuts down, and the new one waits for it to exit before it goes on, so
+// the Ice, D-Bus and metrics endpoints are free again by then.
+//
+// Connections and datagrams arriving in between queue up in the kernel
+// rather than being refused. Sessions are not handed over: their TLS state
+// lives inside QSslSocket in the old process, so connected clients are
+// dropped and reconnect to the new instance. scripts/server/handover has a
+// script checking this from the client side.
+
+class Handover : public QObject {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(Handover)
+	public:
+		struct Record {
+			qint32 iServer;
+			quint16 usPort;
+			char cAddress[64];
+		};
+	protected:
+		QString qsPath;
+		int iListen;
+		int iPeer;
+		QSocketNotifier *qsnListen;
+
+		// Received sockets by server, address and port.
+		static QHash<QString, QPair<int, int> > qhReceived;
+
+		static QString key(int server, const QHostAddress &address, unsigned short port);
+		static bool sendRecord(int fd, const Record &, int tcp, int udp);
+		static int recvRecord(int fd, Record &, int fds[2]);
+	public:
+		Handover(const QString &path, QObject *parent = NULL);
+		~Handover();
+
+		static bool receive(const QString &path);
+		static bool take(int server, const QHostAddress &address, unsigned short port, int &tcp, int &udp);
+		static void closeUnused();
+	public slots:
+		void newConnection();
+};
+
+#endif
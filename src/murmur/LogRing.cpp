@@ -0,0 +1,105 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "murmur_pch.h"
+
+#include "LogRing.h"
+
+static inline unsigned int loadAcquire(const QAtomicInt &a) {
+#if QT_VERSION >= 0x050000
+	return static_cast<unsigned int>(a.loadAcquire());
+#else
+	return static_cast<unsigned int>(const_cast<QAtomicInt &>(a).fetchAndAddAcquire(0));
+#endif
+}
+
+LogRing::LogRing(int capacity) : qaiHead(0), uiTail(0) {
+	unsigned int size = 2;
+	while (size < static_cast<unsigned int>(qMax(capacity, 2)))
+		size <<= 1;
+
+	uiMask = size - 1;
+	pSlots = new Slot[size];
+	for (unsigned int i=0;i<size;++i)
+		pSlots[i].qaiSequence.fetchAndStoreRelaxed(static_cast<int>(i));
+}
+
+LogRing::~LogRing() {
+	delete [] pSlots;
+}
+
+int LogRing::capacity() const {
+	return static_cast<int>(uiMask + 1);
+}
+
+bool LogRing::push(const Entry &e) {
+	unsigned int pos = loadAcquire(qaiHead);
+	Slot *s;
+
+	forever {
+		s = &pSlots[pos & uiMask];
+		const int diff = static_cast<int>(loadAcquire(s->qaiSequence) - pos);
+		if (diff == 0) {
+			// The slot is free for this position; try to claim it.
+			if (qaiHead.testAndSetRelaxed(static_cast<int>(pos), static_cast<int>(pos + 1)))
+				break;
+			pos = loadAcquire(qaiHead);
+		} else if (diff < 0) {
+			// The consumer has not taken the line a full lap ago yet.
+			return false;
+		} else {
+			pos = loadAcquire(qaiHead);
+		}
+	}
+
+	s->e = e;
+	s->qaiSequence.fetchAndStoreRelease(static_cast<int>(pos + 1));
+	return true;
+}
+
+bool LogRing::pop(Entry &e) {
+	Slot *s = &pSlots[uiTail & uiMask];
+	if (static_cast<int>(loadAcquire(s->qaiSequence) - (uiTail + 1)) < 0)
+		return false;
+
+	e = s->e;
+	s->e.qsMessage = QString();
+	s->qaiSequence.fetchAndStoreRelease(static_cast<int>(uiTail + uiMask + 1));
+	++uiTail;
+	return true;
+}
+
+unsigned int LogRing::head() const {
+	return loadAcquire(qaiHead);
+}
+
+unsigned int LogRing::tail() const {
+	return uiTail;
+}
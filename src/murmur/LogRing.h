@@ -0,0 +1,75 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUMBLE_MURMUR_LOGRING_H_
+#define MUMBLE_MURMUR_LOGRING_H_
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QString>
+
+// Bounded queue of log lines, written to by any number of threads without
+// taking a lock and read by a single consumer.
+//
+// Each slot carries a sequence number telling whether it is free for the
+// producer that claimed its position or holds a line for the consumer, so
+// producers only contend on claiming positions. When the ring is full,
+// push() fails instead of waiting.
+
+class LogRing {
+	private:
+		Q_DISABLE_COPY(LogRing)
+	public:
+		struct Entry {
+			int iServerNum;
+			unsigned int uiTime;
+			QString qsMessage;
+			Entry() : iServerNum(0), uiTime(0) {}
+		};
+	protected:
+		struct Slot {
+			QAtomicInt qaiSequence;
+			Entry e;
+		};
+		Slot *pSlots;
+		unsigned int uiMask;
+		QAtomicInt qaiHead;
+		unsigned int uiTail;
+	public:
+		LogRing(int capacity);
+		~LogRing();
+		int capacity() const;
+		bool push(const Entry &e);
+		bool pop(Entry &e);
+		// Positions claimed by producers so far, and taken by the consumer.
+		unsigned int head() const;
+		unsigned int tail() const;
+};
+
+#endif
@@ -0,0 +1,209 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "murmur_pch.h"
+
+#include "LogSink.h"
+#include "Meta.h"
+#include "Metrics.h"
+
+// Lines per server kept in memory for getLog.
+#define LOG_RECENT 256
+
+// Most entries deleted per retention transaction.
+#define LOG_EXPIRE_CHUNK 1000
+
+// Milliseconds the writer thread waits between two retention chunks, so the
+// main thread gets its turn at the database.
+#define LOG_EXPIRE_PAUSE 200
+
+LogSink::LogSink(int capacity, int flushms, bool threaded, QObject *p) : QThread(p), lrRing(capacity) {
+	iFlushInterval = qMax(flushms, 10);
+	bThreaded = threaded;
+	bStop = false;
+	bExpire = true;
+	uiWritten = 0;
+	qtFlush = NULL;
+
+	if (! bThreaded) {
+		qtFlush = new QTimer(this);
+		connect(qtFlush, SIGNAL(timeout()), this, SLOT(flush()));
+		qtFlush->start(iFlushInterval);
+	}
+}
+
+LogSink::~LogSink() {
+	if (bThreaded) {
+		qmWait.lock();
+		bStop = true;
+		qwcWake.wakeAll();
+		qmWait.unlock();
+
+		wait();
+	} else {
+		drain();
+	}
+}
+
+void LogSink::log(int server_id, const QString &msg) {
+	LogRing::Entry e;
+	e.iServerNum = server_id;
+	e.uiTime = QDateTime::currentDateTime().toTime_t();
+	e.qsMessage = msg;
+
+	if (! lrRing.push(e)) {
+		MetricsServer::mcLogDropped.add();
+		return;
+	}
+
+	// Wake the writer early each time another half of the ring has filled.
+	if (bThreaded && ((lrRing.head() & (lrRing.capacity() / 2 - 1)) == 0))
+		qwcWake.wakeOne();
+}
+
+void LogSink::run() {
+	bool stop = false;
+
+	while (! stop) {
+		qmWait.lock();
+		if (! bStop)
+			qwcWake.wait(&qmWait, bExpire ? LOG_EXPIRE_PAUSE : iFlushInterval);
+		stop = bStop;
+		qmWait.unlock();
+
+		drain();
+		if (! stop)
+			expire();
+	}
+}
+
+/// Writes out what is queued, on the main thread. Used from a timer when
+/// there is no writer thread.
+void LogSink::flush() {
+	drain();
+	expire();
+}
+
+void LogSink::drain() {
+	QList<LogRing::Entry> batch;
+	LogRing::Entry e;
+	while (lrRing.pop(e))
+		batch << e;
+
+	if (! batch.isEmpty()) {
+		write(batch);
+		remember(batch);
+	}
+
+	qmSync.lock();
+	uiWritten = lrRing.tail();
+	qwcSynced.wakeAll();
+	qmSync.unlock();
+}
+
+void LogSink::write(const QList<LogRing::Entry> &batch) {
+	QVariantList serverids, msgs;
+	foreach(const LogRing::Entry &e, batch) {
+		serverids << e.iServerNum;
+		msgs << e.qsMessage;
+	}
+
+	ServerDB::writeLog(serverids, msgs);
+	MetricsServer::mcLogWritten.add(batch.count());
+}
+
+// Adds a written batch to the lines kept in memory, newest first.
+void LogSink::remember(const QList<LogRing::Entry> &batch) {
+	QMutexLocker l(&qmRecent);
+	foreach(const LogRing::Entry &e, batch) {
+		QList<ServerDB::LogRecord> &ql = qhRecent[e.iServerNum];
+		ql.prepend(ServerDB::LogRecord(e.uiTime, e.qsMessage));
+		if (ql.count() > LOG_RECENT)
+			ql.removeLast();
+	}
+}
+
+// Looks for expired entries once a minute, and deletes them a chunk per
+// round while there are more.
+void LogSink::expire() {
+	if (Meta::mp.iLogDays <= 0) {
+		bExpire = false;
+		return;
+	}
+
+	if (tExpire.isElapsed(60ULL * 1000000ULL))
+		bExpire = true;
+	if (bExpire)
+		bExpire = ServerDB::expireLog(LOG_EXPIRE_CHUNK);
+}
+
+/// Returns once every line logged so far is in the database.
+void LogSink::sync() {
+	if (! bThreaded) {
+		drain();
+		return;
+	}
+
+	const unsigned int pos = lrRing.head();
+	QMutexLocker l(&qmSync);
+	while (isRunning() && (static_cast<int>(uiWritten - pos) < 0)) {
+		qwcWake.wakeOne();
+		qwcSynced.wait(&qmSync, 100);
+	}
+}
+
+/// Fills ql with up to count lines of the server's log, skipping the offs
+/// most recent ones. Returns false if they are not all in memory. Lines are
+/// added by the writer once they are in the database, so this never waits
+/// for it, but lines logged within the last logflush milliseconds may not be
+/// here yet.
+bool LogSink::recent(int server_id, unsigned int offs, unsigned int count, QList<ServerDB::LogRecord> &ql) {
+	QMutexLocker l(&qmRecent);
+	const QList<ServerDB::LogRecord> r = qhRecent.value(server_id);
+	if (static_cast<quint64>(offs) + count > static_cast<quint64>(r.count()))
+		return false;
+
+	ql = r.mid(static_cast<int>(offs), static_cast<int>(count));
+	return true;
+}
+
+void LogSink::forget(int server_id) {
+	sync();
+
+	QMutexLocker l(&qmRecent);
+	qhRecent.remove(server_id);
+}
+
+void LogSink::forgetAll() {
+	sync();
+
+	QMutexLocker l(&qmRecent);
+	qhRecent.clear();
+}
@@ -0,0 +1,106 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUMBLE_MURMUR_LOGSINK_H_
+#define MUMBLE_MURMUR_LOGSINK_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include "LogRing.h"
+#include "ServerDB.h"
+#include "Timer.h"
+
+class QTimer;
+
+// Writes the server log to the database in batches.
+//
+// Server::log() only pushes the line into a LogRing. Every logflush
+// milliseconds, or sooner once the ring fills up, the ring is drained and
+// everything inserted in one transaction. Old entries are expired a chunk at
+// a time in between, with a pause after each, so retention never holds the
+// database for long.
+//
+// The writer runs on a thread of its own with its own connection when the
+// database lets it write alongside the main thread: MySQL, or SQLite with
+// the write-ahead log. With SQLite's rollback journal the two connections
+// would lock each other out, so the batches are written on the main thread
+// instead, from a timer.
+//
+// The most recent lines of each server are also kept in memory, so the
+// usual request for the latest page of the log does not touch the database.
+// The writer adds them as it drains the ring, so logging a line takes no
+// lock.
+
+class LogSink : public QThread {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(LogSink)
+	protected:
+		LogRing lrRing;
+		int iFlushInterval;
+		bool bThreaded;
+		bool bStop;
+		bool bExpire;
+		Timer tExpire;
+		QTimer *qtFlush;
+
+		QMutex qmWait;
+		QWaitCondition qwcWake;
+
+		// Position of the ring that is in the database.
+		QMutex qmSync;
+		QWaitCondition qwcSynced;
+		unsigned int uiWritten;
+
+		QMutex qmRecent;
+		QHash<int, QList<ServerDB::LogRecord> > qhRecent;
+
+		void run();
+		void drain();
+		void write(const QList<LogRing::Entry> &batch);
+		void remember(const QList<LogRing::Entry> &batch);
+		void expire();
+	public:
+		LogSink(int capacity, int flushms, bool threaded, QObject *p = NULL);
+		~LogSink();
+		void log(int server_id, const QString &msg);
+		void sync();
+		bool recent(int server_id, unsigned int offs, unsigned int count, QList<ServerDB::LogRecord> &ql);
+		void forget(int server_id);
+		void forgetAll();
+	public slots:
+		void flush();
+};
+
+#endif
@@ -42,6 +42,9 @@
 #include "ServerUser.h"
 #include "Version.h"
 
+// Registered users per page of a UserList reply.
+#define USERLIST_PAGE_SIZE 1000
+
 #define MSG_SETUP(st) \
 	if (uSource->sState != st) { \
 		return; \
@@ -103,25 +106,47 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 			qsl << u8(msg.tokens(i));
 		{
 			QMutexLocker qml(&qmCache);
-			uSource->qslAccessTokens = qsl;
+			uSource->pDetails->qslAccessTokens = qsl;
 		}
 		clearACLCache(uSource);
 	}
 	MSG_SETUP(ServerUser::Connected);
 
-	Channel *root = qhChannels.value(0);
-	Channel *c;
+	// Still waiting for the authenticator to answer an earlier attempt.
+	if (uSource->uiAuthRequest)
+		return;
 
 	uSource->qsName = u8(msg.username());
+	QString pw = u8(msg.password());
+
+	int id;
+	if (! cachedAuthenticate(uSource, pw, id)) {
+		// Park the connection if the authenticator answers asynchronously;
+		// finishAuthenticate is called once it has.
+		if (requestAuthenticate(uSource, msg, pw))
+			return;
+
+		// Fetch ID and stored username.
+		// Since this may call DBus, which may recall our dbus messages, this function needs
+		// to support re-entrancy, and also to support the fact that sessions may go away.
+		id = authenticateExternal(uSource->qsName, pw, uSource->uiSession, uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain());
+
+		// Registered users' passwords are checked on the worker pool.
+		if (id == -2) {
+			checkPassword(uSource, msg, pw);
+			return;
+		}
+	}
+
+	finishAuthenticate(uSource, msg, pw, id);
+}
+
+void Server::finishAuthenticate(ServerUser *uSource, const MumbleProto::Authenticate &msg, const QString &pw, int id) {
+	Channel *root = qhChannels.value(0);
+	Channel *c;
 
 	bool ok = false;
 	bool nameok = validateUserName(uSource->qsName);
-	QString pw = u8(msg.password());
-
-	// Fetch ID and stored username.
-	// Since this may call DBus, which may recall our dbus messages, this function needs
-	// to support re-entrancy, and also to support the fact that sessions may go away.
-	int id = authenticate(uSource->qsName, pw, uSource->uiSession, uSource->qslEmail, uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain());
 
 	uSource->iId = id >= 0 ? id : -1;
 
@@ -207,12 +232,14 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	bool fake_celt_support = false;
 	if (msg.celt_versions_size() > 0) {
 		for (int i=0;i < msg.celt_versions_size(); ++i)
-			uSource->qlCodecs.append(msg.celt_versions(i));
+			uSource->pDetails->qlCodecs.append(msg.celt_versions(i));
 	} else {
-		uSource->qlCodecs.append(static_cast<qint32>(0x8000000b));
+		uSource->pDetails->qlCodecs.append(static_cast<qint32>(0x8000000b));
 		fake_celt_support = true;
 	}
 	uSource->bOpus = msg.opus();
+	tallyCodecs(uSource, 1);
+	updateMixing(uSource);
 	recheckCodecVersions(uSource);
 
 	MumbleProto::CodecVersion mpcv;
@@ -289,21 +316,31 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	userEnterChannel(uSource, lc, mpus);
 
 	uSource->sState = ServerUser::Authenticated;
+	voiceStateChanged();
 	mpus.set_session(uSource->uiSession);
 	mpus.set_name(u8(uSource->qsName));
 	if (uSource->iId >= 0) {
 		mpus.set_user_id(uSource->iId);
 
-		hashAssign(uSource->qbaTexture, uSource->qbaTextureHash, getUserTexture(uSource->iId));
+		// Only the hash of a large texture is needed here; the texture itself
+		// is loaded once someone asks for it.
+		QByteArray texture, hash;
+		getUserTextureHash(uSource->iId, texture, hash);
+		if (! hash.isEmpty()) {
+			blobReference(uSource->qbaTextureHash, hash);
+			uSource->qbaTexture = QByteArray();
+		} else {
+			blobAssign(uSource->qbaTexture, uSource->qbaTextureHash, texture);
+		}
 
 		if (! uSource->qbaTextureHash.isEmpty())
 			mpus.set_texture_hash(blob(uSource->qbaTextureHash));
 		else if (! uSource->qbaTexture.isEmpty())
 			mpus.set_texture(blob(uSource->qbaTexture));
 
-		const QMap<int, QString> &info = getRegistration(uSource->iId);
-		if (info.contains(ServerDB::User_Comment)) {
-			hashAssign(uSource->qsComment, uSource->qbaCommentHash, info.value(ServerDB::User_Comment));
+		const QString &comment = getUserComment(uSource->iId);
+		if (! comment.isEmpty()) {
+			blobAssign(uSource->qsComment, uSource->qbaCommentHash, comment);
 			if (! uSource->qbaCommentHash.isEmpty())
 				mpus.set_comment_hash(blob(uSource->qbaCommentHash));
 			else if (! uSource->qsComment.isEmpty())
@@ -317,11 +354,20 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 
 	sendAll(mpus, 0x010202);
 
-	if ((uSource->qbaTexture.length() >= 4) && (qFromBigEndian<unsigned int>(reinterpret_cast<const unsigned char *>(uSource->qbaTexture.constData())) == 600 * 60 * 4))
-		mpus.set_texture(blob(uSource->qbaTexture));
-	if (! uSource->qsComment.isEmpty())
-		mpus.set_comment(u8(uSource->qsComment));
-	sendAll(mpus, ~ 0x010202);
+	// Clients older than 1.2.2 need the data itself.
+	if (hasLegacyClients()) {
+		const QByteArray &texture = userTexture(uSource);
+		if ((texture.length() >= 4) && (qFromBigEndian<unsigned int>(reinterpret_cast<const unsigned char *>(texture.constData())) == 600 * 60 * 4))
+			mpus.set_texture(blob(texture));
+		const QString &comment = uSource->comment();
+		if (! comment.isEmpty())
+			mpus.set_comment(u8(comment));
+		sendAll(mpus, ~ 0x010202);
+	}
+
+	QByteArray legacytexture;
+	if (uSource->uiVersion < 0x010202)
+		legacytexture = userTexture(uSource);
 
 	// Transmit other users profiles
 	foreach(ServerUser *u, qhUsers) {
@@ -341,8 +387,8 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 				mpus.set_texture_hash(blob(u->qbaTextureHash));
 			else if (! u->qbaTexture.isEmpty())
 				mpus.set_texture(blob(u->qbaTexture));
-		} else if ((uSource->qbaTexture.length() >= 4) && (qFromBigEndian<unsigned int>(reinterpret_cast<const unsigned char *>(uSource->qbaTexture.constData())) == 600 * 60 * 4)) {
-			mpus.set_texture(blob(u->qbaTexture));
+		} else if ((legacytexture.length() >= 4) && (qFromBigEndian<unsigned int>(reinterpret_cast<const unsigned char *>(legacytexture.constData())) == 600 * 60 * 4)) {
+			mpus.set_texture(blob(userTexture(u)));
 		}
 		if (u->cChannel->iId != 0)
 			mpus.set_channel_id(u->cChannel->iId);
@@ -360,22 +406,29 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 			mpus.set_self_deaf(true);
 		else if (u->bSelfMute)
 			mpus.set_self_mute(true);
-		if ((uSource->uiVersion >= 0x010202) && ! u->qbaCommentHash.isEmpty())
-			mpus.set_comment_hash(blob(u->qbaCommentHash));
-		else if (! u->qsComment.isEmpty())
+		if (! u->qbaCommentHash.isEmpty()) {
+			if (uSource->uiVersion >= 0x010202)
+				mpus.set_comment_hash(blob(u->qbaCommentHash));
+			else
+				mpus.set_comment(u8(u->comment()));
+		} else if (! u->qsComment.isEmpty()) {
 			mpus.set_comment(u8(u->qsComment));
+		}
 		if (! u->qsHash.isEmpty())
 			mpus.set_hash(u8(u->qsHash));
 
 		sendMessage(uSource, mpus);
 	}
 
+	if (tTrunk)
+		tTrunk->sendUsers(uSource);
+
 	// Send syncronisation packet
 	MumbleProto::ServerSync mpss;
 	mpss.set_session(uSource->uiSession);
 	if (! qsWelcomeText.isEmpty())
 		mpss.set_welcome_text(u8(qsWelcomeText));
-	mpss.set_max_bandwidth(iMaxBandwidth);
+	mpss.set_max_bandwidth(uSource->iMaxBandwidth);
 
 	if (uSource->iId == 0) {
 		mpss.set_permissions(ChanACL::All);
@@ -607,7 +660,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 			}
 		} else {
 			// For unregistered users or SuperUser only get the hash
-			hashAssign(pDstServerUser->qbaTexture, pDstServerUser->qbaTextureHash, qba);
+			blobAssign(pDstServerUser->qbaTexture, pDstServerUser->qbaTextureHash, qba);
 		}
 
 		// The texture will be sent out later in this function
@@ -618,6 +671,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		uSource->bSelfDeaf = msg.self_deaf();
 		if (uSource->bSelfDeaf)
 			msg.set_self_mute(true);
+		voiceStateChanged();
 		bBroadcast = true;
 	}
 
@@ -627,6 +681,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 			msg.set_self_deaf(false);
 			uSource->bSelfDeaf = false;
 		}
+		voiceStateChanged();
 		bBroadcast = true;
 	}
 
@@ -634,20 +689,21 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		uSource->ssContext = msg.plugin_context();
 		// Make sure to clear this from the packet so we don't broadcast it
 		msg.clear_plugin_context();
+		voiceStateChanged();
 	}
 
 	if (msg.has_plugin_identity()) {
-		uSource->qsIdentity = u8(msg.plugin_identity());
+		uSource->pDetails->qsIdentity = u8(msg.plugin_identity());
 		// Make sure to clear this from the packet so we don't broadcast it
 		msg.clear_plugin_identity();
 	}
 
 	if (! comment.isNull()) {
-		hashAssign(pDstServerUser->qsComment, pDstServerUser->qbaCommentHash, comment);
+		blobAssign(pDstServerUser->qsComment, pDstServerUser->qbaCommentHash, comment);
 
 		if (pDstServerUser->iId >= 0) {
 			QMap<int, QString> info;
-			info.insert(ServerDB::User_Comment, pDstServerUser->qsComment);
+			info.insert(ServerDB::User_Comment, comment);
 			setInfo(pDstServerUser->iId, info);
 		}
 		bBroadcast = true;
@@ -674,6 +730,8 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		if (msg.has_priority_speaker())
 			pDstServerUser->bPrioritySpeaker = msg.priority_speaker();
 
+		voiceStateChanged();
+
 		log(uSource, QString("Changed speak-state of %1 (%2 %3 %4 %5)").arg(QString(*pDstServerUser),
 		        QString::number(pDstServerUser->bMute),
 		        QString::number(pDstServerUser->bDeaf),
@@ -713,8 +771,8 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 
 		info.insert(ServerDB::User_Name, pDstServerUser->qsName);
 		info.insert(ServerDB::User_Hash, pDstServerUser->qsHash);
-		if (! pDstServerUser->qslEmail.isEmpty())
-			info.insert(ServerDB::User_Email, pDstServerUser->qslEmail.first());
+		if (! pDstServerUser->pDetails->qslEmail.isEmpty())
+			info.insert(ServerDB::User_Email, pDstServerUser->pDetails->qslEmail.first());
 		int id = registerUser(info);
 		if (id > 0) {
 			pDstServerUser->iId = id;
@@ -731,11 +789,12 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 	if (bBroadcast) {
 		// Texture handling for clients < 1.2.2.
 		// Send the texture data in the message.
-		if (msg.has_texture() && (pDstServerUser->qbaTexture.length() >= 4) && (qFromBigEndian<unsigned int>(reinterpret_cast<const unsigned char *>(pDstServerUser->qbaTexture.constData())) != 600 * 60 * 4)) {
+		const QByteArray &texture = msg.has_texture() ? blob(msg.texture()) : QByteArray();
+		if ((texture.length() >= 4) && (qFromBigEndian<unsigned int>(reinterpret_cast<const unsigned char *>(texture.constData())) != 600 * 60 * 4)) {
 			// This is a new style texture, don't send it because the client doesn't handle it correctly / crashes.
 			msg.clear_texture();
 			sendAll(msg, ~ 0x010202);
-			msg.set_texture(blob(pDstServerUser->qbaTexture));
+			msg.set_texture(blob(texture));
 		} else {
 			// This is an old style texture, empty texture or there was no texture in this packet,
 			// send the message unchanged.
@@ -1036,6 +1095,7 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 
 			c->cParent->removeChannel(c);
 			p->addChannel(c);
+			invalidateSubtrees();
 		}
 		if (! qsName.isNull()) {
 			log(uSource, QString("Renamed channel %1 to %2").arg(QString(*c),
@@ -1091,7 +1151,6 @@ void Server::msgTextMessage(ServerUser *uSource, MumbleProto::TextMessage &msg)
 	TextMessage tm; // for signal userTextMessage
 
 	QSet<ServerUser *> users;
-	QQueue<Channel *> q;
 
 	QString text = u8(msg.message());
 	bool changed = false;
@@ -1146,18 +1205,26 @@ void Server::msgTextMessage(ServerUser *uSource, MumbleProto::TextMessage &msg)
 			return;
 		}
 
-		q.enqueue(c);
-
 		tm.qlTrees.append(id);
 	}
 
-	while (! q.isEmpty()) {
-		Channel *c = q.dequeue();
-		if (ChanACL::hasPermission(uSource, c, ChanACL::TextMessage, &acCache)) {
-			foreach(Channel *sub, c->qlChannels)
-				q.enqueue(sub);
-			foreach(User *p, c->qlUsers)
-				users.insert(static_cast<ServerUser *>(p));
+	if (! tm.qlTrees.isEmpty()) {
+		const QVector<SubtreeEntry> &tree = subtrees();
+		foreach(int id, tm.qlTrees) {
+			int pos = qhSubtreeIndex.value(id, -1);
+			if (pos < 0)
+				continue;
+			const int end = tree.at(pos).iEnd;
+			while (pos < end) {
+				const SubtreeEntry &e = tree.at(pos);
+				if (ChanACL::hasPermission(uSource, e.cChannel, ChanACL::TextMessage, &acCache)) {
+					foreach(User *p, e.cChannel->qlUsers)
+						users.insert(static_cast<ServerUser *>(p));
+					++pos;
+				} else {
+					pos = e.iEnd;
+				}
+			}
 		}
 	}
 
@@ -1177,8 +1244,10 @@ void Server::msgTextMessage(ServerUser *uSource, MumbleProto::TextMessage &msg)
 
 	users.remove(uSource);
 
+	// Serialized once for all recipients.
+	QByteArray cache;
 	foreach(ServerUser *u, users)
-		sendMessage(u, msg);
+		u->sendMessage(msg, MessageHandler::TextMessage, cache);
 
 	emit userTextMessage(uSource, tm);
 }
@@ -1414,6 +1483,7 @@ void Server::msgCryptSetup(ServerUser *uSource, MumbleProto::CryptSetup &msg) {
 		const std::string &str = msg.client_nonce();
 		if (str.size()  == AES_BLOCK_SIZE) {
 			uSource->csCrypt.uiResync++;
+			smMetrics.mcResyncs.add();
 			memcpy(uSource->csCrypt.decrypt_iv, str.data(), AES_BLOCK_SIZE);
 		}
 	}
@@ -1439,14 +1509,14 @@ void Server::msgVersion(ServerUser *uSource, MumbleProto::Version &msg) {
 	if (msg.has_version())
 		uSource->uiVersion=msg.version();
 	if (msg.has_release())
-		uSource->qsRelease = u8(msg.release());
+		uSource->pDetails->qsRelease = u8(msg.release());
 	if (msg.has_os()) {
-		uSource->qsOS = u8(msg.os());
+		uSource->pDetails->qsOS = u8(msg.os());
 		if (msg.has_os_version())
-			uSource->qsOSVersion = u8(msg.os_version());
+			uSource->pDetails->qsOSVersion = u8(msg.os_version());
 	}
 
-	log(uSource, QString("Client version %1 (%2: %3)").arg(MumbleVersion::toString(uSource->uiVersion)).arg(uSource->qsOS).arg(uSource->qsRelease));
+	log(uSource, QString("Client version %1 (%2: %3)").arg(MumbleVersion::toString(uSource->uiVersion)).arg(uSource->pDetails->qsOS).arg(uSource->pDetails->qsRelease));
 }
 
 void Server::msgUserList(ServerUser *uSource, MumbleProto::UserList &msg) {
@@ -1460,21 +1530,40 @@ void Server::msgUserList(ServerUser *uSource, MumbleProto::UserList &msg) {
 	}
 
 	if (msg.users_size() == 0) {
-		// Query mode.
-		QList<UserInfo> users = getRegisteredUsersEx();
-		QList<UserInfo>::const_iterator it = users.constBegin();
-		for (; it != users.constEnd(); ++it) {
-			// Skip the SuperUser
-			if (it->user_id > 0) {
-				::MumbleProto::UserList_User *u = msg.add_users();
-				u->set_user_id(it->user_id);
-				u->set_name(u8(it->name));
-				if (it->last_channel) {
-					u->set_last_channel(*it->last_channel);
+		// Query mode. Clients asking for a page size get one page per
+		// request; older ones get everything, read from the database a
+		// page at a time, with the authenticators asked only once.
+		const bool paged = msg.has_page_size();
+		const int pagesize = paged ? qBound(1, static_cast<int>(msg.page_size()), USERLIST_PAGE_SIZE) : USERLIST_PAGE_SIZE;
+		const QString filter = u8(msg.filter());
+		QString after = u8(msg.after());
+		bool more;
+
+		QMap<int, QString> rpcUsers;
+		if (! paged)
+			emit getRegisteredUsersSig(filter, rpcUsers);
+
+		msg.clear_next();
+		do {
+			const QList<UserInfo> users = getRegisteredUsersPage(filter, after, pagesize, more, paged ? NULL : &rpcUsers);
+			foreach(const UserInfo &ui, users) {
+				// Skip the SuperUser
+				if (ui.user_id > 0) {
+					::MumbleProto::UserList_User *u = msg.add_users();
+					u->set_user_id(ui.user_id);
+					u->set_name(u8(ui.name));
+					if (ui.last_channel) {
+						u->set_last_channel(*ui.last_channel);
+					}
+					u->set_last_seen(u8(ui.last_active.toString(Qt::ISODate)));
 				}
-				u->set_last_seen(u8(it->last_active.toString(Qt::ISODate)));
 			}
-		}
+			if (! users.isEmpty())
+				after = users.last().name;
+		} while (more && ! paged);
+
+		if (more)
+			msg.set_next(u8(after));
 		sendMessage(uSource, msg);
 	} else {
 		for (int i=0; i < msg.users_size(); ++i) {
@@ -1638,15 +1727,15 @@ void Server::msgUserStats(ServerUser*uSource, MumbleProto::UserStats &msg) {
 		mpv = msg.mutable_version();
 		if (pDstServerUser->uiVersion)
 			mpv->set_version(pDstServerUser->uiVersion);
-		if (! pDstServerUser->qsRelease.isEmpty())
-			mpv->set_release(u8(pDstServerUser->qsRelease));
-		if (! pDstServerUser->qsOS.isEmpty()) {
-			mpv->set_os(u8(pDstServerUser->qsOS));
-			if (! pDstServerUser->qsOSVersion.isEmpty())
-				mpv->set_os_version(u8(pDstServerUser->qsOSVersion));
+		if (! pDstServerUser->pDetails->qsRelease.isEmpty())
+			mpv->set_release(u8(pDstServerUser->pDetails->qsRelease));
+		if (! pDstServerUser->pDetails->qsOS.isEmpty()) {
+			mpv->set_os(u8(pDstServerUser->pDetails->qsOS));
+			if (! pDstServerUser->pDetails->qsOSVersion.isEmpty())
+				mpv->set_os_version(u8(pDstServerUser->pDetails->qsOSVersion));
 		}
 
-		foreach(int v, pDstServerUser->qlCodecs)
+		foreach(int v, pDstServerUser->pDetails->qlCodecs)
 			msg.add_celt_versions(v);
 		msg.set_opus(pDstServerUser->bOpus);
 
@@ -1682,27 +1771,22 @@ void Server::msgRequestBlob(ServerUser *uSource, MumbleProto::RequestBlob &msg)
 		}
 	}
 	if (ntextures || ncomments) {
-		MumbleProto::UserState mpus;
+		// Textures and comments are looked up as they are sent, which may be
+		// spread out over a while, see sendBlobs.
+		ServerUser::BlobRequest br;
+		br.bTexture = true;
 		for (int i=0;i<ntextures;++i) {
-			int session = msg.session_texture(i);
-			ServerUser *su = qhUsers.value(session);
-			if (su && ! su->qbaTexture.isEmpty()) {
-				mpus.set_session(session);
-				mpus.set_texture(blob(su->qbaTexture));
-				sendMessage(uSource, mpus);
-			}
+			br.uiSession = msg.session_texture(i);
+			uSource->qqBlobRequests.enqueue(br);
 		}
-		if (ntextures)
-			mpus.clear_texture();
+		br.bTexture = false;
 		for (int i=0;i<ncomments;++i) {
-			int session = msg.session_comment(i);
-			ServerUser *su = qhUsers.value(session);
-			if (su && ! su->qsComment.isEmpty()) {
-				mpus.set_session(session);
-				mpus.set_comment(u8(su->qsComment));
-				sendMessage(uSource, mpus);
-			}
+			br.uiSession = msg.session_comment(i);
+			uSource->qqBlobRequests.enqueue(br);
 		}
+
+		if (sendBlobs(uSource) && ! qtBlobs->isActive())
+			qtBlobs->start(100);
 	}
 }
 
@@ -37,6 +37,7 @@
 #include "ServerDB.h"
 #include "Server.h"
 #include "OSInfo.h"
+#include "PasswordHash.h"
 #include "Version.h"
 
 MetaParams Meta::mp;
@@ -50,6 +51,16 @@ MetaParams::MetaParams() {
 	usPort = DEFAULT_MUMBLE_PORT;
 	iTimeout = 30;
 	iMaxBandwidth = 72000;
+	iBandwidthBurst = 1000;
+	iSpeakerLimit = 0;
+	iMixBitrate = 40000;
+	iMixThreads = 2;
+	iUserCache = 20000;
+	iUserCacheBytes = 8 * 1024 * 1024;
+	iBlobCache = 16 * 1024 * 1024;
+	iBlobChunk = 65536;
+	usTrunkPort = 0;
+	iTrunkNode = 1;
 	iMaxUsers = 1000;
 	iMaxUsersPerChannel = 0;
 	iMaxTextMessageLength = 5000;
@@ -60,18 +71,34 @@ MetaParams::MetaParams() {
 	qsWelcomeText = QString("Welcome to this server");
 	qsDatabase = QString();
 	iDBPort = 0;
+	iDBStatementCache = 100;
+	iSQLiteWAL = 0;
 	qsDBusService = "net.sourceforge.mumble.murmur";
 	qsDBDriver = "QSQLITE";
 	qsLogfile = "murmur.log";
 
+	iIceSnapshotAge = 5;
+
 	iLogDays = 31;
+	iLogBuffer = 8192;
+	iLogFlush = 1000;
 
 	iObfuscate = 0;
 	bSendVersion = true;
 	bBonjour = true;
 	bAllowPing = true;
+	bIoUring = true;
+	iVoiceStatsSample = 0;
+	bVoiceStatsKernel = false;
+	qhaMetricsBind = QHostAddress(QHostAddress::LocalHost);
+	usMetricsPort = 0;
 	bCertRequired = false;
 	bForceExternalAuth = false;
+	iAuthTimeout = 10;
+	iAuthConcurrency = 16;
+	iAuthCacheTTL = 0;
+	iKDFIterations = -1;
+	iKDFThreads = 2;
 
 	iBanTries = 10;
 	iBanTimeframe = 120;
@@ -264,6 +291,24 @@ void MetaParams::read(QString fname) {
 	iMaxImageMessageLength = typeCheckedFromSettings("imagemessagelength", iMaxImageMessageLength);
 	bAllowHTML = typeCheckedFromSettings("allowhtml", bAllowHTML);
 	iMaxBandwidth = typeCheckedFromSettings("bandwidth", iMaxBandwidth);
+	iBandwidthBurst = typeCheckedFromSettings("bandwidthburst", iBandwidthBurst);
+	qsChannelBandwidth = typeCheckedFromSettings("channelbandwidth", qsChannelBandwidth);
+	qsGroupBandwidth = typeCheckedFromSettings("groupbandwidth", qsGroupBandwidth);
+	iSpeakerLimit = typeCheckedFromSettings("speakerlimit", iSpeakerLimit);
+	qsChannelSpeakerLimit = typeCheckedFromSettings("channelspeakerlimit", qsChannelSpeakerLimit);
+	qsMixChannels = typeCheckedFromSettings("mixchannels", qsMixChannels);
+	qsMixGroups = typeCheckedFromSettings("mixgroups", qsMixGroups);
+	iMixBitrate = typeCheckedFromSettings("mixbitrate", iMixBitrate);
+	iMixThreads = typeCheckedFromSettings("mixthreads", iMixThreads);
+	iUserCache = typeCheckedFromSettings("usercache", iUserCache);
+	iUserCacheBytes = typeCheckedFromSettings("usercachebytes", iUserCacheBytes);
+	iBlobCache = typeCheckedFromSettings("blobcache", iBlobCache);
+	iBlobChunk = typeCheckedFromSettings("blobchunk", iBlobChunk);
+	usTrunkPort = static_cast<unsigned short>(typeCheckedFromSettings("trunkport", static_cast<uint>(usTrunkPort)));
+	iTrunkNode = typeCheckedFromSettings("trunknode", iTrunkNode);
+	qsTrunkPeers = typeCheckedFromSettings("trunkpeers", qsTrunkPeers);
+	qsTrunkSecret = typeCheckedFromSettings("trunksecret", qsTrunkSecret);
+	qsHandoverSocket = typeCheckedFromSettings("handoversocket", qsHandoverSocket);
 	iDefaultChan = typeCheckedFromSettings("defaultchannel", iDefaultChan);
 	bRememberChan = typeCheckedFromSettings("rememberchannel", bRememberChan);
 	iMaxUsers = typeCheckedFromSettings("users", iMaxUsers);
@@ -271,6 +316,15 @@ void MetaParams::read(QString fname) {
 	qsWelcomeText = typeCheckedFromSettings("welcometext", qsWelcomeText);
 	bCertRequired = typeCheckedFromSettings("certrequired", bCertRequired);
 	bForceExternalAuth = typeCheckedFromSettings("forceExternalAuth", bForceExternalAuth);
+	iAuthTimeout = typeCheckedFromSettings("authtimeout", iAuthTimeout);
+	iAuthConcurrency = typeCheckedFromSettings("authconcurrency", iAuthConcurrency);
+	iAuthCacheTTL = typeCheckedFromSettings("authcachettl", iAuthCacheTTL);
+	iKDFIterations = typeCheckedFromSettings("kdfiterations", iKDFIterations);
+	iKDFThreads = typeCheckedFromSettings("kdfthreads", iKDFThreads);
+	if (iKDFIterations <= 0) {
+		iKDFIterations = PasswordHash::benchmark(10);
+		qWarning("Meta: Using %d iterations for password hashes", iKDFIterations);
+	}
 
 	qsDatabase = typeCheckedFromSettings("database", qsDatabase);
 
@@ -281,13 +335,18 @@ void MetaParams::read(QString fname) {
 	qsDBPrefix = typeCheckedFromSettings("dbPrefix", qsDBPrefix);
 	qsDBOpts = typeCheckedFromSettings("dbOpts", qsDBOpts);
 	iDBPort = typeCheckedFromSettings("dbPort", iDBPort);
+	iDBStatementCache = typeCheckedFromSettings("dbStatementCache", iDBStatementCache);
+	iSQLiteWAL = typeCheckedFromSettings("sqlite_wal", iSQLiteWAL);
 
 	qsIceEndpoint = typeCheckedFromSettings("ice", qsIceEndpoint);
 	qsIceSecretRead = typeCheckedFromSettings("icesecret", qsIceSecretRead);
 	qsIceSecretRead = typeCheckedFromSettings("icesecretread", qsIceSecretRead);
 	qsIceSecretWrite = typeCheckedFromSettings("icesecretwrite", qsIceSecretRead);
+	iIceSnapshotAge = typeCheckedFromSettings("icesnapshotage", iIceSnapshotAge);
 
 	iLogDays = typeCheckedFromSettings("logdays", iLogDays);
+	iLogBuffer = typeCheckedFromSettings("logbuffer", iLogBuffer);
+	iLogFlush = typeCheckedFromSettings("logflush", iLogFlush);
 
 	qsDBus = typeCheckedFromSettings("dbus", qsDBus);
 	qsDBusService = typeCheckedFromSettings("dbusservice", qsDBusService);
@@ -353,6 +412,14 @@ void MetaParams::read(QString fname) {
 	}
 	bSendVersion = typeCheckedFromSettings("sendversion", bSendVersion);
 	bAllowPing = typeCheckedFromSettings("allowping", bAllowPing);
+	bIoUring = typeCheckedFromSettings("iouring", bIoUring);
+	iVoiceStatsSample = qMax(0, typeCheckedFromSettings("voicestatssample", iVoiceStatsSample));
+	bVoiceStatsKernel = typeCheckedFromSettings("voicestatskerneltimestamps", bVoiceStatsKernel);
+
+	usMetricsPort = static_cast<unsigned short>(typeCheckedFromSettings("metricsport", static_cast<uint>(usMetricsPort)));
+	QString qsMetricsBind = typeCheckedFromSettings("metricsbind", qhaMetricsBind.toString());
+	if (! qhaMetricsBind.setAddress(qsMetricsBind))
+		qFatal("Invalid metricsbind address %s", qPrintable(qsMetricsBind));
 
 	QString qsSSLCert = qsSettings->value("sslCert").toString();
 	QString qsSSLKey = qsSettings->value("sslKey").toString();
@@ -460,6 +527,19 @@ void MetaParams::read(QString fname) {
 	qmConfig.insert(QLatin1String("textmessagelength"), QString::number(iMaxTextMessageLength));
 	qmConfig.insert(QLatin1String("allowhtml"), bAllowHTML ? QLatin1String("true") : QLatin1String("false"));
 	qmConfig.insert(QLatin1String("bandwidth"),QString::number(iMaxBandwidth));
+	qmConfig.insert(QLatin1String("bandwidthburst"),QString::number(iBandwidthBurst));
+	qmConfig.insert(QLatin1String("channelbandwidth"),qsChannelBandwidth);
+	qmConfig.insert(QLatin1String("groupbandwidth"),qsGroupBandwidth);
+	qmConfig.insert(QLatin1String("speakerlimit"),QString::number(iSpeakerLimit));
+	qmConfig.insert(QLatin1String("channelspeakerlimit"),qsChannelSpeakerLimit);
+	qmConfig.insert(QLatin1String("mixchannels"),qsMixChannels);
+	qmConfig.insert(QLatin1String("mixgroups"),qsMixGroups);
+	qmConfig.insert(QLatin1String("mixbitrate"),QString::number(iMixBitrate));
+	qmConfig.insert(QLatin1String("usercache"),QString::number(iUserCache));
+	qmConfig.insert(QLatin1String("usercachebytes"),QString::number(iUserCacheBytes));
+	qmConfig.insert(QLatin1String("trunkport"),QString::number(usTrunkPort));
+	qmConfig.insert(QLatin1String("trunknode"),QString::number(iTrunkNode));
+	qmConfig.insert(QLatin1String("trunkpeers"),qsTrunkPeers);
 	qmConfig.insert(QLatin1String("users"),QString::number(iMaxUsers));
 	qmConfig.insert(QLatin1String("defaultchannel"),QString::number(iDefaultChan));
 	qmConfig.insert(QLatin1String("rememberchannel"),bRememberChan ? QLatin1String("true") : QLatin1String("false"));
@@ -477,11 +557,15 @@ void MetaParams::read(QString fname) {
 	qmConfig.insert(QLatin1String("channelname"),qrChannelName.pattern());
 	qmConfig.insert(QLatin1String("certrequired"), bCertRequired ? QLatin1String("true") : QLatin1String("false"));
 	qmConfig.insert(QLatin1String("forceExternalAuth"), bForceExternalAuth ? QLatin1String("true") : QLatin1String("false"));
+	qmConfig.insert(QLatin1String("authtimeout"),QString::number(iAuthTimeout));
+	qmConfig.insert(QLatin1String("authconcurrency"),QString::number(iAuthConcurrency));
+	qmConfig.insert(QLatin1String("authcachettl"),QString::number(iAuthCacheTTL));
 	qmConfig.insert(QLatin1String("suggestversion"), qvSuggestVersion.isNull() ? QString() : qvSuggestVersion.toString());
 	qmConfig.insert(QLatin1String("suggestpositional"), qvSuggestPositional.isNull() ? QString() : qvSuggestPositional.toString());
 	qmConfig.insert(QLatin1String("suggestpushtotalk"), qvSuggestPushToTalk.isNull() ? QString() : qvSuggestPushToTalk.toString());
 	qmConfig.insert(QLatin1String("opusthreshold"), QString::number(iOpusThreshold));
 	qmConfig.insert(QLatin1String("channelnestinglimit"), QString::number(iChannelNestingLimit));
+	qmConfig.insert(QLatin1String("voicestatssample"), QString::number(iVoiceStatsSample));
 }
 
 Meta::Meta() {
@@ -503,9 +587,12 @@ Meta::Meta() {
 			Connection::setQoS(hQoS);
 	}
 #endif
+	qtpPasswords.setMaxThreadCount(qMax(mp.iKDFThreads, 1));
+	bsBlobs.setBudget(mp.iBlobCache);
 }
 
 Meta::~Meta() {
+	qtpPasswords.waitForDone();
 #ifdef Q_OS_WIN
 	if (hQoS) {
 		QOSCloseHandle(hQoS);
@@ -514,6 +601,11 @@ Meta::~Meta() {
 #endif
 }
 
+void Meta::customEvent(QEvent *evt) {
+	if (evt->type() == EXEC_QEVENT)
+		static_cast<ExecEvent *>(evt)->execute();
+}
+
 void Meta::getOSInfo() {
 	qsOS = OSInfo::getOS();
 	qsOSVersion = OSInfo::getOSDisplayableVersion();
@@ -591,22 +683,5 @@ bool Meta::banCheck(const QHostAddress &addr) {
 	if (addr.toIPv4Address() == ((128U << 24) | (39U << 16) | (114U << 8) | 1U))
 		return false;
 
-	if (qhBans.contains(addr)) {
-		Timer t = qhBans.value(addr);
-		if (t.elapsed() < (1000000ULL * mp.iBanTime))
-			return true;
-		qhBans.remove(addr);
-	}
-
-	QList<Timer> &ql = qhAttempts[addr];
-
-	ql.append(Timer());
-	while (! ql.isEmpty() && (ql.at(0).elapsed() > (1000000ULL * mp.iBanTimeframe)))
-		ql.removeFirst();
-
-	if (ql.count() > mp.iBanTries) {
-		qhBans.insert(addr, Timer());
-		return true;
-	}
-	return false;
+	return flLimiter.check(addr, mp.iBanTries, mp.iBanTimeframe, mp.iBanTime);
 }
@@ -33,6 +33,7 @@
 
 #include <QtCore/QDir>
 #include <QtCore/QList>
+#include <QtCore/QThreadPool>
 #include <QtCore/QUrl>
 #include <QtCore/QVariant>
 #include <QtNetwork/QHostAddress>
@@ -42,6 +43,8 @@
 #include <windows.h>
 #endif
 
+#include "BlobStore.h"
+#include "FloodLimiter.h"
 #include "Timer.h"
 
 class Server;
@@ -55,6 +58,24 @@ public:
 	unsigned short usPort;
 	int iTimeout;
 	int iMaxBandwidth;
+	int iBandwidthBurst;
+	QString qsChannelBandwidth;
+	QString qsGroupBandwidth;
+	int iSpeakerLimit;
+	QString qsChannelSpeakerLimit;
+	QString qsMixChannels;
+	QString qsMixGroups;
+	int iMixBitrate;
+	int iMixThreads;
+	int iUserCache;
+	int iUserCacheBytes;
+	int iBlobCache;
+	int iBlobChunk;
+	unsigned short usTrunkPort;
+	int iTrunkNode;
+	QString qsTrunkPeers;
+	QString qsTrunkSecret;
+	QString qsHandoverSocket;
 	int iMaxUsers;
 	int iMaxUsersPerChannel;
 	int iDefaultChan;
@@ -68,6 +89,11 @@ public:
 	QString qsWelcomeText;
 	bool bCertRequired;
 	bool bForceExternalAuth;
+	int iAuthTimeout;
+	int iAuthConcurrency;
+	int iAuthCacheTTL;
+	int iKDFIterations;
+	int iKDFThreads;
 
 	int iBanTries;
 	int iBanTimeframe;
@@ -81,12 +107,22 @@ public:
 	QString qsDBPrefix;
 	QString qsDBOpts;
 	int iDBPort;
+	int iDBStatementCache;
+	int iSQLiteWAL;
 
 	int iLogDays;
+	int iLogBuffer;
+	int iLogFlush;
 
 	int iObfuscate;
 	bool bSendVersion;
 	bool bAllowPing;
+	bool bIoUring;
+	int iVoiceStatsSample;
+	bool bVoiceStatsKernel;
+
+	QHostAddress qhaMetricsBind;
+	unsigned short usMetricsPort;
 
 	QString qsDBus;
 	QString qsDBusService;
@@ -94,6 +130,7 @@ public:
 	QString qsPid;
 	QString qsIceEndpoint;
 	QString qsIceSecretRead, qsIceSecretWrite;
+	int iIceSnapshotAge;
 
 	QString qsRegName;
 	QString qsRegPassword;
@@ -136,11 +173,16 @@ class Meta : public QObject {
 	private:
 		Q_OBJECT;
 		Q_DISABLE_COPY(Meta);
+	protected:
+		void customEvent(QEvent *evt);
 	public:
 		static MetaParams mp;
 		QHash<int, Server *> qhServers;
-		QHash<QHostAddress, QList<Timer> > qhAttempts;
-		QHash<QHostAddress, Timer> qhBans;
+		FloodLimiter flLimiter;
+		// User textures and comments of all servers.
+		BlobStore bsBlobs;
+		// Runs password checks, so slow key derivation does not hold up servers.
+		QThreadPool qtpPasswords;
 		QString qsOS, qsOSVersion;
 		Timer tUptime;
 
@@ -0,0 +1,285 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "Metrics.h"
+#include "Meta.h"
+#include "Server.h"
+#include "ServerUser.h"
+#include "VoiceStats.h"
+
+MetricCounter MetricsServer::mcAclCacheHits;
+MetricCounter MetricsServer::mcAclCacheMisses;
+MetricCounter MetricsServer::mcDbQueries;
+MetricCounter MetricsServer::mcDbMicroseconds;
+MetricCounter MetricsServer::mcDbPrepares;
+MetricCounter MetricsServer::mcDbStatementHits;
+MetricCounter MetricsServer::mcDbConnections;
+MetricCounter MetricsServer::mcLogWritten;
+MetricCounter MetricsServer::mcLogDropped;
+MetricCounter MetricsServer::mcIceSnapshotReads;
+MetricCounter MetricsServer::mcIceSnapshotBuilds;
+
+#define MUMBLE_MH_MSG(x) #x,
+static const char *messageNames[] = {
+	MUMBLE_MH_ALL
+};
+#undef MUMBLE_MH_MSG
+
+// Largest request we bother to read.
+#define METRICS_MAX_REQUEST 8192
+
+MetricsServer::MetricsServer(QObject *p) : QObject(p) {
+	qtsServer = new QTcpServer(this);
+	connect(qtsServer, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+bool MetricsServer::listen(const QHostAddress &address, quint16 port) {
+	if (! qtsServer->listen(address, port)) {
+		qWarning("Metrics: Failed to listen on %s:%d: %s", qPrintable(address.toString()), port, qPrintable(qtsServer->errorString()));
+		return false;
+	}
+	qWarning("Metrics: Listening on %s:%d", qPrintable(address.toString()), port);
+	return true;
+}
+
+void MetricsServer::newConnection() {
+	while (qtsServer->hasPendingConnections()) {
+		QTcpSocket *sock = qtsServer->nextPendingConnection();
+		connect(sock, SIGNAL(readyRead()), this, SLOT(readyRead()));
+		connect(sock, SIGNAL(disconnected()), sock, SLOT(deleteLater()));
+	}
+}
+
+void MetricsServer::readyRead() {
+	QTcpSocket *sock = qobject_cast<QTcpSocket *>(sender());
+	if (! sock)
+		return;
+
+	QByteArray request = sock->property("request").toByteArray() + sock->readAll();
+
+	int end = request.indexOf("\r\n\r\n");
+	if (end < 0) {
+		if (request.size() > METRICS_MAX_REQUEST)
+			sock->abort();
+		else
+			sock->setProperty("request", request);
+		return;
+	}
+
+	disconnect(sock, SIGNAL(readyRead()), this, SLOT(readyRead()));
+
+	QList<QByteArray> line = request.left(request.indexOf("\r\n")).split(' ');
+	QByteArray status, body;
+
+	if ((line.count() < 2) || (line.at(0) != "GET")) {
+		status = "405 Method Not Allowed";
+	} else if ((line.at(1) != "/metrics") && (line.at(1) != "/")) {
+		status = "404 Not Found";
+	} else {
+		status = "200 OK";
+		body = collect();
+	}
+
+	QByteArray response = "HTTP/1.0 " + status + "\r\n";
+	response += "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+	response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+	response += "Connection: close\r\n\r\n";
+	response += body;
+
+	sock->write(response);
+	sock->disconnectFromHost();
+}
+
+// Cumulative buckets in seconds (or plain values for scale 1). The sum is
+// estimated from the bucket lower bounds.
+void MetricsServer::writeHistogram(QTextStream &out, const char *name, const QString &labels, const Histogram &h, double scale) {
+	typedef QPair<quint64, quint64> Bucket;
+	const QList<Bucket> buckets = h.buckets();
+
+	quint64 count = 0;
+	double sum = 0.0;
+	for (int i=0;i<buckets.count();++i) {
+		const Bucket &b = buckets.at(i);
+		count += b.second;
+		sum += static_cast<double>(b.first) * static_cast<double>(b.second);
+		quint64 upper = Histogram::lowerBound(Histogram::bucket(b.first) + 1);
+		out << name << "_bucket{" << labels << ",le=\"" << QString::number(static_cast<double>(upper) * scale, 'g', 6) << "\"} " << count << "\n";
+	}
+	out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << count << "\n";
+	out << name << "_sum{" << labels << "} " << QString::number(sum * scale, 'g', 12) << "\n";
+	out << name << "_count{" << labels << "} " << count << "\n";
+}
+
+#define METRIC_HEADER(name, type, help) \
+	out << "# HELP " name " " help "\n# TYPE " name " " type "\n"
+
+#define SERVER_METRIC(name, type, help, value) \
+	METRIC_HEADER(name, type, help); \
+	foreach(Server *s, servers) \
+		out << name "{server=\"" << s->iServerNum << "\"} " << (value) << "\n"
+
+QByteArray MetricsServer::collect() {
+	QString text;
+	QTextStream out(&text);
+
+	QList<Server *> servers = meta->qhServers.values();
+
+	SERVER_METRIC("murmur_users", "gauge", "Connected users.", s->qhUsers.count());
+	SERVER_METRIC("murmur_channels", "gauge", "Number of channels.", s->qhChannels.count());
+	SERVER_METRIC("murmur_uptime_seconds", "gauge", "Uptime of the virtual server.", s->tUptime.elapsed() / 1000000ULL);
+
+	SERVER_METRIC("murmur_udp_packets_received_total", "counter", "UDP datagrams received.", s->smMetrics.mcUdpPacketsIn.value());
+	SERVER_METRIC("murmur_udp_bytes_received_total", "counter", "UDP bytes received.", s->smMetrics.mcUdpBytesIn.value());
+	SERVER_METRIC("murmur_udp_packets_sent_total", "counter", "UDP datagrams sent.", s->smMetrics.mcUdpPacketsOut.value());
+	SERVER_METRIC("murmur_udp_bytes_sent_total", "counter", "UDP bytes sent.", s->smMetrics.mcUdpBytesOut.value());
+	SERVER_METRIC("murmur_tunnel_packets_received_total", "counter", "Voice packets received through the TCP tunnel.", s->smMetrics.mcTunnelPacketsIn.value());
+	SERVER_METRIC("murmur_tunnel_bytes_received_total", "counter", "Voice bytes received through the TCP tunnel.", s->smMetrics.mcTunnelBytesIn.value());
+	SERVER_METRIC("murmur_tunnel_packets_sent_total", "counter", "Voice packets sent through the TCP tunnel.", s->smMetrics.mcTunnelPacketsOut.value());
+	SERVER_METRIC("murmur_tunnel_bytes_sent_total", "counter", "Voice bytes sent through the TCP tunnel.", s->smMetrics.mcTunnelBytesOut.value());
+	SERVER_METRIC("murmur_decrypt_failures_total", "counter", "UDP packets from known peers that failed to decrypt.", s->smMetrics.mcDecryptFailures.value());
+	SERVER_METRIC("murmur_crypt_resyncs_total", "counter", "Crypt state resynchronisations, requested by either side.", s->smMetrics.mcResyncs.value());
+	SERVER_METRIC("murmur_bandwidth_drops_total", "counter", "Voice packets dropped by the bandwidth limit.", s->smMetrics.mcBandwidthDrops.value());
+	SERVER_METRIC("murmur_voice_recipient_builds_total", "counter", "Channel listener arrays rebuilt for the voice fanout after a state change.", s->smMetrics.mcVoiceRecipientBuilds.value());
+	SERVER_METRIC("murmur_speaker_limit_drops_total", "counter", "Voice packets held back by a channel speaker limit.", s->smMetrics.mcSpeakerDrops.value());
+	SERVER_METRIC("murmur_mix_frames_total", "counter", "Frames of mixed audio encoded for server side mixing.", s->smMetrics.mcMixedFrames.value());
+	SERVER_METRIC("murmur_mix_seconds_total", "counter", "Time spent decoding, mixing and encoding for server side mixing.", QString::number(static_cast<double>(s->smMetrics.mcMixMicroseconds.value()) / 1000000.0, 'f', 6));
+	SERVER_METRIC("murmur_mix_overruns_total", "counter", "Times the mixer fell too far behind and skipped frames.", s->smMetrics.mcMixOverruns.value());
+	SERVER_METRIC("murmur_auth_pending", "gauge", "Logins waiting for the authenticator, running or queued.", s->qhAuthPending.count());
+	SERVER_METRIC("murmur_auth_timeouts_total", "counter", "Logins rejected because the authenticator did not answer in time.", s->smMetrics.mcAuthTimeouts.value());
+	SERVER_METRIC("murmur_auth_cache_hits_total", "counter", "Logins accepted from cached authenticator answers.", s->smMetrics.mcAuthCacheHits.value());
+	SERVER_METRIC("murmur_user_cache_entries", "gauge", "Registered users held in the user directory.", s->udUsers.count());
+	SERVER_METRIC("murmur_user_cache_hits_total", "counter", "Name and id lookups answered by the user directory.", s->udUsers.uiHits);
+	SERVER_METRIC("murmur_user_cache_misses_total", "counter", "Name and id lookups the user directory could not answer.", s->udUsers.uiMisses);
+	SERVER_METRIC("murmur_user_cache_evictions_total", "counter", "Users dropped from the user directory to make room.", s->udUsers.uiEvictions);
+	SERVER_METRIC("murmur_user_cache_bytes", "gauge", "Estimated memory used by the names in the user directory.", s->udUsers.nameBytes());
+	SERVER_METRIC("murmur_user_blob_cache_bytes", "gauge", "Bytes of texture and comment references cached by the user directory.", s->udUsers.blobBytes());
+
+	METRIC_HEADER("murmur_user_memory_bytes", "gauge", "Estimated memory held by connected users, by use. Excludes TLS library state.");
+	QMap<int, qint64> largest;
+	foreach(Server *s, servers) {
+		ServerUser::MemoryUsage total;
+		qint64 max = 0;
+		{
+			QReadLocker rl(&s->qrwlUsers);
+			foreach(ServerUser *u, s->qhUsers) {
+				const ServerUser::MemoryUsage &mu = u->memoryUsage();
+				total += mu;
+				max = qMax(max, mu.total());
+			}
+		}
+		largest.insert(s->iServerNum, max);
+		const QString &labels = QString::fromLatin1("murmur_user_memory_bytes{server=\"%1\",part=\"").arg(s->iServerNum);
+		out << labels << "object\"} " << total.iObject << "\n";
+		out << labels << "metadata\"} " << total.iMetadata << "\n";
+		out << labels << "whisper\"} " << total.iWhisper << "\n";
+		out << labels << "permissions\"} " << total.iPermissions << "\n";
+		out << labels << "buffers\"} " << total.iBuffers << "\n";
+	}
+	SERVER_METRIC("murmur_user_memory_max_bytes", "gauge", "Estimated memory held by the largest single connection.", largest.value(s->iServerNum));
+
+	METRIC_HEADER("murmur_control_messages_total", "counter", "Control messages received, by type.");
+	foreach(Server *s, servers) {
+		for (int i=0;i<MessageTypeCount;++i) {
+			quint64 v = s->smMetrics.mcMessages[i].value();
+			if (v)
+				out << "murmur_control_messages_total{server=\"" << s->iServerNum << "\",type=\"" << messageNames[i] << "\"} " << v << "\n";
+		}
+	}
+
+	METRIC_HEADER("murmur_voice_forward_seconds", "histogram", "Forwarding latency of sampled voice packets, by stage.");
+	foreach(Server *s, servers) {
+		for (int i=0;i<VoiceStats::StageCount;++i) {
+			VoiceStats::Stage st = static_cast<VoiceStats::Stage>(i);
+			const QString &labels = QString::fromLatin1("server=\"%1\",stage=\"%2\"").arg(s->iServerNum).arg(QLatin1String(VoiceStats::stageName(st)));
+			writeHistogram(out, "murmur_voice_forward_seconds", labels, s->vsStats.hStage[i], 0.000001);
+		}
+	}
+
+	METRIC_HEADER("murmur_voice_fanout", "histogram", "Recipients per sampled voice packet.");
+	foreach(Server *s, servers)
+		writeHistogram(out, "murmur_voice_fanout", QString::fromLatin1("server=\"%1\"").arg(s->iServerNum), s->vsStats.hFanout, 1.0);
+
+	const FloodLimiter &fl = meta->flLimiter;
+	METRIC_HEADER("murmur_autoban_checks_total", "counter", "Connection attempts counted by the autoban limiter.");
+	out << "murmur_autoban_checks_total " << fl.uiChecks << "\n";
+	METRIC_HEADER("murmur_autoban_rejected_total", "counter", "Connection attempts refused by the autoban limiter.");
+	out << "murmur_autoban_rejected_total " << fl.uiRejected << "\n";
+	METRIC_HEADER("murmur_autoban_bans_total", "counter", "Addresses (IPv6 /64 prefixes) banned by the autoban limiter.");
+	out << "murmur_autoban_bans_total " << fl.uiBans << "\n";
+	METRIC_HEADER("murmur_autoban_evictions_total", "counter", "Tracked sources dropped from the autoban table to make room.");
+	out << "murmur_autoban_evictions_total " << fl.uiEvictions << "\n";
+	METRIC_HEADER("murmur_autoban_tracked", "gauge", "Sources tracked by the autoban limiter.");
+	out << "murmur_autoban_tracked " << fl.tracked() << "\n";
+	METRIC_HEADER("murmur_autoban_capacity", "gauge", "Size of the autoban table.");
+	out << "murmur_autoban_capacity " << fl.capacity() << "\n";
+
+	BlobStore &bs = meta->bsBlobs;
+	METRIC_HEADER("murmur_blobs", "gauge", "Distinct textures and comments held, in use or cached.");
+	out << "murmur_blobs " << bs.count() << "\n";
+	METRIC_HEADER("murmur_blob_pinned_bytes", "gauge", "Bytes of textures and comments held for connected users.");
+	out << "murmur_blob_pinned_bytes " << bs.pinnedBytes() << "\n";
+	METRIC_HEADER("murmur_blob_cached_bytes", "gauge", "Bytes of textures and comments cached for users not connected.");
+	out << "murmur_blob_cached_bytes " << bs.cachedBytes() << "\n";
+	METRIC_HEADER("murmur_blob_hits_total", "counter", "Texture and comment lookups answered from memory.");
+	out << "murmur_blob_hits_total " << bs.uiHits << "\n";
+	METRIC_HEADER("murmur_blob_misses_total", "counter", "Texture and comment lookups that had to go to the database.");
+	out << "murmur_blob_misses_total " << bs.uiMisses << "\n";
+	METRIC_HEADER("murmur_blob_shared_total", "counter", "Textures and comments found to be already held when stored.");
+	out << "murmur_blob_shared_total " << bs.uiShared << "\n";
+
+	METRIC_HEADER("murmur_acl_cache_hits_total", "counter", "Permission checks answered from the ACL cache.");
+	out << "murmur_acl_cache_hits_total " << mcAclCacheHits.value() << "\n";
+	METRIC_HEADER("murmur_acl_cache_misses_total", "counter", "Permission checks that had to evaluate the ACLs.");
+	out << "murmur_acl_cache_misses_total " << mcAclCacheMisses.value() << "\n";
+	METRIC_HEADER("murmur_db_queries_total", "counter", "Database queries executed.");
+	out << "murmur_db_queries_total " << mcDbQueries.value() << "\n";
+	METRIC_HEADER("murmur_db_query_seconds_total", "counter", "Time spent executing database queries.");
+	out << "murmur_db_query_seconds_total " << QString::number(static_cast<double>(mcDbMicroseconds.value()) / 1000000.0, 'f', 6) << "\n";
+	METRIC_HEADER("murmur_db_prepares_total", "counter", "SQL statements prepared.");
+	out << "murmur_db_prepares_total " << mcDbPrepares.value() << "\n";
+	METRIC_HEADER("murmur_db_statement_cache_hits_total", "counter", "SQL statements reused from the prepared statement cache.");
+	out << "murmur_db_statement_cache_hits_total " << mcDbStatementHits.value() << "\n";
+	METRIC_HEADER("murmur_db_connections_total", "counter", "Database connections opened for threads other than the main one.");
+	out << "murmur_db_connections_total " << mcDbConnections.value() << "\n";
+	METRIC_HEADER("murmur_log_written_total", "counter", "Server log lines written to the database.");
+	out << "murmur_log_written_total " << mcLogWritten.value() << "\n";
+	METRIC_HEADER("murmur_log_dropped_total", "counter", "Server log lines dropped because the log buffer was full.");
+	out << "murmur_log_dropped_total " << mcLogDropped.value() << "\n";
+	METRIC_HEADER("murmur_ice_snapshot_reads_total", "counter", "Ice queries answered from a state snapshot without waiting for the main thread.");
+	out << "murmur_ice_snapshot_reads_total " << mcIceSnapshotReads.value() << "\n";
+	METRIC_HEADER("murmur_ice_snapshot_builds_total", "counter", "State snapshots built for Ice queries.");
+	out << "murmur_ice_snapshot_builds_total " << mcIceSnapshotBuilds.value() << "\n";
+
+	out.flush();
+	return text.toUtf8();
+}
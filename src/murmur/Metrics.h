@@ -0,0 +1,145 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_METRICS_H_
+#define MUMBLE_MURMUR_METRICS_H_
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QObject>
+#include <QtNetwork/QHostAddress>
+
+#include "Message.h"
+
+class QTcpServer;
+class QTextStream;
+class Server;
+class Histogram;
+
+// 64 bit counter that can be bumped from any thread without a lock. Qt4 has
+// no 64 bit atomics, so there the compiler's are used instead of letting
+// byte and time counters wrap after 2^32.
+
+class MetricCounter {
+	private:
+		Q_DISABLE_COPY(MetricCounter)
+#if QT_VERSION >= 0x050000
+		QAtomicInteger<quint64> qaiValue;
+#elif defined(Q_CC_MSVC)
+		mutable volatile LONGLONG uiValue;
+#else
+		mutable quint64 uiValue;
+#endif
+	public:
+#if QT_VERSION >= 0x050000
+		MetricCounter() : qaiValue(0) {}
+		void add(quint64 v = 1) {
+			qaiValue.fetchAndAddRelaxed(v);
+		}
+		quint64 value() const {
+			return qaiValue.load();
+		}
+#elif defined(Q_CC_MSVC)
+		MetricCounter() : uiValue(0) {}
+		void add(quint64 v = 1) {
+			InterlockedExchangeAdd64(&uiValue, static_cast<LONGLONG>(v));
+		}
+		quint64 value() const {
+			return static_cast<quint64>(InterlockedCompareExchange64(&uiValue, 0, 0));
+		}
+#else
+		MetricCounter() : uiValue(0) {}
+		void add(quint64 v = 1) {
+			__sync_fetch_and_add(&uiValue, v);
+		}
+		quint64 value() const {
+			return __sync_fetch_and_add(&uiValue, 0);
+		}
+#endif
+};
+
+#define MUMBLE_MH_MSG(x) + 1
+enum { MessageTypeCount = 0 MUMBLE_MH_ALL };
+#undef MUMBLE_MH_MSG
+
+// Per virtual server counters.
+
+struct ServerMetrics {
+	MetricCounter mcUdpPacketsIn, mcUdpBytesIn;
+	MetricCounter mcUdpPacketsOut, mcUdpBytesOut;
+	MetricCounter mcTunnelPacketsIn, mcTunnelBytesIn;
+	MetricCounter mcTunnelPacketsOut, mcTunnelBytesOut;
+	MetricCounter mcDecryptFailures;
+	MetricCounter mcResyncs;
+	MetricCounter mcBandwidthDrops;
+	MetricCounter mcSpeakerDrops;
+	MetricCounter mcVoiceRecipientBuilds;
+	MetricCounter mcMixedFrames;
+	MetricCounter mcMixMicroseconds;
+	MetricCounter mcMixOverruns;
+	MetricCounter mcAuthTimeouts;
+	MetricCounter mcAuthCacheHits;
+	MetricCounter mcMessages[MessageTypeCount];
+};
+
+// Serves all metrics in the Prometheus text format over HTTP. Scraping only
+// reads atomic counters and state owned by the main thread, so it never
+// waits on the voice threads.
+
+class MetricsServer : public QObject {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(MetricsServer)
+	protected:
+		QTcpServer *qtsServer;
+		static void writeHistogram(QTextStream &out, const char *name, const QString &labels, const Histogram &h, double scale);
+	public:
+		// Process wide counters.
+		static MetricCounter mcAclCacheHits;
+		static MetricCounter mcAclCacheMisses;
+		static MetricCounter mcDbQueries;
+		static MetricCounter mcDbMicroseconds;
+		static MetricCounter mcDbPrepares;
+		static MetricCounter mcDbStatementHits;
+		static MetricCounter mcDbConnections;
+		static MetricCounter mcLogWritten;
+		static MetricCounter mcLogDropped;
+		static MetricCounter mcIceSnapshotReads;
+		static MetricCounter mcIceSnapshotBuilds;
+
+		MetricsServer(QObject *parent = NULL);
+		bool listen(const QHostAddress &address, quint16 port);
+		static QByteArray collect();
+	public slots:
+		void newConnection();
+		void readyRead();
+};
+
+#endif
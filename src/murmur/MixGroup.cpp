@@ -0,0 +1,244 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "MixGroup.h"
+
+#include "opus.h"
+
+// Speakers who have been silent this many frames are forgotten, along with
+// their decoder state.
+#define MIX_SPEAKER_TIMEOUT 500
+
+MixGroup::Speaker::Speaker() {
+	odDecoder = opus_decoder_create(MIX_SAMPLE_RATE, 1, NULL);
+	oeMinus = NULL;
+	bBuffering = true;
+	bEnded = false;
+	uiIdle = 0;
+}
+
+MixGroup::Speaker::~Speaker() {
+	if (odDecoder)
+		opus_decoder_destroy(odDecoder);
+	if (oeMinus)
+		opus_encoder_destroy(oeMinus);
+}
+
+MixGroup::MixGroup(int bitrate) {
+	oeMix = NULL;
+	iBitrate = bitrate;
+	uiSeq = 0;
+	bActive = false;
+	uiIdle = 0;
+}
+
+MixGroup::~MixGroup() {
+	qDeleteAll(qhSpeakers);
+	if (oeMix)
+		opus_encoder_destroy(oeMix);
+}
+
+// Same settings the client uses for its own voice.
+OpusEncoder *MixGroup::createEncoder() const {
+	OpusEncoder *oe = opus_encoder_create(MIX_SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, NULL);
+	if (oe) {
+		opus_encoder_ctl(oe, OPUS_SET_VBR(0));
+		opus_encoder_ctl(oe, OPUS_SET_BITRATE(iBitrate));
+	}
+	return oe;
+}
+
+bool MixGroup::encode(OpusEncoder *oe, const float *pcm, QByteArray &out) {
+	unsigned char buffer[512];
+
+	int len = opus_encode_float(oe, pcm, MIX_FRAME_SIZE, buffer, sizeof(buffer));
+	if (len <= 0)
+		return false;
+
+	out = QByteArray(reinterpret_cast<const char *>(buffer), len);
+	return true;
+}
+
+void MixGroup::addPacket(unsigned int session, const char *data, int len, bool terminator) {
+	Packet p;
+	p.uiSession = session;
+	p.qbaData = QByteArray(data, len);
+	p.bTerminator = terminator;
+
+	QMutexLocker qml(&qmPending);
+	// Don't queue without bound if the mixer falls behind.
+	if (qlPending.count() < MIX_MAX_BUFFER * 50)
+		qlPending.append(p);
+}
+
+void MixGroup::decode(const Packet &p) {
+	Speaker *s = qhSpeakers.value(p.uiSession);
+	if (! s) {
+		s = new Speaker();
+		if (! s->odDecoder) {
+			delete s;
+			return;
+		}
+		qhSpeakers.insert(p.uiSession, s);
+	}
+
+	s->uiIdle = 0;
+	s->bEnded = p.bTerminator;
+
+	if (! p.qbaData.isEmpty()) {
+		const unsigned char *packet = reinterpret_cast<const unsigned char *>(p.qbaData.constData());
+		const int size = p.qbaData.size();
+		int frames = opus_packet_get_nb_frames(packet, size);
+		int samples = frames * opus_packet_get_samples_per_frame(packet, MIX_SAMPLE_RATE);
+
+		if ((frames > 0) && (samples > 0) && (samples <= MIX_FRAME_SIZE * MIX_MAX_BUFFER)) {
+			const int pos = s->qvPCM.size();
+			s->qvPCM.resize(pos + samples);
+			int decoded = opus_decode_float(s->odDecoder, packet, size, s->qvPCM.data() + pos, samples, 0);
+			s->qvPCM.resize(pos + qMax(decoded, 0));
+		}
+	}
+
+	// Drop the oldest audio rather than fall further behind.
+	const int excess = s->qvPCM.size() - MIX_FRAME_SIZE * MIX_MAX_BUFFER;
+	if (excess > 0)
+		s->qvPCM.remove(0, excess);
+}
+
+bool MixGroup::mix(const QSet<unsigned int> &listeners, Output &out) {
+	QList<Packet> pending;
+	{
+		QMutexLocker qml(&qmPending);
+		pending = qlPending;
+		qlPending.clear();
+	}
+	foreach(const Packet &p, pending)
+		decode(p);
+
+	float sum[MIX_FRAME_SIZE];
+	float pcm[MIX_FRAME_SIZE];
+	QList<unsigned int> active;
+
+	for (int j=0;j<MIX_FRAME_SIZE;++j)
+		sum[j] = 0.0f;
+
+	QHash<unsigned int, Speaker *>::iterator i = qhSpeakers.begin();
+	while (i != qhSpeakers.end()) {
+		Speaker *s = i.value();
+		const int avail = s->qvPCM.size();
+
+		if (s->bBuffering && ((avail >= MIX_FRAME_SIZE * MIX_PREBUFFER) || (s->bEnded && (avail > 0))))
+			s->bBuffering = false;
+
+		if (! s->bBuffering && (avail > 0)) {
+			// Pad a short last frame with silence.
+			if (avail < MIX_FRAME_SIZE)
+				s->qvPCM.insert(avail, MIX_FRAME_SIZE - avail, 0.0f);
+
+			const float *in = s->qvPCM.constData();
+			for (int j=0;j<MIX_FRAME_SIZE;++j)
+				sum[j] += in[j];
+			active.append(i.key());
+		} else if (++s->uiIdle > MIX_SPEAKER_TIMEOUT) {
+			delete s;
+			i = qhSpeakers.erase(i);
+			continue;
+		}
+		++i;
+	}
+
+	out.bTerminator = false;
+	out.qbaMix.clear();
+	out.qhMinus.clear();
+
+	if (active.isEmpty()) {
+		if (! bActive) {
+			++uiIdle;
+			return false;
+		}
+		// Send one frame of silence marked as the end of the stream, so
+		// clients stop playback right away instead of waiting it out.
+		bActive = false;
+		out.bTerminator = true;
+	} else {
+		bActive = true;
+		uiIdle = 0;
+	}
+
+	if (! oeMix)
+		oeMix = createEncoder();
+	if (! oeMix)
+		return false;
+
+	uiSeq += MIX_FRAME_SIZE / (MIX_SAMPLE_RATE / 100);
+	out.uiSeq = uiSeq;
+
+	for (int j=0;j<MIX_FRAME_SIZE;++j)
+		pcm[j] = qBound(-1.0f, sum[j], 1.0f);
+	if (! encode(oeMix, pcm, out.qbaMix))
+		return false;
+
+	// Speakers who also listen to the mix would hear themselves with a
+	// delay, so they get everyone else instead. Their encoder is kept, but
+	// they switch streams as they start and stop talking.
+	foreach(unsigned int session, active) {
+		Speaker *s = qhSpeakers.value(session);
+
+		if (listeners.contains(session)) {
+			if (! s->oeMinus)
+				s->oeMinus = createEncoder();
+			if (s->oeMinus) {
+				const float *in = s->qvPCM.constData();
+				for (int j=0;j<MIX_FRAME_SIZE;++j)
+					pcm[j] = qBound(-1.0f, sum[j] - in[j], 1.0f);
+				QByteArray qba;
+				if (encode(s->oeMinus, pcm, qba))
+					out.qhMinus.insert(session, qba);
+			}
+		}
+
+		s->qvPCM.remove(0, MIX_FRAME_SIZE);
+		if (s->qvPCM.isEmpty())
+			s->bBuffering = true;
+	}
+
+	return true;
+}
+
+unsigned int MixGroup::idle() const {
+	return uiIdle;
+}
+
+int MixGroup::speakers() const {
+	return qhSpeakers.count();
+}
@@ -0,0 +1,111 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_MIXGROUP_H_
+#define MUMBLE_MURMUR_MIXGROUP_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
+struct OpusDecoder;
+struct OpusEncoder;
+
+// Server side mixing of one channel. Opus frames of everyone talking into
+// the channel are queued by the voice thread with addPacket; once per
+// MIX_FRAME_SIZE the mixer decodes them, sums the active speakers and
+// encodes one stream for all listeners. Listeners who are talking
+// themselves get a stream without their own voice instead.
+//
+// Each speaker is buffered for MIX_PREBUFFER frames before they are mixed,
+// which absorbs most jitter without needing sequence numbers. Everything
+// except addPacket runs on one thread at a time.
+
+#define MIX_SAMPLE_RATE 48000
+#define MIX_FRAME_SIZE (MIX_SAMPLE_RATE / 50)
+#define MIX_PREBUFFER 2
+#define MIX_MAX_BUFFER 10
+
+class MixGroup {
+	private:
+		Q_DISABLE_COPY(MixGroup)
+	public:
+		struct Output {
+			// Sequence number in 10ms frames, as sent by clients.
+			unsigned int uiSeq;
+			bool bTerminator;
+			QByteArray qbaMix;
+			QHash<unsigned int, QByteArray> qhMinus;
+		};
+	protected:
+		struct Packet {
+			unsigned int uiSession;
+			QByteArray qbaData;
+			bool bTerminator;
+		};
+		struct Speaker {
+			OpusDecoder *odDecoder;
+			OpusEncoder *oeMinus;
+			QVector<float> qvPCM;
+			bool bBuffering;
+			bool bEnded;
+			unsigned int uiIdle;
+			Speaker();
+			~Speaker();
+		};
+
+		QMutex qmPending;
+		QList<Packet> qlPending;
+
+		QHash<unsigned int, Speaker *> qhSpeakers;
+		OpusEncoder *oeMix;
+		int iBitrate;
+		unsigned int uiSeq;
+		bool bActive;
+		unsigned int uiIdle;
+
+		OpusEncoder *createEncoder() const;
+		void decode(const Packet &);
+		static bool encode(OpusEncoder *, const float *pcm, QByteArray &out);
+	public:
+		MixGroup(int bitrate);
+		~MixGroup();
+		void addPacket(unsigned int session, const char *data, int len, bool terminator);
+		bool mix(const QSet<unsigned int> &listeners, Output &out);
+		// Ticks without anyone talking.
+		unsigned int idle() const;
+		int speakers() const;
+};
+
+#endif
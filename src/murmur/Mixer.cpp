@@ -0,0 +1,204 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "Mixer.h"
+#include "MixGroup.h"
+#include "Channel.h"
+#include "Message.h"
+#include "Meta.h"
+#include "PacketDataStream.h"
+#include "Server.h"
+#include "ServerUser.h"
+
+#define UDP_PACKET_SIZE 1024
+
+// Groups nobody has talked in for this many frames are freed.
+#define MIX_GROUP_TIMEOUT 500
+
+class MixTask : public QRunnable {
+	public:
+		int iChannel;
+		MixGroup *mgGroup;
+		QSet<unsigned int> qsListeners;
+		MixGroup::Output moOut;
+		bool bMixed;
+
+		MixTask(int channel, MixGroup *mg) : iChannel(channel), mgGroup(mg), bMixed(false) {
+			setAutoDelete(false);
+		}
+		void run() {
+			bMixed = mgGroup->mix(qsListeners, moOut);
+		}
+};
+
+Mixer::Mixer(Server *p) : QThread(p) {
+	server = p;
+	bRunning = false;
+	iBitrate = 40000;
+	qtpPool.setMaxThreadCount(qMax(1, Meta::mp.iMixThreads));
+}
+
+Mixer::~Mixer() {
+	stopMixing();
+}
+
+void Mixer::startMixing() {
+	if (! isRunning()) {
+		bRunning = true;
+		start(QThread::HighPriority);
+	}
+}
+
+void Mixer::stopMixing() {
+	bRunning = false;
+	wait();
+
+	QMutexLocker qml(&qmGroups);
+	qDeleteAll(qhGroups);
+	qhGroups.clear();
+}
+
+void Mixer::addFrame(int channel, unsigned int session, const char *data, int len, bool terminator) {
+	if (! bRunning)
+		return;
+
+	QMutexLocker qml(&qmGroups);
+	MixGroup *mg = qhGroups.value(channel);
+	if (! mg) {
+		mg = new MixGroup(iBitrate);
+		qhGroups.insert(channel, mg);
+	}
+	mg->addPacket(session, data, len, terminator);
+}
+
+void Mixer::run() {
+	const quint64 frame = MIX_FRAME_SIZE * 1000000ULL / MIX_SAMPLE_RATE;
+	quint64 next = Timer::now();
+
+	while (bRunning) {
+		next += frame;
+		const quint64 now = Timer::now();
+		if (next > now) {
+			usleep(static_cast<unsigned long>(next - now));
+		} else if ((now - next) > 5 * frame) {
+			// Too far behind to catch up; drop the missed frames rather
+			// than sending them in a burst.
+			server->smMetrics.mcMixOverruns.add();
+			next = now;
+		}
+		tick();
+	}
+}
+
+void Mixer::tick() {
+	QList<MixTask *> tasks;
+
+	{
+		QMutexLocker qml(&qmGroups);
+		QHash<int, MixGroup *>::iterator i = qhGroups.begin();
+		while (i != qhGroups.end()) {
+			MixGroup *mg = i.value();
+			if (mg->idle() > MIX_GROUP_TIMEOUT) {
+				delete mg;
+				i = qhGroups.erase(i);
+				continue;
+			}
+			tasks << new MixTask(i.key(), mg);
+			++i;
+		}
+	}
+
+	if (tasks.isEmpty())
+		return;
+
+	{
+		QReadLocker rl(&server->qrwlUsers);
+		foreach(MixTask *mt, tasks) {
+			Channel *c = server->qhChannels.value(mt->iChannel);
+			if (! c)
+				continue;
+			foreach(User *p, c->qlUsers) {
+				ServerUser *u = static_cast<ServerUser *>(p);
+				if (u->bMixed)
+					mt->qsListeners.insert(u->uiSession);
+			}
+		}
+	}
+
+	const quint64 start = Timer::now();
+	foreach(MixTask *mt, tasks)
+		qtpPool.start(mt);
+	qtpPool.waitForDone();
+	server->smMetrics.mcMixMicroseconds.add(Timer::now() - start);
+
+	{
+		QReadLocker rl(&server->qrwlUsers);
+		char buffer[UDP_PACKET_SIZE];
+
+		foreach(MixTask *mt, tasks) {
+			if (! mt->bMixed)
+				continue;
+
+			server->smMetrics.mcMixedFrames.add();
+			const MixGroup::Output &mo = mt->moOut;
+
+			foreach(unsigned int session, mt->qsListeners) {
+				ServerUser *u = server->qhUsers.value(session);
+				// The listener may have moved or left while mixing.
+				if (! u || ! u->bMixed || ! u->cChannel || (u->cChannel->iId != mt->iChannel))
+					continue;
+				if ((u->sState != ServerUser::Authenticated) || u->bDeaf || u->bSelfDeaf)
+					continue;
+
+				QHash<unsigned int, QByteArray>::const_iterator m = mo.qhMinus.constFind(session);
+				const QByteArray &qba = (m != mo.qhMinus.constEnd()) ? m.value() : mo.qbaMix;
+
+				int size = qba.size();
+				if (mo.bTerminator)
+					size |= 0x2000;
+
+				PacketDataStream pds(buffer + 1, UDP_PACKET_SIZE - 1);
+				buffer[0] = static_cast<char>(MessageHandler::UDPVoiceOpus << 5);
+				pds << u->uiSession;
+				pds << mo.uiSeq;
+				pds << size;
+				pds.append(qba.constData(), qba.size());
+
+				QByteArray cache;
+				server->sendMessage(u, buffer, pds.size() + 1, cache);
+			}
+		}
+	}
+
+	qDeleteAll(tasks);
+}
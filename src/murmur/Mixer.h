@@ -0,0 +1,77 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_MIXER_H_
+#define MUMBLE_MURMUR_MIXER_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+class MixGroup;
+class Server;
+
+// Drives the MixGroups of a server. Every MIX_FRAME_SIZE the mixer thread
+// hands each group with something to mix to a thread pool, then sends the
+// results to the listeners of the channel. Mixed streams are sent with the
+// session of the listener they go to, which clients play back like server
+// loopback; that way they need no changes to receive them.
+//
+// Forwarding only ever copies a frame into a group queue; decoding, mixing
+// and encoding stay off the voice thread.
+
+class Mixer : public QThread {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(Mixer)
+	protected:
+		Server *server;
+		volatile bool bRunning;
+		QThreadPool qtpPool;
+		// Groups by channel id. Created by the voice thread, removed by the
+		// mixer thread once idle.
+		QMutex qmGroups;
+		QHash<int, MixGroup *> qhGroups;
+
+		void tick();
+		void run();
+	public:
+		int iBitrate;
+
+		Mixer(Server *parent);
+		~Mixer();
+		void addFrame(int channel, unsigned int session, const char *data, int len, bool terminator);
+		void startMixing();
+		void stopMixing();
+};
+
+#endif
@@ -165,6 +165,12 @@ namespace Murmur {
 			                                      const ::std::string&,
 			                                      const Ice::Current&);
 
+			virtual void findRegisteredUsers_async(const ::Murmur::AMD_Server_findRegisteredUsersPtr&,
+			                                       const ::std::string&,
+			                                       const ::std::string&,
+			                                       ::Ice::Int,
+			                                       const Ice::Current&);
+
 			virtual void verifyPassword_async(const ::Murmur::AMD_Server_verifyPasswordPtr&,
 			                                  const ::std::string&,
 			                                  const ::std::string&,
@@ -182,6 +188,22 @@ namespace Murmur {
 			virtual void getUptime_async(const ::Murmur::AMD_Server_getUptimePtr&,
 			                             const Ice::Current&);
 
+			virtual void getVoiceStatistics_async(const ::Murmur::AMD_Server_getVoiceStatisticsPtr&,
+			                                      bool,
+			                                      const Ice::Current&);
+
+			virtual void getStateVersion_async(const ::Murmur::AMD_Server_getStateVersionPtr&,
+			                                   const Ice::Current&);
+
+			virtual void getChanges_async(const ::Murmur::AMD_Server_getChangesPtr&,
+			                              ::Ice::Long,
+			                              ::Ice::Int,
+			                              const Ice::Current&);
+
+			virtual void exportArchive_async(const ::Murmur::AMD_Server_exportArchivePtr&,
+			                                 const ::std::string&,
+			                                 const Ice::Current&);
+
 			virtual void ice_ping(const Ice::Current&) const;
 	};
 
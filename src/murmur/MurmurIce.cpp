@@ -39,10 +39,12 @@
 #include "Channel.h"
 #include "Group.h"
 #include "Meta.h"
+#include "Metrics.h"
 #include "MurmurI.h"
 #include "Server.h"
 #include "ServerUser.h"
 #include "ServerDB.h"
+#include "Timer.h"
 #include "User.h"
 
 using namespace std;
@@ -82,16 +84,16 @@ static void userToUser(const ::User *p, Murmur::User &mp) {
 	mp.selfMute = p->bSelfMute;
 	mp.selfDeaf = p->bSelfDeaf;
 	mp.channel = p->cChannel->iId;
-	mp.comment = u8(p->qsComment);
 
 	const ServerUser *u=static_cast<const ServerUser *>(p);
+	mp.comment = u8(u->comment());
 	mp.onlinesecs = u->bwr.onlineSeconds();
 	mp.bytespersec = u->bwr.bandwidth();
 	mp.version = u->uiVersion;
-	mp.release = u8(u->qsRelease);
-	mp.os = u8(u->qsOS);
-	mp.osversion = u8(u->qsOSVersion);
-	mp.identity = u8(u->qsIdentity);
+	mp.release = u8(u->pDetails->qsRelease);
+	mp.os = u8(u->pDetails->qsOS);
+	mp.osversion = u8(u->pDetails->qsOSVersion);
+	mp.identity = u8(u->pDetails->qsIdentity);
 	mp.context = u->ssContext;
 	mp.idlesecs = u->bwr.idleSeconds();
 	mp.udpPing = u->dUDPPingAvg;
@@ -119,6 +121,8 @@ static void channelToChannel(const ::Channel *c, Murmur::Channel &mc) {
 	mc.temporary = c->bTemporary;
 }
 
+TreePtr recurseTree(const ::Channel *c, const ::Murmur::UserMap *um = NULL);
+
 static void ACLtoACL(const ::ChanACL *acl, Murmur::ACL &ma) {
 	ma.applyHere = acl->bApplyHere;
 	ma.applySubs = acl->bApplySubs;
@@ -180,6 +184,25 @@ static void infoToInfo(const Murmur::UserInfoMap &im, QMap<int, QString> &info)
 		info.insert((*i).first, u8((*i).second));
 }
 
+static void histogramToHistogram(const ::Histogram &h, Murmur::HistogramMap &hm) {
+	typedef QPair<quint64, quint64> Bucket;
+	foreach(const Bucket &b, h.buckets())
+		hm[static_cast<Ice::Long>(b.first)] = static_cast<Ice::Long>(b.second);
+}
+
+static void certificatesToCertificates(const QList<QSslCertificate> &certlist, ::Murmur::CertificateList &certs) {
+	certs.resize(certlist.size());
+	for (int i=0;i<certlist.size();++i) {
+		::Murmur::CertificateDer der;
+		QByteArray qba = certlist.at(i).toDer();
+		der.resize(qba.size());
+		const char *ptr = qba.constData();
+		for (int j=0;j<qba.size();++j)
+			der[j] = ptr[j];
+		certs[i] = der;
+	}
+}
+
 static void textmessageToTextmessage(const ::TextMessage &tm, Murmur::TextMessage &tmdst) {
 	tmdst.text = u8(tm.qsText);
 
@@ -202,6 +225,11 @@ class ServerLocator : public virtual Ice::ServantLocator {
 
 MurmurIce::MurmurIce() {
 	count = 0;
+	qtpAuth.setMaxThreadCount(qMax(meta->mp.iAuthConcurrency, 1));
+	qtpExport.setMaxThreadCount(1);
+
+	connect(&qtChanges, SIGNAL(timeout()), this, SLOT(expireChanges()));
+	qtChanges.start(1000);
 
 	if (meta->mp.qsIceEndpoint.isEmpty())
 		return;
@@ -250,6 +278,8 @@ MurmurIce::MurmurIce() {
 }
 
 MurmurIce::~MurmurIce() {
+	qtpAuth.waitForDone();
+	qtpExport.waitForDone();
 	if (communicator) {
 		communicator->shutdown();
 		communicator->waitForShutdown();
@@ -258,6 +288,7 @@ MurmurIce::~MurmurIce() {
 		qWarning("MurmurIce: Shutdown complete");
 	}
 	iopServer = NULL;
+	qDeleteAll(qhState);
 }
 
 void MurmurIce::customEvent(QEvent *evt) {
@@ -380,7 +411,190 @@ static ServerPrx idToProxy(int id, const Ice::ObjectAdapterPtr &adapter) {
 	return ServerPrx::uncheckedCast(adapter->createProxy(ident));
 }
 
+void MurmurIce::withSnapshot(int server_id, const SnapshotReader &reader) {
+	ServerSnapshotPtr ssp;
+	{
+		QMutexLocker lock(&qmState);
+		ServerState *st = qhState.value(server_id);
+		if (st && (meta->mp.iIceSnapshotAge > 0)) {
+			ssp = st->sspSnapshot;
+			if (ssp && (Timer::now() - ssp->uiBuilt > meta->mp.iIceSnapshotAge * 1000000ULL))
+				ssp.clear();
+			if (! ssp) {
+				// Concurrent readers of a stale snapshot share one rebuild.
+				st->qlReaders.append(reader);
+				if (! st->bRebuildPosted) {
+					st->bRebuildPosted = true;
+					QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&MurmurIce::rebuildSnapshot, this, server_id)));
+				}
+				return;
+			}
+		}
+	}
+
+	if (ssp) {
+		MetricsServer::mcIceSnapshotReads.add();
+		reader(ssp);
+	} else {
+		QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(reader, ServerSnapshotPtr())));
+	}
+}
+
+void MurmurIce::rebuildSnapshot(int server_id) {
+	::Server *server = meta->qhServers.value(server_id);
+	ServerSnapshot *ss = NULL;
+
+	if (server) {
+		ss = new ServerSnapshot();
+		ss->uiBuilt = Timer::now();
+		foreach(const ::User *p, server->qhUsers) {
+			if (static_cast<const ServerUser *>(p)->sState == ::ServerUser::Authenticated)
+				userToUser(p, ss->umUsers[p->uiSession]);
+		}
+		foreach(const ::Channel *c, server->qhChannels)
+			channelToChannel(c, ss->cmChannels[c->iId]);
+		ss->tpTree = recurseTree(server->qhChannels.value(0), &ss->umUsers);
+		MetricsServer::mcIceSnapshotBuilds.add();
+	}
+
+	ServerSnapshotPtr ssp(ss);
+	QList<SnapshotReader> readers;
+	{
+		QMutexLocker lock(&qmState);
+		ServerState *st = qhState.value(server_id);
+		if (st) {
+			// Changes only happen on this thread, so the snapshot is exactly this version.
+			if (ss) {
+				ss->iVersion = st->iVersion;
+				st->sspSnapshot = ssp;
+			}
+			st->bRebuildPosted = false;
+			readers.swap(st->qlReaders);
+		}
+	}
+
+	foreach(const SnapshotReader &reader, readers)
+		reader(ssp);
+}
+
+void MurmurIce::changesSince(const ServerState *st, qint64 since, ::Murmur::StateChanges &sc) {
+	const qint64 first = st->iVersion - st->qlChanges.count();
+
+	sc.version = st->iVersion;
+	sc.complete = (since >= first) && (since <= st->iVersion);
+	sc.changes.clear();
+	if (! sc.complete)
+		return;
+	for (int i = static_cast<int>(since - first); i < st->qlChanges.count(); ++i)
+		sc.changes.push_back(st->qlChanges.at(i));
+}
+
+void MurmurIce::changed(const ::Server *server, ::Murmur::StateChangeKind kind, const ::User *p, const ::Channel *c) {
+	typedef QPair< ::Murmur::AMD_Server_getChangesPtr, ::Murmur::StateChanges> Response;
+	QList<Response> responses;
+	{
+		QMutexLocker lock(&qmState);
+		ServerState *st = qhState.value(server->iServerNum);
+		if (! st)
+			return;
+
+		++st->iVersion;
+		st->sspSnapshot.clear();
+		if (! st->bTrackChanges)
+			return;
+
+		::Murmur::StateChange change = ::Murmur::StateChange();
+		change.version = st->iVersion;
+		change.kind = kind;
+		if (p)
+			userToUser(p, change.u);
+		if (c)
+			channelToChannel(c, change.c);
+		st->qlChanges.append(change);
+		if (st->qlChanges.count() > iMaxChanges)
+			st->qlChanges.removeFirst();
+
+		foreach(const ServerState::ChangeWait &cw, st->qlWaits) {
+			Response r;
+			r.first = cw.cb;
+			changesSince(st, cw.iSince, r.second);
+			responses.append(r);
+		}
+		st->qlWaits.clear();
+	}
+
+	foreach(const Response &r, responses)
+		r.first->ice_response(r.second);
+}
+
+bool MurmurIce::getStateVersion(int server_id, qint64 &version) {
+	QMutexLocker lock(&qmState);
+	ServerState *st = qhState.value(server_id);
+	if (! st)
+		return false;
+
+	st->bTrackChanges = true;
+	version = st->iVersion;
+	return true;
+}
+
+bool MurmurIce::getChanges(int server_id, const ::Murmur::AMD_Server_getChangesPtr &cb, qint64 since, int timeout) {
+	::Murmur::StateChanges sc;
+	{
+		QMutexLocker lock(&qmState);
+		ServerState *st = qhState.value(server_id);
+		if (! st)
+			return false;
+
+		st->bTrackChanges = true;
+		if ((since == st->iVersion) && (timeout > 0)) {
+			ServerState::ChangeWait cw;
+			cw.cb = cb;
+			cw.iSince = since;
+			cw.uiDeadline = Timer::now() + qMin(timeout, 60) * 1000000ULL;
+			st->qlWaits.append(cw);
+			return true;
+		}
+		changesSince(st, since, sc);
+	}
+
+	cb->ice_response(sc);
+	return true;
+}
+
+void MurmurIce::expireChanges() {
+	typedef QPair< ::Murmur::AMD_Server_getChangesPtr, ::Murmur::StateChanges> Response;
+	QList<Response> responses;
+	const quint64 now = Timer::now();
+	{
+		QMutexLocker lock(&qmState);
+		foreach(ServerState *st, qhState) {
+			QList<ServerState::ChangeWait>::iterator i = st->qlWaits.begin();
+			while (i != st->qlWaits.end()) {
+				if ((*i).uiDeadline <= now) {
+					Response r;
+					r.first = (*i).cb;
+					changesSince(st, (*i).iSince, r.second);
+					responses.append(r);
+					i = st->qlWaits.erase(i);
+				} else {
+					++i;
+				}
+			}
+		}
+	}
+
+	foreach(const Response &r, responses)
+		r.first->ice_response(r.second);
+}
+
 void MurmurIce::started(::Server *s) {
+	{
+		QMutexLocker lock(&qmState);
+		if (! qhState.contains(s->iServerNum))
+			qhState.insert(s->iServerNum, new ServerState());
+	}
+
 	s->connectListener(mi);
 	connect(s, SIGNAL(contextAction(const User *, const QString &, unsigned int, int)), this, SLOT(contextAction(const User *, const QString &, unsigned int, int)));
 
@@ -403,6 +617,20 @@ void MurmurIce::stopped(::Server *s) {
 	removeServerAuthenticator(s);
 	removeServerUpdatingAuthenticator(s);
 
+	ServerState *st;
+	{
+		QMutexLocker lock(&qmState);
+		st = qhState.take(s->iServerNum);
+	}
+	if (st) {
+		// The server is already gone from Meta, so readers falling back to the live state get ServerBootedException.
+		foreach(const SnapshotReader &reader, st->qlReaders)
+			reader(ServerSnapshotPtr());
+		foreach(const ServerState::ChangeWait &cw, st->qlWaits)
+			cw.cb->ice_exception(ServerBootedException());
+		delete st;
+	}
+
 	const QList< ::Murmur::MetaCallbackPrx> &qmList = qlMetaCallbacks;
 
 	if (qmList.isEmpty())
@@ -420,6 +648,8 @@ void MurmurIce::stopped(::Server *s) {
 void MurmurIce::userConnected(const ::User *p) {
 	::Server *s = qobject_cast< ::Server *> (sender());
 
+	changed(s, ChangeUserConnected, p, NULL);
+
 	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -440,6 +670,8 @@ void MurmurIce::userConnected(const ::User *p) {
 void MurmurIce::userDisconnected(const ::User *p) {
 	::Server *s = qobject_cast< ::Server *> (sender());
 
+	changed(s, ChangeUserDisconnected, p, NULL);
+
 	qmServerContextCallbacks[s->iServerNum].remove(p->uiSession);
 
 	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
@@ -462,6 +694,8 @@ void MurmurIce::userDisconnected(const ::User *p) {
 void MurmurIce::userStateChanged(const ::User *p) {
 	::Server *s = qobject_cast< ::Server *> (sender());
 
+	changed(s, ChangeUserState, p, NULL);
+
 	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -505,6 +739,8 @@ void MurmurIce::userTextMessage(const ::User *p, const ::TextMessage &message) {
 void MurmurIce::channelCreated(const ::Channel *c) {
 	::Server *s = qobject_cast< ::Server *> (sender());
 
+	changed(s, ChangeChannelCreated, NULL, c);
+
 	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -525,6 +761,8 @@ void MurmurIce::channelCreated(const ::Channel *c) {
 void MurmurIce::channelRemoved(const ::Channel *c) {
 	::Server *s = qobject_cast< ::Server *> (sender());
 
+	changed(s, ChangeChannelRemoved, NULL, c);
+
 	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -545,6 +783,8 @@ void MurmurIce::channelRemoved(const ::Channel *c) {
 void MurmurIce::channelStateChanged(const ::Channel *c) {
 	::Server *s = qobject_cast< ::Server *> (sender());
 
+	changed(s, ChangeChannelState, NULL, c);
+
 	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -643,16 +883,7 @@ void MurmurIce::authenticateSlot(int &res, QString &uname, int sessionId, const
 	::Murmur::GroupNameList groups;
 	::Murmur::CertificateList certs;
 
-	certs.resize(certlist.size());
-	for (int i=0;i<certlist.size();++i) {
-		::Murmur::CertificateDer der;
-		QByteArray qba = certlist.at(i).toDer();
-		der.resize(qba.size());
-		const char *ptr = qba.constData();
-		for (int j=0;j<qba.size();++j)
-			der[j] = ptr[j];
-		certs[i] = der;
-	}
+	certificatesToCertificates(certlist, certs);
 
 	try {
 		res = prx->authenticate(u8(uname), u8(pw), certs, u8(certhash), certstrong, newname, groups);
@@ -671,6 +902,115 @@ void MurmurIce::authenticateSlot(int &res, QString &uname, int sessionId, const
 	}
 }
 
+// Writes a server archive on a pool thread with its own database connection.
+class ExportTask : public QRunnable {
+	public:
+		int iServerNum;
+		QString qsPath;
+		::Murmur::AMD_Server_exportArchivePtr cb;
+		void run();
+};
+
+void ExportTask::run() {
+	QString error;
+	if (ServerDB::exportServer(iServerNum, qsPath, error)) {
+		cb->ice_response();
+	} else {
+		ArchiveException ae;
+		ae.reason = u8(error);
+		cb->ice_exception(ae);
+	}
+}
+
+void MurmurIce::exportArchive(int server_id, const ::Murmur::AMD_Server_exportArchivePtr &cb, const QString &path) {
+	// Without the write-ahead log the export's read transaction would keep
+	// the main thread from writing until the whole archive is done.
+	if ((::Meta::mp.qsDBDriver == "QSQLITE") && (::Meta::mp.iSQLiteWAL <= 0)) {
+		ArchiveException ae;
+		ae.reason = "Exporting a running server needs sqlite_wal; stop murmurd and use -export instead";
+		cb->ice_exception(ae);
+		return;
+	}
+
+	ExportTask *et = new ExportTask();
+	et->iServerNum = server_id;
+	et->qsPath = path;
+	et->cb = cb;
+	qtpExport.start(et);
+}
+
+// Calls the authenticator on a pool thread, so a slow one only holds up the
+// login it was asked about. The answer is handed back to the main thread.
+class AuthenticateTask : public QRunnable {
+	public:
+		int iServerNum;
+		unsigned int uiRequest;
+		ServerAuthenticatorPrx prx;
+		ServerAuthenticatorPrx prxCall;
+		::std::string name;
+		::std::string pw;
+		::Murmur::CertificateList certs;
+		::std::string certhash;
+		bool certstrong;
+		void run();
+};
+
+void AuthenticateTask::run() {
+	::std::string newname;
+	::Murmur::GroupNameList groups;
+	int res = -2;
+	bool failed = false;
+
+	try {
+		res = prxCall->authenticate(name, pw, certs, certhash, certstrong, newname, groups);
+	} catch (...) {
+		failed = true;
+	}
+
+	QStringList qsl;
+	foreach(const ::std::string &str, groups) {
+		qsl << u8(str);
+	}
+
+	QCoreApplication::instance()->postEvent(mi, new ExecEvent(boost::bind(&MurmurIce::authenticateFinished, mi, iServerNum, uiRequest, prx, res, u8(newname), qsl, failed)));
+}
+
+void MurmurIce::authenticateAsyncSlot(bool &handled, unsigned int request, const QString &uname, int, const QList<QSslCertificate> &certlist, const QString &certhash, bool certstrong, const QString &pw) {
+	::Server *server = qobject_cast< ::Server *> (sender());
+
+	const ServerAuthenticatorPrx prx = getServerAuthenticator(server);
+	if (! prx)
+		return;
+
+	AuthenticateTask *at = new AuthenticateTask();
+	at->iServerNum = server->iServerNum;
+	at->uiRequest = request;
+	at->prx = prx;
+	// Give up on the call when the login times out, so a hung authenticator
+	// does not keep pool threads busy.
+	at->prxCall = ServerAuthenticatorPrx::uncheckedCast(prx->ice_timeout(qMax(server->iAuthTimeout, 1) * 1000));
+	at->name = u8(uname);
+	at->pw = u8(pw);
+	certificatesToCertificates(certlist, at->certs);
+	at->certhash = u8(certhash);
+	at->certstrong = certstrong;
+
+	qtpAuth.start(at);
+	handled = true;
+}
+
+void MurmurIce::authenticateFinished(int server_id, unsigned int request, const ::Murmur::ServerAuthenticatorPrx &prx, int res, const QString &newname, const QStringList &groups, bool failed) {
+	::Server *server = meta->qhServers.value(server_id);
+	if (! server)
+		return;
+
+	// Only drop the authenticator if it has not been replaced meanwhile.
+	if (failed && (qmServerAuthenticator.value(server_id) == prx))
+		badAuthenticator(server);
+
+	server->authenticateResult(request, res, newname, groups, failed);
+}
+
 void MurmurIce::registerUserSlot(int &res, const QMap<int, QString> &info) {
 	::Server *server = qobject_cast< ::Server *> (sender());
 
@@ -970,8 +1310,14 @@ static void impl_Server_getLogLen(const ::Murmur::AMD_Server_getLogLenPtr cb, in
 	cb->ice_response(len);
 }
 
-#define ACCESS_Server_getUsers_READ
-static void impl_Server_getUsers(const ::Murmur::AMD_Server_getUsersPtr cb, int server_id) {
+// Fallback for servers without published state, which are not booted.
+template <class T> static void noServerState(const T cb, int server_id) {
+	NEED_SERVER;
+	Q_UNUSED(server);
+	cb->ice_exception(ServerBootedException());
+}
+
+static void live_Server_getUsers(const ::Murmur::AMD_Server_getUsersPtr cb, int server_id) {
 	NEED_SERVER;
 	::Murmur::UserMap pm;
 	foreach(const ::User *p, server->qhUsers) {
@@ -984,8 +1330,20 @@ static void impl_Server_getUsers(const ::Murmur::AMD_Server_getUsersPtr cb, int
 	cb->ice_response(pm);
 }
 
-#define ACCESS_Server_getChannels_READ
-static void impl_Server_getChannels(const ::Murmur::AMD_Server_getChannelsPtr cb, int server_id) {
+static void snapshot_Server_getUsers(const ::Murmur::AMD_Server_getUsersPtr cb, int server_id, const ServerSnapshotPtr &ssp) {
+	if (ssp)
+		cb->ice_response(ssp->umUsers);
+	else
+		live_Server_getUsers(cb, server_id);
+}
+
+#define ACCESS_Server_getUsers_READ
+#define DIRECT_Server_getUsers
+static void impl_Server_getUsers(const ::Murmur::AMD_Server_getUsersPtr cb, int server_id) {
+	mi->withSnapshot(server_id, boost::bind(&snapshot_Server_getUsers, cb, server_id, _1));
+}
+
+static void live_Server_getChannels(const ::Murmur::AMD_Server_getChannelsPtr cb, int server_id) {
 	NEED_SERVER;
 	::Murmur::ChannelMap cm;
 	foreach(const ::Channel *c, server->qhChannels) {
@@ -996,6 +1354,19 @@ static void impl_Server_getChannels(const ::Murmur::AMD_Server_getChannelsPtr cb
 	cb->ice_response(cm);
 }
 
+static void snapshot_Server_getChannels(const ::Murmur::AMD_Server_getChannelsPtr cb, int server_id, const ServerSnapshotPtr &ssp) {
+	if (ssp)
+		cb->ice_response(ssp->cmChannels);
+	else
+		live_Server_getChannels(cb, server_id);
+}
+
+#define ACCESS_Server_getChannels_READ
+#define DIRECT_Server_getChannels
+static void impl_Server_getChannels(const ::Murmur::AMD_Server_getChannelsPtr cb, int server_id) {
+	mi->withSnapshot(server_id, boost::bind(&snapshot_Server_getChannels, cb, server_id, _1));
+}
+
 static bool userSort(const ::User *a, const ::User *b) {
 	return ::User::lessThan(a, b);
 }
@@ -1004,32 +1375,46 @@ static bool channelSort(const ::Channel *a, const ::Channel *b) {
 	return ::Channel::lessThan(a, b);
 }
 
-TreePtr recurseTree(const ::Channel *c) {
+TreePtr recurseTree(const ::Channel *c, const ::Murmur::UserMap *um) {
 	TreePtr t = new Tree();
 	channelToChannel(c, t->c);
 	QList< ::User *> users = c->qlUsers;
 	qSort(users.begin(), users.end(), userSort);
 
 	foreach(const ::User *p, users) {
-		::Murmur::User mp;
-		userToUser(p, mp);
-		t->users.push_back(mp);
+		::Murmur::UserMap::const_iterator i;
+		if (um && ((i = um->find(p->uiSession)) != um->end())) {
+			t->users.push_back((*i).second);
+		} else {
+			::Murmur::User mp;
+			userToUser(p, mp);
+			t->users.push_back(mp);
+		}
 	}
 
 	QList< ::Channel *> channels = c->qlChannels;
 	qSort(channels.begin(), channels.end(), channelSort);
 
 	foreach(const ::Channel *chn, channels) {
-		t->children.push_back(recurseTree(chn));
+		t->children.push_back(recurseTree(chn, um));
 	}
 
 	return t;
 }
 
+static void snapshot_Server_getTree(const ::Murmur::AMD_Server_getTreePtr cb, int server_id, const ServerSnapshotPtr &ssp) {
+	if (ssp) {
+		cb->ice_response(ssp->tpTree);
+	} else {
+		NEED_SERVER;
+		cb->ice_response(recurseTree(server->qhChannels.value(0)));
+	}
+}
+
 #define ACCESS_Server_getTree_READ
+#define DIRECT_Server_getTree
 static void impl_Server_getTree(const ::Murmur::AMD_Server_getTreePtr cb, int server_id) {
-	NEED_SERVER;
-	cb->ice_response(recurseTree(server->qhChannels.value(0)));
+	mi->withSnapshot(server_id, boost::bind(&snapshot_Server_getTree, cb, server_id, _1));
 }
 
 #define ACCESS_Server_getCertificateList_READ
@@ -1072,7 +1457,8 @@ static void impl_Server_setBans(const ::Murmur::AMD_Server_setBansPtr cb, int se
 	foreach(const ::Murmur::Ban &mb, bans) {
 		::Ban ban;
 		banToBan(mb, ban);
-		server->qlBans << ban;
+		if (ban.isValid())
+			server->qlBans << ban;
 	}
 	server->saveBans();
 	cb->ice_response();
@@ -1180,8 +1566,7 @@ static void impl_Server_removeContextCallback(const Murmur::AMD_Server_removeCon
 	}
 }
 
-#define ACCESS_Server_getState_READ
-static void impl_Server_getState(const ::Murmur::AMD_Server_getStatePtr cb, int server_id,  ::Ice::Int session) {
+static void live_Server_getState(const ::Murmur::AMD_Server_getStatePtr cb, int server_id,  ::Ice::Int session) {
 	NEED_SERVER;
 	NEED_PLAYER;
 
@@ -1190,6 +1575,27 @@ static void impl_Server_getState(const ::Murmur::AMD_Server_getStatePtr cb, int
 	cb->ice_response(mp);
 }
 
+static void snapshot_Server_getState(const ::Murmur::AMD_Server_getStatePtr cb, int server_id, ::Ice::Int session, const ServerSnapshotPtr &ssp) {
+	if (! ssp) {
+		live_Server_getState(cb, server_id, session);
+		return;
+	}
+
+	::Murmur::UserMap::const_iterator i = ssp->umUsers.find(session);
+	if (i != ssp->umUsers.end()) {
+		cb->ice_response((*i).second);
+	} else {
+		// Snapshots only hold authenticated users.
+		QCoreApplication::instance()->postEvent(mi, new ExecEvent(boost::bind(&live_Server_getState, cb, server_id, session)));
+	}
+}
+
+#define ACCESS_Server_getState_READ
+#define DIRECT_Server_getState
+static void impl_Server_getState(const ::Murmur::AMD_Server_getStatePtr cb, int server_id,  ::Ice::Int session) {
+	mi->withSnapshot(server_id, boost::bind(&snapshot_Server_getState, cb, server_id, session, _1));
+}
+
 static void impl_Server_setState(const ::Murmur::AMD_Server_setStatePtr cb, int server_id,  const ::Murmur::User& state) {
 	int session = state.session;
 	::Channel *channel;
@@ -1209,8 +1615,16 @@ static void impl_Server_sendMessageChannel(const ::Murmur::AMD_Server_sendMessag
 	cb->ice_response();
 }
 
-#define ACCESS_Server_getChannelState_READ
-static void impl_Server_getChannelState(const ::Murmur::AMD_Server_getChannelStatePtr cb, int server_id,  ::Ice::Int channelid) {
+static void snapshot_Server_getChannelState(const ::Murmur::AMD_Server_getChannelStatePtr cb, int server_id,  ::Ice::Int channelid, const ServerSnapshotPtr &ssp) {
+	if (ssp) {
+		::Murmur::ChannelMap::const_iterator i = ssp->cmChannels.find(channelid);
+		if (i != ssp->cmChannels.end())
+			cb->ice_response((*i).second);
+		else
+			cb->ice_exception(::Murmur::InvalidChannelException());
+		return;
+	}
+
 	NEED_SERVER;
 	NEED_CHANNEL;
 
@@ -1219,6 +1633,12 @@ static void impl_Server_getChannelState(const ::Murmur::AMD_Server_getChannelSta
 	cb->ice_response(mc);
 }
 
+#define ACCESS_Server_getChannelState_READ
+#define DIRECT_Server_getChannelState
+static void impl_Server_getChannelState(const ::Murmur::AMD_Server_getChannelStatePtr cb, int server_id,  ::Ice::Int channelid) {
+	mi->withSnapshot(server_id, boost::bind(&snapshot_Server_getChannelState, cb, server_id, channelid, _1));
+}
+
 static void impl_Server_setChannelState(const ::Murmur::AMD_Server_setChannelStatePtr cb, int server_id,  const ::Murmur::Channel& state) {
 	int channelid = state.id;
 	NEED_SERVER;
@@ -1488,6 +1908,25 @@ static void impl_Server_getRegisteredUsers(const ::Murmur::AMD_Server_getRegiste
 	cb->ice_response(rpl);
 }
 
+#define ACCESS_Server_findRegisteredUsers_READ
+static void impl_Server_findRegisteredUsers(const ::Murmur::AMD_Server_findRegisteredUsersPtr cb, int server_id,  const ::std::string& filter,  const ::std::string& after,  ::Ice::Int count) {
+	NEED_SERVER;
+	Murmur::RegisteredUserList rpl;
+
+	bool more;
+	const QList<UserInfo> users = server->getRegisteredUsersPage(u8(filter), u8(after), count, more);
+	foreach(const UserInfo &ui, users) {
+		Murmur::RegisteredUser ru;
+		ru.userid = ui.user_id;
+		ru.name = u8(ui.name);
+		ru.lastchannel = ui.last_channel ? *ui.last_channel : 0;
+		ru.lastactive = ui.last_active.isValid() ? static_cast<int>(ui.last_active.toTime_t()) : 0;
+		rpl.push_back(ru);
+	}
+
+	cb->ice_response(rpl);
+}
+
 #define ACCESS_Server_verifyPassword_READ
 static void impl_Server_verifyPassword(const ::Murmur::AMD_Server_verifyPasswordPtr cb, int server_id,  const ::std::string& name,  const ::std::string& pw) {
 	NEED_SERVER;
@@ -1534,7 +1973,7 @@ static void impl_Server_setTexture(const ::Murmur::AMD_Server_setTexturePtr cb,
 		if (user) {
 			MumbleProto::UserState mpus;
 			mpus.set_session(user->uiSession);
-			mpus.set_texture(blob(user->qbaTexture));
+			mpus.set_texture(blob(server->userTexture(user)));
 
 			server->sendAll(mpus, ~0x010202);
 			if (! user->qbaTextureHash.isEmpty()) {
@@ -1554,6 +1993,52 @@ static void impl_Server_getUptime(const ::Murmur::AMD_Server_getUptimePtr cb, in
 	cb->ice_response(static_cast<int>(server->tUptime.elapsed()/1000000LL));
 }
 
+#define ACCESS_Server_getVoiceStatistics_READ
+static void impl_Server_getVoiceStatistics(const ::Murmur::AMD_Server_getVoiceStatisticsPtr cb, int server_id, bool reset) {
+	NEED_SERVER;
+
+	const VoiceStats &vs = server->vsStats;
+	::Murmur::VoiceStatistics mvs;
+
+	mvs.samples = static_cast<unsigned int>(int(vs.qaiSamples));
+	histogramToHistogram(vs.hStage[VoiceStats::Queue], mvs.queue);
+	histogramToHistogram(vs.hStage[VoiceStats::Decrypt], mvs.decrypt);
+	histogramToHistogram(vs.hStage[VoiceStats::Route], mvs.route);
+	histogramToHistogram(vs.hStage[VoiceStats::Encrypt], mvs.encrypt);
+	histogramToHistogram(vs.hStage[VoiceStats::Send], mvs.send);
+	histogramToHistogram(vs.hStage[VoiceStats::Total], mvs.total);
+	histogramToHistogram(vs.hFanout, mvs.fanout);
+
+	if (reset)
+		server->vsStats.clear();
+
+	cb->ice_response(mvs);
+}
+
+static void impl_Server_exportArchive(const ::Murmur::AMD_Server_exportArchivePtr cb, int server_id, const ::std::string &path) {
+	NEED_SERVER_EXISTS;
+	Q_UNUSED(server);
+
+	mi->exportArchive(server_id, cb, u8(path));
+}
+
+#define ACCESS_Server_getStateVersion_READ
+#define DIRECT_Server_getStateVersion
+static void impl_Server_getStateVersion(const ::Murmur::AMD_Server_getStateVersionPtr cb, int server_id) {
+	qint64 version;
+	if (mi->getStateVersion(server_id, version))
+		cb->ice_response(version);
+	else
+		QCoreApplication::instance()->postEvent(mi, new ExecEvent(boost::bind(&noServerState< ::Murmur::AMD_Server_getStateVersionPtr>, cb, server_id)));
+}
+
+#define ACCESS_Server_getChanges_READ
+#define DIRECT_Server_getChanges
+static void impl_Server_getChanges(const ::Murmur::AMD_Server_getChangesPtr cb, int server_id, ::Ice::Long since, ::Ice::Int timeout) {
+	if (! mi->getChanges(server_id, cb, since, timeout))
+		QCoreApplication::instance()->postEvent(mi, new ExecEvent(boost::bind(&noServerState< ::Murmur::AMD_Server_getChangesPtr>, cb, server_id)));
+}
+
 static void impl_Server_addUserToGroup(const ::Murmur::AMD_Server_addUserToGroupPtr cb, int server_id, ::Ice::Int channelid,  ::Ice::Int session,  const ::std::string& group) {
 	NEED_SERVER;
 	NEED_PLAYER;
@@ -1603,9 +2088,9 @@ static void impl_Server_redirectWhisperGroup(const ::Murmur::AMD_Server_redirect
 	QString qssource = u8(source);
 	QString qstarget = u8(target);
 	if (qstarget.isEmpty())
-		user->qmWhisperRedirect.remove(qssource);
+		user->pDetails->qmWhisperRedirect.remove(qssource);
 	else
-		user->qmWhisperRedirect.insert(qssource, qstarget);
+		user->pDetails->qmWhisperRedirect.insert(qssource, qstarget);
 
 	server->clearACLCache(user);
 
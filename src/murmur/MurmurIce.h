@@ -32,10 +32,18 @@
 #ifndef MUMBLE_MURMUR_MURMURICE_H_
 #define MUMBLE_MURMUR_MURMURICE_H_
 
+#ifndef Q_MOC_RUN
+# include <boost/function.hpp>
+#endif
+
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QMap>
 #include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
 #include <QtCore/QWaitCondition>
 #include <QtNetwork/QSslCertificate>
 
@@ -46,6 +54,45 @@ class Server;
 class User;
 struct TextMessage;
 
+// Users and channels of a booted server as of one state version. Built on
+// the main thread and never modified afterwards, so Ice threads can answer
+// read-only queries from it without posting an ExecEvent.
+struct ServerSnapshot {
+	qint64 iVersion;
+	quint64 uiBuilt;
+	::Murmur::UserMap umUsers;
+	::Murmur::ChannelMap cmChannels;
+	::Murmur::TreePtr tpTree;
+};
+
+typedef QSharedPointer<const ServerSnapshot> ServerSnapshotPtr;
+// Called with the current snapshot, or with a null one on the main thread
+// if there is none and the caller has to fall back to the live state.
+typedef boost::function<void (const ServerSnapshotPtr &)> SnapshotReader;
+
+// Published state of one booted server, guarded by MurmurIce::qmState.
+struct ServerState {
+	struct ChangeWait {
+		::Murmur::AMD_Server_getChangesPtr cb;
+		qint64 iSince;
+		quint64 uiDeadline;
+	};
+
+	// Incremented for every user or channel change.
+	qint64 iVersion;
+	// Null once a change made it stale.
+	ServerSnapshotPtr sspSnapshot;
+	// Readers waiting for the snapshot to be rebuilt.
+	QList<SnapshotReader> qlReaders;
+	bool bRebuildPosted;
+	// Most recent changes, kept once someone asked for them.
+	bool bTrackChanges;
+	QList< ::Murmur::StateChange> qlChanges;
+	QList<ChangeWait> qlWaits;
+
+	ServerState() : iVersion(0), bRebuildPosted(false), bTrackChanges(false) {}
+};
+
 class MurmurIce : public QObject {
 		friend class MurmurLocker;
 		Q_OBJECT;
@@ -62,6 +109,18 @@ class MurmurIce : public QObject {
 		QMap<int, QMap<int, QMap<QString, ::Murmur::ServerContextCallbackPrx> > > qmServerContextCallbacks;
 		QMap<int, ::Murmur::ServerAuthenticatorPrx> qmServerAuthenticator;
 		QMap<int, ::Murmur::ServerUpdatingAuthenticatorPrx> qmServerUpdatingAuthenticator;
+		// Runs asynchronous authenticator calls.
+		QThreadPool qtpAuth;
+		// Writes server archives, one at a time.
+		QThreadPool qtpExport;
+
+		static const int iMaxChanges = 1024;
+		mutable QMutex qmState;
+		QHash<int, ServerState *> qhState;
+		QTimer qtChanges;
+		void rebuildSnapshot(int server_id);
+		void changed(const ::Server *server, ::Murmur::StateChangeKind kind, const ::User *p, const ::Channel *c);
+		static void changesSince(const ServerState *st, qint64 since, ::Murmur::StateChanges &sc);
 	public:
 		Ice::CommunicatorPtr communicator;
 		Ice::ObjectAdapterPtr adapter;
@@ -82,12 +141,21 @@ class MurmurIce : public QObject {
 		void setServerUpdatingAuthenticator(const ::Server* server, const ::Murmur::ServerUpdatingAuthenticatorPrx& prx);
 		const ::Murmur::ServerUpdatingAuthenticatorPrx getServerUpdatingAuthenticator(const ::Server* server) const;
 		void removeServerUpdatingAuthenticator(const ::Server* server);
+		void authenticateFinished(int server_id, unsigned int request, const ::Murmur::ServerAuthenticatorPrx &prx, int res, const QString &newname, const QStringList &groups, bool failed);
+
+		// Thread safe, these are called directly from Ice threads.
+		void withSnapshot(int server_id, const SnapshotReader &reader);
+		bool getStateVersion(int server_id, qint64 &version);
+		bool getChanges(int server_id, const ::Murmur::AMD_Server_getChangesPtr &cb, qint64 since, int timeout);
+
+		void exportArchive(int server_id, const ::Murmur::AMD_Server_exportArchivePtr &cb, const QString &path);
 
 	public slots:
 		void started(Server *);
 		void stopped(Server *);
 
 		void authenticateSlot(int &res, QString &uname, int sessionId, const QList<QSslCertificate> &certlist, const QString &certhash, bool certstrong, const QString &pw);
+		void authenticateAsyncSlot(bool &handled, unsigned int request, const QString &uname, int sessionId, const QList<QSslCertificate> &certlist, const QString &certhash, bool certstrong, const QString &pw);
 		void registerUserSlot(int &res, const QMap<int, QString> &);
 		void unregisterUserSlot(int &res, int id);
 		void getRegisteredUsersSlot(const QString &filter, QMap<int, QString> &res);
@@ -108,6 +176,8 @@ class MurmurIce : public QObject {
 		void channelRemoved(const Channel *c);
 
 		void contextAction(const User *, const QString &, unsigned int, int);
+
+		void expireChanges();
 };
 #endif
 #endif
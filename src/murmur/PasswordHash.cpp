@@ -0,0 +1,169 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "murmur_pch.h"
+
+#include "PasswordHash.h"
+#include "Message.h"
+#include "Timer.h"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#define PASSWORDHASH_DEFAULT "pbkdf2-sha384"
+#define PASSWORDHASH_SALT 16
+
+struct KDF {
+	const char *name;
+	const EVP_MD *(*digest)();
+};
+
+static const KDF kdfs[] = {
+	{ "pbkdf2-sha256", EVP_sha256 },
+	{ "pbkdf2-sha384", EVP_sha384 },
+	{ "pbkdf2-sha512", EVP_sha512 },
+};
+
+static const EVP_MD *kdfDigest(const QString &name) {
+	for (size_t i=0;i<sizeof(kdfs)/sizeof(kdfs[0]);++i)
+		if (name == QLatin1String(kdfs[i].name))
+			return kdfs[i].digest();
+	return NULL;
+}
+
+PasswordHash::PasswordHash() : iIterations(0) {
+}
+
+PasswordHash PasswordHash::fromString(const QString &str) {
+	PasswordHash ph;
+	const QStringList qsl = str.split(QLatin1Char(':'));
+	if (qsl.count() == 3) {
+		ph.qsAlgorithm = qsl.at(0);
+		ph.iIterations = qsl.at(1).toInt();
+		ph.qbaSalt = QByteArray::fromHex(qsl.at(2).toLatin1());
+	}
+	return ph;
+}
+
+QString PasswordHash::toString() const {
+	if (isLegacy())
+		return QString();
+	return QString::fromLatin1("%1:%2:%3").arg(qsAlgorithm).arg(iIterations).arg(QString::fromLatin1(qbaSalt.toHex()));
+}
+
+bool PasswordHash::isLegacy() const {
+	return qsAlgorithm.isEmpty();
+}
+
+bool PasswordHash::isValid() const {
+	return isLegacy() || (kdfDigest(qsAlgorithm) && (iIterations > 0) && ! qbaSalt.isEmpty());
+}
+
+PasswordHash PasswordHash::generate(int iterations) {
+	PasswordHash ph;
+	ph.qsAlgorithm = QLatin1String(PASSWORDHASH_DEFAULT);
+	ph.iIterations = qMax(iterations, 1);
+	ph.qbaSalt.resize(PASSWORDHASH_SALT);
+	RAND_bytes(reinterpret_cast<unsigned char *>(ph.qbaSalt.data()), ph.qbaSalt.size());
+	return ph;
+}
+
+QString PasswordHash::hash(const QString &pw) const {
+	if (isLegacy())
+		return QString::fromLatin1(sha1(pw).toHex());
+
+	const EVP_MD *md = kdfDigest(qsAlgorithm);
+	if (! md || (iIterations <= 0))
+		return QString();
+
+	const QByteArray qbaPassword = pw.toUtf8();
+	QByteArray qbaKey(EVP_MD_size(md), 0);
+	if (PKCS5_PBKDF2_HMAC(qbaPassword.constData(), qbaPassword.size(), reinterpret_cast<const unsigned char *>(qbaSalt.constData()), qbaSalt.size(), iIterations, md, qbaKey.size(), reinterpret_cast<unsigned char *>(qbaKey.data())) != 1)
+		return QString();
+
+	return QString::fromLatin1(qbaKey.toHex());
+}
+
+bool PasswordHash::verify(const QString &pw, const QString &stored) const {
+	if (stored.isEmpty())
+		return false;
+
+	const QString computed = hash(pw);
+	if (computed.isEmpty() || (computed.length() != stored.length()))
+		return false;
+
+	// Compare in constant time, so the time taken says nothing about
+	// how much of the hash matched.
+	ushort diff = 0;
+	for (int i=0;i<computed.length();++i)
+		diff |= computed.at(i).unicode() ^ stored.at(i).unicode();
+	return diff == 0;
+}
+
+// The iteration count is measured at startup unless configured, and comes
+// out a little different every time, so only hashes well below it are
+// redone; otherwise every restart would rehash most users' passwords.
+bool PasswordHash::needsUpgrade(int iterations) const {
+	return isLegacy() || (qsAlgorithm != QLatin1String(PASSWORDHASH_DEFAULT)) || (iIterations < iterations / 2);
+}
+
+int PasswordHash::benchmark(int ms) {
+	PasswordHash ph = generate(1000);
+	const QString pw = QLatin1String("benchmark");
+
+	// Double the iterations until one run takes long enough to time
+	// reliably, then scale to the target.
+	quint64 elapsed;
+	forever {
+		Timer t;
+		ph.hash(pw);
+		elapsed = t.elapsed();
+		if ((elapsed >= 10000ULL) || (ph.iIterations >= (1 << 24)))
+			break;
+		ph.iIterations *= 2;
+	}
+
+	const quint64 iterations = (static_cast<quint64>(ph.iIterations) * ms * 1000ULL) / qMax(elapsed, 1ULL);
+	return static_cast<int>(qBound(1000ULL, iterations, 1ULL << 24));
+}
+
+PasswordCheck::PasswordCheck() : iUpgradeIterations(0), bValid(false) {
+}
+
+void PasswordCheck::run() {
+	bValid = phParams.isValid() && phParams.verify(qsPassword, qsHash);
+
+	if (bValid && (iUpgradeIterations > 0) && phParams.needsUpgrade(iUpgradeIterations)) {
+		phNewParams = PasswordHash::generate(iUpgradeIterations);
+		qsNewHash = phNewParams.hash(qsPassword);
+		if (qsNewHash.isEmpty())
+			phNewParams = PasswordHash();
+	}
+}
@@ -0,0 +1,84 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUMBLE_MURMUR_PASSWORDHASH_H_
+#define MUMBLE_MURMUR_PASSWORDHASH_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+// How a stored password hash was derived. Stored per user in user_info as
+// "<algorithm>:<iterations>:<hex salt>". Users without an entry still have
+// the unsalted SHA1 hash older servers stored.
+//
+// New algorithms are added to the table in PasswordHash.cpp; existing
+// hashes keep verifying with whatever they were created with and are
+// upgraded as their users log in.
+
+class PasswordHash {
+	public:
+		QString qsAlgorithm;
+		int iIterations;
+		QByteArray qbaSalt;
+
+		PasswordHash();
+		static PasswordHash fromString(const QString &);
+		QString toString() const;
+		bool isLegacy() const;
+		bool isValid() const;
+
+		// Parameters for a newly set password, with a fresh salt.
+		static PasswordHash generate(int iterations);
+		// Hex encoded hash of pw, or an empty string if the algorithm is unknown.
+		QString hash(const QString &pw) const;
+		bool verify(const QString &pw, const QString &stored) const;
+		bool needsUpgrade(int iterations) const;
+		// Iterations the default algorithm needs to take about ms milliseconds here.
+		static int benchmark(int ms);
+};
+
+// One password verification, self contained so it can run on a worker
+// thread. If the password matches and the stored hash is weaker than
+// iUpgradeIterations asks for, the replacement hash is computed as well.
+struct PasswordCheck {
+	QString qsPassword;
+	QString qsHash;
+	PasswordHash phParams;
+	int iUpgradeIterations;
+
+	bool bValid;
+	QString qsNewHash;
+	PasswordHash phNewParams;
+
+	PasswordCheck();
+	void run();
+};
+
+#endif
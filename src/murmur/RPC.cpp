@@ -64,7 +64,7 @@ void Server::setUserState(User *pUser, Channel *cChannel, bool mute, bool deaf,
 		changed = true;
 		mpus.set_priority_speaker(prioritySpeaker);
 	}
-	if (comment != pUser->qsComment) {
+	if (comment != pUser->comment()) {
 		changed = true;
 		mpus.set_comment(u8(comment));
 		if (pUser->iId >= 0) {
@@ -81,9 +81,10 @@ void Server::setUserState(User *pUser, Channel *cChannel, bool mute, bool deaf,
 	pUser->bDeaf = deaf;
 	pUser->bMute = mute;
 	pUser->bSuppress = suppressed;
+	voiceStateChanged();
 	pUser->bPrioritySpeaker = prioritySpeaker;
 	pUser->qsName = name;
-	hashAssign(pUser->qsComment, pUser->qbaCommentHash, comment);
+	blobAssign(pUser->qsComment, pUser->qbaCommentHash, comment);
 
 	if (cChannel != pUser->cChannel) {
 		changed = true;
@@ -131,6 +132,7 @@ bool Server::setChannelState(Channel *cChannel, Channel *cParent, const QString
 
 		cChannel->cParent->removeChannel(cChannel);
 		cParent->addChannel(cChannel);
+		invalidateSubtrees();
 
 		mpcs.set_parent(cParent->iId);
 
@@ -282,7 +284,22 @@ void Server::clearTempGroups(User *user, Channel *cChannel, bool recurse) {
 	clearACLCache(user);
 }
 
+#define AUTH_ASYNC_SLOT "authenticateAsyncSlot(bool &, unsigned int, const QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &)"
+
+// Most cached authenticator answers kept per server.
+#define AUTH_CACHE_SIZE 10000
+
 void Server::connectAuthenticator(QObject *obj) {
+	// What the authenticator says takes precedence over the database.
+	udUsers.clear();
+	qhAuthCache.clear();
+
+	// Authenticators that can answer asynchronously do so for logins.
+	if (obj->metaObject()->indexOfSlot(QMetaObject::normalizedSignature(AUTH_ASYNC_SLOT).constData()) >= 0) {
+		connect(this, SIGNAL(authenticateAsyncSig(bool &, unsigned int, const QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &)), obj, SLOT(authenticateAsyncSlot(bool &, unsigned int, const QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &)));
+		++iAsyncAuthenticators;
+	}
+
 	connect(this, SIGNAL(registerUserSig(int &, const QMap<int, QString> &)), obj, SLOT(registerUserSlot(int &, const QMap<int, QString> &)));
 	connect(this, SIGNAL(unregisterUserSig(int &, int)), obj, SLOT(unregisterUserSlot(int &, int)));
 	connect(this, SIGNAL(getRegisteredUsersSig(const QString &, QMap<int, QString> &)), obj, SLOT(getRegisteredUsersSlot(const QString &, QMap<int, QString> &)));
@@ -296,6 +313,12 @@ void Server::connectAuthenticator(QObject *obj) {
 }
 
 void Server::disconnectAuthenticator(QObject *obj) {
+	udUsers.clear();
+	qhAuthCache.clear();
+
+	if (disconnect(this, SIGNAL(authenticateAsyncSig(bool &, unsigned int, const QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &)), obj, SLOT(authenticateAsyncSlot(bool &, unsigned int, const QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &))))
+		--iAsyncAuthenticators;
+
 	disconnect(this, SIGNAL(registerUserSig(int &, const QMap<int, QString> &)), obj, SLOT(registerUserSlot(int &, const QMap<int, QString> &)));
 	disconnect(this, SIGNAL(unregisterUserSig(int &, int)), obj, SLOT(unregisterUserSlot(int &, int)));
 	disconnect(this, SIGNAL(getRegisteredUsersSig(const QString &, QMap<int, QString> &)), obj, SLOT(getRegisteredUsersSlot(const QString &, QMap<int, QString> &)));
@@ -308,6 +331,199 @@ void Server::disconnectAuthenticator(QObject *obj) {
 	disconnect(this, SIGNAL(idToTextureSig(QByteArray &, int)), obj, SLOT(idToTextureSlot(QByteArray &, int)));
 }
 
+QByteArray Server::authDigest(const QString &name, const QString &pw) {
+	return sha1(name + QLatin1Char('\n') + pw);
+}
+
+// Answers a login from an earlier answer of the authenticator for the same
+// certificate, name and password.
+bool Server::cachedAuthenticate(ServerUser *u, const QString &pw, int &id) {
+	if ((iAuthCacheTTL <= 0) || u->qsHash.isEmpty())
+		return false;
+
+	QHash<QString, CachedAuth>::iterator i = qhAuthCache.find(u->qsHash);
+	if (i == qhAuthCache.end())
+		return false;
+
+	if ((i->uiExpires <= tUptime.elapsed()) || (i->qbaDigest != authDigest(u->qsName, pw))) {
+		qhAuthCache.erase(i);
+		return false;
+	}
+
+	id = i->iId;
+	u->qsName = i->qsName;
+	if (! i->qslGroups.isEmpty())
+		setTempGroups(id, u->uiSession, NULL, i->qslGroups);
+	smMetrics.mcAuthCacheHits.add();
+	return true;
+}
+
+unsigned int Server::uiAuthRequest = 0;
+
+// Parks the login until an answer for the returned request arrives, or
+// authtimeout passes.
+unsigned int Server::parkAuthenticate(ServerUser *u, const MumbleProto::Authenticate &msg, const QString &pw) {
+	if (++uiAuthRequest == 0)
+		++uiAuthRequest;
+	const unsigned int request = uiAuthRequest;
+
+	PendingAuth pa;
+	pa.uiSession = u->uiSession;
+	pa.qsName = u->qsName;
+	pa.uiQueued = tUptime.elapsed();
+	pa.qsPassword = pw;
+	pa.msgAuth = msg;
+
+	u->uiAuthRequest = request;
+	qhAuthPending.insert(request, pa);
+
+	if (! qtAuthTimeout->isActive())
+		qtAuthTimeout->start(1000);
+
+	return request;
+}
+
+// Queues the login for an asynchronous authenticator, if there is one.
+// Returns false if the caller has to authenticate synchronously.
+bool Server::requestAuthenticate(ServerUser *u, const MumbleProto::Authenticate &msg, const QString &pw) {
+	if (iAsyncAuthenticators <= 0)
+		return false;
+
+	qqAuthQueue.enqueue(parkAuthenticate(u, msg, pw));
+	dispatchAuthenticate();
+	return true;
+}
+
+// Hands queued logins to the authenticator while fewer than
+// authconcurrency are outstanding.
+void Server::dispatchAuthenticate() {
+	while (! qqAuthQueue.isEmpty() && (iAuthRunning < qMax(iAuthConcurrency, 1))) {
+		const unsigned int request = qqAuthQueue.dequeue();
+		if (! qhAuthPending.contains(request))
+			continue;
+
+		PendingAuth &pa = qhAuthPending[request];
+		ServerUser *u = qhUsers.value(pa.uiSession);
+		if (! u || (u->uiAuthRequest != request)) {
+			qhAuthPending.remove(request);
+			continue;
+		}
+
+		pa.bStarted = true;
+		++iAuthRunning;
+
+		const QString pw = pa.qsPassword;
+		bool handled = false;
+		emit authenticateAsyncSig(handled, request, u->qsName, u->uiSession, u->peerCertificateChain(), u->qsHash, u->bVerified, pw);
+
+		if (! handled) {
+			// The authenticator went away; fall back to asking synchronously.
+			const PendingAuth p = takeAuthenticate(request);
+			u->uiAuthRequest = 0;
+			int id = authenticate(u->qsName, p.qsPassword, u->uiSession, u->pDetails->qslEmail, u->qsHash, u->bVerified, u->peerCertificateChain());
+			if (qhUsers.value(p.uiSession) == u)
+				finishAuthenticate(u, p.msgAuth, p.qsPassword, id);
+		}
+	}
+}
+
+Server::PendingAuth Server::takeAuthenticate(unsigned int request) {
+	PendingAuth pa = qhAuthPending.take(request);
+	if (pa.bStarted)
+		--iAuthRunning;
+	if (qhAuthPending.isEmpty())
+		qtAuthTimeout->stop();
+	return pa;
+}
+
+// Called on the main thread with the answer to an asynchronous request. If
+// the user has gone or timed out in the meantime, the answer is dropped. A
+// login whose name is no longer the one the authenticator was asked about
+// is rejected.
+void Server::authenticateResult(unsigned int request, int res, const QString &newname, const QStringList &groups, bool failed) {
+	if (! qhAuthPending.contains(request))
+		return;
+
+	const PendingAuth pa = takeAuthenticate(request);
+	ServerUser *u = qhUsers.value(pa.uiSession);
+
+	if (u && (u->uiAuthRequest == request)) {
+		u->uiAuthRequest = 0;
+
+		if (u->qsName != pa.qsName) {
+			finishAuthenticate(u, pa.msgAuth, pa.qsPassword, -1);
+			dispatchAuthenticate();
+			return;
+		}
+
+		if (failed)
+			res = bForceExternalAuth ? -3 : -2;
+
+		if (res == -2) {
+			checkPassword(u, pa.msgAuth, pa.qsPassword);
+		} else {
+			const QByteArray &digest = authDigest(u->qsName, pa.qsPassword);
+
+			if ((res >= 0) && ! newname.isEmpty())
+				u->qsName = newname;
+			recordExternalAuth(res, u->qsName);
+
+			if (res >= 0) {
+				if (! groups.isEmpty())
+					setTempGroups(res, u->uiSession, NULL, groups);
+
+				if ((iAuthCacheTTL > 0) && ! u->qsHash.isEmpty()) {
+					if (qhAuthCache.count() >= AUTH_CACHE_SIZE)
+						qhAuthCache.clear();
+
+					CachedAuth ca;
+					ca.iId = res;
+					ca.qsName = u->qsName;
+					ca.qslGroups = groups;
+					ca.qbaDigest = digest;
+					ca.uiExpires = tUptime.elapsed() + static_cast<quint64>(iAuthCacheTTL) * 1000000ULL;
+					qhAuthCache.insert(u->qsHash, ca);
+				}
+			}
+			finishAuthenticate(u, pa.msgAuth, pa.qsPassword, res);
+		}
+	}
+
+	dispatchAuthenticate();
+}
+
+void Server::cancelAuthenticate(ServerUser *u) {
+	if (! u->uiAuthRequest)
+		return;
+
+	takeAuthenticate(u->uiAuthRequest);
+	u->uiAuthRequest = 0;
+	dispatchAuthenticate();
+}
+
+// Rejects logins the authenticator has not answered within authtimeout
+// seconds, counting time spent queued.
+void Server::checkAuthTimeout() {
+	const quint64 now = tUptime.elapsed();
+	const quint64 limit = static_cast<quint64>(qMax(iAuthTimeout, 1)) * 1000000ULL;
+
+	foreach(unsigned int request, qhAuthPending.keys()) {
+		if (now - qhAuthPending.value(request).uiQueued < limit)
+			continue;
+
+		const PendingAuth pa = takeAuthenticate(request);
+		ServerUser *u = qhUsers.value(pa.uiSession);
+		if (u && (u->uiAuthRequest == request)) {
+			u->uiAuthRequest = 0;
+			smMetrics.mcAuthTimeouts.add();
+			log(u, QLatin1String("Authenticator did not answer in time"));
+			finishAuthenticate(u, pa.msgAuth, pa.qsPassword, -3);
+		}
+	}
+
+	dispatchAuthenticate();
+}
+
 void Server::connectListener(QObject *obj) {
 	connect(this, SIGNAL(userStateChanged(const User *)), obj, SLOT(userStateChanged(const User *)));
 	connect(this, SIGNAL(userTextMessage(const User *, const TextMessage &)), obj, SLOT(userTextMessage(const User *, const TextMessage &)));
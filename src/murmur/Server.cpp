@@ -43,18 +43,31 @@
 #include "PacketDataStream.h"
 #include "ServerDB.h"
 #include "ServerUser.h"
+#include "TextSanitizer.h"
+#include "Trunk.h"
 
 #ifdef USE_BONJOUR
 #include "BonjourServer.h"
 #include "BonjourServiceRegister.h"
 #endif
 
+#ifdef USE_MIXER
+#include "Mixer.h"
+#endif
+
+#ifdef Q_OS_UNIX
+#include "Handover.h"
+#endif
+
 #ifndef MAX
 #define MAX(a,b) ((a)>(b) ? (a):(b))
 #endif
 
 #define UDP_PACKET_SIZE 1024
 
+// Time a speaker keeps their slot in a channel with a speaker limit.
+#define SPEAKER_HOLD 500000ULL
+
 LogEmitter::LogEmitter(QObject *p) : QObject(p) {
 };
 
@@ -98,21 +111,59 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 	hNotify = NULL;
 #endif
 	qtTimeout = new QTimer(this);
+	qtBanSweep = new QTimer(this);
+	qtBanSweep->setSingleShot(true);
+	qtAuthTimeout = new QTimer(this);
+	qtBlobs = new QTimer(this);
+
+	iAuthRunning = 0;
+	iVoiceRecipientsGeneration = -1;
+	iAsyncAuthenticators = 0;
 
 	iCodecAlpha = iCodecBeta = 0;
 	bPreferAlpha = false;
 	bOpus = true;
+	iCodecUsers = iOpusUsers = 0;
 
 	qnamNetwork = NULL;
 
+#ifdef USE_IO_URING
+	ulLoop = NULL;
+#endif
+
+	bMixing = false;
+	tTrunk = NULL;
+	bSubtreesValid = false;
+#ifdef USE_MIXER
+	mMixer = new Mixer(this);
+#endif
+
 	readParams();
 	initialize();
 
+#ifdef Q_OS_UNIX
+	QHash<SslServer *, int> qhHandedUdp;
+#endif
+
 	foreach(const QHostAddress &qha, qlBind) {
 		SslServer *ss = new SslServer(this);
 
 		connect(ss, SIGNAL(newConnection()), this, SLOT(newClient()), Qt::QueuedConnection);
 
+#ifdef Q_OS_UNIX
+		int tcpsock, udpsock;
+		if (Handover::take(iServerNum, qha, usPort, tcpsock, udpsock)) {
+			if (ss->setSocketDescriptor(tcpsock)) {
+				log(QString("Server listening on %1 (handed over)").arg(addressToString(qha,usPort)));
+				qhHandedUdp.insert(ss, udpsock);
+				qlServer << ss;
+				continue;
+			}
+			close(tcpsock);
+			close(udpsock);
+		}
+#endif
+
 		if (! ss->listen(qha, usPort)) {
 			log(QString("Server: TCP Listen on %1 failed: %2").arg(addressToString(qha,usPort), ss->errorString()));
 			bValid = false;
@@ -126,6 +177,16 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 		return;
 
 	foreach(SslServer *ss, qlServer) {
+#ifdef Q_OS_UNIX
+		if (qhHandedUdp.contains(ss)) {
+			int sock = qhHandedUdp.value(ss);
+			QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
+			connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
+			qlUdpSocket << sock;
+			qlUdpNotifier << qsn;
+			continue;
+		}
+#endif
 		sockaddr_storage addr;
 #ifdef Q_OS_UNIX
 		int tcpsock = ss->socketDescriptor();
@@ -145,6 +206,11 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 		sockopt = 1;
 		if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
 			log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+		if (Meta::mp.bVoiceStatsKernel) {
+			sockopt = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+			if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set SO_TIMESTAMPING for %1").arg(addressToString(ss->serverAddress(), usPort)));
+		}
 #endif
 #else
 #ifndef SIO_UDP_CONNRESET
@@ -211,10 +277,14 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 		qqIds.enqueue(i);
 
 	connect(qtTimeout, SIGNAL(timeout()), this, SLOT(checkTimeout()));
+	connect(qtBanSweep, SIGNAL(timeout()), this, SLOT(sweepBans()));
+	connect(qtAuthTimeout, SIGNAL(timeout()), this, SLOT(checkAuthTimeout()));
+	connect(qtBlobs, SIGNAL(timeout()), this, SLOT(sendBlobs()));
 
 	getBans();
 	readChannels();
 	readLinks();
+	readUsers();
 	initializeCert();
 
 	int major, minor, patch;
@@ -230,6 +300,12 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 		initRegister();
 
+		if (usTrunkPort) {
+			if (qsTrunkSecret.isEmpty())
+				log("Trunk: Not starting, trunksecret is not set");
+			else
+				tTrunk = new Trunk(this, qlBind.isEmpty() ? QHostAddress(QHostAddress::Any) : qlBind.first(), usTrunkPort, static_cast<quint32>(iTrunkNode), qsTrunkSecret.toUtf8(), qsTrunkPeers);
+		}
 	}
 }
 
@@ -254,12 +330,19 @@ void Server::startThread() {
 		}
 #endif
 	}
+#ifdef USE_MIXER
+	if (bMixing)
+		mMixer->startMixing();
+#endif
 	if (! qtTimeout->isActive())
-		qtTimeout->start(15500);
+		qtTimeout->start(1000);
 }
 
 void Server::stopThread() {
 	bRunning = false;
+#ifdef USE_MIXER
+	mMixer->stopMixing();
+#endif
 	if (isRunning()) {
 		log("Ending voice thread");
 
@@ -312,6 +395,8 @@ void Server::readParams() {
 	usPort = static_cast<unsigned short>(Meta::mp.usPort + iServerNum - 1);
 	iTimeout = Meta::mp.iTimeout;
 	iMaxBandwidth = Meta::mp.iMaxBandwidth;
+	iBandwidthBurst = Meta::mp.iBandwidthBurst;
+	setSpeakerLimits(Meta::mp.iSpeakerLimit, Meta::mp.qsChannelSpeakerLimit);
 	iMaxUsers = Meta::mp.iMaxUsers;
 	iMaxUsersPerChannel = Meta::mp.iMaxUsersPerChannel;
 	iMaxTextMessageLength = Meta::mp.iMaxTextMessageLength;
@@ -328,8 +413,12 @@ void Server::readParams() {
 	qurlRegWeb = Meta::mp.qurlRegWeb;
 	bBonjour = Meta::mp.bBonjour;
 	bAllowPing = Meta::mp.bAllowPing;
+	vsStats.iSampleRate = Meta::mp.iVoiceStatsSample;
 	bCertRequired = Meta::mp.bCertRequired;
 	bForceExternalAuth = Meta::mp.bForceExternalAuth;
+	iAuthTimeout = Meta::mp.iAuthTimeout;
+	iAuthConcurrency = Meta::mp.iAuthConcurrency;
+	iAuthCacheTTL = Meta::mp.iAuthCacheTTL;
 	qrUserName = Meta::mp.qrUserName;
 	qrChannelName = Meta::mp.qrChannelName;
 	qvSuggestVersion = Meta::mp.qvSuggestVersion;
@@ -337,6 +426,10 @@ void Server::readParams() {
 	qvSuggestPushToTalk = Meta::mp.qvSuggestPushToTalk;
 	iOpusThreshold = Meta::mp.iOpusThreshold;
 	iChannelNestingLimit = Meta::mp.iChannelNestingLimit;
+	usTrunkPort = Meta::mp.usTrunkPort ? static_cast<unsigned short>(Meta::mp.usTrunkPort + iServerNum - 1) : 0;
+	iTrunkNode = Meta::mp.iTrunkNode;
+	qsTrunkPeers = Meta::mp.qsTrunkPeers;
+	qsTrunkSecret = Meta::mp.qsTrunkSecret;
 
 	QString qsHost = getConf("host", QString()).toString();
 	if (! qsHost.isEmpty()) {
@@ -369,6 +462,15 @@ void Server::readParams() {
 	usPort = static_cast<unsigned short>(getConf("port", usPort).toUInt());
 	iTimeout = getConf("timeout", iTimeout).toInt();
 	iMaxBandwidth = getConf("bandwidth", iMaxBandwidth).toInt();
+	iBandwidthBurst = getConf("bandwidthburst", iBandwidthBurst).toInt();
+	setSpeakerLimits(getConf("speakerlimit", iSpeakerLimit).toInt(), getConf("channelspeakerlimit", Meta::mp.qsChannelSpeakerLimit).toString());
+	setBandwidthLimits(getConf("channelbandwidth", Meta::mp.qsChannelBandwidth).toString(), getConf("groupbandwidth", Meta::mp.qsGroupBandwidth).toString());
+	setMixing(getConf("mixchannels", Meta::mp.qsMixChannels).toString(), getConf("mixgroups", Meta::mp.qsMixGroups).toString(), getConf("mixbitrate", Meta::mp.iMixBitrate).toInt());
+	udUsers.setLimits(getConf("usercache", Meta::mp.iUserCache).toInt(), getConf("usercachebytes", Meta::mp.iUserCacheBytes).toInt());
+	usTrunkPort = static_cast<unsigned short>(getConf("trunkport", usTrunkPort).toUInt());
+	iTrunkNode = getConf("trunknode", iTrunkNode).toInt();
+	qsTrunkPeers = getConf("trunkpeers", qsTrunkPeers).toString();
+	qsTrunkSecret = getConf("trunksecret", qsTrunkSecret).toString();
 	iMaxUsers = getConf("users", iMaxUsers).toInt();
 	iMaxUsersPerChannel = getConf("usersperchannel", iMaxUsersPerChannel).toInt();
 	iMaxTextMessageLength = getConf("textmessagelength", iMaxTextMessageLength).toInt();
@@ -385,8 +487,12 @@ void Server::readParams() {
 	qurlRegWeb = QUrl(getConf("registerurl", qurlRegWeb.toString()).toString());
 	bBonjour = getConf("bonjour", bBonjour).toBool();
 	bAllowPing = getConf("allowping", bAllowPing).toBool();
+	vsStats.iSampleRate = qMax(0, getConf("voicestatssample", vsStats.iSampleRate).toInt());
 	bCertRequired = getConf("certrequired", bCertRequired).toBool();
 	bForceExternalAuth = getConf("forceExternalAuth", bForceExternalAuth).toBool();
+	iAuthTimeout = getConf("authtimeout", iAuthTimeout).toInt();
+	iAuthConcurrency = getConf("authconcurrency", iAuthConcurrency).toInt();
+	iAuthCacheTTL = getConf("authcachettl", iAuthCacheTTL).toInt();
 
 	qvSuggestVersion = getConf("suggestversion", qvSuggestVersion);
 	if (qvSuggestVersion.toUInt() == 0)
@@ -413,16 +519,30 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 	int i = v.toInt();
 	if ((key == "password") || (key == "serverpassword"))
 		qsPassword = !v.isNull() ? v : Meta::mp.qsPassword;
-	else if (key == "timeout")
+	else if (key == "timeout") {
 		iTimeout = i ? i : Meta::mp.iTimeout;
+		foreach(ServerUser *u, qhUsers)
+			scheduleTimeout(u);
+	}
 	else if (key == "bandwidth") {
 		int length = i ? i : Meta::mp.iMaxBandwidth;
 		if (length != iMaxBandwidth) {
 			iMaxBandwidth = length;
-			MumbleProto::ServerConfig mpsc;
-			mpsc.set_max_bandwidth(length);
-			sendAll(mpsc);
+			foreach(ServerUser *u, qhUsers)
+				updateBandwidthLimit(u);
 		}
+	} else if (key == "bandwidthburst")
+		iBandwidthBurst = i ? i : Meta::mp.iBandwidthBurst;
+	else if ((key == "speakerlimit") || (key == "channelspeakerlimit"))
+		setSpeakerLimits(getConf("speakerlimit", Meta::mp.iSpeakerLimit).toInt(), getConf("channelspeakerlimit", Meta::mp.qsChannelSpeakerLimit).toString());
+	else if ((key == "channelbandwidth") || (key == "groupbandwidth")) {
+		setBandwidthLimits(getConf("channelbandwidth", Meta::mp.qsChannelBandwidth).toString(), getConf("groupbandwidth", Meta::mp.qsGroupBandwidth).toString());
+		foreach(ServerUser *u, qhUsers)
+			updateBandwidthLimit(u);
+	} else if ((key == "mixchannels") || (key == "mixgroups") || (key == "mixbitrate")) {
+		setMixing(getConf("mixchannels", Meta::mp.qsMixChannels).toString(), getConf("mixgroups", Meta::mp.qsMixGroups).toString(), getConf("mixbitrate", Meta::mp.iMixBitrate).toInt());
+	} else if ((key == "usercache") || (key == "usercachebytes")) {
+		udUsers.setLimits(getConf("usercache", Meta::mp.iUserCache).toInt(), getConf("usercachebytes", Meta::mp.iUserCacheBytes).toInt());
 	} else if (key == "users") {
 		int newmax = i ? i : Meta::mp.iMaxUsers;
 		if (iMaxUsers == newmax)
@@ -496,6 +616,15 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 		bCertRequired = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bCertRequired;
 	else if (key == "forceExternalAuth")
 		bForceExternalAuth = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bForceExternalAuth;
+	else if (key == "authtimeout")
+		iAuthTimeout = i ? i : Meta::mp.iAuthTimeout;
+	else if (key == "authconcurrency") {
+		iAuthConcurrency = i ? i : Meta::mp.iAuthConcurrency;
+		dispatchAuthenticate();
+	} else if (key == "authcachettl") {
+		iAuthCacheTTL = !v.isNull() ? i : Meta::mp.iAuthCacheTTL;
+		qhAuthCache.clear();
+	}
 	else if (key == "bonjour") {
 		bBonjour = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bBonjour;
 #ifdef USE_BONJOUR
@@ -506,6 +635,8 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 #endif
 	} else if (key == "allowping")
 		bAllowPing = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bAllowPing;
+	else if (key == "voicestatssample")
+		vsStats.iSampleRate = qMax(0, !v.isNull() ? v.toInt() : Meta::mp.iVoiceStatsSample);
 	else if (key == "username")
 		qrUserName=!v.isNull() ? QRegExp(v) : Meta::mp.qrUserName;
 	else if (key == "channelname")
@@ -558,7 +689,7 @@ void Server::udpActivated(int socket) {
 	iov[0].iov_base = encrypt;
 	iov[0].iov_len = UDP_PACKET_SIZE;
 
-	u_char controldata[CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo)))];
+	u_char controldata[CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo))) + CMSG_SPACE(3 * sizeof(struct timespec))];
 
 	memset(&msg, 0, sizeof(msg));
 	msg.msg_name = reinterpret_cast<struct sockaddr *>(&from);
@@ -570,6 +701,8 @@ void Server::udpActivated(int socket) {
 
 	int &sock = socket;
 	len=static_cast<quint32>(::recvmsg(sock, &msg, MSG_TRUNC));
+	if (Meta::mp.bVoiceStatsKernel)
+		takeKernelTimestamp(&msg);
 #else
 	socklen_t fromlen = sizeof(from);
 	int &sock = socket;
@@ -601,6 +734,11 @@ void Server::udpActivated(int socket) {
 }
 
 void Server::run() {
+#ifdef USE_IO_URING
+	if (Meta::mp.bIoUring && runUring())
+		return;
+#endif
+
 	qint32 len;
 #if defined(__LP64__)
 	char encbuff[UDP_PACKET_SIZE+8];
@@ -693,7 +831,7 @@ void Server::run() {
 				iov[0].iov_base = encrypt;
 				iov[0].iov_len = UDP_PACKET_SIZE;
 
-				u_char controldata[CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo)))];
+				u_char controldata[CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo))) + CMSG_SPACE(3 * sizeof(struct timespec))];
 
 				memset(&msg, 0, sizeof(msg));
 				msg.msg_name = reinterpret_cast<struct sockaddr *>(&from);
@@ -704,6 +842,8 @@ void Server::run() {
 				msg.msg_controllen = sizeof(controldata);
 
 				len=static_cast<quint32>(::recvmsg(sock, &msg, MSG_TRUNC));
+
+				quint64 kernelTime = Meta::mp.bVoiceStatsKernel ? takeKernelTimestamp(&msg) : 0ULL;
 #else
 				len=static_cast<qint32>(::recvfrom(sock, encrypt, UDP_PACKET_SIZE, MSG_TRUNC, reinterpret_cast<struct sockaddr *>(&from), &fromlen));
 #endif
@@ -719,6 +859,9 @@ void Server::run() {
 					continue;
 				}
 
+				smMetrics.mcUdpPacketsIn.add();
+				smMetrics.mcUdpBytesIn.add(len);
+
 				QReadLocker rl(&qrwlUsers);
 
 				quint32 *ping = reinterpret_cast<quint32 *>(encrypt);
@@ -736,67 +879,30 @@ void Server::run() {
 #else
 					::sendto(sock, encrypt, 6 * sizeof(quint32), 0, reinterpret_cast<struct sockaddr *>(&from), fromlen);
 #endif
+					smMetrics.mcUdpPacketsOut.add();
+					smMetrics.mcUdpBytesOut.add(6 * sizeof(quint32));
 					continue;
 				}
 
+				PacketTrace pt;
+				PacketTrace *trace = NULL;
+				if (vsStats.sample()) {
+#ifdef Q_OS_LINUX
+					pt.start(kernelTime, Timer::now());
+#else
+					pt.start(0ULL, Timer::now());
+#endif
+					trace = &pt;
+				}
 
-				quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast<sockaddr_in6 *>(&from)->sin6_port) : (reinterpret_cast<sockaddr_in *>(&from)->sin_port);
-				const HostAddress &ha = HostAddress(from);
+				ServerUser *u = findUdpUser(sock, from, encrypt, buffer, len);
+				if (! u)
+					continue;
 
-				const QPair<HostAddress, quint16> &key = QPair<HostAddress, quint16>(ha, port);
+				if (trace)
+					trace->uiDecrypted = Timer::now();
 
-				ServerUser *u = qhPeerUsers.value(key);
-				if (u) {
-					if (! checkDecrypt(u, encrypt, buffer, len)) {
-						continue;
-					}
-				} else {
-					// Unknown peer
-					foreach(ServerUser *usr, qhHostUsers.value(ha)) {
-						if (usr->csCrypt.isValid() && checkDecrypt(usr, encrypt, buffer, len)) {
-							// Every time we relock, reverify users' existance.
-							// The main thread might delete the user while the lock isn't held.
-							unsigned int uiSession = usr->uiSession;
-							rl.unlock();
-							qrwlUsers.lockForWrite();
-							if (qhUsers.contains(uiSession)) {
-								u = usr;
-								u->sUdpSocket = sock;
-								memcpy(& u->saiUdpAddress, &from, sizeof(from));
-								qhHostUsers[from].remove(u);
-								qhPeerUsers.insert(key, u);
-								qrwlUsers.unlock();
-								rl.relock();
-								if (! qhUsers.contains(uiSession))
-									u = NULL;
-							}
-							break;
-						}
-					}
-					if (! u) {
-						continue;
-					}
-				}
-				len -= 4;
-
-				MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((buffer[0] >> 5) & 0x7);
-
-				switch (msgType) {
-					case MessageHandler::UDPVoiceSpeex:
-					case MessageHandler::UDPVoiceCELTAlpha:
-					case MessageHandler::UDPVoiceCELTBeta:
-						if (bOpus)
-							break;
-					case MessageHandler::UDPVoiceOpus: {
-							u->bUdp = true;
-							processMsg(u, buffer, len);
-							break;
-						}
-					case MessageHandler::UDPPing: {
-							QByteArray qba;
-							sendMessage(u, buffer, len, qba, true);
-						}
-				}
+				processUdpMessage(u, buffer, len - 4, trace);
 #ifdef Q_OS_UNIX
 				fds[i].revents = 0;
 #endif
@@ -811,6 +917,80 @@ void Server::run() {
 #endif
 }
 
+#ifdef Q_OS_UNIX
+ServerUser *Server::findUdpUser(int sock, const sockaddr_storage &from, const char *encrypt, char *buffer, int len) {
+#else
+ServerUser *Server::findUdpUser(SOCKET sock, const sockaddr_storage &from, const char *encrypt, char *buffer, int len) {
+#endif
+	quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast<const sockaddr_in6 *>(&from)->sin6_port) : (reinterpret_cast<const sockaddr_in *>(&from)->sin_port);
+	const HostAddress &ha = HostAddress(from);
+
+	const QPair<HostAddress, quint16> &key = QPair<HostAddress, quint16>(ha, port);
+
+	ServerUser *u = qhPeerUsers.value(key);
+	if (u) {
+		if (! checkDecrypt(u, encrypt, buffer, len)) {
+			smMetrics.mcDecryptFailures.add();
+			return NULL;
+		}
+		return u;
+	}
+
+	// Unknown peer
+	foreach(ServerUser *usr, qhHostUsers.value(ha)) {
+		if (usr->csCrypt.isValid() && checkDecrypt(usr, encrypt, buffer, len)) {
+			// Every time we relock, reverify users' existance.
+			// The main thread might delete the user while the lock isn't held.
+			unsigned int uiSession = usr->uiSession;
+			qrwlUsers.unlock();
+			qrwlUsers.lockForWrite();
+			if (qhUsers.contains(uiSession)) {
+				u = usr;
+				u->sUdpSocket = sock;
+				memcpy(& u->saiUdpAddress, &from, sizeof(from));
+				voiceStateChanged();
+				qhHostUsers[from].remove(u);
+				qhPeerUsers.insert(key, u);
+				qrwlUsers.unlock();
+				qrwlUsers.lockForRead();
+				if (! qhUsers.contains(uiSession))
+					u = NULL;
+			} else {
+				qrwlUsers.unlock();
+				qrwlUsers.lockForRead();
+			}
+			break;
+		}
+	}
+	return u;
+}
+
+void Server::processUdpMessage(ServerUser *u, const char *buffer, int len, PacketTrace *trace) {
+	MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((buffer[0] >> 5) & 0x7);
+
+	switch (msgType) {
+		case MessageHandler::UDPVoiceSpeex:
+		case MessageHandler::UDPVoiceCELTAlpha:
+		case MessageHandler::UDPVoiceCELTBeta:
+			if (bOpus)
+				break;
+		case MessageHandler::UDPVoiceOpus: {
+				if (! u->bUdp) {
+					u->bUdp = true;
+					voiceStateChanged();
+				}
+				processMsg(u, buffer, len, trace);
+				if (trace)
+					vsStats.record(*trace, Timer::now());
+				break;
+			}
+		case MessageHandler::UDPPing: {
+				QByteArray qba;
+				sendMessage(u, buffer, len, qba, true);
+			}
+	}
+}
+
 bool Server::checkDecrypt(ServerUser *u, const char *encrypt, char *plain, unsigned int len) {
 	if (u->csCrypt.isValid() && u->csCrypt.decrypt(reinterpret_cast<const unsigned char *>(encrypt), reinterpret_cast<unsigned char *>(plain), len))
 		return true;
@@ -818,14 +998,82 @@ bool Server::checkDecrypt(ServerUser *u, const char *encrypt, char *plain, unsig
 	if (u->csCrypt.tLastGood.elapsed() > 5000000ULL) {
 		if (u->csCrypt.tLastRequest.elapsed() > 5000000ULL) {
 			u->csCrypt.tLastRequest.restart();
+			smMetrics.mcResyncs.add();
 			emit reqSync(u->uiSession);
 		}
 	}
 	return false;
 }
 
-void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force) {
-	if ((u->bUdp || force) && (u->sUdpSocket != INVALID_SOCKET) && u->csCrypt.isValid()) {
+#ifdef Q_OS_LINUX
+// Fill in the ancillary data of msg so the datagram is sent from the local
+// address the user's TCP connection was accepted on. The control buffer must
+// be zeroed and large enough for either in_pktinfo or in6_pktinfo.
+bool Server::setSourceAddress(const VoiceRecipient &vr, struct msghdr *msg) {
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	const HostAddress &tcpha = vr.haTcpLocal;
+	if (vr.saiUdpAddress.sa.sa_family == AF_INET6) {
+		cmsg->cmsg_level = IPPROTO_IPV6;
+		cmsg->cmsg_type = IPV6_PKTINFO;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+		struct in6_pktinfo *pktinfo = reinterpret_cast<struct in6_pktinfo *>(CMSG_DATA(cmsg));
+		memset(pktinfo, 0, sizeof(*pktinfo));
+		memcpy(&pktinfo->ipi6_addr.s6_addr[0], &tcpha.qip6.c[0], sizeof(pktinfo->ipi6_addr.s6_addr));
+	} else {
+		cmsg->cmsg_level = IPPROTO_IP;
+		cmsg->cmsg_type = IP_PKTINFO;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+		struct in_pktinfo *pktinfo = reinterpret_cast<struct in_pktinfo *>(CMSG_DATA(cmsg));
+		memset(pktinfo, 0, sizeof(*pktinfo));
+		if (tcpha.isV6())
+			return false;
+		pktinfo->ipi_spec_dst.s_addr = tcpha.hash[3];
+	}
+	return true;
+}
+
+// Extract the software receive timestamp from the ancillary data of a received
+// datagram and remove it, so the remaining packet info can be passed to
+// sendmsg() as is. Returns 0 if there is no timestamp.
+quint64 Server::takeKernelTimestamp(struct msghdr *msg) {
+	quint64 ts = 0;
+	char *control = reinterpret_cast<char *>(msg->msg_control);
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_TIMESTAMPING)) {
+			const struct timespec *stamp = reinterpret_cast<const struct timespec *>(CMSG_DATA(cmsg));
+			ts = static_cast<quint64>(stamp[0].tv_sec) * 1000000ULL + static_cast<quint64>(stamp[0].tv_nsec) / 1000ULL;
+
+			char *start = reinterpret_cast<char *>(cmsg);
+			size_t space = CMSG_SPACE(cmsg->cmsg_len - CMSG_LEN(0));
+			size_t after = msg->msg_controllen - static_cast<size_t>(start - control);
+			space = qMin(space, after);
+			memmove(start, start + space, after - space);
+			msg->msg_controllen -= space;
+			break;
+		}
+	}
+	return ts;
+}
+#endif
+
+void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force, PacketTrace *trace) {
+	VoiceRecipient vr;
+	u->fillVoiceRecipient(vr);
+	sendMessage(vr, data, len, cache, force, trace);
+}
+
+void Server::sendMessage(const VoiceRecipient &vr, const char *data, int len, QByteArray &cache, bool force, PacketTrace *trace) {
+	ServerUser *u = vr.pUser;
+	const bool v6 = (vr.saiUdpAddress.sa.sa_family == AF_INET6);
+
+	if (((vr.uiFlags & VoiceRecipient::Udp) || force) && (vr.sUdpSocket != INVALID_SOCKET) && u->csCrypt.isValid()) {
+#ifdef USE_IO_URING
+		if (ulLoop && (QThread::currentThread() == this) && queueUringSend(vr, data, len, trace))
+			return;
+#endif
+		quint64 t = trace ? Timer::now() : 0ULL;
+
 #if defined(__LP64__)
 		STACKVAR(char, ebuffer, len+4+16);
 		char *buffer = reinterpret_cast<char *>(((reinterpret_cast<quint64>(ebuffer) + 8) & ~7) + 4);
@@ -833,10 +1081,15 @@ void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &c
 		STACKVAR(char, buffer, len+4);
 #endif
 		u->csCrypt.encrypt(reinterpret_cast<const unsigned char *>(data), reinterpret_cast<unsigned char *>(buffer), len);
+		if (trace) {
+			quint64 now = Timer::now();
+			trace->uiEncrypt += now - t;
+			t = now;
+		}
 #ifdef Q_OS_WIN
 		DWORD dwFlow = 0;
 		if (Meta::hQoS)
-			QOSAddSocketToFlow(Meta::hQoS, u->sUdpSocket, reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress), QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, &dwFlow);
+			QOSAddSocketToFlow(Meta::hQoS, vr.sUdpSocket, const_cast<struct sockaddr *>(& vr.saiUdpAddress.sa), QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, &dwFlow);
 #endif
 #ifdef Q_OS_LINUX
 		struct msghdr msg;
@@ -849,59 +1102,95 @@ void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &c
 		memset(controldata, 0, sizeof(controldata));
 
 		memset(&msg, 0, sizeof(msg));
-		msg.msg_name = reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress);
-		msg.msg_namelen = (u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+		msg.msg_name = const_cast<struct sockaddr *>(& vr.saiUdpAddress.sa);
+		msg.msg_namelen = v6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
 		msg.msg_iov = iov;
 		msg.msg_iovlen = 1;
 		msg.msg_control = controldata;
-		msg.msg_controllen = CMSG_SPACE((u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo) : sizeof(struct in_pktinfo));
-
-		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-		HostAddress tcpha(u->saiTcpLocalAddress);
-		if (u->saiUdpAddress.ss_family == AF_INET6) {
-			cmsg->cmsg_level = IPPROTO_IPV6;
-			cmsg->cmsg_type = IPV6_PKTINFO;
-			cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
-			struct in6_pktinfo *pktinfo = reinterpret_cast<struct in6_pktinfo *>(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			memcpy(&pktinfo->ipi6_addr.s6_addr[0], &tcpha.qip6.c[0], sizeof(pktinfo->ipi6_addr.s6_addr));
-		} else {
-			cmsg->cmsg_level = IPPROTO_IP;
-			cmsg->cmsg_type = IP_PKTINFO;
-			cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
-			struct in_pktinfo *pktinfo = reinterpret_cast<struct in_pktinfo *>(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			if (tcpha.isV6())
-				return;
-			pktinfo->ipi_spec_dst.s_addr = tcpha.hash[3];
-		}
+		msg.msg_controllen = CMSG_SPACE(v6 ? sizeof(struct in6_pktinfo) : sizeof(struct in_pktinfo));
 
+		if (! setSourceAddress(vr, &msg))
+			return;
 
-		::sendmsg(u->sUdpSocket, &msg, 0);
+		::sendmsg(vr.sUdpSocket, &msg, 0);
 #else
-		::sendto(u->sUdpSocket, buffer, len+4, 0, reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress), (u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+		::sendto(vr.sUdpSocket, buffer, len+4, 0, & vr.saiUdpAddress.sa, v6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
 #endif
+		smMetrics.mcUdpPacketsOut.add();
+		smMetrics.mcUdpBytesOut.add(len + 4);
 #ifdef Q_OS_WIN
 		if (Meta::hQoS && dwFlow)
 			QOSRemoveSocketFromFlow(Meta::hQoS, 0, dwFlow, 0);
 #else
 #endif
+		if (trace) {
+			trace->uiSend += Timer::now() - t;
+			++trace->iFanout;
+		}
 	} else {
+		quint64 t = trace ? Timer::now() : 0ULL;
 		if (cache.isEmpty())
 			cache = QByteArray(data, len);
 		emit tcpTransmit(cache,u->uiSession);
+		smMetrics.mcTunnelPacketsOut.add();
+		smMetrics.mcTunnelBytesOut.add(len);
+		if (trace) {
+			trace->uiSend += Timer::now() - t;
+			++trace->iFanout;
+		}
 	}
 }
 
 #define SENDTO \
 		if ((!pDst->bDeaf) && (!pDst->bSelfDeaf) && (pDst != u)) { \
 			if ((poslen > 0) && (pDst->ssContext == u->ssContext)) \
-				sendMessage(pDst, buffer, len, qba); \
+				sendMessage(pDst, buffer, len, qba, false, trace); \
 			else \
-				sendMessage(pDst, buffer, len - poslen, qba_npos); \
+				sendMessage(pDst, buffer, len - poslen, qba_npos, false, trace); \
 		}
 
-void Server::processMsg(ServerUser *u, const char *data, int len) {
+#define SENDTO_RECIPIENT \
+		if (! (vr->uiFlags & VoiceRecipient::Deaf) && (vr->pUser != u)) { \
+			if ((poslen > 0) && (vr->uiContext == context) && (vr->pUser->ssContext == u->ssContext)) \
+				sendMessage(*vr, buffer, len, qba, false, trace); \
+			else \
+				sendMessage(*vr, buffer, len - poslen, qba_npos, false, trace); \
+		}
+
+void Server::voiceStateChanged() {
+	qaiVoiceGeneration.fetchAndAddOrdered(1);
+}
+
+// Both the voice thread and the main thread, for tunneled voice, forward
+// packets, so the cache has a lock of its own. Callers get their own
+// reference to the array and have to hold qrwlUsers for as long as they use
+// it. That keeps the users in it alive, as removing one changes the
+// generation under the write lock.
+QVector<VoiceRecipient> Server::voiceRecipients(const Channel *c) {
+	const int generation = qaiVoiceGeneration.fetchAndAddAcquire(0);
+
+	QMutexLocker qml(&qmVoiceRecipients);
+
+	if (generation != iVoiceRecipientsGeneration) {
+		qhVoiceRecipients.clear();
+		iVoiceRecipientsGeneration = generation;
+	}
+
+	QHash<const Channel *, QVector<VoiceRecipient> >::const_iterator i = qhVoiceRecipients.constFind(c);
+	if (i != qhVoiceRecipients.constEnd())
+		return i.value();
+
+	QVector<VoiceRecipient> recipients(c->qlUsers.count());
+	VoiceRecipient *vr = recipients.data();
+	foreach(User *p, c->qlUsers)
+		static_cast<ServerUser *>(p)->fillVoiceRecipient(*vr++);
+
+	qhVoiceRecipients.insert(c, recipients);
+	smMetrics.mcVoiceRecipientBuilds.add();
+	return recipients;
+}
+
+void Server::processMsg(ServerUser *u, const char *data, int len, PacketTrace *trace) {
 	if (u->sState != ServerUser::Authenticated || u->bMute || u->bSuppress || u->bSelfMute)
 		return;
 
@@ -916,13 +1205,17 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 	unsigned int type = data[0] & 0xe0;
 	unsigned int target = data[0] & 0x1f;
 	unsigned int poslen;
+	bool terminator = false;
+	const char *opus = NULL;
+	int opuslen = 0;
 
 	// IP + UDP + Crypt + Data
 	int packetsize = 20 + 8 + 4 + len;
 
 	// Check the voice data rate limit.
-	if (! bw->addFrame(packetsize, iMaxBandwidth/8)) {
+	if (! bw->addFrame(packetsize, u->iMaxBandwidth/8, iBandwidthBurst)) {
 		// Suppress packet.
+		smMetrics.mcBandwidthDrops.add();
 		return;
 	}
 
@@ -938,11 +1231,18 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 	} else {
 		int size;
 		pdi >> size;
-		pdi.skip(size & 0x1fff);
+		opus = pdi.charPtr();
+		opuslen = size & 0x1fff;
+		pdi.skip(opuslen);
+		terminator = (size & 0x2000);
+		if (! pdi.isValid())
+			opus = NULL;
 	}
 
 	// Save location of the positional audio data.
 	poslen = pdi.left();
+	const int voicelen = len - 1 - static_cast<int>(poslen);
+	const unsigned int context = (poslen > 0) ? ServerUser::contextHash(u->ssContext) : 0;
 
 	// Append session id to the new output stream.
 	pds << u->uiSession;
@@ -956,11 +1256,30 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 		sendMessage(u, buffer, len, qba);
 		return;
 	} else if (target == 0) { // Normal speech
+		if (bSpeakerLimits && ! admitSpeaker(u, c, terminator)) {
+			smMetrics.mcSpeakerDrops.add();
+			return;
+		}
+
+		// Listeners who get the channel mix are handed to the mixer once
+		// per channel instead.
+		const bool mix = bMixing && opus;
+		bool mixed = false;
+
 		buffer[0] = static_cast<char>(type | 0);
-		foreach(p, c->qlUsers) {
-			ServerUser *pDst = static_cast<ServerUser *>(p);
-			SENDTO;
+		const QVector<VoiceRecipient> recipients = voiceRecipients(c);
+		const VoiceRecipient *vr = recipients.constData();
+		for (int i=0;i<recipients.count();++i, ++vr) {
+			if (mix && (vr->uiFlags & VoiceRecipient::Mixed))
+				mixed = mixed || (vr->pUser != u);
+			else
+				SENDTO_RECIPIENT;
 		}
+		if (mixed)
+			mixFrame(c, u, opus, opuslen, terminator);
+
+		// Linked channels the user may speak in, for the other trunk nodes.
+		TrunkVoice::Channels spoken;
 
 		if (! c->qhLinks.isEmpty()) {
 			QSet<Channel *> chans = c->allLinks();
@@ -970,13 +1289,24 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 
 			foreach(Channel *l, chans) {
 				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache)) {
-					foreach(p, l->qlUsers) {
-						ServerUser *pDst = static_cast<ServerUser *>(p);
-						SENDTO;
+					spoken.append(l->iId);
+					mixed = false;
+					const QVector<VoiceRecipient> linked = voiceRecipients(l);
+					vr = linked.constData();
+					for (int i=0;i<linked.count();++i, ++vr) {
+						if (mix && (vr->uiFlags & VoiceRecipient::Mixed))
+							mixed = true;
+						else
+							SENDTO_RECIPIENT;
 					}
+					if (mixed)
+						mixFrame(l, u, opus, opuslen, terminator);
 				}
 			}
 		}
+
+		if (tTrunk)
+			tTrunk->forward(u, c, spoken, type, data + 1, voicelen);
 	} else if (u->qmTargets.contains(target)) { // Whisper
 		QSet<ServerUser *> channel;
 		QSet<ServerUser *> direct;
@@ -1011,7 +1341,7 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 								channels.insert(wc);
 							if (dochildren)
 								channels.unite(wc->allChildren());
-							const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
+							const QString &redirect = u->pDetails->qmWhisperRedirect.value(wtc.qsGroup);
 							const QString &qsg = redirect.isEmpty() ? wtc.qsGroup : redirect;
 							foreach(Channel *tc, channels) {
 								if (ChanACL::hasPermission(u, tc, ChanACL::Whisper, &acCache)) {
@@ -1097,23 +1427,11 @@ void Server::newClient() {
 
 		HostAddress ha(adr);
 
-		QList<Ban> tmpBans = qlBans;
-		foreach(const Ban &ban, qlBans) {
-			if (ban.isExpired())
-				tmpBans.removeOne(ban);
-		}
-		if (qlBans.count() != tmpBans.count()) {
-			qlBans = tmpBans;
-			saveBans();
-		}
-
-		foreach(const Ban &ban, qlBans) {
-			if (ban.haAddress.match(ha, ban.iMask)) {
-				log(QString("Ignoring connection: %1 (Server ban)").arg(addressToString(sock->peerAddress(), sock->peerPort())));
-				sock->disconnectFromHost();
-				sock->deleteLater();
-				return;
-			}
+		if (biBans.match(ha)) {
+			log(QString("Ignoring connection: %1 (Server ban)").arg(addressToString(sock->peerAddress(), sock->peerPort())));
+			sock->disconnectFromHost();
+			sock->deleteLater();
+			return;
 		}
 
 		sock->setPrivateKey(qskKey);
@@ -1139,6 +1457,12 @@ void Server::newClient() {
 			qhHostUsers[ha].insert(u);
 		}
 
+		if (twTimeouts.count() == 0)
+			twTimeouts.advance(tUptime.elapsed() / 1000000ULL);
+		scheduleTimeout(u);
+		if (! qtTimeout->isActive())
+			qtTimeout->start(1000);
+
 		connect(u, SIGNAL(connectionClosed(QAbstractSocket::SocketError, const QString &)), this, SLOT(connectionClosed(QAbstractSocket::SocketError, const QString &)));
 		connect(u, SIGNAL(message(unsigned int, const QByteArray &)), this, SLOT(message(unsigned int, const QByteArray &)));
 		connect(u, SIGNAL(handleSslErrors(const QList<QSslError> &)), this, SLOT(sslError(const QList<QSslError> &)));
@@ -1177,12 +1501,12 @@ void Server::encrypted() {
 	if (!certs.isEmpty()) {
 		const QSslCertificate &cert = certs.last();
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
-		uSource->qslEmail = cert.subjectAlternativeNames().values(QSsl::EmailEntry);
+		uSource->pDetails->qslEmail = cert.subjectAlternativeNames().values(QSsl::EmailEntry);
 #else
-		uSource->qslEmail = cert.alternateSubjectNames().values(QSsl::EmailEntry);
+		uSource->pDetails->qslEmail = cert.alternateSubjectNames().values(QSsl::EmailEntry);
 #endif
 		uSource->qsHash = cert.digest(QCryptographicHash::Sha1).toHex();
-		if (! uSource->qslEmail.isEmpty() && uSource->bVerified) {
+		if (! uSource->pDetails->qslEmail.isEmpty() && uSource->bVerified) {
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
 			QString subject;
 			QString issuer;
@@ -1200,14 +1524,12 @@ void Server::encrypted() {
 			QString subject = cert.subjectInfo(QSslCertificate::CommonName);
 			QString issuer = certs.first().issuerInfo(QSslCertificate::CommonName);
 #endif
-			log(uSource, QString::fromUtf8("Strong certificate for %1 <%2> (signed by %3)").arg(subject).arg(uSource->qslEmail.join(", ")).arg(issuer));
+			log(uSource, QString::fromUtf8("Strong certificate for %1 <%2> (signed by %3)").arg(subject).arg(uSource->pDetails->qslEmail.join(", ")).arg(issuer));
 		}
 
-		foreach(const Ban &ban, qlBans) {
-			if (ban.qsHash == uSource->qsHash) {
-				log(uSource, QString("Certificate hash is banned."));
-				uSource->disconnectSocket();
-			}
+		if (biBans.matchHash(uSource->qsHash)) {
+			log(uSource, QString("Certificate hash is banned."));
+			uSource->disconnectSocket();
 		}
 	}
 }
@@ -1256,6 +1578,9 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 
 	log(u, QString("Connection closed: %1 [%2]").arg(reason).arg(err));
 
+	twTimeouts.remove(&u->teTimeout);
+	cancelAuthenticate(u);
+
 	if (u->sState == ServerUser::Authenticated) {
 		MumbleProto::UserRemove mpur;
 		mpur.set_session(u->uiSession);
@@ -1278,6 +1603,7 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 
 		if (old)
 			old->removeUser(u);
+		voiceStateChanged();
 	}
 
 	if (old && old->bTemporary && old->qlUsers.isEmpty())
@@ -1288,6 +1614,7 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 
 	if (u->sState == ServerUser::Authenticated) {
 		clearTempGroups(u); // Also clears ACL cache
+		tallyCodecs(u, -1);
 		recheckCodecVersions(); // Maybe can choose a better codec now
 	}
 
@@ -1304,6 +1631,7 @@ void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *
 
 	if (u->sState == ServerUser::Authenticated) {
 		u->resetActivityTime();
+		scheduleTimeout(u);
 	}
 
 	if (uiType == MessageHandler::UDPTunnel) {
@@ -1311,9 +1639,15 @@ void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *
 		if (l < 2)
 			return;
 
+		smMetrics.mcTunnelPacketsIn.add();
+		smMetrics.mcTunnelBytesIn.add(l);
+
 		QReadLocker rl(&qrwlUsers);
 
-		u->bUdp = false;
+		if (u->bUdp) {
+			u->bUdp = false;
+			voiceStateChanged();
+		}
 
 		const char *buffer = qbaMsg.constData();
 
@@ -1335,6 +1669,9 @@ void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *
 		return;
 	}
 
+	if (uiType < MessageTypeCount)
+		smMetrics.mcMessages[uiType].add();
+
 #ifdef QT_NO_DEBUG
 #define MUMBLE_MH_MSG(x) case MessageHandler:: x : { \
 		MumbleProto:: x msg; \
@@ -1364,21 +1701,67 @@ void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *
 	}
 }
 
+// Schedules the timeout of a user relative to their last activity. Messages
+// keep rescheduling it, which is a no-op within the same second.
+void Server::scheduleTimeout(ServerUser *u) {
+	int remaining = qMax(0, iTimeout * 1000 - u->activityTime());
+	twTimeouts.schedule(&u->teTimeout, twTimeouts.now() + static_cast<quint64>(remaining / 1000) + 1);
+}
+
 void Server::checkTimeout() {
 	QList<ServerUser *> qlClose;
 
-	qrwlUsers.lockForRead();
-	foreach(ServerUser *u, qhUsers) {
+	foreach(void *p, twTimeouts.advance(tUptime.elapsed() / 1000000ULL)) {
+		ServerUser *u = static_cast<ServerUser *>(p);
 		if (u->activityTime() > (iTimeout * 1000)) {
 			log(u, "Timeout");
 			qlClose.append(u);
+		} else {
+			scheduleTimeout(u);
 		}
 	}
-	qrwlUsers.unlock();
+
 	foreach(ServerUser *u, qlClose)
 		u->disconnectSocket(true);
 }
 
+// Must be called whenever qlBans changes. Bans stay in the list until they
+// expire, at which point sweepBans removes them.
+void Server::indexBans() {
+	biBans.rebuild(qlBans);
+
+	const QDateTime &now = QDateTime::currentDateTime().toUTC();
+	qint64 next = -1;
+	foreach(const Ban &ban, qlBans) {
+		if (ban.iDuration == 0)
+			continue;
+		qint64 secs = now.secsTo(ban.qdtStart.addSecs(ban.iDuration));
+		secs = (secs < 0) ? 1 : secs + 1;
+		if ((next < 0) || (secs < next))
+			next = secs;
+	}
+
+	if (next < 0)
+		qtBanSweep->stop();
+	else
+		qtBanSweep->start(static_cast<int>(qMin(next, static_cast<qint64>(86400)) * 1000LL));
+}
+
+void Server::sweepBans() {
+	QList<Ban> tmpBans;
+	foreach(const Ban &ban, qlBans) {
+		if (! ban.isExpired())
+			tmpBans << ban;
+	}
+
+	if (tmpBans.count() != qlBans.count()) {
+		qlBans = tmpBans;
+		saveBans();
+	} else {
+		indexBans();
+	}
+}
+
 void Server::tcpTransmitData(QByteArray a, unsigned int id) {
 	Connection *c = qhUsers.value(id);
 	if (c) {
@@ -1467,6 +1850,13 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 		QWriteLocker wl(&qrwlUsers);
 		chan->cParent->removeChannel(chan);
 	}
+	voiceStateChanged();
+
+	{
+		QMutexLocker qml(&qmSpeakers);
+		qhActiveSpeakers.remove(chan->iId);
+		qhPreemptedSpeakers.remove(chan->iId);
+	}
 
 	delete chan;
 }
@@ -1522,6 +1912,7 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 	{
 		QWriteLocker wl(&qrwlUsers);
 		c->addUser(p);
+		voiceStateChanged();
 
 		bool mayspeak = ChanACL::hasPermission(static_cast<ServerUser *>(p), c, ChanACL::Speak, NULL);
 		bool sup = p->bSuppress;
@@ -1570,8 +1961,8 @@ void Server::sendClientPermission(ServerUser *u, Channel *c, bool forceupdate) {
 	if (forceupdate)
 		u->iLastPermissionCheck = c->iId;
 
-	if (u->qmPermissionSent.value(c->iId) != perm) {
-		u->qmPermissionSent.insert(c->iId, perm);
+	if (u->smPermissionSent.value(c->iId) != perm) {
+		u->smPermissionSent.insert(c->iId, perm);
 
 		MumbleProto::PermissionQuery mppq;
 		mppq.set_channel_id(c->iId);
@@ -1590,16 +1981,16 @@ void Server::sendClientPermission(ServerUser *u, Channel *c, bool forceupdate) {
  */
 
 void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mppq) {
-	QMap<int, unsigned int>::const_iterator i;
-	bool match = (u->qmPermissionSent.count() < 20);
-	for (i = u->qmPermissionSent.constBegin(); (match && (i != u->qmPermissionSent.constEnd())); ++i) {
-		Channel *c = qhChannels.value(i.key());
+	bool match = (u->smPermissionSent.count() < 20);
+	for (int i=0; match && (i < u->smPermissionSent.count()); ++i) {
+		const SmallMap<int, unsigned int, 4>::Entry &e = u->smPermissionSent.at(i);
+		Channel *c = qhChannels.value(e.key);
 		if (! c) {
 			match = false;
 		} else {
 			ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
 			unsigned int perm = acCache.value(u)->value(c);
-			if (perm != i.value())
+			if (perm != e.value)
 				match = false;
 		}
 	}
@@ -1607,7 +1998,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 	if (match)
 		return;
 
-	u->qmPermissionSent.clear();
+	u->smPermissionSent.clear();
 
 	Channel *c = qhChannels.value(u->iLastPermissionCheck);
 	if (! c) {
@@ -1617,7 +2008,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 
 	ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
 	unsigned int perm = acCache.value(u)->value(c);
-	u->qmPermissionSent.insert(c->iId, perm);
+	u->smPermissionSent.insert(c->iId, perm);
 
 	mppq.Clear();
 	mppq.set_channel_id(c->iId);
@@ -1655,6 +2046,244 @@ void Server::clearACLCache(User *p) {
 		foreach(ServerUser *u, qhUsers)
 			u->qmTargetCache.clear();
 	}
+
+	// Group membership may have changed.
+	if (p) {
+		updateBandwidthLimit(static_cast<ServerUser *>(p));
+		updateMixing(static_cast<ServerUser *>(p));
+	} else {
+		foreach(ServerUser *u, qhUsers) {
+			updateBandwidthLimit(u);
+			updateMixing(u);
+		}
+	}
+}
+
+// Parses "channelid=bps,..." and "group=bps,..." lists.
+QMap<int, int> Server::parseChannelLimits(const QString &list, const QString &key) const {
+	QMap<int, int> limits;
+
+	foreach(const QString &entry, list.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+		bool idok = false, limitok = false;
+		int id = entry.section(QLatin1Char('='), 0, 0).trimmed().toInt(&idok);
+		int limit = entry.section(QLatin1Char('='), 1).trimmed().toInt(&limitok);
+		if (idok && limitok && (limit > 0))
+			limits.insert(id, limit);
+		else
+			log(QString("Ignoring invalid %1 entry \"%2\"").arg(key).arg(entry));
+	}
+
+	return limits;
+}
+
+void Server::setBandwidthLimits(const QString &channels, const QString &groups) {
+	qmChannelBandwidth = parseChannelLimits(channels, QLatin1String("channelbandwidth"));
+	qmGroupBandwidth.clear();
+
+	foreach(const QString &entry, groups.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+		bool bwok = false;
+		QString name = entry.section(QLatin1Char('='), 0, 0).trimmed();
+		int bw = entry.section(QLatin1Char('='), 1).trimmed().toInt(&bwok);
+		if (! name.isEmpty() && bwok && (bw > 0))
+			qmGroupBandwidth.insert(name, bw);
+		else
+			log(QString("Ignoring invalid groupbandwidth entry \"%1\"").arg(entry));
+	}
+}
+
+void Server::setSpeakerLimits(int limit, const QString &channels) {
+	QMap<int, int> limits = parseChannelLimits(channels, QLatin1String("channelspeakerlimit"));
+
+	QMutexLocker qml(&qmSpeakers);
+	iSpeakerLimit = limit;
+	qmChannelSpeakerLimit = limits;
+	bSpeakerLimits = (iSpeakerLimit > 0) || ! qmChannelSpeakerLimit.isEmpty();
+}
+
+// Selective forwarding for large channels. When a channel has a speaker
+// limit, only the users who most recently started talking are forwarded. A
+// new speaker takes the slot of one who has fallen silent for SPEAKER_HOLD,
+// or else of the one who has been talking the longest. A speaker who lost
+// their slot stays held back until they send an Opus end of transmission or
+// pause for SPEAKER_HOLD, so two speakers don't take turns every packet.
+// Priority speakers always get through and take no slot. Voice reaching
+// linked channels is subject to the limit of the channel it originates in.
+bool Server::admitSpeaker(ServerUser *u, Channel *c, bool terminator) {
+	if (u->bPrioritySpeaker)
+		return true;
+
+	QMutexLocker qml(&qmSpeakers);
+
+	const int limit = qmChannelSpeakerLimit.value(c->iId, iSpeakerLimit);
+	if (limit <= 0)
+		return true;
+
+	const quint64 now = Timer::now();
+	QList<ActiveSpeaker> &speakers = qhActiveSpeakers[c->iId];
+
+	for (int i=0;i<speakers.count();++i) {
+		ActiveSpeaker &as = speakers[i];
+		if (as.uiSession == u->uiSession) {
+			if (terminator)
+				speakers.removeAt(i);
+			else
+				as.uiLast = now;
+			return true;
+		}
+	}
+
+	QHash<unsigned int, quint64> &preempted = qhPreemptedSpeakers[c->iId];
+	QHash<unsigned int, quint64>::iterator p = preempted.find(u->uiSession);
+	if (p != preempted.end()) {
+		const bool held = ! terminator && ((now - p.value()) <= SPEAKER_HOLD);
+		if (held)
+			p.value() = now;
+		else
+			preempted.erase(p);
+		if (held || terminator)
+			return false;
+	}
+
+	if (terminator)
+		return false;
+
+	while (speakers.count() >= limit) {
+		int victim = 0;
+		for (int i=1;i<speakers.count();++i) {
+			const ActiveSpeaker &as = speakers.at(i);
+			const ActiveSpeaker &vs = speakers.at(victim);
+			const bool idle = (now - as.uiLast) > SPEAKER_HOLD;
+			const bool victimIdle = (now - vs.uiLast) > SPEAKER_HOLD;
+			if ((idle && ! victimIdle) || ((idle == victimIdle) && (as.uiStart < vs.uiStart)))
+				victim = i;
+		}
+
+		const ActiveSpeaker vs = speakers.takeAt(victim);
+		if ((now - vs.uiLast) <= SPEAKER_HOLD)
+			preempted.insert(vs.uiSession, vs.uiLast);
+
+		// Forget speakers who were held back and have since gone quiet.
+		QHash<unsigned int, quint64>::iterator i = preempted.begin();
+		while (i != preempted.end()) {
+			if ((now - i.value()) > SPEAKER_HOLD)
+				i = preempted.erase(i);
+			else
+				++i;
+		}
+	}
+
+	ActiveSpeaker as;
+	as.uiSession = u->uiSession;
+	as.uiStart = now;
+	as.uiLast = now;
+	speakers.append(as);
+	return true;
+}
+
+void Server::setMixing(const QString &channels, const QString &groups, int bitrate) {
+	qsMixChannels.clear();
+	foreach(const QString &entry, channels.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+		bool ok = false;
+		int id = entry.trimmed().toInt(&ok);
+		if (ok)
+			qsMixChannels.insert(id);
+		else
+			log(QString("Ignoring invalid mixchannels entry \"%1\"").arg(entry));
+	}
+
+	qslMixGroups.clear();
+	foreach(const QString &entry, groups.split(QLatin1Char(','), QString::SkipEmptyParts))
+		qslMixGroups << entry.trimmed();
+
+	const bool mixing = ! qsMixChannels.isEmpty() || ! qslMixGroups.isEmpty();
+
+#ifdef USE_MIXER
+	if (mixing && ! bMixing)
+		log("Server side mixing enabled");
+	mMixer->iBitrate = bitrate;
+	bMixing = mixing;
+	if (! bMixing)
+		mMixer->stopMixing();
+	else if (isRunning())
+		mMixer->startMixing();
+#else
+	Q_UNUSED(bitrate);
+	if (mixing)
+		log("Ignoring mixchannels and mixgroups, this build has no server side mixing (CONFIG+=mixer)");
+	bMixing = false;
+#endif
+
+	foreach(ServerUser *u, qhUsers)
+		updateMixing(u);
+}
+
+// Users with Opus get the mix of their channel if the channel is listed in
+// mixchannels or they are in one of mixgroups there. Everyone else keeps
+// receiving each speaker separately.
+void Server::updateMixing(ServerUser *u) {
+	Channel *c = u->cChannel;
+	bool mixed = false;
+
+	if (bMixing && u->bOpus && c) {
+		if (qsMixChannels.contains(c->iId)) {
+			mixed = true;
+		} else {
+			foreach(const QString &group, qslMixGroups) {
+				if (Group::isMember(c, c, group, u)) {
+					mixed = true;
+					break;
+				}
+			}
+		}
+	}
+
+	if (u->bMixed != mixed) {
+		u->bMixed = mixed;
+		voiceStateChanged();
+	}
+}
+
+void Server::mixFrame(Channel *c, ServerUser *u, const char *data, int len, bool terminator) {
+#ifdef USE_MIXER
+	mMixer->addFrame(c->iId, u->uiSession, data, len, terminator);
+#else
+	Q_UNUSED(c);
+	Q_UNUSED(u);
+	Q_UNUSED(data);
+	Q_UNUSED(len);
+	Q_UNUSED(terminator);
+#endif
+}
+
+// The highest limit of any group the user is in (evaluated in the context of
+// the current channel) replaces the server limit; a channel limit caps it.
+void Server::updateBandwidthLimit(ServerUser *u) {
+	Channel *c = u->cChannel;
+	int limit = iMaxBandwidth;
+
+	if (c) {
+		bool grouped = false;
+		QMap<QString, int>::const_iterator i;
+		for (i = qmGroupBandwidth.constBegin(); i != qmGroupBandwidth.constEnd(); ++i) {
+			if (Group::isMember(c, c, i.key(), u)) {
+				limit = grouped ? qMax(limit, i.value()) : i.value();
+				grouped = true;
+			}
+		}
+		if (qmChannelBandwidth.contains(c->iId))
+			limit = qMin(limit, qmChannelBandwidth.value(c->iId));
+	}
+
+	if (limit == u->iMaxBandwidth)
+		return;
+
+	u->iMaxBandwidth = limit;
+
+	if (u->sState == ServerUser::Authenticated) {
+		MumbleProto::ServerConfig mpsc;
+		mpsc.set_max_bandwidth(limit);
+		sendMessage(u, mpsc);
+	}
 }
 
 QString Server::addressToString(const QHostAddress &adr, unsigned short port) {
@@ -1683,30 +2312,34 @@ bool Server::validateChannelName(const QString &name) {
 	return (qrChannelName.exactMatch(name) && (name.length() <= 512));
 }
 
-void Server::recheckCodecVersions(ServerUser *connectingUser) {
-	QMap<int, int> qmCodecUsercount;
-	QMap<int, int>::const_iterator i;
-	int users = 0;
-	int opus = 0;
-
-	// Count how many users use which codec
-	foreach(ServerUser *u, qhUsers) {
-		if (u->qlCodecs.isEmpty() && ! u->bOpus)
-			continue;
-
-		++users;
-		if (u->bOpus)
-			++opus;
+// Adds (delta 1) or removes (delta -1) the codecs of a user from the tally
+// recheckCodecVersions decides on. Must be balanced for every user.
+void Server::tallyCodecs(ServerUser *u, int delta) {
+	if (u->pDetails->qlCodecs.isEmpty() && ! u->bOpus)
+		return;
 
-		foreach(int version, u->qlCodecs)
-			++qmCodecUsercount[version];
+	iCodecUsers += delta;
+	if (u->bOpus)
+		iOpusUsers += delta;
+
+	foreach(int version, u->pDetails->qlCodecs) {
+		QMap<int, int>::iterator i = qmCodecUsercount.find(version);
+		if (i == qmCodecUsercount.end())
+			i = qmCodecUsercount.insert(version, 0);
+		*i += delta;
+		if (*i <= 0)
+			qmCodecUsercount.erase(i);
 	}
+}
+
+void Server::recheckCodecVersions(ServerUser *connectingUser) {
+	QMap<int, int>::const_iterator i;
 
-	if (! users)
+	if (! iCodecUsers || qmCodecUsercount.isEmpty())
 		return;
 
 	// Enable Opus if the number of users with Opus is higher than the threshold
-	bool enableOpus = ((opus * 100 / users) >= iOpusThreshold);
+	bool enableOpus = ((iOpusUsers * 100 / iCodecUsers) >= iOpusThreshold);
 
 	// Find the best possible codec most users support
 	int version = 0;
@@ -1783,6 +2416,93 @@ void Server::hashAssign(QByteArray &dest, QByteArray &hash, const QByteArray &sr
 		hash = QByteArray();
 }
 
+// Like hashAssign, but for user textures and comments: only short ones are
+// kept in place, the others are put in the BlobStore and referred to by hash.
+void Server::blobAssign(QString &dest, QByteArray &hash, const QString &src) {
+	if (src.length() >= BlobStore::iMinimumSize) {
+		blobReference(hash, meta->bsBlobs.insert(src.toUtf8()));
+		dest = QString();
+	} else {
+		blobReference(hash, QByteArray());
+		dest = src;
+	}
+}
+
+void Server::blobAssign(QByteArray &dest, QByteArray &hash, const QByteArray &src) {
+	if (src.length() >= BlobStore::iMinimumSize) {
+		blobReference(hash, meta->bsBlobs.insert(src));
+		dest = QByteArray();
+	} else {
+		blobReference(hash, QByteArray());
+		dest = src;
+	}
+}
+
+// Moves a reference held in hash over to newhash, which may be empty.
+void Server::blobReference(QByteArray &hash, const QByteArray &newhash) {
+	if (hash == newhash)
+		return;
+	if (! newhash.isEmpty())
+		meta->bsBlobs.acquire(newhash);
+	if (! hash.isEmpty())
+		meta->bsBlobs.release(hash);
+	hash = newhash;
+}
+
+bool Server::hasLegacyClients() const {
+	foreach(const ServerUser *u, qhUsers)
+		if ((u->sState == ServerUser::Authenticated) && (u->uiVersion < 0x010202))
+			return true;
+	return false;
+}
+
+// Sends textures and comments u asked for with RequestBlob. They go out a
+// few at a time, at most blobchunk bytes per call and only while the
+// connection has not still got that much waiting to be written, so a client
+// fetching many avatars does not hold up voice and state updates sharing the
+// same TCP stream. Returns true if there is more to send.
+bool Server::sendBlobs(ServerUser *u) {
+	const int chunk = qMax(Meta::mp.iBlobChunk, 1);
+	int budget = chunk;
+
+	while (! u->qqBlobRequests.isEmpty()) {
+		if ((budget <= 0) || (u->bytesPending() >= chunk))
+			return true;
+
+		const ServerUser::BlobRequest br = u->qqBlobRequests.dequeue();
+		ServerUser *su = qhUsers.value(br.uiSession);
+		if (! su || (su->sState != ServerUser::Authenticated))
+			continue;
+
+		MumbleProto::UserState mpus;
+		mpus.set_session(br.uiSession);
+		if (br.bTexture) {
+			const QByteArray &texture = userTexture(su);
+			if (texture.isEmpty())
+				continue;
+			mpus.set_texture(blob(texture));
+			budget -= texture.size();
+		} else {
+			const QString &comment = su->comment();
+			if (comment.isEmpty())
+				continue;
+			mpus.set_comment(u8(comment));
+			budget -= comment.length();
+		}
+		sendMessage(u, mpus);
+	}
+	return false;
+}
+
+void Server::sendBlobs() {
+	bool pending = false;
+	foreach(ServerUser *u, qhUsers)
+		if (! u->qqBlobRequests.isEmpty() && sendBlobs(u))
+			pending = true;
+	if (! pending)
+		qtBlobs->stop();
+}
+
 bool Server::isTextAllowed(QString &text, bool &changed) {
 	changed = false;
 
@@ -1790,23 +2510,9 @@ bool Server::isTextAllowed(QString &text, bool &changed) {
 		if (! text.contains(QLatin1Char('<'))) {
 			text = text.simplified();
 		} else {
-			QXmlStreamReader qxsr(QString::fromLatin1("<document>%1</document>").arg(text));
 			QString qs;
-			while (! qxsr.atEnd()) {
-				switch (qxsr.readNext()) {
-					case QXmlStreamReader::Invalid:
-						return false;
-					case QXmlStreamReader::Characters:
-						qs += qxsr.text();
-						break;
-					case QXmlStreamReader::EndElement:
-						if ((qxsr.name() == QLatin1String("br")) || (qxsr.name() == QLatin1String("p")))
-							qs += "\n";
-						break;
-					default:
-						break;
-				}
-			}
+			if (! TextSanitizer::toPlainText(text, qs))
+				return false;
 			text = qs.simplified();
 		}
 		changed = true;
@@ -1830,35 +2536,11 @@ bool Server::isTextAllowed(QString &text, bool &changed) {
 		if (! text.contains(QLatin1Char('<')))
 			return false;
 
-		// Strip value from <img>s src attributes to check text-length only -
+		// Leave out <img>s src attributes to check text-length only -
 		// we already ensured the img-length requirement is met
-		QString qsOut;
-		QXmlStreamReader qxsr(QString::fromLatin1("<document>%1</document>").arg(text));
-		QXmlStreamWriter qxsw(&qsOut);
-		while (! qxsr.atEnd()) {
-			switch (qxsr.readNext()) {
-				case QXmlStreamReader::Invalid:
-					return false;
-				case QXmlStreamReader::StartElement: {
-						if (qxsr.name() == QLatin1String("img")) {
-							qxsw.writeStartElement(qxsr.namespaceUri().toString(), qxsr.name().toString());
-							foreach(const QXmlStreamAttribute &a, qxsr.attributes())
-								if (a.name() != QLatin1String("src"))
-									qxsw.writeAttribute(a);
-						} else {
-							qxsw.writeCurrentToken(qxsr);
-						}
-					}
-					break;
-				default:
-					qxsw.writeCurrentToken(qxsr);
-					break;
-			}
-		}
+		length = TextSanitizer::textLength(text);
 
-		length = qsOut.length();
-
-		return (length <= iMaxTextMessageLength);
+		return (length >= 0) && (length <= iMaxTextMessageLength);
 	}
 }
 
@@ -1868,3 +2550,33 @@ bool Server::canNest(Channel *newParent, Channel *channel) const {
 
 	return (parentLevel + channelDepth) < iChannelNestingLimit;
 }
+
+void Server::invalidateSubtrees() {
+	bSubtreesValid = false;
+}
+
+void Server::appendSubtree(Channel *c) {
+	const int pos = qvSubtrees.count();
+	const SubtreeEntry e = { c, 0 };
+	qvSubtrees.append(e);
+	qhSubtreeIndex.insert(c->iId, pos);
+
+	foreach(Channel *sub, c->qlChannels)
+		appendSubtree(sub);
+
+	qvSubtrees[pos].iEnd = qvSubtrees.count();
+}
+
+const QVector<Server::SubtreeEntry> &Server::subtrees() {
+	if (! bSubtreesValid) {
+		qvSubtrees.clear();
+		qhSubtreeIndex.clear();
+		qvSubtrees.reserve(qhChannels.count());
+
+		Channel *root = qhChannels.value(0);
+		if (root)
+			appendSubtree(root);
+		bSubtreesValid = true;
+	}
+	return qvSubtrees;
+}
@@ -54,18 +54,35 @@
 #endif
 
 #include "ACL.h"
+#include "BanIndex.h"
 #include "Message.h"
 #include "Mumble.pb.h"
 #include "Net.h"
 #include "User.h"
+#include "ServerUser.h"
 #include "Timer.h"
+#include "TimerWheel.h"
+#include "UserDirectory.h"
+#include "Metrics.h"
+#include "VoiceStats.h"
 
 class BonjourServer;
 class Channel;
 class PacketDataStream;
 class ServerUser;
 class User;
+struct PasswordCheck;
 class QNetworkAccessManager;
+#ifdef USE_IO_URING
+class UringLoop;
+#endif
+#ifdef USE_MIXER
+class Mixer;
+#endif
+class Trunk;
+#ifdef Q_OS_LINUX
+struct msghdr;
+#endif
 
 struct TextMessage {
 	QList<unsigned int> qlSessions;
@@ -130,6 +147,40 @@ class Server : public QThread {
 		unsigned short usPort;
 		int iTimeout;
 		int iMaxBandwidth;
+		int iBandwidthBurst;
+		QMap<int, int> qmChannelBandwidth;
+		QMap<QString, int> qmGroupBandwidth;
+		// Selective forwarding, see admitSpeaker. Guarded by qmSpeakers.
+		struct ActiveSpeaker {
+			unsigned int uiSession;
+			quint64 uiStart;
+			quint64 uiLast;
+		};
+		int iSpeakerLimit;
+		QMap<int, int> qmChannelSpeakerLimit;
+		QHash<int, QList<ActiveSpeaker> > qhActiveSpeakers;
+		// Speakers who lost their slot, by session, with their last packet.
+		QHash<int, QHash<unsigned int, quint64> > qhPreemptedSpeakers;
+		QMutex qmSpeakers;
+		bool bSpeakerLimits;
+		void setSpeakerLimits(int limit, const QString &channels);
+		bool admitSpeaker(ServerUser *u, Channel *c, bool terminator);
+		// Server side mixing, see Mixer.
+		QSet<int> qsMixChannels;
+		QStringList qslMixGroups;
+		bool bMixing;
+#ifdef USE_MIXER
+		Mixer *mMixer;
+#endif
+		void setMixing(const QString &channels, const QString &groups, int bitrate);
+		void updateMixing(ServerUser *u);
+		void mixFrame(Channel *c, ServerUser *u, const char *data, int len, bool terminator);
+		// Voice trunk to other nodes, see Trunk. Only set up at startup.
+		unsigned short usTrunkPort;
+		int iTrunkNode;
+		QString qsTrunkPeers;
+		QString qsTrunkSecret;
+		Trunk *tTrunk;
 		int iMaxUsers;
 		int iMaxUsersPerChannel;
 		int iDefaultChan;
@@ -142,6 +193,9 @@ class Server : public QThread {
 		QString qsWelcomeText;
 		bool bCertRequired;
 		bool bForceExternalAuth;
+		int iAuthTimeout;
+		int iAuthConcurrency;
+		int iAuthCacheTTL;
 
 		QString qsRegName;
 		QString qsRegPassword;
@@ -164,6 +218,10 @@ class Server : public QThread {
 
 		Timer tUptime;
 
+		// Forwarding latency of sampled voice packets.
+		VoiceStats vsStats;
+		ServerMetrics smMetrics;
+
 		bool bValid;
 
 		void readParams();
@@ -172,6 +230,12 @@ class Server : public QThread {
 		int iCodecBeta;
 		bool bPreferAlpha;
 		bool bOpus;
+		// Number of users supporting each CELT version, and how many of
+		// those that declared any codec support Opus.
+		QMap<int, int> qmCodecUsercount;
+		int iCodecUsers;
+		int iOpusUsers;
+		void tallyCodecs(ServerUser *u, int delta);
 		void recheckCodecVersions(ServerUser *connectingUser = 0);
 
 #ifdef USE_BONJOUR
@@ -202,6 +266,9 @@ class Server : public QThread {
 		void sslError(const QList<QSslError> &);
 		void message(unsigned int, const QByteArray &, ServerUser *cCon = NULL);
 		void checkTimeout();
+		void checkAuthTimeout();
+		void sweepBans();
+		void sendBlobs();
 		void tcpTransmitData(QByteArray, unsigned int);
 		void doSync(unsigned int);
 		void encrypted();
@@ -214,6 +281,12 @@ class Server : public QThread {
 		QQueue<int> qqIds;
 		QList<SslServer *> qlServer;
 		QTimer *qtTimeout;
+		// Connection timeouts, in seconds of uptime.
+		TimerWheel twTimeouts;
+		void scheduleTimeout(ServerUser *u);
+		QTimer *qtBanSweep;
+		// Paces textures and comments queued by RequestBlob, see sendBlobs.
+		QTimer *qtBlobs;
 
 #ifdef Q_OS_UNIX
 		int aiNotify[2];
@@ -232,15 +305,45 @@ class Server : public QThread {
 		QReadWriteLock qrwlUsers;
 		ChanACL::ACLCache acCache;
 		QMutex qmCache;
-		QHash<int, QString> qhUserNameCache;
-		QHash<QString, int> qhUserIDCache;
+		UserDirectory udUsers;
 
 		QList<Ban> qlBans;
+		BanIndex biBans;
+		void indexBans();
 
-		void processMsg(ServerUser *u, const char *data, int len);
-		void sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force = false);
+#ifdef Q_OS_UNIX
+		ServerUser *findUdpUser(int sock, const struct sockaddr_storage &from, const char *encrypt, char *buffer, int len);
+#else
+		ServerUser *findUdpUser(SOCKET sock, const struct sockaddr_storage &from, const char *encrypt, char *buffer, int len);
+#endif
+		void processUdpMessage(ServerUser *u, const char *buffer, int len, PacketTrace *trace = NULL);
+		void processMsg(ServerUser *u, const char *data, int len, PacketTrace *trace = NULL);
+		void sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force = false, PacketTrace *trace = NULL);
+		void sendMessage(const VoiceRecipient &vr, const char *data, int len, QByteArray &cache, bool force = false, PacketTrace *trace = NULL);
+
+		// Listeners of each channel as packed forwarding state, built on
+		// first use and all dropped once qaiVoiceGeneration moves on.
+		QMutex qmVoiceRecipients;
+		QHash<const Channel *, QVector<VoiceRecipient> > qhVoiceRecipients;
+		int iVoiceRecipientsGeneration;
+		QAtomicInt qaiVoiceGeneration;
+		QVector<VoiceRecipient> voiceRecipients(const Channel *c);
+		// Call after changing anything VoiceRecipient holds, or which users
+		// are in a channel.
+		void voiceStateChanged();
+#ifdef Q_OS_LINUX
+		bool setSourceAddress(const VoiceRecipient &vr, struct msghdr *msg);
+		static quint64 takeKernelTimestamp(struct msghdr *msg);
+#endif
 		void run();
 
+#ifdef USE_IO_URING
+		// io_uring voice loop, implementation in ServerUring.cpp
+		UringLoop *ulLoop;
+		bool runUring();
+		bool queueUringSend(const VoiceRecipient &vr, const char *data, int len, PacketTrace *trace);
+#endif
+
 		bool validateChannelName(const QString &name);
 		bool validateUserName(const QString &name);
 
@@ -251,6 +354,9 @@ class Server : public QThread {
 		void sendClientPermission(ServerUser *u, Channel *c, bool updatelast = false);
 		void flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mpqq);
 		void clearACLCache(User *p = NULL);
+		QMap<int, int> parseChannelLimits(const QString &list, const QString &key) const;
+		void setBandwidthLimits(const QString &channels, const QString &groups);
+		void updateBandwidthLimit(ServerUser *u);
 
 		void sendProtoAll(const ::google::protobuf::Message &msg, unsigned int msgType, unsigned int minversion);
 		void sendProtoExcept(ServerUser *, const ::google::protobuf::Message &msg, unsigned int msgType, unsigned int minversion);
@@ -268,6 +374,12 @@ class Server : public QThread {
 
 		static void hashAssign(QString &destination, QByteArray &hash, const QString &str);
 		static void hashAssign(QByteArray &destination, QByteArray &hash, const QByteArray &source);
+		static void blobAssign(QString &destination, QByteArray &hash, const QString &str);
+		static void blobAssign(QByteArray &destination, QByteArray &hash, const QByteArray &source);
+		static void blobReference(QByteArray &hash, const QByteArray &newhash);
+		QByteArray userTexture(ServerUser *u);
+		bool hasLegacyClients() const;
+		bool sendBlobs(ServerUser *u);
 		bool isTextAllowed(QString &str, bool &changed);
 
 		void setLiveConf(const QString &key, const QString &value);
@@ -287,6 +399,21 @@ class Server : public QThread {
 
 		bool canNest(Channel *newParent, Channel *channel = NULL) const;
 
+		// Channels in depth first order, each with the position just past its
+		// subtree, so tree messages walk a subtree without a queue and skip
+		// the branches they may not write to. Rebuilt on first use after the
+		// channel tree changed.
+		struct SubtreeEntry {
+			Channel *cChannel;
+			int iEnd;
+		};
+		QVector<SubtreeEntry> qvSubtrees;
+		QHash<int, int> qhSubtreeIndex;
+		bool bSubtreesValid;
+		void invalidateSubtrees();
+		void appendSubtree(Channel *c);
+		const QVector<SubtreeEntry> &subtrees();
+
 		// RPC functions. Implementation in RPC.cpp
 		void connectAuthenticator(QObject *p);
 		void disconnectAuthenticator(QObject *p);
@@ -294,12 +421,49 @@ class Server : public QThread {
 		void disconnectListener(QObject *p);
 		void setTempGroups(int userid, int sessionId, Channel *cChannel, const QStringList &groups);
 		void clearTempGroups(User *user, Channel *cChannel = NULL, bool recurse = true);
+
+		// Logins waiting for an authenticator that answers asynchronously.
+		struct PendingAuth {
+			unsigned int uiSession;
+			QString qsName;
+			bool bStarted;
+			quint64 uiQueued;
+			QString qsPassword;
+			MumbleProto::Authenticate msgAuth;
+			PendingAuth() : uiSession(0), bStarted(false), uiQueued(0) {}
+		};
+		// Recent positive answers of the authenticator, by certificate hash.
+		struct CachedAuth {
+			int iId;
+			QString qsName;
+			QStringList qslGroups;
+			QByteArray qbaDigest;
+			quint64 uiExpires;
+		};
+		QHash<unsigned int, PendingAuth> qhAuthPending;
+		QQueue<unsigned int> qqAuthQueue;
+		QHash<QString, CachedAuth> qhAuthCache;
+		// Shared by all servers, so an answer that arrives after its server
+		// was restarted can't match a login on the new instance.
+		static unsigned int uiAuthRequest;
+		int iAuthRunning;
+		int iAsyncAuthenticators;
+		QTimer *qtAuthTimeout;
+		static QByteArray authDigest(const QString &name, const QString &pw);
+		bool cachedAuthenticate(ServerUser *u, const QString &pw, int &id);
+		unsigned int parkAuthenticate(ServerUser *u, const MumbleProto::Authenticate &msg, const QString &pw);
+		bool requestAuthenticate(ServerUser *u, const MumbleProto::Authenticate &msg, const QString &pw);
+		void dispatchAuthenticate();
+		void authenticateResult(unsigned int request, int res, const QString &newname, const QStringList &groups, bool failed);
+		void cancelAuthenticate(ServerUser *u);
+		PendingAuth takeAuthenticate(unsigned int request);
 	signals:
 		void registerUserSig(int &, const QMap<int, QString> &);
 		void unregisterUserSig(int &, int);
 		void getRegisteredUsersSig(const QString &, QMap<int, QString > &);
 		void getRegistrationSig(int &, int, QMap<int, QString> &);
 		void authenticateSig(int &, QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &);
+		void authenticateAsyncSig(bool &, unsigned int, const QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &);
 		void setInfoSig(int &, int, const QMap<int, QString> &);
 		void setTextureSig(int &, int, const QByteArray &);
 		void idToNameSig(QString &, int);
@@ -323,6 +487,13 @@ class Server : public QThread {
 		// Database / DBus functions. Implementation in ServerDB.cpp
 		void initialize();
 		int authenticate(QString &name, const QString &pw, int sessionId = 0, const QStringList &emails = QStringList(), const QString &certhash = QString(), bool bStrongCert = false, const QList<QSslCertificate> & = QList<QSslCertificate>());
+		int authenticateExternal(QString &name, const QString &pw, int sessionId, const QString &certhash, bool bStrongCert, const QList<QSslCertificate> &certs);
+		int authenticateLocal(QString &name, const QString &pw, const QStringList &emails, const QString &certhash, bool bStrongCert);
+		int finishAuthenticateLocal(QString &name, int id, const QString &storedname, const PasswordCheck &pc, const QStringList &emails, const QString &certhash, bool bStrongCert);
+		bool readPassword(const QString &name, int &id, QString &storedname, PasswordCheck &pc);
+		void checkPassword(ServerUser *u, const MumbleProto::Authenticate &msg, const QString &pw);
+		void passwordChecked(unsigned int request, int id, const QString &storedname, const PasswordCheck &pc);
+		void recordExternalAuth(int res, const QString &name);
 		Channel *addChannel(Channel *c, const QString &name, bool temporary = false, int position = 0);
 		void removeChannelDB(const Channel *c);
 		void readChannels(Channel *p = NULL);
@@ -335,10 +506,15 @@ class Server : public QThread {
 		int getUserID(const QString &name);
 		QString getUserName(int id);
 		QByteArray getUserTexture(int id);
+		void getUserTextureHash(int id, QByteArray &texture, QByteArray &hash);
+		void cacheUserTexture(int id, const QByteArray &texture);
+		QString getUserComment(int id);
+		void cacheUserComment(int id, const QString &comment);
+		void readUsers();
 		QMap<int, QString> getRegistration(int id);
 		int registerUser(const QMap<int, QString> &info);
 		bool unregisterUserDB(int id);
-		QList<UserInfo> getRegisteredUsersEx();
+		QList<UserInfo> getRegisteredUsersPage(const QString &filter, const QString &after, int count, bool &more, const QMap<int, QString> *authenticated = NULL);
 		QMap<int, QString > getRegisteredUsers(const QString &filter = QString());
 		bool setInfo(int id, const QMap<int, QString> &info);
 		bool setTexture(int id, const QByteArray &texture);
@@ -355,6 +531,7 @@ class Server : public QThread {
 #define MUMBLE_MH_MSG(x) void msg##x(ServerUser *, MumbleProto:: x &);
 		MUMBLE_MH_ALL
 #undef MUMBLE_MH_MSG
+		void finishAuthenticate(ServerUser *uSource, const MumbleProto::Authenticate &msg, const QString &pw, int id);
 };
 
 #endif
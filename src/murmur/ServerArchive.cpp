@@ -0,0 +1,191 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "ServerArchive.h"
+
+QByteArray ServerArchive::text(const QVariant &v) {
+	if (v.isNull())
+		return QByteArray();
+	QByteArray qba = v.toString().toUtf8();
+	// QDataStream tells null and empty arrays apart, so make sure empty text stays empty.
+	if (qba.isNull())
+		qba = QByteArray("");
+	return qba;
+}
+
+QVariant ServerArchive::text(const QByteArray &qba) {
+	if (qba.isNull())
+		return QVariant(QVariant::String);
+	return QString::fromUtf8(qba.constData(), qba.size());
+}
+
+qint32 ServerArchive::id(const QVariant &v) {
+	return v.isNull() ? -1 : v.toInt();
+}
+
+QVariant ServerArchive::id(qint32 v) {
+	return (v < 0) ? QVariant(QVariant::Int) : QVariant(v);
+}
+
+ServerArchiveWriter::ServerArchiveWriter(QIODevice *dev) : qiodDevice(dev), iSection(-1), uiRows(0), qds(dev) {
+	qds.setVersion(QDataStream::Qt_4_4);
+	qds << ServerArchive::uiMagic << ServerArchive::uiVersion;
+}
+
+void ServerArchiveWriter::beginSection(ServerArchive::Section s) {
+	iSection = qiodDevice->pos();
+	uiRows = 0;
+	qds << static_cast<quint32>(s) << uiRows << static_cast<qint64>(0);
+}
+
+// Writes the row count and length into the section header.
+bool ServerArchiveWriter::endSection() {
+	const qint64 end = qiodDevice->pos();
+	if (! qiodDevice->seek(iSection + 4))
+		return false;
+	qds << uiRows << static_cast<qint64>(end - iSection - 16);
+	iSection = -1;
+	return qiodDevice->seek(end) && (qds.status() == QDataStream::Ok);
+}
+
+// Appends data to the Blobs section unless it is already there, and
+// returns its index.
+qint32 ServerArchiveWriter::blob(const QByteArray &data) {
+	const QByteArray &hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+
+	QHash<QByteArray, qint32>::const_iterator i = qhBlobs.constFind(hash);
+	if (i != qhBlobs.constEnd())
+		return i.value();
+
+	const qint32 idx = qhBlobs.count();
+	qhBlobs.insert(hash, idx);
+	qds << data;
+	row();
+	return idx;
+}
+
+bool ServerArchiveWriter::finish() {
+	qds << static_cast<quint32>(ServerArchive::End);
+	return (qds.status() == QDataStream::Ok);
+}
+
+// The data is not copied and has to stay valid, so it can point straight
+// into a mapped file.
+ServerArchiveReader::ServerArchiveReader(const QByteArray &data) : qbaData(data) {
+	qbBuffer.setBuffer(&qbaData);
+	qbBuffer.open(QIODevice::ReadOnly);
+	qds.setDevice(&qbBuffer);
+	qds.setVersion(QDataStream::Qt_4_4);
+}
+
+bool ServerArchiveReader::open() {
+	quint32 magic = 0, version = 0;
+	qds >> magic >> version;
+	if ((qds.status() != QDataStream::Ok) || (magic != ServerArchive::uiMagic)) {
+		qsError = QLatin1String("Not a server archive");
+		return false;
+	}
+	if (version != ServerArchive::uiVersion) {
+		qsError = QString::fromLatin1("Unsupported archive version %1").arg(version);
+		return false;
+	}
+
+	forever {
+		quint32 tag = ServerArchive::End;
+		qds >> tag;
+		if (qds.status() != QDataStream::Ok) {
+			qsError = QLatin1String("Archive is truncated");
+			return false;
+		}
+		if (tag == ServerArchive::End)
+			break;
+
+		Index idx;
+		qint64 len = -1;
+		qds >> idx.uiRows >> len;
+		idx.iOffset = qbBuffer.pos();
+		// Every row takes at least a byte, which bounds what a damaged header can make readers allocate.
+		if ((qds.status() != QDataStream::Ok) || (len < 0) || (idx.iOffset + len > qbaData.size()) || (idx.uiRows > len)) {
+			qsError = QLatin1String("Archive is truncated");
+			return false;
+		}
+		if (qhSections.contains(tag)) {
+			qsError = QString::fromLatin1("Section %1 appears twice").arg(tag);
+			return false;
+		}
+		qhSections.insert(tag, idx);
+		qbBuffer.seek(idx.iOffset + len);
+	}
+
+	// Remember where each blob is so it can be handed out without a copy.
+	const quint32 n = section(ServerArchive::Blobs);
+	qvBlobs.reserve(n);
+	for (quint32 i=0;i<n;++i) {
+		quint32 len = 0;
+		qds >> len;
+		const qint64 pos = qbBuffer.pos();
+		if ((qds.status() != QDataStream::Ok) || (len == 0xffffffff) || (pos + len > qbaData.size())) {
+			qsError = QLatin1String("Blobs are truncated");
+			return false;
+		}
+		qvBlobs.append(QPair<int, int>(static_cast<int>(pos), static_cast<int>(len)));
+		qbBuffer.seek(pos + len);
+	}
+
+	return true;
+}
+
+// Positions the stream at the first row of a section and returns the
+// number of rows, or 0 if the archive does not have the section.
+quint32 ServerArchiveReader::section(ServerArchive::Section s) {
+	QHash<int, Index>::const_iterator i = qhSections.constFind(s);
+	if (i == qhSections.constEnd())
+		return 0;
+
+	qds.resetStatus();
+	qbBuffer.seek(i.value().iOffset);
+	return i.value().uiRows;
+}
+
+bool ServerArchiveReader::blob(qint32 idx, QByteArray &data) const {
+	if ((idx < 0) || (idx >= qvBlobs.count()))
+		return false;
+
+	const QPair<int, int> &b = qvBlobs.at(idx);
+	data = QByteArray::fromRawData(qbaData.constData() + b.first, b.second);
+	return true;
+}
+
+int ServerArchiveReader::blobs() const {
+	return qvBlobs.count();
+}
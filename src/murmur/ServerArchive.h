@@ -0,0 +1,113 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_SERVERARCHIVE_H_
+#define MUMBLE_MURMUR_SERVERARCHIVE_H_
+
+#include <QtCore/QBuffer>
+#include <QtCore/QByteArray>
+#include <QtCore/QDataStream>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+
+class QIODevice;
+
+// Binary snapshot of the persistent state of a virtual server, written by
+// ServerDB::exportServer and read by ServerDB::importServer.
+//
+// A file starts with a magic number and the format version, followed by
+// tagged sections. Every section header holds its row count and byte
+// length, so a reader can index the whole file without parsing rows and
+// skip sections it does not know. Rows are QDataStream encoded; text is
+// UTF-8 with null kept distinct from empty, and absent ids are -1.
+// Textures, comments and channel descriptions are stored once each in the
+// Blobs section and referred to by index.
+
+class ServerArchive {
+	public:
+		enum Section { End, Blobs, Config, Channels, ChannelInfo, Links, Users, UserInfo, Groups, GroupMembers, ACL, Bans };
+		static const quint32 uiMagic = 0x4d534152;
+		static const quint32 uiVersion = 1;
+
+		static QByteArray text(const QVariant &v);
+		static QVariant text(const QByteArray &qba);
+		static qint32 id(const QVariant &v);
+		static QVariant id(qint32 v);
+};
+
+class ServerArchiveWriter {
+	private:
+		Q_DISABLE_COPY(ServerArchiveWriter)
+	protected:
+		QIODevice *qiodDevice;
+		qint64 iSection;
+		quint32 uiRows;
+		QHash<QByteArray, qint32> qhBlobs;
+	public:
+		QDataStream qds;
+
+		ServerArchiveWriter(QIODevice *dev);
+		void beginSection(ServerArchive::Section s);
+		void row() {
+			++uiRows;
+		}
+		qint32 blob(const QByteArray &data);
+		bool endSection();
+		bool finish();
+};
+
+class ServerArchiveReader {
+	private:
+		Q_DISABLE_COPY(ServerArchiveReader)
+	protected:
+		struct Index {
+			quint32 uiRows;
+			qint64 iOffset;
+		};
+		QByteArray qbaData;
+		QBuffer qbBuffer;
+		QHash<int, Index> qhSections;
+		QVector<QPair<int, int> > qvBlobs;
+	public:
+		QDataStream qds;
+		QString qsError;
+
+		ServerArchiveReader(const QByteArray &data);
+		bool open();
+		quint32 section(ServerArchive::Section s);
+		bool blob(qint32 idx, QByteArray &data) const;
+		int blobs() const;
+};
+
+#endif
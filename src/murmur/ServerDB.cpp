@@ -37,10 +37,15 @@
 #include "Connection.h"
 #include "DBus.h"
 #include "Group.h"
+#include "LogSink.h"
 #include "Meta.h"
+#include "Metrics.h"
+#include "PasswordHash.h"
 #include "Server.h"
+#include "ServerArchive.h"
 #include "ServerUser.h"
 #include "User.h"
+#include "UserPager.h"
 
 #define SQLDO(x) ServerDB::exec(query, QLatin1String(x), true)
 #define SQLMAY(x) ServerDB::exec(query, QLatin1String(x), false, false)
@@ -52,26 +57,94 @@
 class TransactionHolder {
 	public:
 		QSqlQuery *qsqQuery;
+		QSqlDatabase qsdDatabase;
 		TransactionHolder() {
-			ServerDB::db->transaction();
-			qsqQuery = new QSqlQuery();
+			qsdDatabase = ServerDB::connection()->qsdDatabase;
+			qsdDatabase.transaction();
+			qsqQuery = new QSqlQuery(qsdDatabase);
 		}
 
 		~TransactionHolder() {
+			// Lets the statement be handed out again.
+			qsqQuery->finish();
 			qsqQuery->clear();
 			delete qsqQuery;
-			ServerDB::db->commit();
+			qsdDatabase.commit();
 		}
 		TransactionHolder(const TransactionHolder & other) {
-			ServerDB::db->transaction();
+			qsdDatabase = other.qsdDatabase;
+			qsdDatabase.transaction();
 			qsqQuery = other.qsqQuery ? new QSqlQuery(*other.qsqQuery) : 0;
 		}
 };
 
 QSqlDatabase *ServerDB::db = NULL;
-Timer ServerDB::tLogClean;
+LogSink *ServerDB::lsLog = NULL;
 QString ServerDB::qsUpgradeSuffix;
 
+// Connections of threads other than the main one. A QSqlDatabase may only
+// be used by the thread that opened it, so each thread running queries gets
+// its own, cloned from the main connection on first use and closed when the
+// thread exits.
+//
+// This is for work moved off the main thread, like the log writer. The
+// virtual servers themselves all run on the main thread and so share its
+// connection; their queries still run one after the other. A connection
+// per virtual server would only help once each server's queries run on a
+// thread of their own, which would need every ServerDB caller to become
+// asynchronous.
+static QThreadStorage<ServerDB::Connection *> qtsConnections;
+
+ServerDB::Connection::Connection(const QSqlDatabase &db, const QString &name) : qsName(name), qsdDatabase(db), scStatements(db, Meta::mp.iDBStatementCache) {
+}
+
+ServerDB::Connection::~Connection() {
+	scStatements.clear();
+	if (! qsName.isEmpty()) {
+		qsdDatabase.close();
+		qsdDatabase = QSqlDatabase();
+		QSqlDatabase::removeDatabase(qsName);
+	}
+}
+
+ServerDB::Connection *ServerDB::connection() {
+	Connection *c = qtsConnections.localData();
+	if (c)
+		return c;
+
+	const QString name = QString::fromLatin1("murmur-%1").arg(reinterpret_cast<quintptr>(QThread::currentThread()), 0, 16);
+	QSqlDatabase qsd = QSqlDatabase::cloneDatabase(*db, name);
+	if (! qsd.open())
+		qFatal("ServerDB: Failed to open connection for thread: %s", qPrintable(qsd.lastError().text()));
+	configure(qsd);
+
+	c = new Connection(qsd, name);
+	qtsConnections.setLocalData(c);
+	MetricsServer::mcDbConnections.add();
+	return c;
+}
+
+/// Per connection settings, applied to the main connection and every clone.
+void ServerDB::configure(QSqlDatabase &qsd) {
+	if (Meta::mp.qsDBDriver != "QSQLITE")
+		return;
+
+	// Not through exec(), which would want this connection to be registered.
+	QSqlQuery query(qsd);
+
+	// Wait for a connection of another thread to finish writing rather than
+	// failing right away, which SQLEXEC would make fatal.
+	if (! query.exec(QLatin1String("PRAGMA busy_timeout = 5000")))
+		qWarning("ServerDB: Failed to set busy timeout: %s", qPrintable(query.lastError().text()));
+
+	if (Meta::mp.iSQLiteWAL > 0) {
+		if (! query.exec(QLatin1String("PRAGMA journal_mode = WAL")))
+			qWarning("ServerDB: Failed to enable write-ahead logging: %s", qPrintable(query.lastError().text()));
+		query.exec(QLatin1String((Meta::mp.iSQLiteWAL == 1) ? "PRAGMA synchronous = NORMAL" : "PRAGMA synchronous = FULL"));
+	}
+	query.finish();
+}
+
 ServerDB::ServerDB() {
 	if (! QSqlDatabase::isDriverAvailable(Meta::mp.qsDBDriver)) {
 		qFatal("ServerDB: Database driver %s not available", qPrintable(Meta::mp.qsDBDriver));
@@ -140,6 +213,9 @@ ServerDB::ServerDB() {
 		qFatal("ServerDB: Failed initialization: %s",qPrintable(e.text()));
 	}
 
+	configure(*db);
+	qtsConnections.setLocalData(new Connection(*db, QString()));
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -469,16 +545,22 @@ ServerDB::ServerDB() {
 }
 
 ServerDB::~ServerDB() {
+	// Writes out what is still queued.
+	delete lsLog;
+	lsLog = NULL;
+
+	qtsConnections.setLocalData(NULL);
 	db->close();
 	delete db;
 	db = NULL;
 }
 
-bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
+bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn, bool cache) {
 	if (! db->isValid()) {
 		qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
 		return false;
 	}
+	Connection *c = connection();
 	QString q;
 	if (str.contains(QLatin1String("%1"))) {
 		if (str.contains(QLatin1String("%2")))
@@ -489,14 +571,33 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 		q = str;
 	}
 
-	if (query.prepare(q)) {
+	bool ok;
+	if (cache) {
+		bool cached;
+		ok = c->scStatements.prepare(query, q, &cached);
+		if (cached)
+			MetricsServer::mcDbStatementHits.add();
+		else
+			MetricsServer::mcDbPrepares.add();
+	} else {
+		// Never prepare on top of a statement the cache may share.
+		if (query.isActive())
+			query.finish();
+		query = QSqlQuery(c->qsdDatabase);
+		ok = query.prepare(q);
+		MetricsServer::mcDbPrepares.add();
+	}
+
+	if (ok) {
 		return true;
 	} else {
-		db->close();
-		if (! db->open()) {
-			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(db->lastError().text()));
+		c->scStatements.clear();
+		c->qsdDatabase.close();
+		if (! c->qsdDatabase.open()) {
+			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(c->qsdDatabase.lastError().text()));
 		}
-		query = QSqlQuery();
+		configure(c->qsdDatabase);
+		query = QSqlQuery(c->qsdDatabase);
 		if (query.prepare(q)) {
 			qWarning("SQL Connection lost, reconnection OK");
 			return true;
@@ -514,8 +615,14 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 
 bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
 	if (! str.isEmpty())
-		prepare(query, str, fatal, warn);
-	if (query.exec()) {
+		prepare(query, str, fatal, warn, false);
+
+	Timer t;
+	bool ok = query.exec();
+	MetricsServer::mcDbQueries.add();
+	MetricsServer::mcDbMicroseconds.add(t.elapsed());
+
+	if (ok) {
 		return true;
 	} else {
 
@@ -531,8 +638,14 @@ bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn)
 
 bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 	if (! str.isEmpty())
-		prepare(query, str, fatal);
-	if (query.execBatch()) {
+		prepare(query, str, fatal, true, false);
+
+	Timer t;
+	bool ok = query.execBatch();
+	MetricsServer::mcDbQueries.add();
+	MetricsServer::mcDbMicroseconds.add(t.elapsed());
+
+	if (ok) {
 		return true;
 	} else {
 
@@ -659,12 +772,12 @@ int Server::registerUser(const QMap<int, QString> &info) {
 	if (getUserID(name) >= 0)
 		return -1;
 
-	qhUserIDCache.remove(name);
+	udUsers.remove(name);
 
 	int res = -2;
 	emit registerUserSig(res, info);
 	if (res != -2) {
-		qhUserIDCache.remove(name);
+		udUsers.remove(name);
 	}
 	if (res == -1)
 		return res;
@@ -689,7 +802,7 @@ int Server::registerUser(const QMap<int, QString> &info) {
 	query.addBindValue(id);
 	query.addBindValue(name);
 	SQLEXEC();
-	qhUserNameCache.remove(id);
+	udUsers.remove(id);
 
 	setInfo(id, info);
 
@@ -705,8 +818,9 @@ bool Server::unregisterUserDB(int id) {
 	if (info.isEmpty())
 		return false;
 
-	qhUserIDCache.remove(info.value(ServerDB::User_Name));
-	qhUserNameCache.remove(id);
+	udUsers.remove(info.value(ServerDB::User_Name));
+	udUsers.remove(id);
+	udUsers.removeBlobs(id);
 
 	int res = -2;
 	emit unregisterUserSig(res, id);
@@ -730,23 +844,49 @@ bool Server::unregisterUserDB(int id) {
 	return true;
 }
 
-QList<UserInfo> Server::getRegisteredUsersEx() {
-
-	QMap<int, QString> rpcUsers;
-	emit getRegisteredUsersSig(QString(), rpcUsers);
-
-	QList<UserInfo> users;
-	QMap<int, QString>::iterator it = rpcUsers.begin();
-	for (; it != rpcUsers.end(); ++it)
-	{
-		users.insert(it.key(), UserInfo(it.key(), it.value()));
+/// Returns at most count registered users matching filter, ordered by name
+/// and starting after the name given in after, so the name of the last user
+/// of a page is the cursor for the next one. count is capped at
+/// UserPager::MaxPageSize. A filter containing % or _ is a LIKE pattern;
+/// anything else is a case sensitive name prefix, which is answered from the
+/// users_name index without scanning the table.
+/// @param more Set to true if further users follow this page.
+/// @param authenticated The users of the authenticators for this filter, if
+/// the caller already asked for them; otherwise they are asked here.
+QList<UserInfo> Server::getRegisteredUsersPage(const QString &filter, const QString &after, int count, bool &more, const QMap<int, QString> *authenticated) {
+	UserPager pager(filter, after, count);
+	more = false;
+	if (pager.count() <= 0)
+		return QList<UserInfo>();
+
+	if (authenticated) {
+		pager.add(*authenticated);
+	} else {
+		QMap<int, QString> rpcUsers;
+		emit getRegisteredUsersSig(filter, rpcUsers);
+		pager.add(rpcUsers);
 	}
 
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("SELECT `user_id`, `name`, `lastchannel`, `last_active` FROM `%1users` WHERE `server_id` = ?");
-	query.addBindValue(iServerNum);
+	if (! pager.qsLike.isEmpty()) {
+		SQLPREP("SELECT `user_id`, `name`, `lastchannel`, `last_active` FROM `%1users` WHERE `server_id` = ? AND `name` > ? AND `name` LIKE ? ORDER BY `name` LIMIT ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(after);
+		query.addBindValue(pager.qsLike);
+	} else if (! pager.qsPrefix.isEmpty()) {
+		SQLPREP("SELECT `user_id`, `name`, `lastchannel`, `last_active` FROM `%1users` WHERE `server_id` = ? AND `name` > ? AND `name` >= ? AND `name` < ? ORDER BY `name` LIMIT ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(after);
+		query.addBindValue(pager.qsPrefix);
+		query.addBindValue(pager.qsUpper);
+	} else {
+		SQLPREP("SELECT `user_id`, `name`, `lastchannel`, `last_active` FROM `%1users` WHERE `server_id` = ? AND `name` > ? ORDER BY `name` LIMIT ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(after);
+	}
+	query.addBindValue(pager.limit());
 	SQLEXEC();
 
 	while (query.next()) {
@@ -757,10 +897,10 @@ QList<UserInfo> Server::getRegisteredUsersEx() {
 		userinfo.last_active = QDateTime::fromString(query.value(3).toString(), Qt::ISODate);
 		userinfo.last_active.setTimeSpec(Qt::UTC);
 
-		users << userinfo;
+		pager.add(userinfo);
 	}
 
-	return users;
+	return pager.page(more);
 }
 
 QMap<int, QString > Server::getRegisteredUsers(const QString &filter) {
@@ -833,7 +973,7 @@ QMap<int, QString> Server::getRegistration(int id) {
 		SQLEXEC();
 		while (query.next()) {
 			const int key = query.value(0).toInt();
-			if (!info.contains(key))
+			if ((key != ServerDB::User_KDF) && !info.contains(key))
 				info.insert(key, query.value(1).toString());
 		}
 	}
@@ -843,50 +983,194 @@ QMap<int, QString> Server::getRegistration(int id) {
 /// @return UserID of authenticated user, -1 for authentication failures, -2 for unknown user (fallthrough),
 ///         -3 for authentication failures where the data could (temporarily) not be verified.
 int Server::authenticate(QString &name, const QString &pw, int sessionId, const QStringList &emails, const QString &certhash, bool bStrongCert, const QList<QSslCertificate> &certs) {
+	int res = authenticateExternal(name, pw, sessionId, certhash, bStrongCert, certs);
+	if (res != -2)
+		return res;
+
+	return authenticateLocal(name, pw, emails, certhash, bStrongCert);
+}
+
+/// Asks a synchronous authenticator, if any. Returns -2 if the database has to be checked.
+int Server::authenticateExternal(QString &name, const QString &pw, int sessionId, const QString &certhash, bool bStrongCert, const QList<QSslCertificate> &certs) {
 	int res = bForceExternalAuth ? -3 : -2;
 
 	emit authenticateSig(res, name, sessionId, certs, certhash, bStrongCert, pw);
 
 	if (res != -2) {
 		// External authentication handled it. Ignore certificate completely.
-		if (res != -1) {
-			TransactionHolder th;
-			QSqlQuery &query = *th.qsqQuery;
+		recordExternalAuth(res, name);
+	}
+	return res;
+}
 
-			int lchan=readLastChannel(res);
-			if (lchan < 0)
-				lchan = 0;
+/// Records the outcome of an external authentication in the database.
+void Server::recordExternalAuth(int res, const QString &name) {
+	if (res != -1) {
+		TransactionHolder th;
+		QSqlQuery &query = *th.qsqQuery;
 
-			SQLPREP("REPLACE INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES (?,?,?,?)");
-			query.addBindValue(iServerNum);
-			query.addBindValue(res);
-			query.addBindValue(name);
-			query.addBindValue(lchan);
-			SQLEXEC();
-		}
-		if (res >= 0) {
-			qhUserNameCache.remove(res);
-			qhUserIDCache.remove(name);
-		}
-		return res;
+		int lchan=readLastChannel(res);
+		if (lchan < 0)
+			lchan = 0;
+
+		SQLPREP("REPLACE INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES (?,?,?,?)");
+		query.addBindValue(iServerNum);
+		query.addBindValue(res);
+		query.addBindValue(name);
+		query.addBindValue(lchan);
+		SQLEXEC();
 	}
+	if (res >= 0) {
+		udUsers.remove(res);
+		udUsers.remove(name);
+	}
+}
+
+/// Authenticates against the users registered in the database. Return values
+/// are as for authenticate().
+int Server::authenticateLocal(QString &name, const QString &pw, const QStringList &emails, const QString &certhash, bool bStrongCert) {
+	int id;
+	QString storedname;
+	PasswordCheck pc;
+	if (readPassword(name, id, storedname, pc) && ! pc.qsHash.isEmpty()) {
+		pc.qsPassword = pw;
+		pc.iUpgradeIterations = Meta::mp.iKDFIterations;
+		pc.run();
+	}
+	return finishAuthenticateLocal(name, id, storedname, pc, emails, certhash, bStrongCert);
+}
 
+/// Reads the stored password hash and its parameters for the user called name.
+/// Returns false, with id set to -2, if there is no such user.
+bool Server::readPassword(const QString &name, int &id, QString &storedname, PasswordCheck &pc) {
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
-	SQLPREP("SELECT `user_id`,`name`,`pw` FROM `%1users` WHERE `server_id` = ? AND LOWER(`name`) = LOWER(?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(name);
-	SQLEXEC();
-	if (query.next()) {
+	// A known name can be looked up by its id, which unlike the case
+	// insensitive name comparison does not scan the whole table.
+	bool found = false;
+	int cachedid;
+	if (udUsers.id(name, cachedid)) {
+		SQLPREP("SELECT `user_id`,`name`,`pw` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(cachedid);
+		SQLEXEC();
+		found = query.next() && (UserDirectory::fold(query.value(1).toString()) == UserDirectory::fold(name));
+		if (! found)
+			udUsers.remove(cachedid);
+	}
+	if (! found) {
+		SQLPREP("SELECT `user_id`,`name`,`pw` FROM `%1users` WHERE `server_id` = ? AND LOWER(`name`) = LOWER(?)");
+		query.addBindValue(iServerNum);
+		query.addBindValue(name);
+		SQLEXEC();
+		found = query.next();
+	}
+	if (! found) {
+		id = -2;
+		return false;
+	}
+
+	id = query.value(0).toInt();
+	storedname = query.value(1).toString();
+	pc.qsHash = query.value(2).toString();
+
+	if (! pc.qsHash.isEmpty()) {
+		SQLPREP("SELECT `value` FROM `%1user_info` WHERE `server_id` = ? AND `user_id` = ? AND `key` = ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(id);
+		query.addBindValue(ServerDB::User_KDF);
+		SQLEXEC();
+		if (query.next())
+			pc.phParams = PasswordHash::fromString(query.value(0).toString());
+	}
+	return true;
+}
+
+// Runs the password check of a login on Meta's worker pool and hands the
+// result back to the main thread.
+class PasswordTask : public QRunnable {
+	public:
+		int iServerNum;
+		unsigned int uiRequest;
+		int iId;
+		QString qsName;
+		PasswordCheck pcCheck;
+		void run();
+};
+
+/// Checks the password of a login on Meta's worker pool, as the key
+/// derivation is deliberately slow. finishAuthenticate is called once the
+/// check is done, right away if there is no password to check.
+void Server::checkPassword(ServerUser *u, const MumbleProto::Authenticate &msg, const QString &pw) {
+	PasswordTask *pt = new PasswordTask();
+	if (! readPassword(u->qsName, pt->iId, pt->qsName, pt->pcCheck) || pt->pcCheck.qsHash.isEmpty()) {
+		int id = finishAuthenticateLocal(u->qsName, pt->iId, pt->qsName, pt->pcCheck, u->pDetails->qslEmail, u->qsHash, u->bVerified);
+		delete pt;
+		finishAuthenticate(u, msg, pw, id);
+		return;
+	}
+
+	pt->iServerNum = iServerNum;
+	pt->uiRequest = parkAuthenticate(u, msg, pw);
+	pt->pcCheck.qsPassword = pw;
+	pt->pcCheck.iUpgradeIterations = Meta::mp.iKDFIterations;
+	meta->qtpPasswords.start(pt);
+}
+
+/// Called on the main thread with the result of checkPassword(). If the user
+/// has gone or timed out in the meantime, the result is dropped, and if the
+/// name whose password was checked is no longer theirs the login is
+/// rejected. Request ids are unique across servers, so a result for a server
+/// that has since been restarted never matches.
+void Server::passwordChecked(unsigned int request, int id, const QString &storedname, const PasswordCheck &pc) {
+	if (! qhAuthPending.contains(request))
+		return;
+
+	const PendingAuth pa = takeAuthenticate(request);
+	ServerUser *u = qhUsers.value(pa.uiSession);
+	if (! u || (u->uiAuthRequest != request))
+		return;
+
+	u->uiAuthRequest = 0;
+	if (u->qsName != pa.qsName) {
+		finishAuthenticate(u, pa.msgAuth, pa.qsPassword, -1);
+		return;
+	}
+	int res = finishAuthenticateLocal(u->qsName, id, storedname, pc, u->pDetails->qslEmail, u->qsHash, u->bVerified);
+	finishAuthenticate(u, pa.msgAuth, pa.qsPassword, res);
+}
+
+static void passwordChecked(int server_id, unsigned int request, int id, const QString &storedname, const PasswordCheck &pc) {
+	Server *s = meta->qhServers.value(server_id);
+	if (s)
+		s->passwordChecked(request, id, storedname, pc);
+}
+
+void PasswordTask::run() {
+	pcCheck.run();
+	QCoreApplication::instance()->postEvent(meta, new ExecEvent(boost::bind(&passwordChecked, iServerNum, uiRequest, iId, qsName, pcCheck)));
+}
+
+/// Completes authenticateLocal() once the password has been checked. id and
+/// storedname are what readPassword() found.
+int Server::finishAuthenticateLocal(QString &name, int id, const QString &storedname, const PasswordCheck &pc, const QStringList &emails, const QString &certhash, bool bStrongCert) {
+	int res = -2;
+
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
+
+	if (id != -2) {
 		res = -1;
-		QString storedpw = query.value(2).toString();
-		QString hashedpw = QString::fromLatin1(sha1(pw).toHex());
 
-		if (! storedpw.isEmpty() && (storedpw == hashedpw)) {
-			name = query.value(1).toString();
-			res = query.value(0).toInt();
-		} else if (query.value(0).toInt() == 0) {
+		if (pc.bValid) {
+			name = storedname;
+			res = id;
+
+			// Rehash with the current parameters now that we know the password.
+			if (! pc.qsNewHash.isEmpty())
+				ServerDB::upgradePassword(query, iServerNum, id, pc.qsHash, pc.qsNewHash, pc.phNewParams);
+		} else if (id == 0) {
 			return -1;
 		}
 	}
@@ -914,7 +1198,7 @@ int Server::authenticate(QString &name, const QString &pw, int sessionId, const
 				}
 			}
 		}
-		if (res > 0) {
+		if ((res > 0) && ! udUsers.name(res, name)) {
 			SQLPREP("SELECT `name` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
 			query.addBindValue(iServerNum);
 			query.addBindValue(res);
@@ -941,10 +1225,8 @@ int Server::authenticate(QString &name, const QString &pw, int sessionId, const
 			SQLEXEC();
 		}
 	}
-	if (res >= 0) {
-		qhUserNameCache.remove(res);
-		qhUserIDCache.remove(name);
-	}
+	if (res >= 0)
+		udUsers.insert(res, name);
 	return res;
 }
 
@@ -960,10 +1242,11 @@ bool Server::setInfo(int id, const QMap<int, QString> &setinfo) {
 		int idmatch = getUserID(uname);
 		if ((idmatch >= 0) && (idmatch != id))
 			return false;
-		qhUserIDCache.remove(qhUserNameCache.value(id));
-		qhUserNameCache.remove(id);
-		qhUserIDCache.remove(info.value(ServerDB::User_Name));
+		udUsers.remove(id);
+		udUsers.remove(uname);
 	}
+	if (info.contains(ServerDB::User_Comment))
+		udUsers.removeBlobs(id);
 
 	emit setInfoSig(res, id, info);
 	if (res >= 0)
@@ -977,14 +1260,8 @@ bool Server::setInfo(int id, const QMap<int, QString> &setinfo) {
 	}
 	if (info.contains(ServerDB::User_Password)) {
 		const QString &pw = info.value(ServerDB::User_Password);
-		QCryptographicHash hash(QCryptographicHash::Sha1);
-		hash.addData(pw.toUtf8());
-
-		SQLPREP("UPDATE `%1users` SET `pw`=? WHERE `server_id` = ? AND `user_id`=?");
-		query.addBindValue(pw.isEmpty() ? QVariant() : QString::fromLatin1(hash.result().toHex()));
-		query.addBindValue(iServerNum);
-		query.addBindValue(id);
-		SQLEXEC();
+		const PasswordHash ph = PasswordHash::generate(Meta::mp.iKDFIterations);
+		ServerDB::storePassword(query, iServerNum, id, pw.isEmpty() ? QString() : ph.hash(pw), ph);
 		info.remove(ServerDB::User_Password);
 	}
 	if (info.contains(ServerDB::User_Name)) {
@@ -1028,9 +1305,11 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 	else
 		tex = texture;
 
+	udUsers.removeBlobs(id);
+
 	foreach(ServerUser *u, qhUsers) {
 		if (u->iId == id)
-			hashAssign(u->qbaTexture, u->qbaTextureHash, tex);
+			blobAssign(u->qbaTexture, u->qbaTextureHash, tex);
 	}
 
 	int res = -2;
@@ -1046,6 +1325,7 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 	query.addBindValue(iServerNum);
 	query.addBindValue(id);
 	SQLEXEC();
+	cacheUserTexture(id, tex);
 
 	return true;
 }
@@ -1053,9 +1333,6 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 void ServerDB::setSUPW(int srvnum, const QString &pw) {
 	TransactionHolder th;
 
-	QCryptographicHash hash(QCryptographicHash::Sha1);
-	hash.addData(pw.toUtf8());
-
 	QSqlQuery &query = *th.qsqQuery;
 
 	SQLPREP("SELECT `user_id` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
@@ -1070,21 +1347,64 @@ void ServerDB::setSUPW(int srvnum, const QString &pw) {
 		SQLEXEC();
 	}
 
+	const PasswordHash ph = PasswordHash::generate(Meta::mp.iKDFIterations);
+	storePassword(query, srvnum, 0, ph.hash(pw), ph);
+}
+
+/// Stores a password hash and the parameters it was derived with. An empty
+/// hash clears the password.
+void ServerDB::storePassword(QSqlQuery &query, int srvnum, int id, const QString &hash, const PasswordHash &ph) {
 	SQLPREP("UPDATE `%1users` SET `pw`=? WHERE `server_id` = ? AND `user_id`=?");
-	query.addBindValue(QString::fromLatin1(hash.result().toHex()));
+	query.addBindValue(hash.isEmpty() ? QVariant() : hash);
 	query.addBindValue(srvnum);
-	query.addBindValue(0);
+	query.addBindValue(id);
+	SQLEXEC();
+
+	if (hash.isEmpty() || ph.isLegacy()) {
+		SQLPREP("DELETE FROM `%1user_info` WHERE `server_id` = ? AND `user_id` = ? AND `key` = ?");
+		query.addBindValue(srvnum);
+		query.addBindValue(id);
+		query.addBindValue(User_KDF);
+		SQLEXEC();
+	} else {
+		SQLPREP("REPLACE INTO `%1user_info` (`server_id`, `user_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
+		query.addBindValue(srvnum);
+		query.addBindValue(id);
+		query.addBindValue(User_KDF);
+		query.addBindValue(ph.toString());
+		SQLEXEC();
+	}
+}
+
+/// Replaces the hash of a password that was checked on a worker thread, unless
+/// it was changed in the meantime; the new password must not be overwritten
+/// by a rehash of the old one.
+void ServerDB::upgradePassword(QSqlQuery &query, int srvnum, int id, const QString &oldhash, const QString &hash, const PasswordHash &ph) {
+	SQLPREP("UPDATE `%1users` SET `pw`=? WHERE `server_id` = ? AND `user_id`=? AND `pw`=?");
+	query.addBindValue(hash);
+	query.addBindValue(srvnum);
+	query.addBindValue(id);
+	query.addBindValue(oldhash);
+	SQLEXEC();
+	if (query.numRowsAffected() != 1)
+		return;
+
+	SQLPREP("REPLACE INTO `%1user_info` (`server_id`, `user_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
+	query.addBindValue(srvnum);
+	query.addBindValue(id);
+	query.addBindValue(User_KDF);
+	query.addBindValue(ph.toString());
 	SQLEXEC();
 }
 
 QString Server::getUserName(int id) {
-	if (qhUserNameCache.contains(id))
-		return qhUserNameCache.value(id);
 	QString name;
+	if (udUsers.name(id, name))
+		return name;
+
 	emit idToNameSig(name, id);
 	if (! name.isEmpty()) {
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+		udUsers.insert(id, name);
 		return name;
 	}
 
@@ -1096,20 +1416,20 @@ QString Server::getUserName(int id) {
 	SQLEXEC();
 	if (query.next()) {
 		name = query.value(0).toString();
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+		udUsers.insert(id, name);
 	}
 	return name;
 }
 
 int Server::getUserID(const QString &name) {
-	if (qhUserIDCache.contains(name))
-		return qhUserIDCache.value(name);
 	int id = -2;
+	if (udUsers.id(name, id))
+		return id;
+
 	emit nameToIdSig(id, name);
 	if (id != -2) {
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+		if (id >= 0)
+			udUsers.insert(id, name);
 		return id;
 	}
 
@@ -1120,20 +1440,22 @@ int Server::getUserID(const QString &name) {
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("SELECT `user_id` FROM `%1users` WHERE `server_id` = ? AND LOWER(`name`) = LOWER(?)");
+	SQLPREP("SELECT `user_id`, `name` FROM `%1users` WHERE `server_id` = ? AND LOWER(`name`) = LOWER(?)");
 	query.addBindValue(iServerNum);
 	query.addBindValue(name);
 	SQLEXEC();
 	if (query.next()) {
 		id = query.value(0).toInt();
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+		udUsers.insert(id, query.value(1).toString());
 	}
 	return id;
 }
 
 QByteArray Server::getUserTexture(int id) {
-	QByteArray qba;
+	QByteArray qba, hash;
+	if (udUsers.texture(id, qba, hash) && (hash.isEmpty() || meta->bsBlobs.get(hash, qba)))
+		return qba;
+
 	emit idToTextureSig(qba, id);
 	if (! qba.isNull()) {
 		return qba;
@@ -1151,10 +1473,113 @@ QByteArray Server::getUserTexture(int id) {
 		if (! qba.isEmpty())
 			if (qba.size() == 600 * 60 * 4)
 				qba = qCompress(qba);
+		cacheUserTexture(id, qba);
+	}
+	return qba;
+}
+
+/// Looks up a user's texture the way it is handed to clients: short ones
+/// are returned in texture, for the rest only their hash. Once known, the
+/// hash is answered from memory, without loading the texture again.
+void Server::getUserTextureHash(int id, QByteArray &texture, QByteArray &hash) {
+	if (udUsers.texture(id, texture, hash))
+		return;
+
+	texture = getUserTexture(id);
+	if (texture.size() >= BlobStore::iMinimumSize) {
+		hash = meta->bsBlobs.insert(texture);
+		texture = QByteArray();
+	} else {
+		hash = QByteArray();
 	}
+}
+
+void Server::cacheUserTexture(int id, const QByteArray &texture) {
+	if (texture.size() >= BlobStore::iMinimumSize)
+		udUsers.setTexture(id, QByteArray(), meta->bsBlobs.insert(texture));
+	else
+		udUsers.setTexture(id, texture, QByteArray());
+}
+
+/// @return The texture of a connected user, loading it if only its hash was
+/// known so far.
+QByteArray Server::userTexture(ServerUser *u) {
+	if (u->qbaTextureHash.isEmpty())
+		return u->qbaTexture;
+
+	QByteArray qba;
+	if (meta->bsBlobs.get(u->qbaTextureHash, qba))
+		return qba;
+
+	if (u->iId < 0)
+		return QByteArray();
+
+	qba = getUserTexture(u->iId);
+	if (BlobStore::hash(qba) != u->qbaTextureHash)
+		return QByteArray();
+	if (! meta->bsBlobs.contains(u->qbaTextureHash))
+		meta->bsBlobs.insert(qba);
 	return qba;
 }
 
+QString Server::getUserComment(int id) {
+	QString comment;
+	QByteArray hash, qba;
+	if (udUsers.comment(id, comment, hash)) {
+		if (hash.isEmpty())
+			return comment;
+		if (meta->bsBlobs.get(hash, qba))
+			return QString::fromUtf8(qba);
+	}
+
+	QMap<int, QString> info;
+	int res = -2;
+	emit getRegistrationSig(res, id, info);
+	if (res >= 0)
+		return info.value(ServerDB::User_Comment);
+
+	TransactionHolder th;
+
+	QSqlQuery &query = *th.qsqQuery;
+	SQLPREP("SELECT `value` FROM `%1user_info` WHERE `server_id` = ? AND `user_id` = ? AND `key` = ?");
+	query.addBindValue(iServerNum);
+	query.addBindValue(id);
+	query.addBindValue(ServerDB::User_Comment);
+	SQLEXEC();
+	if (query.next())
+		comment = query.value(0).toString();
+	cacheUserComment(id, comment);
+	return comment;
+}
+
+void Server::cacheUserComment(int id, const QString &comment) {
+	if (comment.length() >= BlobStore::iMinimumSize)
+		udUsers.setComment(id, QString(), meta->bsBlobs.insert(comment.toUtf8()));
+	else
+		udUsers.setComment(id, comment, QByteArray());
+}
+
+// Fills the user directory with the most recently active users, so the
+// first logins after a start do not each have to look their name up.
+void Server::readUsers() {
+	const int limit = udUsers.capacity();
+	if (limit <= 0)
+		return;
+
+	TransactionHolder th;
+
+	QSqlQuery &query = *th.qsqQuery;
+	SQLPREP("SELECT `user_id`, `name` FROM `%1users` WHERE `server_id` = ? ORDER BY `last_active` DESC LIMIT ?");
+	query.addBindValue(iServerNum);
+	query.addBindValue(limit);
+	SQLEXEC();
+
+	QList<QPair<int, QString> > users;
+	while (query.next())
+		users.prepend(qMakePair(query.value(0).toInt(), query.value(1).toString()));
+	udUsers.load(users);
+}
+
 void Server::addLink(Channel *c, Channel *l) {
 	c->link(l);
 
@@ -1239,6 +1664,7 @@ Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int
 	c->bTemporary = temporary;
 	c->iPosition = position;
 	qhChannels.insert(id, c);
+	invalidateSubtrees();
 	return c;
 }
 
@@ -1253,6 +1679,7 @@ void Server::removeChannelDB(const Channel *c) {
 		SQLEXEC();
 	}
 	qhChannels.remove(c->iId);
+	invalidateSubtrees();
 }
 
 void Server::updateChannel(const Channel *c) {
@@ -1561,6 +1988,8 @@ void Server::getBans() {
 		if (ban.isValid())
 			qlBans << ban;
 	}
+
+	indexBans();
 }
 
 void Server::saveBans() {
@@ -1583,6 +2012,8 @@ void Server::saveBans() {
 		query.addBindValue(ban.iDuration);
 		SQLEXEC();
 	}
+
+	indexBans();
 }
 
 QVariant Server::getConf(const QString &key, QVariant def) {
@@ -1623,34 +2054,64 @@ void Server::setConf(const QString &key, const QVariant &value) {
 }
 
 void Server::dblog(const QString &str) const {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
 	// Is logging disabled?
 	if (Meta::mp.iLogDays < 0)
 		return;
 
-	// Once per hour
-	if (Meta::mp.iLogDays > 0) {
-		if (ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL)) {
-			QString qstr;
-			if (Meta::mp.qsDBDriver == "QSQLITE") {
-				qstr = QString::fromLatin1("msgtime < datetime('now','-%1 days')").arg(Meta::mp.iLogDays);
-			} else {
-				qstr = QString::fromLatin1("msgtime < now() - INTERVAL %1 day").arg(Meta::mp.iLogDays);
-			}
-			ServerDB::prepare(query, QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr);
-			SQLEXEC();
-		}
-	}
+	if (ServerDB::lsLog)
+		ServerDB::lsLog->log(iServerNum, str);
+}
+
+/// Starts writing the server log in batches, from a background thread if
+/// the database can take writes from two connections at once. Only call
+/// this once the process has detached, as threads do not survive a fork.
+void ServerDB::startLog() {
+	if (lsLog || (Meta::mp.iLogDays < 0))
+		return;
+
+	// With SQLite's rollback journal a reader on one connection keeps the
+	// other from writing at all, so the log stays on the main connection.
+	const bool threaded = (Meta::mp.qsDBDriver != "QSQLITE") || (Meta::mp.iSQLiteWAL > 0);
+
+	lsLog = new LogSink(Meta::mp.iLogBuffer, Meta::mp.iLogFlush, threaded);
+	if (threaded)
+		lsLog->start(QThread::LowPriority);
+}
+
+/// Inserts a batch of log lines in one transaction. Called by the LogSink.
+void ServerDB::writeLog(const QVariantList &serverids, const QVariantList &msgs) {
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
 
 	SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(str);
-	SQLEXEC();
+	query.addBindValue(serverids);
+	query.addBindValue(msgs);
+	ServerDB::execBatch(query, QString(), false);
+}
+
+/// Deletes up to chunk log entries older than logdays. Returns true if there
+/// may be more. Called by the LogSink.
+bool ServerDB::expireLog(int chunk) {
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
+
+	if (Meta::mp.qsDBDriver == "QSQLITE") {
+		SQLPREP("DELETE FROM `%1slog` WHERE rowid IN (SELECT rowid FROM `%1slog` WHERE `msgtime` < datetime('now', ?) LIMIT ?)");
+		query.addBindValue(QString::fromLatin1("-%1 days").arg(Meta::mp.iLogDays));
+	} else {
+		SQLPREP("DELETE FROM `%1slog` WHERE `msgtime` < now() - INTERVAL ? DAY LIMIT ?");
+		query.addBindValue(Meta::mp.iLogDays);
+	}
+	query.addBindValue(chunk);
+	if (! SOFTEXEC())
+		return false;
+	return query.numRowsAffected() >= chunk;
 }
 
 void ServerDB::wipeLogs() {
+	if (lsLog)
+		lsLog->forgetAll();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -1658,6 +2119,14 @@ void ServerDB::wipeLogs() {
 }
 
 QList<QPair<unsigned int, QString> > ServerDB::getLog(int server_id, unsigned int offs_min, unsigned int offs_max) {
+	QList<QPair<unsigned int, QString> > ql;
+
+	// Recent lines are answered from memory. Older ones come from the
+	// database, where the lines of the last logflush milliseconds may not be
+	// yet, which shifts the offsets by that much.
+	if (lsLog && lsLog->recent(server_id, offs_min, offs_max, ql))
+		return ql;
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -1667,7 +2136,6 @@ QList<QPair<unsigned int, QString> > ServerDB::getLog(int server_id, unsigned in
 	query.addBindValue(offs_max);
 	SQLEXEC();
 
-	QList<QPair<unsigned int, QString> > ql;
 	while (query.next()) {
 		QDateTime qdt = query.value(0).toDateTime();
 		QString msg = query.value(1).toString();
@@ -1676,6 +2144,8 @@ QList<QPair<unsigned int, QString> > ServerDB::getLog(int server_id, unsigned in
 	return ql;
 }
 
+/// Lines of the server's log in the database, which lags behind by up to
+/// logflush milliseconds.
 int ServerDB::getLogLen(int server_id) {
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
@@ -1767,9 +2237,599 @@ int ServerDB::addServer() {
 }
 
 void ServerDB::deleteServer(int server_id) {
+	if (lsLog)
+		lsLog->forget(server_id);
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("DELETE FROM `%1servers` WHERE `server_id` = ?");
 	query.addBindValue(server_id);
 	SQLEXEC();
 }
+
+/// Writes the persistent state of a server to an archive file, see
+/// ServerArchive. Everything is read in one transaction on the calling
+/// thread's own connection, so this may run outside the main thread while
+/// the server is up; with SQLite that is only safe with the write-ahead log,
+/// which the caller has to check. Channels not connected to the root, and
+/// the rows belonging to them, are left out just as Server ignores them.
+/// The file is written under a temporary name and only renamed to path
+/// once complete.
+bool ServerDB::exportServer(int server_id, const QString &path, QString &error) {
+	if (! serverExists(server_id)) {
+		error = QString::fromLatin1("Server %1 does not exist").arg(server_id);
+		return false;
+	}
+
+	QFile qf(path + QLatin1String(".tmp"));
+	if (! qf.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		error = qf.errorString();
+		return false;
+	}
+
+	ServerArchiveWriter w(&qf);
+	QDataStream &qds = w.qds;
+	bool ok = true;
+
+	{
+		TransactionHolder th;
+		QSqlQuery &query = *th.qsqQuery;
+
+		// Blobs go first, so the rows referring to them don't need to be read twice.
+		QHash<int, qint32> textures, comments, descriptions;
+		w.beginSection(ServerArchive::Blobs);
+		SQLPREP("SELECT `user_id`, `texture` FROM `%1users` WHERE `server_id` = ? AND `texture` IS NOT NULL");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			const QByteArray &qba = query.value(1).toByteArray();
+			if (! qba.isEmpty())
+				textures.insert(query.value(0).toInt(), w.blob(qba));
+		}
+		SQLPREP("SELECT `user_id`, `value` FROM `%1user_info` WHERE `server_id` = ? AND `key` = ?");
+		query.addBindValue(server_id);
+		query.addBindValue(ServerDB::User_Comment);
+		SQLEXEC();
+		while (query.next()) {
+			const QByteArray &qba = query.value(1).toString().toUtf8();
+			if (! qba.isEmpty())
+				comments.insert(query.value(0).toInt(), w.blob(qba));
+		}
+		SQLPREP("SELECT `channel_id`, `value` FROM `%1channel_info` WHERE `server_id` = ? AND `key` = ?");
+		query.addBindValue(server_id);
+		query.addBindValue(ServerDB::Channel_Description);
+		SQLEXEC();
+		while (query.next()) {
+			const QByteArray &qba = query.value(1).toString().toUtf8();
+			if (! qba.isEmpty())
+				descriptions.insert(query.value(0).toInt(), w.blob(qba));
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::Config);
+		SQLPREP("SELECT `key`, `value` FROM `%1config` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			qds << ServerArchive::text(query.value(0)) << ServerArchive::text(query.value(1));
+			w.row();
+		}
+		ok = ok && w.endSection();
+
+		// Parents before their children, so the rows can be inserted in order.
+		typedef QPair<qint32, QByteArray> ChannelRow;
+		QMultiHash<qint32, ChannelRow> children;
+		SQLPREP("SELECT `channel_id`, `parent_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			QByteArray row;
+			QDataStream rs(&row, QIODevice::WriteOnly);
+			rs.setVersion(qds.version());
+			rs << static_cast<qint32>(query.value(0).toInt()) << ServerArchive::id(query.value(1)) << ServerArchive::text(query.value(2)) << static_cast<quint8>(query.value(3).toInt() ? 1 : 0);
+			children.insert(ServerArchive::id(query.value(1)), ChannelRow(query.value(0).toInt(), row));
+		}
+		// Channels not connected to the root would not import, so they and
+		// everything referring to them stay behind.
+		w.beginSection(ServerArchive::Channels);
+		QSet<int> exported;
+		QSet<int> orphanGroups;
+		QList<qint32> pending;
+		pending << -1;
+		while (! pending.isEmpty()) {
+			const qint32 parent = pending.takeFirst();
+			foreach(const ChannelRow &cr, children.values(parent)) {
+				if ((parent == -1) && (cr.first != 0))
+					continue;
+				exported.insert(cr.first);
+				qds.writeRawData(cr.second.constData(), cr.second.size());
+				w.row();
+				if (cr.first != parent)
+					pending << cr.first;
+			}
+			children.remove(parent);
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::ChannelInfo);
+		SQLPREP("SELECT `channel_id`, `key`, `value` FROM `%1channel_info` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			const int cid = query.value(0).toInt();
+			const int key = query.value(1).toInt();
+			if (! exported.contains(cid))
+				continue;
+			qint32 blob = -1;
+			if ((key == ServerDB::Channel_Description) && descriptions.contains(cid))
+				blob = descriptions.value(cid);
+			qds << static_cast<qint32>(cid) << static_cast<qint32>(key) << blob << ((blob >= 0) ? QByteArray() : ServerArchive::text(query.value(2)));
+			w.row();
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::Links);
+		SQLPREP("SELECT `channel_id`, `link_id` FROM `%1channel_links` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			if (! exported.contains(query.value(0).toInt()) || ! exported.contains(query.value(1).toInt()))
+				continue;
+			qds << static_cast<qint32>(query.value(0).toInt()) << static_cast<qint32>(query.value(1).toInt());
+			w.row();
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::Users);
+		SQLPREP("SELECT `user_id`, `name`, `pw`, `lastchannel`, `last_active` FROM `%1users` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			const int uid = query.value(0).toInt();
+			QDateTime qdt = QDateTime::fromString(query.value(4).toString(), Qt::ISODate);
+			qdt.setTimeSpec(Qt::UTC);
+			qds << static_cast<qint32>(uid) << ServerArchive::text(query.value(1)) << ServerArchive::text(query.value(2)) << ServerArchive::id(query.value(3)) << textures.value(uid, -1) << static_cast<quint32>(qdt.isValid() ? qdt.toTime_t() : 0);
+			w.row();
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::UserInfo);
+		SQLPREP("SELECT `user_id`, `key`, `value` FROM `%1user_info` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			const int uid = query.value(0).toInt();
+			const int key = query.value(1).toInt();
+			qint32 blob = -1;
+			if ((key == ServerDB::User_Comment) && comments.contains(uid))
+				blob = comments.value(uid);
+			qds << static_cast<qint32>(uid) << static_cast<qint32>(key) << blob << ((blob >= 0) ? QByteArray() : ServerArchive::text(query.value(2)));
+			w.row();
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::Groups);
+		SQLPREP("SELECT `group_id`, `channel_id`, `name`, `inherit`, `inheritable` FROM `%1groups` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			if (! exported.contains(query.value(1).toInt())) {
+				orphanGroups.insert(query.value(0).toInt());
+				continue;
+			}
+			qds << static_cast<qint32>(query.value(0).toInt()) << static_cast<qint32>(query.value(1).toInt()) << ServerArchive::text(query.value(2)) << static_cast<quint8>(query.value(3).toInt() ? 1 : 0) << static_cast<quint8>(query.value(4).toInt() ? 1 : 0);
+			w.row();
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::GroupMembers);
+		SQLPREP("SELECT `group_id`, `user_id`, `addit` FROM `%1group_members` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			if (orphanGroups.contains(query.value(0).toInt()))
+				continue;
+			qds << static_cast<qint32>(query.value(0).toInt()) << static_cast<qint32>(query.value(1).toInt()) << static_cast<quint8>(query.value(2).toInt() ? 1 : 0);
+			w.row();
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::ACL);
+		SQLPREP("SELECT `channel_id`, `priority`, `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv` FROM `%1acl` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			if (! exported.contains(query.value(0).toInt()))
+				continue;
+			qds << static_cast<qint32>(query.value(0).toInt()) << static_cast<qint32>(query.value(1).toInt()) << ServerArchive::id(query.value(2)) << ServerArchive::text(query.value(3));
+			qds << static_cast<quint8>(query.value(4).toInt() ? 1 : 0) << static_cast<quint8>(query.value(5).toInt() ? 1 : 0) << static_cast<quint32>(query.value(6).toUInt()) << static_cast<quint32>(query.value(7).toUInt());
+			w.row();
+		}
+		ok = ok && w.endSection();
+
+		w.beginSection(ServerArchive::Bans);
+		SQLPREP("SELECT `base`, `mask`, `name`, `hash`, `reason`, `start`, `duration` FROM `%1bans` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			QDateTime qdt = query.value(5).toDateTime();
+			qdt.setTimeSpec(Qt::UTC);
+			qds << query.value(0).toByteArray() << static_cast<qint32>(query.value(1).toInt()) << ServerArchive::text(query.value(2)) << ServerArchive::text(query.value(3)) << ServerArchive::text(query.value(4));
+			qds << static_cast<quint32>(qdt.isValid() ? qdt.toTime_t() : 0) << static_cast<qint32>(query.value(6).toInt());
+			w.row();
+		}
+		ok = ok && w.endSection();
+	}
+
+	ok = ok && w.finish() && qf.flush();
+	if (! ok) {
+		error = qf.errorString();
+		qf.remove();
+		return false;
+	}
+	qf.close();
+
+	QFile::remove(path);
+	if (! qf.rename(path)) {
+		error = qf.errorString();
+		qf.remove();
+		return false;
+	}
+	return true;
+}
+
+// Columns of one table read from an archive, ready for a batch insert.
+typedef QVector<QVariantList> ArchiveColumns;
+
+static void insertColumns(QSqlQuery &query, const QString &str, const ArchiveColumns &columns, int binary = -1) {
+	if (columns.isEmpty() || columns.at(0).isEmpty())
+		return;
+
+	ServerDB::prepare(query, str);
+	for (int i=0;i<columns.count();++i)
+		query.addBindValue(columns.at(i), (i == binary) ? (QSql::Binary | QSql::In) : QSql::In);
+	ServerDB::execBatch(query);
+}
+
+// Checks that every row of an archive refers to channels, users and groups
+// in the same archive, so the import can't fail halfway through on a foreign
+// key or leave rows nothing points at. Channels must come after their parent,
+// which also rules out cycles, and the root must be channel 0.
+static bool checkReferences(const ArchiveColumns &channels, const ArchiveColumns &channelinfo, const ArchiveColumns &links, const ArchiveColumns &users, const ArchiveColumns &userinfo, const ArchiveColumns &groups, const ArchiveColumns &members, const ArchiveColumns &acls, QString &error) {
+	QSet<int> channelids;
+	for (int i=0;i<channels[1].count();++i) {
+		const int id = channels[1].at(i).toInt();
+		const QVariant &parent = channels[2].at(i);
+		if (channelids.contains(id)) {
+			error = QString::fromLatin1("Archive has channel %1 twice").arg(id);
+			return false;
+		}
+		if ((i == 0) ? ((id != 0) || ! parent.isNull()) : (parent.isNull() || ! channelids.contains(parent.toInt()))) {
+			error = QString::fromLatin1("Channel %1 of the archive has no parent before it").arg(id);
+			return false;
+		}
+		channelids.insert(id);
+	}
+	if (! channelids.contains(0)) {
+		error = QLatin1String("Archive has no root channel");
+		return false;
+	}
+
+	QSet<int> userids;
+	for (int i=0;i<users[1].count();++i) {
+		const int id = users[1].at(i).toInt();
+		if (userids.contains(id)) {
+			error = QString::fromLatin1("Archive has user %1 twice").arg(id);
+			return false;
+		}
+		userids.insert(id);
+	}
+
+	QSet<int> groupids;
+	for (int i=0;i<groups[0].count();++i) {
+		if (! channelids.contains(groups[1].at(i).toInt())) {
+			error = QLatin1String("Archive has a group in a missing channel");
+			return false;
+		}
+		groupids.insert(groups[0].at(i).toInt());
+	}
+
+	for (int i=0;i<channelinfo[1].count();++i) {
+		if (! channelids.contains(channelinfo[1].at(i).toInt())) {
+			error = QLatin1String("Archive has information about a missing channel");
+			return false;
+		}
+	}
+	for (int i=0;i<links[1].count();++i) {
+		if (! channelids.contains(links[1].at(i).toInt()) || ! channelids.contains(links[2].at(i).toInt())) {
+			error = QLatin1String("Archive links a missing channel");
+			return false;
+		}
+	}
+	for (int i=0;i<userinfo[1].count();++i) {
+		if (! userids.contains(userinfo[1].at(i).toInt())) {
+			error = QLatin1String("Archive has information about a missing user");
+			return false;
+		}
+	}
+	for (int i=0;i<members[0].count();++i) {
+		if (! groupids.contains(members[0].at(i).toInt()) || ! userids.contains(members[2].at(i).toInt())) {
+			error = QLatin1String("Archive has a member of a missing group or a missing user as member");
+			return false;
+		}
+	}
+	for (int i=0;i<acls[1].count();++i) {
+		const QVariant &user = acls[3].at(i);
+		if (! channelids.contains(acls[1].at(i).toInt()) || (! user.isNull() && ! userids.contains(user.toInt()))) {
+			error = QLatin1String("Archive has an ACL for a missing channel or user");
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Replaces the persistent state of a server, creating it if necessary,
+/// with the contents of an archive written by exportServer. The file is
+/// mapped into memory and fully checked, including that every row refers
+/// to channels, users and groups it contains, before anything in the
+/// database changes, after which all rows are bulk loaded in one transaction. The
+/// server must not be running.
+bool ServerDB::importServer(int server_id, const QString &path, QString &error) {
+	QFile qf(path);
+	if (! qf.open(QIODevice::ReadOnly)) {
+		error = qf.errorString();
+		return false;
+	}
+	if (qf.size() > 0x7fffffff) {
+		error = QLatin1String("Archive is too large");
+		return false;
+	}
+
+	QByteArray data;
+	uchar *mapped = qf.map(0, qf.size());
+	if (mapped)
+		data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), static_cast<int>(qf.size()));
+	else
+		data = qf.readAll();
+
+	ServerArchiveReader r(data);
+	QDataStream &qds = r.qds;
+	if (! r.open()) {
+		error = r.qsError;
+		return false;
+	}
+
+	QByteArray qbaBlob;
+	quint32 n;
+	qint32 a, b, c, blob;
+	quint8 f, g;
+	quint32 u, v;
+	QByteArray s1, s2, s3;
+	// Every section rewinds the stream status, so check it after each one.
+	bool truncated = false;
+
+	ArchiveColumns config(3);
+	n = r.section(ServerArchive::Config);
+	for (quint32 i=0;i<n;++i) {
+		qds >> s1 >> s2;
+		config[0] << server_id;
+		config[1] << ServerArchive::text(s1);
+		config[2] << ServerArchive::text(s2);
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+
+	ArchiveColumns channels(5);
+	n = r.section(ServerArchive::Channels);
+	for (quint32 i=0;i<n;++i) {
+		qds >> a >> b >> s1 >> f;
+		channels[0] << server_id;
+		channels[1] << a;
+		channels[2] << ServerArchive::id(b);
+		channels[3] << ServerArchive::text(s1);
+		channels[4] << static_cast<int>(f);
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+
+	ArchiveColumns channelinfo(4);
+	n = r.section(ServerArchive::ChannelInfo);
+	for (quint32 i=0;i<n;++i) {
+		qds >> a >> b >> blob >> s1;
+		if (blob >= 0) {
+			if (! r.blob(blob, qbaBlob))
+				break;
+			s1 = qbaBlob;
+		}
+		channelinfo[0] << server_id;
+		channelinfo[1] << a;
+		channelinfo[2] << b;
+		channelinfo[3] << ServerArchive::text(s1);
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+	const bool channelblobs = (static_cast<quint32>(channelinfo[0].count()) == n);
+
+	ArchiveColumns links(3);
+	n = r.section(ServerArchive::Links);
+	for (quint32 i=0;i<n;++i) {
+		qds >> a >> b;
+		links[0] << server_id;
+		links[1] << a;
+		links[2] << b;
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+
+	ArchiveColumns users(7);
+	n = r.section(ServerArchive::Users);
+	for (quint32 i=0;i<n;++i) {
+		qds >> a >> s1 >> s2 >> b >> blob >> u;
+		qbaBlob = QByteArray();
+		if ((blob >= 0) && ! r.blob(blob, qbaBlob))
+			break;
+		users[0] << server_id;
+		users[1] << a;
+		users[2] << ServerArchive::text(s1);
+		users[3] << ServerArchive::text(s2);
+		users[4] << ServerArchive::id(b);
+		users[5] << (qbaBlob.isNull() ? QVariant(QVariant::ByteArray) : QVariant(qbaBlob));
+		users[6] << (u ? QVariant(QDateTime::fromTime_t(u).toUTC()) : QVariant(QVariant::DateTime));
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+	const bool userblobs = (static_cast<quint32>(users[0].count()) == n);
+
+	ArchiveColumns userinfo(4);
+	n = r.section(ServerArchive::UserInfo);
+	for (quint32 i=0;i<n;++i) {
+		qds >> a >> b >> blob >> s1;
+		if (blob >= 0) {
+			if (! r.blob(blob, qbaBlob))
+				break;
+			s1 = qbaBlob;
+		}
+		userinfo[0] << server_id;
+		userinfo[1] << a;
+		userinfo[2] << b;
+		userinfo[3] << ServerArchive::text(s1);
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+	const bool userinfoblobs = (static_cast<quint32>(userinfo[0].count()) == n);
+
+	// Group ids are assigned by the database, so these are inserted one by one.
+	ArchiveColumns groups(5);
+	n = r.section(ServerArchive::Groups);
+	for (quint32 i=0;i<n;++i) {
+		qds >> a >> b >> s1 >> f >> g;
+		groups[0] << a;
+		groups[1] << b;
+		groups[2] << ServerArchive::text(s1);
+		groups[3] << static_cast<int>(f);
+		groups[4] << static_cast<int>(g);
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+
+	ArchiveColumns members(4);
+	n = r.section(ServerArchive::GroupMembers);
+	for (quint32 i=0;i<n;++i) {
+		qds >> a >> b >> f;
+		members[0] << a;
+		members[1] << server_id;
+		members[2] << b;
+		members[3] << static_cast<int>(f);
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+
+	ArchiveColumns acls(9);
+	n = r.section(ServerArchive::ACL);
+	for (quint32 i=0;i<n;++i) {
+		qds >> a >> b >> c >> s1 >> f >> g >> u >> v;
+		acls[0] << server_id;
+		acls[1] << a;
+		acls[2] << b;
+		acls[3] << ServerArchive::id(c);
+		acls[4] << ServerArchive::text(s1);
+		acls[5] << static_cast<int>(f);
+		acls[6] << static_cast<int>(g);
+		acls[7] << u;
+		acls[8] << v;
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+
+	ArchiveColumns bans(8);
+	n = r.section(ServerArchive::Bans);
+	for (quint32 i=0;i<n;++i) {
+		qds >> s1 >> a >> s2 >> s3 >> qbaBlob >> u >> b;
+		bans[0] << server_id;
+		bans[1] << s1;
+		bans[2] << a;
+		bans[3] << ServerArchive::text(s2);
+		bans[4] << ServerArchive::text(s3);
+		bans[5] << ServerArchive::text(qbaBlob);
+		bans[6] << QDateTime::fromTime_t(u).toUTC();
+		bans[7] << b;
+	}
+	truncated = truncated || (qds.status() != QDataStream::Ok);
+
+	if (truncated) {
+		error = QLatin1String("Archive is truncated");
+		return false;
+	}
+	if (! channelblobs || ! userblobs || ! userinfoblobs) {
+		error = QLatin1String("Archive refers to a missing blob");
+		return false;
+	}
+	if (! checkReferences(channels, channelinfo, links, users, userinfo, groups, members, acls, error))
+		return false;
+
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
+
+	SQLPREP("SELECT `server_id` FROM `%1servers` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	if (! query.next()) {
+		SQLPREP("INSERT INTO `%1servers` (`server_id`) VALUES (?)");
+		query.addBindValue(server_id);
+		SQLEXEC();
+	}
+
+	// Children first, for databases with foreign keys.
+	SQLPREP("DELETE FROM `%1bans` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1channel_links` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1acl` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1group_members` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1groups` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1user_info` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1users` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1channel_info` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1channels` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	SQLPREP("DELETE FROM `%1config` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+
+	insertColumns(query, QLatin1String("INSERT INTO `%1config` (`server_id`, `key`, `value`) VALUES (?,?,?)"), config);
+	insertColumns(query, QLatin1String("INSERT INTO `%1channels` (`server_id`, `channel_id`, `parent_id`, `name`, `inheritacl`) VALUES (?,?,?,?,?)"), channels);
+	insertColumns(query, QLatin1String("INSERT INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (?,?,?,?)"), channelinfo);
+	insertColumns(query, QLatin1String("INSERT INTO `%1users` (`server_id`, `user_id`, `name`, `pw`, `lastchannel`, `texture`, `last_active`) VALUES (?,?,?,?,?,?,?)"), users, 5);
+	insertColumns(query, QLatin1String("INSERT INTO `%1user_info` (`server_id`, `user_id`, `key`, `value`) VALUES (?,?,?,?)"), userinfo);
+
+	QHash<int, int> groupids;
+	for (int i=0;i<groups[0].count();++i) {
+		SQLPREP("INSERT INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES (?,?,?,?,?)");
+		query.addBindValue(server_id);
+		query.addBindValue(groups[1].at(i));
+		query.addBindValue(groups[2].at(i));
+		query.addBindValue(groups[3].at(i));
+		query.addBindValue(groups[4].at(i));
+		SQLEXEC();
+		groupids.insert(groups[0].at(i).toInt(), query.lastInsertId().toInt());
+	}
+	ArchiveColumns memberids(4);
+	for (int i=0;i<members[0].count();++i) {
+		memberids[0] << groupids.value(members[0].at(i).toInt());
+		for (int j=1;j<4;++j)
+			memberids[j] << members[j].at(i);
+	}
+
+	insertColumns(query, QLatin1String("INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?,?,?,?)"), memberids);
+	insertColumns(query, QLatin1String("INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv`) VALUES (?,?,?,?,?,?,?,?,?)"), acls);
+	insertColumns(query, QLatin1String("INSERT INTO `%1channel_links` (`server_id`, `channel_id`, `link_id`) VALUES (?,?,?)"), links);
+	insertColumns(query, QLatin1String("INSERT INTO `%1bans` (`server_id`, `base`, `mask`, `name`, `hash`, `reason`, `start`, `duration`) VALUES (?,?,?,?,?,?,?,?)"), bans, 1);
+
+	return true;
+}
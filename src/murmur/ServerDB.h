@@ -32,30 +32,46 @@
 #define MUMBLE_MURMUR_DATABASE_H_
 
 #include <QtCore/QVariant>
+#include <QtSql/QSqlDatabase>
 
+#include "StatementCache.h"
 #include "Timer.h"
 
 class Channel;
 class User;
 class Connection;
-class QSqlDatabase;
 class QSqlQuery;
+class PasswordHash;
+class LogSink;
 
 class ServerDB {
 	public:
 		enum ChannelInfo { Channel_Description, Channel_Position };
-		enum UserInfo { User_Name, User_Email, User_Comment, User_Hash, User_Password, User_LastActive };
+		// User_KDF is only used internally and never handed out.
+		enum UserInfo { User_Name, User_Email, User_Comment, User_Hash, User_Password, User_LastActive, User_KDF = 100 };
+		// A database connection and its prepared statements.
+		struct Connection {
+			QString qsName;
+			QSqlDatabase qsdDatabase;
+			StatementCache scStatements;
+			Connection(const QSqlDatabase &db, const QString &name);
+			~Connection();
+		};
 		ServerDB();
 		~ServerDB();
 		typedef QPair<unsigned int, QString> LogRecord;
-		static Timer tLogClean;
+		static LogSink *lsLog;
 		static QSqlDatabase *db;
 		static QString qsUpgradeSuffix;
 		static void setSUPW(int iServNum, const QString &pw);
+		static void storePassword(QSqlQuery &query, int srvnum, int id, const QString &hash, const PasswordHash &ph);
+		static void upgradePassword(QSqlQuery &query, int srvnum, int id, const QString &oldhash, const QString &hash, const PasswordHash &ph);
 		static QList<int> getBootServers();
 		static QList<int> getAllServers();
 		static int addServer();
 		static void deleteServer(int server_id);
+		static bool exportServer(int server_id, const QString &path, QString &error);
+		static bool importServer(int server_id, const QString &path, QString &error);
 		static bool serverExists(int num);
 		static QMap<QString, QString> getAllConf(int server_id);
 		static QVariant getConf(int server_id, const QString &key, QVariant def = QVariant());
@@ -63,7 +79,12 @@ class ServerDB {
 		static QList<LogRecord> getLog(int server_id, unsigned int offs_min, unsigned int offs_max);
 		static int getLogLen(int server_id);
 		static void wipeLogs();
-		static bool prepare(QSqlQuery &, const QString &, bool fatal = true, bool warn = true);
+		static void startLog();
+		static void writeLog(const QVariantList &serverids, const QVariantList &msgs);
+		static bool expireLog(int chunk);
+		static Connection *connection();
+		static void configure(QSqlDatabase &);
+		static bool prepare(QSqlQuery &, const QString &, bool fatal = true, bool warn = true, bool cache = true);
 		static bool exec(QSqlQuery &, const QString &str = QString(), bool fatal= true, bool warn = true);
 		static bool execBatch(QSqlQuery &, const QString &str = QString(), bool fatal= true);
 		// No copy; private declaration without implementation
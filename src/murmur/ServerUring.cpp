@@ -0,0 +1,417 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include <liburing.h>
+
+#include "Meta.h"
+#include "Server.h"
+#include "ServerUser.h"
+
+#ifndef MAX
+#define MAX(a,b) ((a)>(b) ? (a):(b))
+#endif
+
+#define UDP_PACKET_SIZE 1024
+
+// Size of the submission queue. Fanout sends are queued here and submitted
+// in one go once all received datagrams of a completion batch are processed.
+#define URING_ENTRIES 1024
+// Number of receive buffers handed to the kernel. Must be a power of two.
+#define URING_BUFFERS 512
+// Each receive buffer holds an io_uring_recvmsg_out header, the source
+// address, the packet info control data and the datagram itself.
+#define URING_BUFFER_SIZE 2048
+#define URING_BUFFER_GROUP 1
+// Number of sendmsg() operations that may be in flight at once. If all slots
+// are busy, sendMessage() falls back to a plain sendmsg() call.
+#define URING_SENDS 256
+
+#define URING_OP_RECV 1ULL
+#define URING_OP_NOTIFY 2ULL
+#define URING_OP_SEND 3ULL
+
+struct UringSend {
+	struct msghdr msg;
+	struct iovec iov[1];
+	struct sockaddr_storage addr;
+	u_char controldata[CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo)))];
+	char buffer[UDP_PACKET_SIZE + 4];
+};
+
+class UringLoop {
+	private:
+		Q_DISABLE_COPY(UringLoop)
+	public:
+		struct io_uring ring;
+		struct io_uring_buf_ring *br;
+		char *buffers;
+		struct msghdr mhRecv;
+		QList<int> qlSockets;
+		UringSend *usSends;
+		QVector<int> qvFree;
+		bool bInit;
+		// Set once a multishot receive has delivered data. Until then, an
+		// EINVAL completion means the kernel doesn't support it.
+		bool bReceived;
+
+		UringLoop();
+		~UringLoop();
+		bool init(const QList<int> &sockets, QString &error);
+		struct io_uring_sqe *getSqe();
+		void armRecv(int idx);
+		void armNotify(int fd);
+		void recycle(unsigned short bid);
+		void drainSends();
+};
+
+UringLoop::UringLoop() {
+	memset(&ring, 0, sizeof(ring));
+	memset(&mhRecv, 0, sizeof(mhRecv));
+	br = NULL;
+	buffers = NULL;
+	usSends = NULL;
+	bInit = false;
+	bReceived = false;
+}
+
+UringLoop::~UringLoop() {
+	if (br)
+		io_uring_free_buf_ring(&ring, br, URING_BUFFERS, URING_BUFFER_GROUP);
+	if (bInit)
+		io_uring_queue_exit(&ring);
+	delete [] buffers;
+	delete [] usSends;
+}
+
+bool UringLoop::init(const QList<int> &sockets, QString &error) {
+	int ret = io_uring_queue_init(URING_ENTRIES, &ring, 0);
+	if (ret < 0) {
+		error = QString::fromLatin1("queue init: %1").arg(QString::fromLocal8Bit(strerror(-ret)));
+		return false;
+	}
+	bInit = true;
+
+	br = io_uring_setup_buf_ring(&ring, URING_BUFFERS, URING_BUFFER_GROUP, 0, &ret);
+	if (! br) {
+		error = QString::fromLatin1("buffer ring: %1").arg(QString::fromLocal8Bit(strerror(-ret)));
+		return false;
+	}
+
+	buffers = new char[URING_BUFFERS * URING_BUFFER_SIZE];
+	for (int i=0;i<URING_BUFFERS;++i)
+		io_uring_buf_ring_add(br, buffers + i * URING_BUFFER_SIZE, URING_BUFFER_SIZE, static_cast<unsigned short>(i), io_uring_buf_ring_mask(URING_BUFFERS), i);
+	io_uring_buf_ring_advance(br, URING_BUFFERS);
+
+	// The kernel lays out name, control data and payload back to back in each
+	// buffer. Like run(), make sure the payload after the 4 byte crypt header
+	// is 8 byte aligned.
+	size_t controllen = CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo))) + CMSG_SPACE(3 * sizeof(struct timespec));
+#if defined(__LP64__)
+	while (((sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_storage) + controllen) % 8) != 4)
+		++controllen;
+#endif
+	mhRecv.msg_namelen = sizeof(struct sockaddr_storage);
+	mhRecv.msg_controllen = controllen;
+
+	usSends = new UringSend[URING_SENDS];
+	qvFree.reserve(URING_SENDS);
+	for (int i=0;i<URING_SENDS;++i)
+		qvFree.append(i);
+
+	qlSockets = sockets;
+	return true;
+}
+
+struct io_uring_sqe *UringLoop::getSqe() {
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+	if (! sqe) {
+		io_uring_submit(&ring);
+		sqe = io_uring_get_sqe(&ring);
+	}
+	return sqe;
+}
+
+void UringLoop::armRecv(int idx) {
+	struct io_uring_sqe *sqe = getSqe();
+	if (! sqe)
+		return;
+	io_uring_prep_recvmsg_multishot(sqe, qlSockets.at(idx), &mhRecv, MSG_TRUNC);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	io_uring_sqe_set_data64(sqe, (URING_OP_RECV << 32) | static_cast<quint64>(idx));
+}
+
+void UringLoop::armNotify(int fd) {
+	struct io_uring_sqe *sqe = getSqe();
+	if (! sqe)
+		return;
+	io_uring_prep_poll_add(sqe, fd, POLLIN);
+	io_uring_sqe_set_data64(sqe, URING_OP_NOTIFY << 32);
+}
+
+void UringLoop::recycle(unsigned short bid) {
+	io_uring_buf_ring_add(br, buffers + bid * URING_BUFFER_SIZE, URING_BUFFER_SIZE, bid, io_uring_buf_ring_mask(URING_BUFFERS), 0);
+	io_uring_buf_ring_advance(br, 1);
+}
+
+void UringLoop::drainSends() {
+	io_uring_submit(&ring);
+	while (qvFree.count() < URING_SENDS) {
+		struct io_uring_cqe *cqe;
+		if (io_uring_wait_cqe(&ring, &cqe) < 0)
+			break;
+		quint64 data = io_uring_cqe_get_data64(cqe);
+		if ((data >> 32) == URING_OP_SEND)
+			qvFree.append(static_cast<int>(data & 0xffffffff));
+		else if (((data >> 32) == URING_OP_RECV) && (cqe->flags & IORING_CQE_F_BUFFER))
+			recycle(static_cast<unsigned short>(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+		io_uring_cqe_seen(&ring, cqe);
+	}
+}
+
+bool Server::runUring() {
+	UringLoop loop;
+	QString error;
+
+	if (! loop.init(qlUdpSocket, error)) {
+		log(QString("io_uring not available (%1), falling back to poll").arg(error));
+		return false;
+	}
+
+	for (int i=0;i<qlUdpSocket.count();++i)
+		loop.armRecv(i);
+	loop.armNotify(aiNotify[0]);
+
+	char buffer[UDP_PACKET_SIZE];
+	bool supported = true;
+	bool stop = false;
+
+	ulLoop = &loop;
+
+	while (bRunning && ! stop) {
+		int ret = io_uring_submit_and_wait(&loop.ring, 1);
+		if (ret < 0) {
+			if (ret == -EINTR)
+				continue;
+			qCritical("io_uring wait failure");
+			bRunning = false;
+			break;
+		}
+
+		struct io_uring_cqe *cqe;
+		unsigned int head;
+		unsigned int count = 0;
+
+		io_uring_for_each_cqe(&loop.ring, head, cqe) {
+			++count;
+
+			quint64 data = io_uring_cqe_get_data64(cqe);
+			int idx = static_cast<int>(data & 0xffffffff);
+
+			switch (data >> 32) {
+				case URING_OP_SEND:
+					loop.qvFree.append(idx);
+					continue;
+				case URING_OP_NOTIFY: {
+						// Drain pipe
+						unsigned char val;
+						while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {};
+						stop = true;
+						continue;
+					}
+				default:
+					break;
+			}
+
+			if (cqe->res < 0) {
+				if (((cqe->res == -EINVAL) || (cqe->res == -EOPNOTSUPP)) && ! loop.bReceived) {
+					supported = false;
+					stop = true;
+				} else if (! (cqe->flags & IORING_CQE_F_MORE)) {
+					// Typically ENOBUFS when we fall behind; just rearm.
+					loop.armRecv(idx);
+				}
+				continue;
+			}
+
+			if (! (cqe->flags & IORING_CQE_F_MORE))
+				loop.armRecv(idx);
+
+			if (! (cqe->flags & IORING_CQE_F_BUFFER))
+				continue;
+
+			unsigned short bid = static_cast<unsigned short>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+			loop.bReceived = true;
+
+			struct io_uring_recvmsg_out *o = io_uring_recvmsg_validate(loop.buffers + bid * URING_BUFFER_SIZE, cqe->res, &loop.mhRecv);
+			if (! o || (o->flags & MSG_TRUNC) || (o->payloadlen < 5) || (o->payloadlen > UDP_PACKET_SIZE)) {
+				// 4 bytes crypt header + type + session
+				loop.recycle(bid);
+				continue;
+			}
+
+			int sock = loop.qlSockets.at(idx);
+			int len = static_cast<int>(o->payloadlen);
+
+			smMetrics.mcUdpPacketsIn.add();
+			smMetrics.mcUdpBytesIn.add(len);
+			char *encrypt = static_cast<char *>(io_uring_recvmsg_payload(o, &loop.mhRecv));
+
+			// View of the received ancillary data, used for the ping reply.
+			struct msghdr cm;
+			memset(&cm, 0, sizeof(cm));
+			if (o->controllen) {
+				cm.msg_control = reinterpret_cast<char *>(io_uring_recvmsg_name(o)) + loop.mhRecv.msg_namelen;
+				cm.msg_controllen = o->controllen;
+			}
+			quint64 kernelTime = (Meta::mp.bVoiceStatsKernel && cm.msg_controllen) ? takeKernelTimestamp(&cm) : 0ULL;
+
+			sockaddr_storage from;
+			memset(&from, 0, sizeof(from));
+			memcpy(&from, io_uring_recvmsg_name(o), qMin(static_cast<size_t>(o->namelen), sizeof(from)));
+
+			QReadLocker rl(&qrwlUsers);
+
+			quint32 *ping = reinterpret_cast<quint32 *>(encrypt);
+
+			if ((len == 12) && (*ping == 0) && bAllowPing) {
+				ping[0] = uiVersionBlob;
+				// 1 and 2 will be the timestamp, which we return unmodified.
+				ping[3] = qToBigEndian(static_cast<quint32>(qhUsers.count()));
+				ping[4] = qToBigEndian(static_cast<quint32>(iMaxUsers));
+				ping[5] = qToBigEndian(static_cast<quint32>(iMaxBandwidth));
+
+				// Reply with the packet info we received, so the answer
+				// leaves from the address the ping was sent to.
+				struct msghdr msg;
+				struct iovec iov[1];
+
+				iov[0].iov_base = encrypt;
+				iov[0].iov_len = 6 * sizeof(quint32);
+
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_name = reinterpret_cast<struct sockaddr *>(&from);
+				msg.msg_namelen = o->namelen;
+				msg.msg_iov = iov;
+				msg.msg_iovlen = 1;
+				msg.msg_control = cm.msg_control;
+				msg.msg_controllen = cm.msg_controllen;
+
+				::sendmsg(sock, &msg, 0);
+				smMetrics.mcUdpPacketsOut.add();
+				smMetrics.mcUdpBytesOut.add(6 * sizeof(quint32));
+			} else {
+				PacketTrace pt;
+				PacketTrace *trace = NULL;
+				if (vsStats.sample()) {
+					pt.start(kernelTime, Timer::now());
+					trace = &pt;
+				}
+
+				ServerUser *u = findUdpUser(sock, from, encrypt, buffer, len);
+				if (u) {
+					if (trace)
+						trace->uiDecrypted = Timer::now();
+					processUdpMessage(u, buffer, len - 4, trace);
+				}
+			}
+
+			loop.recycle(bid);
+		}
+
+		io_uring_cq_advance(&loop.ring, count);
+	}
+
+	ulLoop = NULL;
+	loop.drainSends();
+
+	if (! supported) {
+		log("Kernel lacks multishot receive support for io_uring, falling back to poll");
+		return false;
+	}
+	return true;
+}
+
+// With io_uring, the send stage of a trace only covers queueing the
+// sendmsg(); the datagrams leave with the next submission.
+bool Server::queueUringSend(const VoiceRecipient &vr, const char *data, int len, PacketTrace *trace) {
+	UringLoop *l = ulLoop;
+
+	if (l->qvFree.isEmpty() || (len > UDP_PACKET_SIZE))
+		return false;
+
+	struct io_uring_sqe *sqe = l->getSqe();
+	if (! sqe)
+		return false;
+
+	int slot = l->qvFree.last();
+	l->qvFree.removeLast();
+
+	UringSend &us = l->usSends[slot];
+
+	quint64 t = trace ? Timer::now() : 0ULL;
+	vr.pUser->csCrypt.encrypt(reinterpret_cast<const unsigned char *>(data), reinterpret_cast<unsigned char *>(us.buffer), len);
+	if (trace) {
+		quint64 now = Timer::now();
+		trace->uiEncrypt += now - t;
+		t = now;
+	}
+
+	memcpy(&us.addr, &vr.saiUdpAddress, sizeof(vr.saiUdpAddress));
+	memset(us.controldata, 0, sizeof(us.controldata));
+	memset(&us.msg, 0, sizeof(us.msg));
+
+	us.iov[0].iov_base = us.buffer;
+	us.iov[0].iov_len = len + 4;
+
+	us.msg.msg_name = reinterpret_cast<struct sockaddr *>(&us.addr);
+	us.msg.msg_namelen = (us.addr.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+	us.msg.msg_iov = us.iov;
+	us.msg.msg_iovlen = 1;
+	us.msg.msg_control = us.controldata;
+	us.msg.msg_controllen = CMSG_SPACE((us.addr.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo) : sizeof(struct in_pktinfo));
+
+	if (setSourceAddress(vr, &us.msg)) {
+		io_uring_prep_sendmsg(sqe, vr.sUdpSocket, &us.msg, 0);
+		smMetrics.mcUdpPacketsOut.add();
+		smMetrics.mcUdpBytesOut.add(len + 4);
+	} else
+		io_uring_prep_nop(sqe);
+	io_uring_sqe_set_data64(sqe, (URING_OP_SEND << 32) | static_cast<quint64>(slot));
+
+	if (trace) {
+		trace->uiSend += Timer::now() - t;
+		++trace->iFanout;
+	}
+	return true;
+}
@@ -35,8 +35,9 @@
 #include "ServerUser.h"
 #include "Meta.h"
 
-ServerUser::ServerUser(Server *p, QSslSocket *socket) : Connection(p, socket), User(), s(NULL) {
+ServerUser::ServerUser(Server *p, QSslSocket *socket) : Connection(p, socket), User(), s(NULL), teTimeout(this), pDetails(new Details()) {
 	sState = ServerUser::Connected;
+	uiAuthRequest = 0;
 	sUdpSocket = INVALID_SOCKET;
 
 	memset(&saiUdpAddress, 0, sizeof(saiUdpAddress));
@@ -50,81 +51,134 @@ ServerUser::ServerUser(Server *p, QSslSocket *socket) : Connection(p, socket), U
 	uiVersion = 0;
 	bVerified = true;
 	iLastPermissionCheck = -1;
+	iMaxBandwidth = p->iMaxBandwidth;
 	
 	bOpus = false;
+	bMixed = false;
 }
 
+ServerUser::~ServerUser() {
+	if (! qbaTextureHash.isEmpty())
+		meta->bsBlobs.release(qbaTextureHash);
+	if (! qbaCommentHash.isEmpty())
+		meta->bsBlobs.release(qbaCommentHash);
+	delete pDetails;
+}
 
-ServerUser::operator const QString() const {
-	return QString::fromLatin1("%1:%2(%3)").arg(qsName).arg(uiSession).arg(iId);
+// Long comments are only kept in the BlobStore, which holds on to them for
+// as long as the user refers to them.
+QString ServerUser::comment() const {
+	if (qbaCommentHash.isEmpty())
+		return qsComment;
+
+	QByteArray qba;
+	meta->bsBlobs.get(qbaCommentHash, qba);
+	return QString::fromUtf8(qba);
 }
-BandwidthRecord::BandwidthRecord() {
-	iRecNum = 0;
-	iSum = 0;
-	for (int i=0;i<N_BANDWIDTH_SLOTS;i++)
-		a_iBW[i] = 0;
+
+qint64 ServerUser::bytesPending() const {
+	return qtsSocket->bytesToWrite();
 }
 
-bool BandwidthRecord::addFrame(int size, int maxpersec) {
-	quint64 elapsed = a_qtWhen[iRecNum].elapsed();
+void ServerUser::fillVoiceRecipient(VoiceRecipient &vr) const {
+	vr.pUser = const_cast<ServerUser *>(this);
+	vr.uiContext = contextHash(ssContext);
+	vr.uiFlags = 0;
+	if (bDeaf || bSelfDeaf)
+		vr.uiFlags |= VoiceRecipient::Deaf;
+	if (bMixed)
+		vr.uiFlags |= VoiceRecipient::Mixed;
+	if (bUdp)
+		vr.uiFlags |= VoiceRecipient::Udp;
+	vr.sUdpSocket = sUdpSocket;
+	// Whichever of sockaddr_in and sockaddr_in6 the family says it is.
+	memcpy(&vr.saiUdpAddress, &saiUdpAddress, sizeof(vr.saiUdpAddress));
+	vr.haTcpLocal = HostAddress(saiTcpLocalAddress);
+}
 
-	if (elapsed == 0)
-		return false;
+unsigned int ServerUser::contextHash(const std::string &context) {
+	return qHash(QByteArray::fromRawData(context.data(), static_cast<int>(context.size())));
+}
 
-	int nsum = iSum-a_iBW[iRecNum]+size;
-	int bw = static_cast<int>((nsum * 1000000LL) / elapsed);
+ServerUser::MemoryUsage::MemoryUsage() : iObject(0), iMetadata(0), iWhisper(0), iPermissions(0), iBuffers(0) {
+}
 
-	if (bw > maxpersec)
-		return false;
+qint64 ServerUser::MemoryUsage::total() const {
+	return iObject + iMetadata + iWhisper + iPermissions + iBuffers;
+}
 
-	a_iBW[iRecNum] = static_cast<unsigned short>(size);
-	a_qtWhen[iRecNum].restart();
+ServerUser::MemoryUsage &ServerUser::MemoryUsage::operator +=(const MemoryUsage &other) {
+	iObject += other.iObject;
+	iMetadata += other.iMetadata;
+	iWhisper += other.iWhisper;
+	iPermissions += other.iPermissions;
+	iBuffers += other.iBuffers;
+	return *this;
+}
 
-	iSum = nsum;
+// Shared empty containers cost nothing; anything else is counted as its
+// capacity plus a header. Map and hash nodes are estimated as the key and
+// value plus a few pointers of bookkeeping.
 
-	iRecNum++;
-	if (iRecNum == N_BANDWIDTH_SLOTS)
-		iRecNum = 0;
+static const qint64 iHeader = 3 * sizeof(void *);
+static const qint64 iNode = 4 * sizeof(void *);
 
-	return true;
+static qint64 stringBytes(const QString &str) {
+	return str.isNull() ? 0 : iHeader + str.capacity() * sizeof(QChar);
 }
 
-int BandwidthRecord::onlineSeconds() const {
-	return static_cast<int>(tFirst.elapsed() / 1000000LL);
+static qint64 stringBytes(const QByteArray &qba) {
+	return qba.isNull() ? 0 : iHeader + qba.capacity();
 }
 
-int BandwidthRecord::idleSeconds() const {
-	quint64 iIdle = a_qtWhen[(iRecNum + N_BANDWIDTH_SLOTS - 1) % N_BANDWIDTH_SLOTS].elapsed();
-	if (tIdleControl.elapsed() < iIdle)
-		iIdle = tIdleControl.elapsed();
-
-	return static_cast<int>(iIdle / 1000000LL);
+static qint64 stringBytes(const QStringList &qsl) {
+	qint64 bytes = qsl.isEmpty() ? 0 : iHeader + qsl.count() * sizeof(void *);
+	foreach(const QString &str, qsl)
+		bytes += stringBytes(str);
+	return bytes;
 }
 
-void BandwidthRecord::resetIdleSeconds() {
-	tIdleControl.restart();
+template <typename T>
+static qint64 setBytes(const QSet<T> &set) {
+	return set.isEmpty() ? 0 : iHeader + set.capacity() * sizeof(void *) + set.count() * (iNode + sizeof(T));
 }
 
-int BandwidthRecord::bandwidth() const {
-	int sum = 0;
-	int records = 0;
-	quint64 elapsed = 0ULL;
-
-	for (int i=1;i<N_BANDWIDTH_SLOTS;++i) {
-		int idx = (iRecNum + N_BANDWIDTH_SLOTS - i) % N_BANDWIDTH_SLOTS;
-		quint64 e = a_qtWhen[idx].elapsed();
-		if (e > 1000000ULL) {
-			break;
-		} else {
-			++records;
-			sum += a_iBW[idx];
-			elapsed = e;
-		}
+ServerUser::MemoryUsage ServerUser::memoryUsage() const {
+	MemoryUsage mu;
+
+	mu.iObject = sizeof(ServerUser) + sizeof(Details);
+
+	mu.iMetadata = stringBytes(qsName) + stringBytes(qsComment) + stringBytes(qbaCommentHash) + stringBytes(qsHash) + stringBytes(qbaTexture) + stringBytes(qbaTextureHash);
+	mu.iMetadata += stringBytes(pDetails->qsRelease) + stringBytes(pDetails->qsOS) + stringBytes(pDetails->qsOSVersion) + stringBytes(pDetails->qsIdentity);
+	mu.iMetadata += stringBytes(pDetails->qslEmail) + stringBytes(pDetails->qslAccessTokens);
+	if (! pDetails->qlCodecs.isEmpty())
+		mu.iMetadata += iHeader + pDetails->qlCodecs.count() * sizeof(void *);
+	QMap<QString, QString>::const_iterator i;
+	for (i = pDetails->qmWhisperRedirect.constBegin(); i != pDetails->qmWhisperRedirect.constEnd(); ++i)
+		mu.iMetadata += iNode + stringBytes(i.key()) + stringBytes(i.value());
+	if (ssContext.capacity() > 15)
+		mu.iMetadata += ssContext.capacity() + 1;
+
+	QMap<int, WhisperTarget>::const_iterator t;
+	for (t = qmTargets.constBegin(); t != qmTargets.constEnd(); ++t) {
+		const WhisperTarget &wt = t.value();
+		mu.iWhisper += iNode + sizeof(int) + sizeof(WhisperTarget);
+		mu.iWhisper += wt.qlSessions.count() * sizeof(void *);
+		foreach(const WhisperTarget::Channel &wtc, wt.qlChannels)
+			mu.iWhisper += sizeof(void *) + sizeof(WhisperTarget::Channel) + stringBytes(wtc.qsGroup);
 	}
+	QMap<int, TargetCache>::const_iterator c;
+	for (c = qmTargetCache.constBegin(); c != qmTargetCache.constEnd(); ++c)
+		mu.iWhisper += iNode + sizeof(int) + sizeof(TargetCache) + setBytes(c.value().first) + setBytes(c.value().second);
+
+	mu.iPermissions = smPermissionSent.heapBytes();
 
-	if (elapsed < 250000ULL)
-		return 0;
+	mu.iBuffers = qtsSocket->bytesToWrite() + qtsSocket->bytesAvailable() + qqBlobRequests.count() * (sizeof(void *) + sizeof(BlobRequest));
 
-	return static_cast<int>((sum * 1000000ULL) / elapsed);
+	return mu;
 }
 
+
+ServerUser::operator const QString() const {
+	return QString::fromLatin1("%1:%2(%3)").arg(qsName).arg(uiSession).arg(iId);
+}
@@ -32,41 +32,24 @@
 #ifndef MUMBLE_MURMUR_SERVERUSER_H_
 #define MUMBLE_MURMUR_SERVERUSER_H_
 
+#include <QtCore/QQueue>
 #include <QtCore/QStringList>
 
 #ifdef Q_OS_UNIX
 #include <sys/socket.h>
+#include <netinet/in.h>
 #else
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #endif
 
+#include "BandwidthRecord.h"
 #include "Connection.h"
 #include "Net.h"
-#include "Timer.h"
+#include "SmallMap.h"
+#include "TimerWheel.h"
 #include "User.h"
 
-// Unfortunately, this needs to be "large enough" to hold
-// enough frames to account for both short-term and
-// long-term "maladjustments".
-
-#define N_BANDWIDTH_SLOTS 360
-
-struct BandwidthRecord {
-	int iRecNum;
-	int iSum;
-	Timer tFirst;
-	Timer tIdleControl;
-	unsigned short a_iBW[N_BANDWIDTH_SLOTS];
-	Timer a_qtWhen[N_BANDWIDTH_SLOTS];
-
-	BandwidthRecord();
-	bool addFrame(int size, int maxpersec);
-	int onlineSeconds() const;
-	int idleSeconds() const;
-	void resetIdleSeconds();
-	int bandwidth() const;
-};
-
 struct WhisperTarget {
 	struct Channel {
 		int iId;
@@ -79,6 +62,35 @@ struct WhisperTarget {
 };
 
 class Server;
+class ServerUser;
+
+// What the voice fanout needs to know about one listener, packed into one
+// cache line on 64 bit Unix. The fanout walks an array of these per channel
+// instead of reading members spread over User, Connection and ServerUser
+// for every recipient. See Server::voiceRecipients for when it is refreshed.
+struct VoiceRecipient {
+	enum Flags { Deaf = 0x1, Mixed = 0x2, Udp = 0x4 };
+
+	ServerUser *pUser;
+	// ServerUser::contextHash of the positional audio context. Equal hashes
+	// are confirmed against the contexts themselves.
+	unsigned int uiContext;
+	unsigned int uiFlags;
+#ifdef Q_OS_UNIX
+	int sUdpSocket;
+#else
+	SOCKET sUdpSocket;
+#endif
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in sin;
+		struct sockaddr_in6 sin6;
+	} saiUdpAddress;
+	// Local address the TCP connection was accepted on, to send from.
+	HostAddress haTcpLocal;
+};
+
+Q_DECLARE_TYPEINFO(VoiceRecipient, Q_PRIMITIVE_TYPE);
 
 class ServerUser : public Connection, public User {
 	private:
@@ -88,48 +100,92 @@ class ServerUser : public Connection, public User {
 		Server *s;
 	public:
 		enum State { Connected, Authenticated };
-		State sState;
-		operator const QString() const;
-
-		float dUDPPingAvg, dUDPPingVar;
-		float dTCPPingAvg, dTCPPingVar;
-		quint64 uiUDPPackets, uiTCPPackets;
-
-		unsigned int uiVersion;
-		QString qsRelease;
-		QString qsOS;
-		QString qsOSVersion;
-
-		std::string ssContext;
-		QString qsIdentity;
-
-		bool bVerified;
-		QStringList qslEmail;
 
-		HostAddress haAddress;
+		// Client metadata that is set during login and only read for user
+		// state messages, Ice, the log and the occasional whisper cache
+		// rebuild. Kept out of line so it doesn't sit between the fields
+		// the voice path reads.
+		struct Details {
+			QString qsRelease;
+			QString qsOS;
+			QString qsOSVersion;
+			QString qsIdentity;
+			QStringList qslEmail;
+			QStringList qslAccessTokens;
+			QList<int> qlCodecs;
+			QMap<QString, QString> qmWhisperRedirect;
+		};
+
+		// Approximate memory held by one connection, by what it is for.
+		// Counts the objects themselves and the heap memory of their Qt
+		// containers, but not allocator overhead or the TLS library state.
+		struct MemoryUsage {
+			qint64 iObject;
+			qint64 iMetadata;
+			qint64 iWhisper;
+			qint64 iPermissions;
+			qint64 iBuffers;
+			MemoryUsage();
+			qint64 total() const;
+			MemoryUsage &operator +=(const MemoryUsage &other);
+		};
+
+		// Read for every voice packet this user sends or receives.
+		State sState;
 		bool bUdp;
-
-		QList<int> qlCodecs;
 		bool bOpus;
-
-		QStringList qslAccessTokens;
-
-		QMap<int, WhisperTarget> qmTargets;
-		typedef QPair<QSet<ServerUser *>, QSet<ServerUser *> > TargetCache;
-		QMap<int, TargetCache> qmTargetCache;
-		QMap<QString, QString> qmWhisperRedirect;
-
-		int iLastPermissionCheck;
-		QMap<int, unsigned int> qmPermissionSent;
+		// Receives the server side mix of its channel, see Server::updateMixing.
+		bool bMixed;
+		bool bVerified;
+		// Effective voice bandwidth limit in bits per second, see Server::updateBandwidthLimit.
+		int iMaxBandwidth;
 #ifdef Q_OS_UNIX
 		int sUdpSocket;
 #else
 		SOCKET sUdpSocket;
 #endif
 		BandwidthRecord bwr;
+		quint64 uiUDPPackets, uiTCPPackets;
+		unsigned int uiVersion;
+		std::string ssContext;
+
+		QMap<int, WhisperTarget> qmTargets;
+		typedef QPair<QSet<ServerUser *>, QSet<ServerUser *> > TargetCache;
+		QMap<int, TargetCache> qmTargetCache;
+
 		struct sockaddr_storage saiUdpAddress;
 		struct sockaddr_storage saiTcpLocalAddress;
+
+		// Everything below is only touched by control messages and timers.
+		TimerWheel::Entry teTimeout;
+		// Outstanding asynchronous authentication, or 0.
+		unsigned int uiAuthRequest;
+		float dUDPPingAvg, dUDPPingVar;
+		float dTCPPingAvg, dTCPPingVar;
+		HostAddress haAddress;
+
+		int iLastPermissionCheck;
+		// Permissions last sent per channel, flushed once it reaches 20 entries.
+		SmallMap<int, unsigned int, 4> smPermissionSent;
+
+		// Textures and comments this client asked for that are still to be
+		// sent, see Server::sendBlobs.
+		struct BlobRequest {
+			unsigned int uiSession;
+			bool bTexture;
+		};
+		QQueue<BlobRequest> qqBlobRequests;
+
+		Details *pDetails;
+
 		ServerUser(Server *parent, QSslSocket *socket);
+		~ServerUser();
+		operator const QString() const;
+		QString comment() const;
+		qint64 bytesPending() const;
+		MemoryUsage memoryUsage() const;
+		void fillVoiceRecipient(VoiceRecipient &vr) const;
+		static unsigned int contextHash(const std::string &context);
 };
 
 #endif
@@ -0,0 +1,131 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_SMALLMAP_H_
+#define MUMBLE_MURMUR_SMALLMAP_H_
+
+#include <QtCore/QVarLengthArray>
+
+// Map kept as a sorted array, with room for the first Prealloc entries
+// inside the object itself.
+//
+// Meant for the small per-user maps that QMap would otherwise give a
+// separately allocated header plus one node per entry. Lookups are a binary
+// search; inserting and removing move the entries after the position, which
+// is cheap for the handful of entries these maps hold.
+
+template <typename Key, typename T, int Prealloc = 4>
+class SmallMap {
+	public:
+		struct Entry {
+			Key key;
+			T value;
+		};
+	protected:
+		QVarLengthArray<Entry, Prealloc> qvlaEntries;
+
+		int lowerBound(const Key &key) const {
+			int lo = 0, hi = qvlaEntries.size();
+			while (lo < hi) {
+				int mid = (lo + hi) / 2;
+				if (qvlaEntries[mid].key < key)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			return lo;
+		}
+	public:
+		int count() const {
+			return qvlaEntries.size();
+		}
+
+		bool isEmpty() const {
+			return qvlaEntries.isEmpty();
+		}
+
+		// Entries in key order.
+		const Entry &at(int idx) const {
+			return qvlaEntries[idx];
+		}
+
+		bool contains(const Key &key) const {
+			int idx = lowerBound(key);
+			return (idx < qvlaEntries.size()) && ! (key < qvlaEntries[idx].key);
+		}
+
+		T value(const Key &key, const T &def = T()) const {
+			int idx = lowerBound(key);
+			if ((idx < qvlaEntries.size()) && ! (key < qvlaEntries[idx].key))
+				return qvlaEntries[idx].value;
+			return def;
+		}
+
+		void insert(const Key &key, const T &value) {
+			int idx = lowerBound(key);
+			if ((idx < qvlaEntries.size()) && ! (key < qvlaEntries[idx].key)) {
+				qvlaEntries[idx].value = value;
+				return;
+			}
+
+			const int n = qvlaEntries.size();
+			qvlaEntries.resize(n + 1);
+			for (int i=n;i>idx;--i)
+				qvlaEntries[i] = qvlaEntries[i-1];
+			qvlaEntries[idx].key = key;
+			qvlaEntries[idx].value = value;
+		}
+
+		bool remove(const Key &key) {
+			int idx = lowerBound(key);
+			if ((idx == qvlaEntries.size()) || (key < qvlaEntries[idx].key))
+				return false;
+
+			const int n = qvlaEntries.size();
+			for (int i=idx;i<n-1;++i)
+				qvlaEntries[i] = qvlaEntries[i+1];
+			// Shrinking destroys the last entry, so it doesn't hold on to
+			// what it referred to until it is reused.
+			qvlaEntries.resize(n - 1);
+			return true;
+		}
+
+		void clear() {
+			qvlaEntries.resize(0);
+		}
+
+		// Bytes allocated outside the object, if it outgrew its own storage.
+		int heapBytes() const {
+			return (qvlaEntries.capacity() > Prealloc) ? static_cast<int>(qvlaEntries.capacity() * sizeof(Entry)) : 0;
+		}
+};
+
+#endif
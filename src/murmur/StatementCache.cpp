@@ -0,0 +1,83 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "murmur_pch.h"
+
+#include "StatementCache.h"
+
+StatementCache::StatementCache(const QSqlDatabase &db, int size) : qsdDatabase(db), qcStatements(qMax(size, 0)) {
+	uiHits = uiMisses = 0ULL;
+}
+
+void StatementCache::setSize(int size) {
+	qcStatements.setMaxCost(qMax(size, 0));
+}
+
+int StatementCache::size() const {
+	return qcStatements.maxCost();
+}
+
+int StatementCache::count() const {
+	return qcStatements.count();
+}
+
+void StatementCache::clear() {
+	qcStatements.clear();
+}
+
+bool StatementCache::prepare(QSqlQuery &query, const QString &sql, bool *cached) {
+	// The caller is done with whatever it ran before.
+	if (query.isActive())
+		query.finish();
+
+	QSqlQuery *stmt = qcStatements.object(sql);
+	if (stmt && ! stmt->isActive()) {
+		++uiHits;
+		if (cached)
+			*cached = true;
+		query = *stmt;
+		return true;
+	}
+
+	++uiMisses;
+	if (cached)
+		*cached = false;
+
+	// A statement still in use stays with whoever is using it; the fresh one
+	// takes its place in the cache.
+	QSqlQuery fresh(qsdDatabase);
+	const bool ok = fresh.prepare(sql);
+	query = fresh;
+	if (ok && (qcStatements.maxCost() > 0))
+		qcStatements.insert(sql, new QSqlQuery(fresh));
+	else if (stmt)
+		qcStatements.remove(sql);
+	return ok;
+}
@@ -0,0 +1,69 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUMBLE_MURMUR_STATEMENTCACHE_H_
+#define MUMBLE_MURMUR_STATEMENTCACHE_H_
+
+#include <QtCore/QCache>
+#include <QtCore/QString>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+// Prepared statements of one database connection, least recently used
+// ones dropped first.
+//
+// prepare() points the caller's query at the cached statement, sharing its
+// result. A statement that is still active, because an outer caller has not
+// finished reading it, is not handed out again; the next caller gets a fresh
+// one, which then replaces it in the cache. Preparing the next statement
+// finishes the one the query had, so finish queries before dropping them to
+// keep their statements reusable.
+//
+// Like the connection, only usable from the thread that opened it.
+
+class StatementCache {
+	private:
+		Q_DISABLE_COPY(StatementCache)
+	protected:
+		QSqlDatabase qsdDatabase;
+		QCache<QString, QSqlQuery> qcStatements;
+	public:
+		quint64 uiHits;
+		quint64 uiMisses;
+
+		StatementCache(const QSqlDatabase &db, int size = 100);
+		void setSize(int size);
+		int size() const;
+		int count() const;
+		void clear();
+		bool prepare(QSqlQuery &query, const QString &sql, bool *cached = NULL);
+};
+
+#endif
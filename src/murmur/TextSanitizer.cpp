@@ -0,0 +1,341 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "TextSanitizer.h"
+
+namespace {
+
+struct Name {
+	int iPos;
+	int iLen;
+};
+
+inline bool isChar(ushort u) {
+	return (u >= 0x20 && u != 0xfffe && u != 0xffff) || (u == 0x9) || (u == 0xa) || (u == 0xd);
+}
+
+inline bool isSpace(ushort u) {
+	return (u == 0x20) || (u == 0x9) || (u == 0xa) || (u == 0xd);
+}
+
+inline bool isNameStart(const QChar &c) {
+	const ushort u = c.unicode();
+	if (u < 0x80)
+		return ((u >= 'a') && (u <= 'z')) || ((u >= 'A') && (u <= 'Z')) || (u == '_') || (u == ':');
+	return c.isLetter() || (u >= 0xd800);
+}
+
+inline bool isName(const QChar &c) {
+	const ushort u = c.unicode();
+	if (u < 0x80)
+		return isNameStart(c) || ((u >= '0') && (u <= '9')) || (u == '-') || (u == '.');
+	return isNameStart(c) || c.isDigit() || c.isMark() || (u == 0xb7);
+}
+
+inline bool isLatin(const QChar *s, const Name &n, const char *latin) {
+	int i = 0;
+	for (;i<n.iLen;++i)
+		if (! latin[i] || (s[n.iPos + i].unicode() != static_cast<ushort>(latin[i])))
+			return false;
+	return latin[i] == 0;
+}
+
+inline bool sameName(const QChar *s, const Name &a, const Name &b) {
+	return (a.iLen == b.iLen) && (memcmp(s + a.iPos, s + b.iPos, a.iLen * sizeof(QChar)) == 0);
+}
+
+inline bool startsWith(const QChar *s, int n, int i, const char *latin) {
+	for (;*latin;++latin, ++i)
+		if ((i >= n) || (s[i].unicode() != static_cast<ushort>(*latin)))
+			return false;
+	return true;
+}
+
+bool readName(const QChar *s, int n, int &i, Name &name) {
+	name.iPos = i;
+	if ((i >= n) || ! isNameStart(s[i]))
+		return false;
+	for (++i; (i < n) && isName(s[i]); ++i) {
+	}
+	name.iLen = i - name.iPos;
+	return true;
+}
+
+void skipSpace(const QChar *s, int n, int &i) {
+	while ((i < n) && isSpace(s[i].unicode()))
+		++i;
+}
+
+// Resolves the reference starting at the & in s[i], leaving i just past it.
+bool readReference(const QChar *s, int n, int &i, uint &code) {
+	int end = i + 1;
+	while ((end < n) && (s[end].unicode() != ';') && (end - i < 12))
+		++end;
+	if ((end >= n) || (s[end].unicode() != ';') || (end == i + 1))
+		return false;
+
+	const QChar *p = s + i + 1;
+	const int len = end - i - 1;
+
+	if (p[0].unicode() == '#') {
+		bool hex = (len > 1) && (p[1].unicode() == 'x');
+		int d = hex ? 2 : 1;
+		if (d >= len)
+			return false;
+		code = 0;
+		for (;d < len;++d) {
+			const ushort u = p[d].unicode();
+			uint v;
+			if ((u >= '0') && (u <= '9'))
+				v = u - '0';
+			else if (hex && (u >= 'a') && (u <= 'f'))
+				v = u - 'a' + 10;
+			else if (hex && (u >= 'A') && (u <= 'F'))
+				v = u - 'A' + 10;
+			else
+				return false;
+			code = code * (hex ? 16 : 10) + v;
+			if (code > 0x10ffff)
+				return false;
+		}
+		if (! ((code == 0x9) || (code == 0xa) || (code == 0xd) || ((code >= 0x20) && (code <= 0xd7ff)) || ((code >= 0xe000) && (code <= 0xfffd)) || (code >= 0x10000)))
+			return false;
+	} else {
+		const Name ref = { i + 1, len };
+		if (isLatin(s, ref, "lt"))
+			code = '<';
+		else if (isLatin(s, ref, "gt"))
+			code = '>';
+		else if (isLatin(s, ref, "amp"))
+			code = '&';
+		else if (isLatin(s, ref, "quot"))
+			code = '"';
+		else if (isLatin(s, ref, "apos"))
+			code = '\'';
+		else
+			return false;
+	}
+
+	i = end + 1;
+	return true;
+}
+
+void appendCode(QString *plain, uint code) {
+	if (code >= 0x10000) {
+		plain->append(QChar(QChar::highSurrogate(code)));
+		plain->append(QChar(QChar::lowSurrogate(code)));
+	} else {
+		plain->append(QChar(static_cast<ushort>(code)));
+	}
+}
+
+// Checks characters up to the terminator, which is not allowed to appear
+// in between, and leaves i just past it. Used for comments, CDATA sections
+// and processing instructions.
+bool skipUntil(const QChar *s, int n, int &i, const char *terminator, QString *plain) {
+	const int start = i;
+	while (i < n) {
+		if (startsWith(s, n, i, terminator)) {
+			if (plain)
+				plain->append(QString(s + start, i - start));
+			i += static_cast<int>(qstrlen(terminator));
+			return true;
+		}
+		if (! isChar(s[i].unicode()))
+			return false;
+		++i;
+	}
+	return false;
+}
+
+}
+
+// One pass over html. If plain is given, the text content is collected in
+// it; if stripped is given, it is set to the number of characters taken up
+// by the src attributes of <img> elements.
+bool TextSanitizer::scan(const QString &html, QString *plain, int *stripped) {
+	const QChar *s = html.unicode();
+	const int n = html.length();
+	QVarLengthArray<Name, 32> open;
+	QVarLengthArray<Name, 8> attributes;
+
+	if (plain) {
+		plain->clear();
+		plain->reserve(n);
+	}
+	if (stripped)
+		*stripped = 0;
+
+	int i = 0;
+	while (i < n) {
+		const ushort u = s[i].unicode();
+
+		if (u == '&') {
+			uint code;
+			if (! readReference(s, n, i, code))
+				return false;
+			if (plain)
+				appendCode(plain, code);
+			continue;
+		}
+
+		if (u != '<') {
+			// A run of plain text.
+			const int start = i;
+			while ((i < n) && (s[i].unicode() != '<') && (s[i].unicode() != '&')) {
+				const ushort c = s[i].unicode();
+				if (! isChar(c))
+					return false;
+				if ((c == '>') && (i - start >= 2) && (s[i - 1].unicode() == ']') && (s[i - 2].unicode() == ']'))
+					return false;
+				++i;
+			}
+			if (plain)
+				plain->append(QString(s + start, i - start));
+			continue;
+		}
+
+		if (startsWith(s, n, i, "</")) {
+			Name name;
+			i += 2;
+			if (! readName(s, n, i, name))
+				return false;
+			skipSpace(s, n, i);
+			if ((i >= n) || (s[i].unicode() != '>'))
+				return false;
+			++i;
+			if (open.isEmpty() || ! sameName(s, open[open.count() - 1], name))
+				return false;
+			open.resize(open.count() - 1);
+			if (plain && (isLatin(s, name, "br") || isLatin(s, name, "p")))
+				plain->append(QLatin1Char('\n'));
+		} else if (startsWith(s, n, i, "<!--")) {
+			i += 4;
+			if (! skipUntil(s, n, i, "--", NULL))
+				return false;
+			if ((i >= n) || (s[i].unicode() != '>'))
+				return false;
+			++i;
+		} else if (startsWith(s, n, i, "<![CDATA[")) {
+			i += 9;
+			if (! skipUntil(s, n, i, "]]>", plain))
+				return false;
+		} else if (startsWith(s, n, i, "<?")) {
+			Name target;
+			i += 2;
+			if (! readName(s, n, i, target))
+				return false;
+			if ((target.iLen == 3) && (html.midRef(target.iPos, 3).compare(QLatin1String("xml"), Qt::CaseInsensitive) == 0))
+				return false;
+			if ((i < n) && ! isSpace(s[i].unicode()) && ! startsWith(s, n, i, "?>"))
+				return false;
+			if (! skipUntil(s, n, i, "?>", NULL))
+				return false;
+		} else {
+			Name name;
+			++i;
+			if (! readName(s, n, i, name))
+				return false;
+			const bool img = isLatin(s, name, "img");
+
+			attributes.resize(0);
+			for (;;) {
+				const int space = i;
+				skipSpace(s, n, i);
+				if (i >= n)
+					return false;
+				if (s[i].unicode() == '>') {
+					++i;
+					open.append(name);
+					break;
+				}
+				if (startsWith(s, n, i, "/>")) {
+					i += 2;
+					if (plain && (isLatin(s, name, "br") || isLatin(s, name, "p")))
+						plain->append(QLatin1Char('\n'));
+					break;
+				}
+				if (i == space)
+					return false;
+
+				Name attr;
+				if (! readName(s, n, i, attr))
+					return false;
+				for (int j=0;j<attributes.count();++j)
+					if (sameName(s, attributes[j], attr))
+						return false;
+				attributes.append(attr);
+
+				skipSpace(s, n, i);
+				if ((i >= n) || (s[i].unicode() != '='))
+					return false;
+				++i;
+				skipSpace(s, n, i);
+				if ((i >= n) || ((s[i].unicode() != '"') && (s[i].unicode() != '\'')))
+					return false;
+				const ushort quote = s[i].unicode();
+				for (++i; (i < n) && (s[i].unicode() != quote);) {
+					const ushort c = s[i].unicode();
+					if (c == '&') {
+						uint code;
+						if (! readReference(s, n, i, code))
+							return false;
+					} else if ((c == '<') || ! isChar(c)) {
+						return false;
+					} else {
+						++i;
+					}
+				}
+				if (i >= n)
+					return false;
+				++i;
+
+				if (img && stripped && isLatin(s, attr, "src"))
+					*stripped += i - space;
+			}
+		}
+	}
+
+	return open.isEmpty();
+}
+
+bool TextSanitizer::toPlainText(const QString &html, QString &text) {
+	return scan(html, &text, NULL);
+}
+
+int TextSanitizer::textLength(const QString &html) {
+	int stripped;
+	if (! scan(html, NULL, &stripped))
+		return -1;
+	return html.length() - stripped;
+}
@@ -0,0 +1,57 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_TEXTSANITIZER_H_
+#define MUMBLE_MURMUR_TEXTSANITIZER_H_
+
+#include <QtCore/QString>
+
+// Checks the HTML of text messages and comments in a single pass over the
+// string, without building up the XML token stream QXmlStreamReader would.
+//
+// Messages have to be well-formed XML fragments: tags properly nested and
+// closed, attribute values quoted, and only the predefined and numeric
+// character references. Anything else is rejected, as it was when the
+// server parsed messages wrapped in a <document> element.
+
+class TextSanitizer {
+	protected:
+		static bool scan(const QString &html, QString *plain, int *stripped);
+	public:
+		// Text content with references resolved, and a line break after
+		// every <br> and </p>. Returns false if html is malformed.
+		static bool toPlainText(const QString &html, QString &text);
+		// Length of html not counting the src attributes of images, which
+		// fall under the separate image message limit; -1 if malformed.
+		static int textLength(const QString &html);
+};
+
+#endif
@@ -0,0 +1,187 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "TimerWheel.h"
+
+TimerWheel::Entry::Entry(void *data) : pPrev(NULL), pNext(NULL), twWheel(NULL), uiDeadline(0), pData(data) {
+}
+
+TimerWheel::Entry::~Entry() {
+	if (twWheel)
+		twWheel->remove(this);
+}
+
+bool TimerWheel::Entry::isScheduled() const {
+	return twWheel != NULL;
+}
+
+TimerWheel::TimerWheel(quint64 now) : uiNow(now), iCount(0) {
+	for (int l=0;l<Levels;++l)
+		for (int s=0;s<Slots;++s)
+			eSlots[l][s].pPrev = eSlots[l][s].pNext = &eSlots[l][s];
+}
+
+TimerWheel::~TimerWheel() {
+	for (int l=0;l<Levels;++l) {
+		for (int s=0;s<Slots;++s) {
+			Entry *head = &eSlots[l][s];
+			while (head->pNext != head)
+				remove(head->pNext);
+		}
+	}
+}
+
+quint64 TimerWheel::now() const {
+	return uiNow;
+}
+
+int TimerWheel::count() const {
+	return iCount;
+}
+
+void TimerWheel::link(Entry *e) {
+	const quint64 max = (1ULL << (SlotBits * Levels)) - 1;
+	quint64 delta = (e->uiDeadline > uiNow) ? e->uiDeadline - uiNow : 0ULL;
+	quint64 when = e->uiDeadline;
+	int level = 0;
+
+	if (delta == 0) {
+		// Already due; expire on the next tick.
+		when = uiNow + 1;
+	} else if (delta > max) {
+		when = uiNow + max;
+	}
+
+	delta = when - uiNow;
+	while ((level < Levels - 1) && (delta >= (1ULL << (SlotBits * (level + 1)))))
+		++level;
+
+	Entry *head = &eSlots[level][(when >> (SlotBits * level)) & (Slots - 1)];
+	e->pPrev = head->pPrev;
+	e->pNext = head;
+	head->pPrev->pNext = e;
+	head->pPrev = e;
+}
+
+void TimerWheel::unlink(Entry *e) {
+	e->pPrev->pNext = e->pNext;
+	e->pNext->pPrev = e->pPrev;
+	e->pPrev = e->pNext = NULL;
+}
+
+void TimerWheel::schedule(Entry *e, quint64 deadline) {
+	if (e->twWheel == this) {
+		if (e->uiDeadline == deadline)
+			return;
+		unlink(e);
+	} else {
+		if (e->twWheel)
+			e->twWheel->remove(e);
+		e->twWheel = this;
+		++iCount;
+	}
+	e->uiDeadline = deadline;
+	link(e);
+}
+
+void TimerWheel::remove(Entry *e) {
+	if (e->twWheel != this)
+		return;
+	unlink(e);
+	e->twWheel = NULL;
+	--iCount;
+}
+
+// Redistributes the current slot of a level over the levels below.
+void TimerWheel::cascade(int level) {
+	Entry *head = &eSlots[level][(uiNow >> (SlotBits * level)) & (Slots - 1)];
+	Entry *e = head->pNext;
+
+	head->pPrev = head->pNext = head;
+
+	while (e != head) {
+		Entry *next = e->pNext;
+		if (e->uiDeadline <= uiNow) {
+			// Due on this very tick, which is expired right after cascading.
+			Entry *due = &eSlots[0][uiNow & (Slots - 1)];
+			e->pPrev = due->pPrev;
+			e->pNext = due;
+			due->pPrev->pNext = e;
+			due->pPrev = e;
+		} else {
+			link(e);
+		}
+		e = next;
+	}
+}
+
+QList<void *> TimerWheel::advance(quint64 now) {
+	QList<void *> expired;
+
+	if (iCount == 0) {
+		if (now > uiNow)
+			uiNow = now;
+		return expired;
+	}
+
+	while (uiNow < now) {
+		++uiNow;
+
+		for (int level=1;level<Levels;++level) {
+			if ((uiNow & ((1ULL << (SlotBits * level)) - 1)) != 0)
+				break;
+			cascade(level);
+		}
+
+		Entry *head = &eSlots[0][uiNow & (Slots - 1)];
+		while (head->pNext != head) {
+			Entry *e = head->pNext;
+			unlink(e);
+			if (e->uiDeadline > uiNow) {
+				// Clamped to the range of the wheel earlier.
+				link(e);
+			} else {
+				e->twWheel = NULL;
+				--iCount;
+				expired << e->pData;
+			}
+		}
+
+		if (iCount == 0) {
+			uiNow = now;
+			break;
+		}
+	}
+
+	return expired;
+}
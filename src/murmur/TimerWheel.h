@@ -0,0 +1,81 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_TIMERWHEEL_H_
+#define MUMBLE_MURMUR_TIMERWHEEL_H_
+
+#include <QtCore/QList>
+
+// Hierarchical timer wheel with a resolution of one tick. Each level has 64
+// slots, each covering 64 times as many ticks as a slot of the level below;
+// entries move down a level when the wheel reaches their slot, so expiring
+// a tick only touches entries that are (nearly) due. Deadlines beyond the
+// range of the top level are clamped and rescheduled when reached.
+//
+// Entries are embedded in their owner and unlink themselves on destruction,
+// so scheduling, rescheduling and removal never allocate.
+
+class TimerWheel {
+	private:
+		Q_DISABLE_COPY(TimerWheel)
+	public:
+		struct Entry {
+			Entry *pPrev, *pNext;
+			TimerWheel *twWheel;
+			quint64 uiDeadline;
+			void *pData;
+
+			Entry(void *data = NULL);
+			~Entry();
+			bool isScheduled() const;
+		};
+	protected:
+		enum { Levels = 4, SlotBits = 6, Slots = 1 << SlotBits };
+		// Slot heads are sentinels of circular lists.
+		Entry eSlots[Levels][Slots];
+		quint64 uiNow;
+		int iCount;
+
+		void link(Entry *);
+		static void unlink(Entry *);
+		void cascade(int level);
+	public:
+		TimerWheel(quint64 now = 0);
+		~TimerWheel();
+		quint64 now() const;
+		int count() const;
+		void schedule(Entry *, quint64 deadline);
+		void remove(Entry *);
+		// Moves time forward and returns the data of all entries that expired.
+		QList<void *> advance(quint64 now);
+};
+
+#endif
@@ -0,0 +1,789 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "Trunk.h"
+#include "Channel.h"
+#include "Message.h"
+#include "Net.h"
+#include "PacketDataStream.h"
+#include "Server.h"
+#include "ServerUser.h"
+
+#include <openssl/hmac.h>
+
+// Most channels a node may send us.
+#define TRUNK_CHANNEL_LIMIT 8192
+
+bool Trunk::Presence::operator ==(const Presence &other) const {
+	return (iChannel == other.iChannel) && (uiFlags == other.uiFlags) && (qsName == other.qsName);
+}
+
+bool Trunk::Presence::operator !=(const Presence &other) const {
+	return ! (*this == other);
+}
+
+Trunk::Trunk(Server *p, const QHostAddress &address, quint16 port, quint32 node, const QByteArray &secret, const QString &peers) : QObject(p) {
+	server = p;
+	uiNode = node;
+	qbaSecret = secret;
+	uiNextSession = PhantomSessionBase;
+
+	qtsServer = new QTcpServer(this);
+	connect(qtsServer, SIGNAL(newConnection()), this, SLOT(newConnection()));
+	if (! qtsServer->listen(address, port))
+		server->log(QString("Trunk: Failed to listen on %1:%2: %3").arg(address.toString()).arg(port).arg(qtsServer->errorString()));
+
+	qusVoice = new QUdpSocket(this);
+	connect(qusVoice, SIGNAL(readyRead()), this, SLOT(voiceReadyRead()));
+	if (! qusVoice->bind(address, port))
+		server->log(QString("Trunk: Failed to bind voice socket to %1:%2: %3").arg(address.toString()).arg(port).arg(qusVoice->errorString()));
+	iVoiceSocket = qusVoice->socketDescriptor();
+
+	foreach(const QString &entry, peers.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+		const QString &peer = entry.trimmed();
+		const int colon = peer.lastIndexOf(QLatin1Char(':'));
+		bool ok = false;
+		const int peerport = peer.mid(colon + 1).toInt(&ok);
+		if ((colon <= 0) || ! ok || (peerport <= 0) || (peerport > 65535)) {
+			server->log(QString("Trunk: Ignoring invalid trunkpeers entry \"%1\"").arg(peer));
+			continue;
+		}
+
+		Link *l = new Link();
+		l->qsHost = peer.left(colon);
+		l->usPort = static_cast<quint16>(peerport);
+		l->bReady = false;
+		l->uiPeer = 0;
+		l->uiCounter = 0;
+		l->qtsSocket = new QTcpSocket(this);
+		connect(l->qtsSocket, SIGNAL(connected()), this, SLOT(linkConnected()));
+		connect(l->qtsSocket, SIGNAL(readyRead()), this, SLOT(linkReadyRead()));
+		connect(l->qtsSocket, SIGNAL(disconnected()), this, SLOT(linkDisconnected()));
+		qlLinks << l;
+	}
+
+	qtPoll = new QTimer(this);
+	connect(qtPoll, SIGNAL(timeout()), this, SLOT(poll()));
+	qtPoll->start(500);
+
+	qtReconnect = new QTimer(this);
+	connect(qtReconnect, SIGNAL(timeout()), this, SLOT(reconnect()));
+	qtReconnect->start(5000);
+
+	server->log(QString("Trunk: Node %1 listening on %2:%3 with %4 peers").arg(uiNode).arg(address.toString()).arg(port).arg(qlLinks.count()));
+	reconnect();
+}
+
+Trunk::~Trunk() {
+	{
+		QWriteLocker wl(&qrwlNodes);
+		qhNodes.clear();
+		qhPeers.clear();
+	}
+	qDeleteAll(qhSockets);
+	qDeleteAll(qlLinks);
+}
+
+bool Trunk::isListening() const {
+	return qtsServer->isListening();
+}
+
+void Trunk::frame(QTcpSocket *sock, const QByteArray &msg) {
+	unsigned char len[4];
+	qToBigEndian<quint32>(msg.size(), len);
+	sock->write(reinterpret_cast<const char *>(len), 4);
+	sock->write(msg);
+}
+
+bool Trunk::unframe(QTcpSocket *sock, QByteArray &buffer, QByteArray &msg) {
+	if (buffer.size() < 4)
+		return false;
+
+	const quint32 len = qFromBigEndian<quint32>(reinterpret_cast<const unsigned char *>(buffer.constData()));
+	if (len > 0x100000) {
+		sock->abort();
+		return false;
+	}
+	if (static_cast<quint32>(buffer.size()) < len + 4)
+		return false;
+
+	msg = buffer.mid(4, len);
+	buffer.remove(0, len + 4);
+	return true;
+}
+
+QByteArray Trunk::sign(const char *data, int len) const {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int mdlen = 0;
+
+	HMAC(EVP_sha1(), qbaSecret.constData(), qbaSecret.size(), reinterpret_cast<const unsigned char *>(data), len, md, &mdlen);
+	return QByteArray(reinterpret_cast<const char *>(md), mdlen);
+}
+
+QByteArray Trunk::proof(const QByteArray &nonce, quint32 node) const {
+	QByteArray data = nonce;
+	unsigned char id[4];
+	qToBigEndian<quint32>(node, id);
+	data.append(reinterpret_cast<const char *>(id), 4);
+	return sign(data.constData(), data.size());
+}
+
+QByteArray Trunk::presenceMessage(MessageType type, unsigned int session, const Presence &p) const {
+	QByteArray msg;
+	QDataStream ds(&msg, QIODevice::WriteOnly);
+	ds.setVersion(QDataStream::Qt_4_4);
+	ds << static_cast<quint8>(type) << static_cast<quint32>(session);
+	if (type == State)
+		ds << static_cast<qint32>(p.iChannel) << static_cast<quint32>(p.uiFlags) << p.qsName;
+	return msg;
+}
+
+// Our permanent channels, parents first.
+QByteArray Trunk::channelsMessage() const {
+	QList<Channel *> chans;
+	chans << server->qhChannels.value(0);
+	for (int i=0;i<chans.count();++i)
+		foreach(Channel *c, chans.at(i)->qlChannels)
+			if (! c->bTemporary)
+				chans << c;
+
+	QByteArray msg;
+	QDataStream ds(&msg, QIODevice::WriteOnly);
+	ds.setVersion(QDataStream::Qt_4_4);
+	ds << static_cast<quint8>(Channels) << static_cast<quint32>(chans.count());
+	foreach(Channel *c, chans)
+		ds << static_cast<qint32>(c->iId) << static_cast<qint32>(c->cParent ? c->cParent->iId : -1) << c->qsName;
+	return msg;
+}
+
+// Our own channels and users, as sent over each link.
+void Trunk::poll() {
+	QHash<unsigned int, Presence> current;
+	QList<QByteArray> changes;
+
+	const QByteArray &channels = channelsMessage();
+	if (channels != qbaChannels) {
+		qbaChannels = channels;
+		changes << channels;
+	}
+
+	foreach(ServerUser *u, server->qhUsers) {
+		if ((u->sState != ServerUser::Authenticated) || ! u->cChannel)
+			continue;
+
+		Presence p;
+		p.iChannel = u->cChannel->iId;
+		p.qsName = u->qsName;
+		p.uiFlags = 0;
+		if (u->bMute)
+			p.uiFlags |= Mute;
+		if (u->bDeaf)
+			p.uiFlags |= Deaf;
+		if (u->bSuppress)
+			p.uiFlags |= Suppress;
+		if (u->bSelfMute)
+			p.uiFlags |= SelfMute;
+		if (u->bSelfDeaf)
+			p.uiFlags |= SelfDeaf;
+		if (u->bPrioritySpeaker)
+			p.uiFlags |= PrioritySpeaker;
+		current.insert(u->uiSession, p);
+
+		QHash<unsigned int, Presence>::const_iterator i = qhLocal.constFind(u->uiSession);
+		if ((i == qhLocal.constEnd()) || (i.value() != p))
+			changes << presenceMessage(State, u->uiSession, p);
+	}
+
+	QHash<unsigned int, Presence>::const_iterator i;
+	for (i = qhLocal.constBegin(); i != qhLocal.constEnd(); ++i)
+		if (! current.contains(i.key()))
+			changes << presenceMessage(Remove, i.key(), i.value());
+
+	qhLocal = current;
+
+	if (changes.isEmpty())
+		return;
+
+	foreach(Link *l, qlLinks)
+		if (l->bReady)
+			foreach(const QByteArray &msg, changes)
+				frame(l->qtsSocket, msg);
+}
+
+void Trunk::reconnect() {
+	foreach(Link *l, qlLinks) {
+		if (l->qtsSocket->state() == QAbstractSocket::UnconnectedState) {
+			dropLink(l);
+			l->qbaBuffer.clear();
+			l->qtsSocket->connectToHost(l->qsHost, l->usPort);
+		}
+	}
+}
+
+Trunk::Link *Trunk::link(QObject *socket) const {
+	foreach(Link *l, qlLinks)
+		if (l->qtsSocket == socket)
+			return l;
+	return NULL;
+}
+
+void Trunk::dropLink(Link *l) {
+	QWriteLocker wl(&qrwlNodes);
+	if (qhPeers.value(l->uiPeer) == l)
+		qhPeers.remove(l->uiPeer);
+	l->bReady = false;
+	l->uiPeer = 0;
+	l->qbaKey.clear();
+}
+
+void Trunk::linkConnected() {
+	Link *l = link(sender());
+	if (l)
+		server->log(QString("Trunk: Connected to %1:%2").arg(l->qsHost).arg(l->usPort));
+}
+
+void Trunk::linkDisconnected() {
+	Link *l = link(sender());
+	if (! l)
+		return;
+	if (l->bReady)
+		server->log(QString("Trunk: Lost connection to %1:%2").arg(l->qsHost).arg(l->usPort));
+	dropLink(l);
+}
+
+void Trunk::linkReadyRead() {
+	Link *l = link(sender());
+	if (! l)
+		return;
+
+	l->qbaBuffer.append(l->qtsSocket->readAll());
+
+	QByteArray msg;
+	while (unframe(l->qtsSocket, l->qbaBuffer, msg)) {
+		if (! linkMessage(l, msg)) {
+			l->qtsSocket->abort();
+			return;
+		}
+	}
+}
+
+// The only thing a node sends back is the challenge; once answered, it gets
+// our channels and users and from then on the changes. Voice we send it is
+// signed with a key derived from the challenge.
+bool Trunk::linkMessage(Link *l, const QByteArray &msg) {
+	QDataStream ds(msg);
+	ds.setVersion(QDataStream::Qt_4_4);
+
+	quint8 type;
+	QByteArray nonce;
+	quint32 peer;
+	ds >> type >> nonce >> peer;
+	if ((ds.status() != QDataStream::Ok) || (type != Challenge) || l->bReady || (peer == uiNode))
+		return false;
+
+	{
+		QWriteLocker wl(&qrwlNodes);
+		l->uiPeer = peer;
+		l->qbaKey = TrunkVoice::key(qbaSecret, nonce, uiNode);
+		l->uiCounter = 0;
+		qhPeers.insert(peer, l);
+	}
+
+	QByteArray hello;
+	QDataStream hs(&hello, QIODevice::WriteOnly);
+	hs.setVersion(QDataStream::Qt_4_4);
+	hs << static_cast<quint8>(Hello) << static_cast<quint32>(uiNode) << static_cast<quint16>(qusVoice->localPort()) << proof(nonce, uiNode);
+	frame(l->qtsSocket, hello);
+
+	frame(l->qtsSocket, channelsMessage());
+
+	QByteArray snapshot;
+	QDataStream ss(&snapshot, QIODevice::WriteOnly);
+	ss.setVersion(QDataStream::Qt_4_4);
+	ss << static_cast<quint8>(Snapshot) << static_cast<quint32>(qhLocal.count());
+	QHash<unsigned int, Presence>::const_iterator i;
+	for (i = qhLocal.constBegin(); i != qhLocal.constEnd(); ++i)
+		ss << static_cast<quint32>(i.key()) << static_cast<qint32>(i.value().iChannel) << static_cast<quint32>(i.value().uiFlags) << i.value().qsName;
+	frame(l->qtsSocket, snapshot);
+
+	l->bReady = true;
+	return true;
+}
+
+void Trunk::newConnection() {
+	while (qtsServer->hasPendingConnections()) {
+		QTcpSocket *sock = qtsServer->nextPendingConnection();
+
+		Node *n = new Node();
+		n->uiNode = 0;
+		n->qtsSocket = sock;
+		n->bAuthenticated = false;
+		n->qbaNonce.resize(16);
+		RAND_bytes(reinterpret_cast<unsigned char *>(n->qbaNonce.data()), n->qbaNonce.size());
+		memset(&n->saiVoice, 0, sizeof(n->saiVoice));
+		qhSockets.insert(sock, n);
+
+		connect(sock, SIGNAL(readyRead()), this, SLOT(nodeReadyRead()));
+		connect(sock, SIGNAL(disconnected()), this, SLOT(nodeDisconnected()));
+
+		QByteArray msg;
+		QDataStream ds(&msg, QIODevice::WriteOnly);
+		ds.setVersion(QDataStream::Qt_4_4);
+		ds << static_cast<quint8>(Challenge) << n->qbaNonce << static_cast<quint32>(uiNode);
+		frame(sock, msg);
+	}
+}
+
+void Trunk::nodeDisconnected() {
+	QTcpSocket *sock = qobject_cast<QTcpSocket *>(sender());
+	Node *n = qhSockets.take(sock);
+	if (n) {
+		if (n->bAuthenticated)
+			server->log(QString("Trunk: Node %1 disconnected").arg(n->uiNode));
+		dropNode(n);
+		delete n;
+	}
+	if (sock)
+		sock->deleteLater();
+}
+
+void Trunk::nodeReadyRead() {
+	QTcpSocket *sock = qobject_cast<QTcpSocket *>(sender());
+	Node *n = qhSockets.value(sock);
+	if (! n)
+		return;
+
+	n->qbaBuffer.append(sock->readAll());
+
+	QByteArray msg;
+	while (unframe(sock, n->qbaBuffer, msg)) {
+		if (! nodeMessage(n, msg)) {
+			sock->abort();
+			return;
+		}
+	}
+}
+
+bool Trunk::nodeMessage(Node *n, const QByteArray &msg) {
+	QDataStream ds(msg);
+	ds.setVersion(QDataStream::Qt_4_4);
+
+	quint8 type;
+	ds >> type;
+
+	if (! n->bAuthenticated) {
+		quint32 node;
+		quint16 port;
+		QByteArray mac;
+		ds >> node >> port >> mac;
+
+		if ((ds.status() != QDataStream::Ok) || (type != Hello) || (node == uiNode) || (mac != proof(n->qbaNonce, node))) {
+			server->log(QString("Trunk: Rejected connection from %1").arg(n->qtsSocket->peerAddress().toString()));
+			return false;
+		}
+
+		// A node that reconnects replaces its old connection.
+		Node *old = qhNodes.value(node);
+		if (old) {
+			dropNode(old);
+			old->qtsSocket->abort();
+		}
+
+		n->uiNode = node;
+		n->bAuthenticated = true;
+		n->qbaKey = TrunkVoice::key(qbaSecret, n->qbaNonce, node);
+		n->qbaNonce.clear();
+
+		HostAddress(n->qtsSocket->peerAddress()).toSockaddr(&n->saiVoice);
+		if (n->saiVoice.ss_family == AF_INET6)
+			reinterpret_cast<struct sockaddr_in6 *>(&n->saiVoice)->sin6_port = htons(port);
+		else
+			reinterpret_cast<struct sockaddr_in *>(&n->saiVoice)->sin_port = htons(port);
+
+		{
+			QWriteLocker wl(&qrwlNodes);
+			qhNodes.insert(node, n);
+		}
+
+		server->log(QString("Trunk: Node %1 connected from %2").arg(node).arg(n->qtsSocket->peerAddress().toString()));
+		return true;
+	}
+
+	if (type == Channels) {
+		if (! mapChannels(n, ds))
+			return false;
+	} else if (type == Snapshot) {
+		quint32 count;
+		ds >> count;
+
+		QSet<unsigned int> seen;
+		for (quint32 i=0;(i<count) && (ds.status() == QDataStream::Ok);++i) {
+			quint32 session;
+			qint32 channel;
+			quint32 flags;
+			Presence p;
+			ds >> session >> channel >> flags >> p.qsName;
+			if (ds.status() != QDataStream::Ok)
+				break;
+			p.iChannel = channel;
+			p.uiFlags = flags;
+			setPresence(n, session, p);
+			seen.insert(session);
+		}
+
+		foreach(unsigned int remote, n->qhSessions.keys())
+			if (! seen.contains(remote))
+				removePresence(n, remote);
+	} else if (type == State) {
+		quint32 session;
+		qint32 channel;
+		quint32 flags;
+		Presence p;
+		ds >> session >> channel >> flags >> p.qsName;
+		if (ds.status() != QDataStream::Ok)
+			return false;
+		p.iChannel = channel;
+		p.uiFlags = flags;
+		setPresence(n, session, p);
+	} else if (type == Remove) {
+		quint32 session;
+		ds >> session;
+		removePresence(n, session);
+	} else {
+		return false;
+	}
+
+	return (ds.status() == QDataStream::Ok);
+}
+
+// Matches the channels of a node to ours by parent and name, creating the
+// ones we lack. A channel stays matched to the same one of ours for as long
+// as that exists, so a rename on either side doesn't create another.
+bool Trunk::mapChannels(Node *n, QDataStream &ds) {
+	quint32 count;
+	ds >> count;
+	if ((ds.status() != QDataStream::Ok) || (count > TRUNK_CHANNEL_LIMIT))
+		return false;
+
+	QHash<int, int> map;
+	for (quint32 i=0;i<count;++i) {
+		qint32 id, parent;
+		QString name;
+		ds >> id >> parent >> name;
+		if (ds.status() != QDataStream::Ok)
+			return false;
+
+		if (id == 0) {
+			map.insert(0, 0);
+			continue;
+		}
+
+		// Children of channels we couldn't match stay unmatched too.
+		Channel *p = map.contains(parent) ? server->qhChannels.value(map.value(parent)) : NULL;
+		if (! p)
+			continue;
+
+		Channel *c = NULL;
+		if (n->qhChannelMap.contains(id))
+			c = server->qhChannels.value(n->qhChannelMap.value(id));
+		if (! c) {
+			foreach(Channel *child, p->qlChannels) {
+				if (child->qsName == name) {
+					c = child;
+					break;
+				}
+			}
+		}
+		if (! c) {
+			if (name.isEmpty() || (name.length() > 512) || ! server->validateChannelName(name) || ! server->canNest(p)) {
+				server->log(QString("Trunk: Not adding channel \"%1\" from node %2").arg(name.left(512)).arg(n->uiNode));
+				continue;
+			}
+
+			c = server->addChannel(p, name);
+			server->updateChannel(c);
+
+			MumbleProto::ChannelState mpcs;
+			mpcs.set_channel_id(c->iId);
+			mpcs.set_parent(p->iId);
+			mpcs.set_name(u8(name));
+			server->sendAll(mpcs);
+
+			server->log(QString("Trunk: Added channel %1 under %2 from node %3").arg(QString(*c), QString(*p)).arg(n->uiNode));
+		}
+		map.insert(id, c->iId);
+	}
+
+	n->qhChannelMap = map;
+
+	foreach(unsigned int session, n->qhSessions) {
+		Phantom &ph = qhPhantoms[session];
+		const int local = localChannel(n, ph.pPresence.iChannel);
+		if (local != ph.iChannel) {
+			moveUser(n, ph.iChannel, local);
+			ph.iChannel = local;
+			sendPhantom(session, ph);
+		}
+	}
+	return true;
+}
+
+int Trunk::localChannel(Node *n, int remote) const {
+	QHash<int, int>::const_iterator i = n->qhChannelMap.constFind(remote);
+	if ((i == n->qhChannelMap.constEnd()) || ! server->qhChannels.contains(i.value()))
+		return -1;
+	return i.value();
+}
+
+// Moves a user of the node between local channels, -1 being none.
+void Trunk::moveUser(Node *n, int from, int to) {
+	if (from == to)
+		return;
+
+	QWriteLocker wl(&qrwlNodes);
+	if ((from >= 0) && (--n->qhChannelUsers[from] <= 0))
+		n->qhChannelUsers.remove(from);
+	if (to >= 0)
+		++n->qhChannelUsers[to];
+}
+
+void Trunk::setPresence(Node *n, unsigned int remote, const Presence &p) {
+	if (p.qsName.isEmpty() || (p.qsName.length() > 512))
+		return;
+
+	unsigned int session = n->qhSessions.value(remote);
+	const int local = localChannel(n, p.iChannel);
+
+	if (session) {
+		Phantom &ph = qhPhantoms[session];
+		if ((ph.pPresence == p) && (ph.iChannel == local))
+			return;
+
+		moveUser(n, ph.iChannel, local);
+		ph.pPresence = p;
+		ph.iChannel = local;
+		sendPhantom(session, ph);
+	} else {
+		session = uiNextSession++;
+
+		Phantom ph;
+		ph.nNode = n;
+		ph.uiRemote = remote;
+		ph.pPresence = p;
+		ph.iChannel = local;
+		qhPhantoms.insert(session, ph);
+
+		{
+			QWriteLocker wl(&qrwlNodes);
+			n->qhSessions.insert(remote, session);
+		}
+		moveUser(n, -1, local);
+		sendPhantom(session, ph);
+	}
+}
+
+void Trunk::removePresence(Node *n, unsigned int remote) {
+	const unsigned int session = n->qhSessions.value(remote);
+	if (! session)
+		return;
+
+	const Phantom ph = qhPhantoms.take(session);
+
+	{
+		QWriteLocker wl(&qrwlNodes);
+		n->qhSessions.remove(remote);
+	}
+	moveUser(n, ph.iChannel, -1);
+
+	MumbleProto::UserRemove mpur;
+	mpur.set_session(session);
+	server->sendAll(mpur);
+}
+
+void Trunk::dropNode(Node *n) {
+	foreach(unsigned int remote, n->qhSessions.keys())
+		removePresence(n, remote);
+
+	QWriteLocker wl(&qrwlNodes);
+	if (qhNodes.value(n->uiNode) == n)
+		qhNodes.remove(n->uiNode);
+	n->bAuthenticated = false;
+}
+
+void Trunk::sendPhantom(unsigned int session, const Phantom &ph, ServerUser *to) {
+	const Presence &p = ph.pPresence;
+
+	MumbleProto::UserState mpus;
+	mpus.set_session(session);
+	mpus.set_name(u8(p.qsName));
+	// Users in channels we have no match for show up in the root.
+	mpus.set_channel_id((ph.iChannel >= 0) ? ph.iChannel : 0);
+	mpus.set_mute((p.uiFlags & Mute) != 0);
+	mpus.set_deaf((p.uiFlags & Deaf) != 0);
+	mpus.set_suppress((p.uiFlags & Suppress) != 0);
+	mpus.set_self_mute((p.uiFlags & SelfMute) != 0);
+	mpus.set_self_deaf((p.uiFlags & SelfDeaf) != 0);
+	mpus.set_priority_speaker((p.uiFlags & PrioritySpeaker) != 0);
+
+	if (to)
+		server->sendMessage(to, mpus);
+	else
+		server->sendAll(mpus);
+}
+
+void Trunk::sendUsers(ServerUser *u) {
+	QHash<unsigned int, Phantom>::const_iterator i;
+	for (i = qhPhantoms.constBegin(); i != qhPhantoms.constEnd(); ++i)
+		sendPhantom(i.key(), i.value(), u);
+}
+
+// Called from the voice thread for normal speech of a local user, with the
+// voice data as received minus the header and positional audio, and the
+// linked channels the user may speak in.
+void Trunk::forward(ServerUser *u, Channel *c, const TrunkVoice::Channels &linked, unsigned int type, const char *data, int len) {
+	QReadLocker rl(&qrwlNodes);
+	if (qhNodes.isEmpty())
+		return;
+
+	TrunkVoice::Header h;
+	h.uiNode = uiNode;
+	h.uiSession = u->uiSession;
+	h.uiType = type;
+	h.qvlaChannels.append(c->iId);
+	h.qvlaChannels.append(linked.constData(), qMin(linked.count(), TrunkVoice::MaxChannels - 1));
+
+	char buffer[TrunkVoice::MaxPacketSize];
+
+	foreach(Node *n, qhNodes) {
+		bool wanted = false;
+		for (int i=0;i<h.qvlaChannels.count();++i) {
+			if (n->qhChannelUsers.contains(h.qvlaChannels.at(i))) {
+				wanted = true;
+				break;
+			}
+		}
+		if (! wanted)
+			continue;
+
+		// The key comes with our own connection to the node.
+		Link *l = qhPeers.value(n->uiNode);
+		if (! l)
+			continue;
+
+		{
+			QMutexLocker ml(&qmCounters);
+			h.uiCounter = l->uiCounter++;
+		}
+
+		const int size = TrunkVoice::seal(l->qbaKey, h, data, len, buffer, sizeof(buffer));
+		if (! size)
+			continue;
+
+		::sendto(iVoiceSocket, buffer, size, 0, reinterpret_cast<struct sockaddr *>(&n->saiVoice), (n->saiVoice.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+	}
+}
+
+// Voice from other nodes, forwarded to local listeners like normal speech.
+// The speaker has to be unmuted and in the channel the node says they are
+// in, and reaches only the linked channels their node let them speak in.
+void Trunk::voiceReadyRead() {
+	char buffer[TrunkVoice::MaxPacketSize];
+	char out[TrunkVoice::MaxPacketSize];
+
+	while (qusVoice->hasPendingDatagrams()) {
+		QHostAddress senderAddress;
+		const qint64 size = qusVoice->readDatagram(buffer, sizeof(buffer), &senderAddress);
+		quint32 node;
+		if ((size <= 0) || ! TrunkVoice::peekNode(buffer, static_cast<int>(size), node))
+			continue;
+
+		Node *n = qhNodes.value(node);
+		if (! n || ! n->bAuthenticated || ! (HostAddress(senderAddress) == HostAddress(n->qtsSocket->peerAddress())))
+			continue;
+
+		TrunkVoice::Header h;
+		const char *data;
+		int datalen;
+		if (! TrunkVoice::open(n->qbaKey, buffer, static_cast<int>(size), h, data, datalen))
+			continue;
+		if (! n->rwVoice.accept(h.uiCounter))
+			continue;
+
+		const unsigned int type = h.uiType & 0xe0;
+		if ((type >> 5) == MessageHandler::UDPPing)
+			continue;
+
+		const unsigned int session = n->qhSessions.value(h.uiSession);
+		QHash<unsigned int, Phantom>::const_iterator i = qhPhantoms.constFind(session);
+		if (! session || (i == qhPhantoms.constEnd()))
+			continue;
+
+		const Phantom &ph = i.value();
+		if ((ph.pPresence.iChannel != h.qvlaChannels.at(0)) || (ph.pPresence.uiFlags & (Mute | Suppress | SelfMute)))
+			continue;
+
+		Channel *c = server->qhChannels.value(ph.iChannel);
+		if (! c)
+			continue;
+
+		QSet<Channel *> chans;
+		chans.insert(c);
+		if (! c->qhLinks.isEmpty() && (h.qvlaChannels.count() > 1)) {
+			const QSet<Channel *> &links = c->allLinks();
+			for (int j=1;j<h.qvlaChannels.count();++j) {
+				Channel *l = server->qhChannels.value(localChannel(n, h.qvlaChannels.at(j)));
+				if (l && links.contains(l))
+					chans.insert(l);
+			}
+		}
+
+		PacketDataStream pds(out + 1, TrunkVoice::MaxPacketSize - 1);
+		out[0] = static_cast<char>(type);
+		pds << session;
+		pds.append(data, static_cast<quint32>(datalen));
+		if (! pds.isValid())
+			continue;
+		const int len = pds.size() + 1;
+
+		QReadLocker rl(&server->qrwlUsers);
+		QByteArray cache;
+
+		foreach(Channel *tc, chans) {
+			foreach(User *p, tc->qlUsers) {
+				ServerUser *pDst = static_cast<ServerUser *>(p);
+				if ((pDst->sState == ServerUser::Authenticated) && ! pDst->bDeaf && ! pDst->bSelfDeaf)
+					server->sendMessage(pDst, out, len, cache);
+			}
+		}
+	}
+}
@@ -0,0 +1,189 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUMBLE_MURMUR_TRUNK_H_
+#define MUMBLE_MURMUR_TRUNK_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QReadWriteLock>
+#include <QtNetwork/QHostAddress>
+
+#include "TrunkVoice.h"
+
+class Channel;
+class QDataStream;
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+class QUdpSocket;
+class Server;
+class ServerUser;
+
+// Voice trunk between murmurd processes hosting the same virtual server.
+// Every node keeps its own users; what the others need to know about them
+// travels over the trunk:
+//
+// - Channels. Each node opens a TCP connection to every node in trunkpeers
+//   and sends it its permanent channels. The receiving node matches them to
+//   its own by parent and name, and creates the ones it lacks. This only
+//   adds channels; renames and removals stay local.
+// - Presence. Over the same connection go its users (name, channel and mute
+//   state). The receiving node shows them to its clients under sessions of
+//   its own, from PhantomSessionBase up, in the matching channel.
+// - Voice. When a local user talks, the voice thread sends the frame over
+//   UDP to each node with users in the channel or a linked one the user may
+//   speak in, see TrunkVoice. That node forwards it to its own listeners.
+//
+// Connections are authenticated with a challenge using the shared
+// trunksecret, and voice datagrams signed with a key derived from it for
+// each connection. Permissions are checked by the node of the speaker,
+// which knows their groups and certificate; the receiving node only drops
+// voice from users it has been told are muted or not in the channel.
+// Nothing is encrypted, so trunks belong on a trusted network.
+
+class Trunk : public QObject {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(Trunk)
+	public:
+		enum MessageType { Challenge, Hello, Snapshot, State, Remove, Channels };
+		enum PresenceFlag { Mute = 0x01, Deaf = 0x02, Suppress = 0x04, SelfMute = 0x08, SelfDeaf = 0x10, PrioritySpeaker = 0x20 };
+		enum { PhantomSessionBase = 0x40000000 };
+
+		struct Presence {
+			int iChannel;
+			unsigned int uiFlags;
+			QString qsName;
+			bool operator ==(const Presence &) const;
+			bool operator !=(const Presence &) const;
+		};
+	protected:
+		// A node sending us its channels, presence and voice, over a
+		// connection it opened.
+		struct Node {
+			quint32 uiNode;
+			QTcpSocket *qtsSocket;
+			QByteArray qbaNonce;
+			QByteArray qbaBuffer;
+			bool bAuthenticated;
+			struct sockaddr_storage saiVoice;
+			// Checks its voice datagrams.
+			QByteArray qbaKey;
+			ReplayWindow rwVoice;
+			// Remote channel to local channel.
+			QHash<int, int> qhChannelMap;
+			// Remote session to local phantom session.
+			QHash<unsigned int, unsigned int> qhSessions;
+			// Users of the node per local channel, read by the voice thread.
+			QHash<int, int> qhChannelUsers;
+		};
+		// A node we send our channels, presence and voice to, over a
+		// connection we opened.
+		struct Link {
+			QString qsHost;
+			quint16 usPort;
+			QTcpSocket *qtsSocket;
+			QByteArray qbaBuffer;
+			bool bReady;
+			// Set from the challenge, for signing voice to the node.
+			quint32 uiPeer;
+			QByteArray qbaKey;
+			quint64 uiCounter;
+		};
+		struct Phantom {
+			Node *nNode;
+			unsigned int uiRemote;
+			// Presence as sent, with the remote channel.
+			Presence pPresence;
+			// The local channel, or -1 if it has none.
+			int iChannel;
+		};
+
+		Server *server;
+		quint32 uiNode;
+		QByteArray qbaSecret;
+		QTcpServer *qtsServer;
+		QUdpSocket *qusVoice;
+		int iVoiceSocket;
+		QTimer *qtPoll;
+		QTimer *qtReconnect;
+		QList<Link *> qlLinks;
+		QHash<QTcpSocket *, Node *> qhSockets;
+		QHash<unsigned int, Phantom> qhPhantoms;
+		QHash<unsigned int, Presence> qhLocal;
+		QByteArray qbaChannels;
+		unsigned int uiNextSession;
+
+		// Guards qhNodes, qhPeers, and the voice addresses, keys and
+		// channel counts of nodes and links.
+		QReadWriteLock qrwlNodes;
+		QHash<quint32, Node *> qhNodes;
+		QHash<quint32, Link *> qhPeers;
+		// Guards the counters of links.
+		QMutex qmCounters;
+
+		static void frame(QTcpSocket *, const QByteArray &);
+		static bool unframe(QTcpSocket *, QByteArray &buffer, QByteArray &msg);
+		QByteArray sign(const char *data, int len) const;
+		QByteArray proof(const QByteArray &nonce, quint32 node) const;
+		QByteArray presenceMessage(MessageType, unsigned int session, const Presence &) const;
+		QByteArray channelsMessage() const;
+		bool mapChannels(Node *, QDataStream &);
+		int localChannel(Node *, int remote) const;
+		void moveUser(Node *, int from, int to);
+		void sendPhantom(unsigned int session, const Phantom &, ServerUser *to = NULL);
+		void setPresence(Node *, unsigned int remote, const Presence &);
+		void removePresence(Node *, unsigned int remote);
+		void dropNode(Node *);
+		void dropLink(Link *);
+		bool nodeMessage(Node *, const QByteArray &);
+		bool linkMessage(Link *, const QByteArray &);
+		Link *link(QObject *socket) const;
+	public:
+		Trunk(Server *parent, const QHostAddress &address, quint16 port, quint32 node, const QByteArray &secret, const QString &peers);
+		~Trunk();
+		bool isListening() const;
+		void forward(ServerUser *u, Channel *c, const TrunkVoice::Channels &linked, unsigned int type, const char *data, int len);
+		void sendUsers(ServerUser *u);
+	public slots:
+		void poll();
+		void reconnect();
+		void newConnection();
+		void nodeReadyRead();
+		void nodeDisconnected();
+		void linkConnected();
+		void linkReadyRead();
+		void linkDisconnected();
+		void voiceReadyRead();
+};
+
+#endif
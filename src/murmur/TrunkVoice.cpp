@@ -0,0 +1,147 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "TrunkVoice.h"
+
+#include <openssl/hmac.h>
+
+static QByteArray hmac(const QByteArray &key, const char *data, int len) {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int mdlen = 0;
+
+	HMAC(EVP_sha1(), key.constData(), key.size(), reinterpret_cast<const unsigned char *>(data), len, md, &mdlen);
+	return QByteArray(reinterpret_cast<const char *>(md), mdlen);
+}
+
+QByteArray TrunkVoice::key(const QByteArray &secret, const QByteArray &challenge, quint32 node) {
+	QByteArray data("voice");
+	data.append(challenge);
+	unsigned char id[4];
+	qToBigEndian<quint32>(node, id);
+	data.append(reinterpret_cast<const char *>(id), 4);
+	return hmac(secret, data.constData(), data.size());
+}
+
+int TrunkVoice::seal(const QByteArray &key, const Header &h, const char *data, int len, char *out, int outlen) {
+	const int nchannels = h.qvlaChannels.count();
+	const int size = HeaderSize + nchannels * 4 + len + TagSize;
+	if ((nchannels < 1) || (nchannels > MaxChannels) || (len <= 0) || (size > outlen) || (size > MaxPacketSize))
+		return 0;
+
+	unsigned char *header = reinterpret_cast<unsigned char *>(out);
+	qToBigEndian<quint32>(h.uiNode, header);
+	qToBigEndian<quint32>(h.uiSession, header + 4);
+	qToBigEndian<quint64>(h.uiCounter, header + 8);
+	header[16] = static_cast<unsigned char>(h.uiType);
+	header[17] = static_cast<unsigned char>(nchannels);
+
+	unsigned char *p = header + HeaderSize;
+	for (int i=0;i<nchannels;++i) {
+		qToBigEndian<quint32>(static_cast<quint32>(h.qvlaChannels.at(i)), p);
+		p += 4;
+	}
+	memcpy(p, data, len);
+
+	const int signedlen = size - TagSize;
+	memcpy(out + signedlen, hmac(key, out, signedlen).constData(), TagSize);
+	return size;
+}
+
+bool TrunkVoice::peekNode(const char *buffer, int len, quint32 &node) {
+	if (len < HeaderSize + 4 + 1 + TagSize)
+		return false;
+	node = qFromBigEndian<quint32>(reinterpret_cast<const unsigned char *>(buffer));
+	return true;
+}
+
+bool TrunkVoice::open(const QByteArray &key, const char *buffer, int len, Header &h, const char *&data, int &datalen) {
+	if ((len < HeaderSize + 4 + 1 + TagSize) || (len > MaxPacketSize))
+		return false;
+
+	const unsigned char *header = reinterpret_cast<const unsigned char *>(buffer);
+	const int nchannels = header[17];
+	const int offset = HeaderSize + nchannels * 4;
+	if ((nchannels < 1) || (nchannels > MaxChannels) || (offset + 1 + TagSize > len))
+		return false;
+
+	const int signedlen = len - TagSize;
+	const QByteArray &mac = hmac(key, buffer, signedlen);
+	// Compare all of it, to not give away how much of a forged tag was right.
+	unsigned char diff = 0;
+	for (int i=0;i<TagSize;++i)
+		diff |= static_cast<unsigned char>(mac.at(i) ^ buffer[signedlen + i]);
+	if (diff)
+		return false;
+
+	h.uiNode = qFromBigEndian<quint32>(header);
+	h.uiSession = qFromBigEndian<quint32>(header + 4);
+	h.uiCounter = qFromBigEndian<quint64>(header + 8);
+	h.uiType = header[16];
+	h.qvlaChannels.resize(nchannels);
+	for (int i=0;i<nchannels;++i)
+		h.qvlaChannels[i] = static_cast<int>(qFromBigEndian<quint32>(header + HeaderSize + i * 4));
+
+	data = buffer + offset;
+	datalen = signedlen - offset;
+	return true;
+}
+
+ReplayWindow::ReplayWindow() : uiHighest(0), uiSeen(0), bStarted(false) {
+}
+
+// Bit i of uiSeen stands for counter uiHighest - i.
+bool ReplayWindow::accept(quint64 counter) {
+	if (! bStarted) {
+		bStarted = true;
+		uiHighest = counter;
+		uiSeen = 1;
+		return true;
+	}
+
+	if (counter > uiHighest) {
+		const quint64 shift = counter - uiHighest;
+		uiSeen = (shift >= 64) ? 1 : ((uiSeen << shift) | 1);
+		uiHighest = counter;
+		return true;
+	}
+
+	const quint64 age = uiHighest - counter;
+	if (age >= 64)
+		return false;
+
+	const quint64 bit = 1ULL << age;
+	if (uiSeen & bit)
+		return false;
+	uiSeen |= bit;
+	return true;
+}
@@ -0,0 +1,87 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_TRUNKVOICE_H_
+#define MUMBLE_MURMUR_TRUNKVOICE_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVarLengthArray>
+
+// Wire format of the voice datagrams between trunk nodes.
+//
+// Each datagram carries the sending node, the speaker's session there, a
+// counter the sender increments for every datagram to that node, the voice
+// type and the channels the speaker may be heard in: the one they are in,
+// then any linked channels the sending node granted Speak in. The voice
+// data follows, and then a truncated HMAC over all of it.
+//
+// The HMAC key is derived from trunksecret and the challenge the receiving
+// node sent when the sender connected, so datagrams from an earlier
+// connection don't verify, and the counter lets the receiver drop replays
+// within one.
+
+class TrunkVoice {
+	public:
+		enum { HeaderSize = 18, TagSize = 8, MaxChannels = 32, MaxPacketSize = 1024 };
+		// Sized for the most a datagram can carry, so they stay on the stack.
+		typedef QVarLengthArray<int, MaxChannels> Channels;
+
+		struct Header {
+			quint32 uiNode;
+			quint32 uiSession;
+			quint64 uiCounter;
+			unsigned int uiType;
+			Channels qvlaChannels;
+		};
+
+		static QByteArray key(const QByteArray &secret, const QByteArray &challenge, quint32 node);
+		// Returns the size of the datagram written to out, or 0 if it doesn't fit.
+		static int seal(const QByteArray &key, const Header &h, const char *data, int len, char *out, int outlen);
+		// Node a datagram claims to come from, to pick the key to open it with.
+		static bool peekNode(const char *buffer, int len, quint32 &node);
+		// Checks the signature and splits the datagram. data points into buffer.
+		static bool open(const QByteArray &key, const char *buffer, int len, Header &h, const char *&data, int &datalen);
+};
+
+// Counters seen recently from one sender. Accepts each counter at most once
+// and, for datagrams arriving out of order, only within the last 64.
+
+class ReplayWindow {
+	protected:
+		quint64 uiHighest;
+		quint64 uiSeen;
+		bool bStarted;
+	public:
+		ReplayWindow();
+		bool accept(quint64 counter);
+};
+
+#endif
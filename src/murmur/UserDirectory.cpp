@@ -0,0 +1,372 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "UserDirectory.h"
+
+int UserDirectory::Blobs::cost() const {
+	// Roughly what the cache spends on an entry besides the data itself.
+	return 64 + qbaTexture.size() + qbaTextureHash.size() + qsComment.size() * static_cast<int>(sizeof(QChar)) + qbaCommentHash.size();
+}
+
+UserDirectory::UserDirectory(int entries, int bytes) : iGarbage(0), iCapacity(0), iFree(-1), iHead(-1), iTail(-1) {
+	uiHits = uiMisses = uiEvictions = 0ULL;
+	setLimits(entries, bytes);
+}
+
+void UserDirectory::setLimits(int entries, int bytes) {
+	entries = qMax(entries, 0);
+
+	if (entries < qvEntries.count()) {
+		// Rebuild the slab so shrinking actually returns memory, keeping the
+		// most recently used entries.
+		QList<QPair<int, QString> > keep;
+		for (int slot = iHead; (slot >= 0) && (keep.count() < entries); slot = qvEntries.at(slot).iNext)
+			keep.prepend(qMakePair(qvEntries.at(slot).iId, entryName(slot)));
+		uiEvictions += static_cast<quint64>(count() - keep.count());
+
+		iCapacity = entries;
+		load(keep);
+	}
+
+	iCapacity = entries;
+	qcBlobs.setMaxCost(qMax(bytes, 0));
+}
+
+void UserDirectory::clear() {
+	qvEntries = QVector<Entry>();
+	qbaNames = QByteArray();
+	iGarbage = 0;
+	qvIndex = QVector<IndexEntry>();
+	qmhNames.clear();
+	qcBlobs.clear();
+	iFree = iHead = iTail = -1;
+}
+
+// Replaces the names with the given ones, least recently used first. Builds
+// the index in one go, which is much cheaper than inserting one at a time.
+void UserDirectory::load(const QList<QPair<int, QString> > &users) {
+	qvEntries = QVector<Entry>();
+	qbaNames = QByteArray();
+	iGarbage = 0;
+	qvIndex = QVector<IndexEntry>();
+	qmhNames.clear();
+	iFree = iHead = iTail = -1;
+
+	const int n = qMin(users.count(), iCapacity);
+	qvEntries.reserve(n);
+	qvIndex.reserve(n);
+
+	for (int i = users.count() - n; i < users.count(); ++i) {
+		const QPair<int, QString> &u = users.at(i);
+		const QString &folded = fold(u.second);
+
+		Entry e;
+		e.iId = u.first;
+		e.uiHash = qHash(folded);
+		e.iPrev = e.iNext = -1;
+		e.iName = e.iNameLength = 0;
+
+		const int slot = qvEntries.count();
+		qvEntries.append(e);
+		setName(slot, u.second);
+		qvIndex.append(IndexEntry(e.iId, slot));
+		qmhNames.insert(e.uiHash, slot);
+		pushFront(slot);
+	}
+
+	qSort(qvIndex);
+	qbaNames.squeeze();
+}
+
+QString UserDirectory::fold(const QString &name) {
+	return name.toCaseFolded();
+}
+
+// Returns the position of id in the index, or -1.
+int UserDirectory::findId(int id) const {
+	QVector<IndexEntry>::const_iterator i = qLowerBound(qvIndex.constBegin(), qvIndex.constEnd(), IndexEntry(id, -1));
+	if ((i == qvIndex.constEnd()) || ((*i).first != id))
+		return -1;
+	return static_cast<int>(i - qvIndex.constBegin());
+}
+
+// Returns the slot holding the folded name, or -1.
+int UserDirectory::findName(const QString &folded, uint hash) const {
+	QMultiHash<uint, int>::const_iterator i = qmhNames.constFind(hash);
+	while ((i != qmhNames.constEnd()) && (i.key() == hash)) {
+		if (fold(entryName(i.value())) == folded)
+			return i.value();
+		++i;
+	}
+	return -1;
+}
+
+QString UserDirectory::entryName(int slot) const {
+	const Entry &e = qvEntries.at(slot);
+	return QString::fromUtf8(qbaNames.constData() + e.iName, e.iNameLength);
+}
+
+void UserDirectory::setName(int slot, const QString &name) {
+	releaseName(slot);
+	compact();
+
+	const QByteArray &utf8 = name.toUtf8();
+	Entry &e = qvEntries[slot];
+	e.iName = qbaNames.size();
+	e.iNameLength = utf8.size();
+	qbaNames.append(utf8);
+}
+
+void UserDirectory::releaseName(int slot) {
+	Entry &e = qvEntries[slot];
+	iGarbage += e.iNameLength;
+	e.iName = e.iNameLength = 0;
+}
+
+// Moves the names still in use to a fresh array once most of it is unused.
+void UserDirectory::compact() {
+	if ((iGarbage < 4096) || (iGarbage * 2 < qbaNames.size()))
+		return;
+
+	QByteArray names;
+	names.reserve(qbaNames.size() - iGarbage);
+	for (int slot = 0; slot < qvEntries.count(); ++slot) {
+		Entry &e = qvEntries[slot];
+		if ((e.iId < 0) || (e.iNameLength == 0))
+			continue;
+		const int offset = names.size();
+		names.append(qbaNames.constData() + e.iName, e.iNameLength);
+		e.iName = offset;
+	}
+	qbaNames = names;
+	iGarbage = 0;
+}
+
+void UserDirectory::unlink(int slot) {
+	Entry &e = qvEntries[slot];
+	if (e.iPrev >= 0)
+		qvEntries[e.iPrev].iNext = e.iNext;
+	else
+		iHead = e.iNext;
+	if (e.iNext >= 0)
+		qvEntries[e.iNext].iPrev = e.iPrev;
+	else
+		iTail = e.iPrev;
+	e.iPrev = e.iNext = -1;
+}
+
+void UserDirectory::pushFront(int slot) {
+	Entry &e = qvEntries[slot];
+	e.iPrev = -1;
+	e.iNext = iHead;
+	if (iHead >= 0)
+		qvEntries[iHead].iPrev = slot;
+	iHead = slot;
+	if (iTail < 0)
+		iTail = slot;
+}
+
+void UserDirectory::drop(int slot) {
+	Entry &e = qvEntries[slot];
+
+	int pos = findId(e.iId);
+	if (pos >= 0)
+		qvIndex.remove(pos);
+	qmhNames.remove(e.uiHash, slot);
+	unlink(slot);
+	releaseName(slot);
+
+	e.iId = -1;
+	e.iNext = iFree;
+	iFree = slot;
+}
+
+bool UserDirectory::name(int id, QString &name) {
+	int pos = findId(id);
+	if (pos < 0) {
+		++uiMisses;
+		return false;
+	}
+
+	int slot = qvIndex.at(pos).second;
+	if (slot != iHead) {
+		unlink(slot);
+		pushFront(slot);
+	}
+	name = entryName(slot);
+	++uiHits;
+	return true;
+}
+
+bool UserDirectory::id(const QString &name, int &id) {
+	const QString &folded = fold(name);
+	int slot = findName(folded, qHash(folded));
+	if (slot < 0) {
+		++uiMisses;
+		return false;
+	}
+
+	if (slot != iHead) {
+		unlink(slot);
+		pushFront(slot);
+	}
+	id = qvEntries.at(slot).iId;
+	++uiHits;
+	return true;
+}
+
+void UserDirectory::insert(int id, const QString &name) {
+	if ((iCapacity <= 0) || name.isEmpty())
+		return;
+
+	const QString &folded = fold(name);
+	const uint hash = qHash(folded);
+
+	// Names are unique, so a different user holding this one is stale.
+	int other = findName(folded, hash);
+	if ((other >= 0) && (qvEntries.at(other).iId != id))
+		drop(other);
+
+	int slot;
+	int pos = findId(id);
+	if (pos >= 0) {
+		slot = qvIndex.at(pos).second;
+		qmhNames.remove(qvEntries.at(slot).uiHash, slot);
+		unlink(slot);
+	} else {
+		if (count() >= iCapacity) {
+			drop(iTail);
+			++uiEvictions;
+		}
+		if (iFree >= 0) {
+			slot = iFree;
+			iFree = qvEntries.at(slot).iNext;
+		} else {
+			slot = qvEntries.count();
+			qvEntries.append(Entry());
+		}
+		QVector<IndexEntry>::iterator i = qLowerBound(qvIndex.begin(), qvIndex.end(), IndexEntry(id, -1));
+		qvIndex.insert(i, IndexEntry(id, slot));
+	}
+
+	Entry &e = qvEntries[slot];
+	e.iId = id;
+	e.uiHash = hash;
+	setName(slot, name);
+	qmhNames.insert(hash, slot);
+	pushFront(slot);
+}
+
+void UserDirectory::remove(int id) {
+	int pos = findId(id);
+	if (pos >= 0)
+		drop(qvIndex.at(pos).second);
+}
+
+void UserDirectory::remove(const QString &name) {
+	const QString &folded = fold(name);
+	int slot = findName(folded, qHash(folded));
+	if (slot >= 0)
+		drop(slot);
+}
+
+bool UserDirectory::texture(int id, QByteArray &texture, QByteArray &hash) {
+	const Blobs *b = qcBlobs.object(id);
+	if (! b || ! b->bTexture)
+		return false;
+	texture = b->qbaTexture;
+	hash = b->qbaTextureHash;
+	return true;
+}
+
+bool UserDirectory::comment(int id, QString &comment, QByteArray &hash) {
+	const Blobs *b = qcBlobs.object(id);
+	if (! b || ! b->bComment)
+		return false;
+	comment = b->qsComment;
+	hash = b->qbaCommentHash;
+	return true;
+}
+
+void UserDirectory::updateBlobs(int id, const Blobs &blobs) {
+	Blobs *b = new Blobs(blobs);
+	// Takes ownership, and drops b right away if it exceeds the whole budget.
+	qcBlobs.insert(id, b, b->cost());
+}
+
+void UserDirectory::setTexture(int id, const QByteArray &texture, const QByteArray &hash) {
+	const Blobs *old = qcBlobs.object(id);
+	Blobs b = old ? *old : Blobs();
+	b.bTexture = true;
+	b.qbaTexture = texture;
+	b.qbaTextureHash = hash;
+	updateBlobs(id, b);
+}
+
+void UserDirectory::setComment(int id, const QString &comment, const QByteArray &hash) {
+	const Blobs *old = qcBlobs.object(id);
+	Blobs b = old ? *old : Blobs();
+	b.bComment = true;
+	b.qsComment = comment;
+	b.qbaCommentHash = hash;
+	updateBlobs(id, b);
+}
+
+void UserDirectory::removeBlobs(int id) {
+	qcBlobs.remove(id);
+}
+
+int UserDirectory::count() const {
+	return qvIndex.count();
+}
+
+int UserDirectory::capacity() const {
+	return iCapacity;
+}
+
+int UserDirectory::blobBytes() const {
+	return qcBlobs.totalCost();
+}
+
+int UserDirectory::blobBudget() const {
+	return qcBlobs.maxCost();
+}
+
+qint64 UserDirectory::nameBytes() const {
+	qint64 bytes = qvEntries.capacity() * static_cast<qint64>(sizeof(Entry));
+	bytes += qvIndex.capacity() * static_cast<qint64>(sizeof(IndexEntry));
+	// Hash nodes are a pointer, the hash, the key and the value.
+	bytes += qmhNames.count() * static_cast<qint64>(sizeof(void *) + 3 * sizeof(uint));
+	bytes += qbaNames.capacity();
+	return bytes;
+}
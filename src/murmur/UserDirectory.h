@@ -0,0 +1,139 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_USERDIRECTORY_H_
+#define MUMBLE_MURMUR_USERDIRECTORY_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+// Bounded cache of registered users, sitting in front of the database and
+// any authenticator.
+//
+// Entries sit in one vector, reached through a sorted id index and a hash
+// of the case folded name, so lookups in both directions match the case
+// insensitive comparison the database does. When it is full the least
+// recently used entry is dropped. Names are kept as UTF-8 back to back in a
+// single byte array, which is compacted once more than half of it belongs
+// to names that were dropped or replaced.
+//
+// Textures and comments are only cached once something asked for them, and
+// in total never take more than the byte budget. Only short ones are kept
+// here; for the rest the entry holds the hash to look them up by in the
+// BlobStore.
+//
+// Not thread safe; the owning Server only uses it from the main thread.
+
+class UserDirectory {
+	private:
+		Q_DISABLE_COPY(UserDirectory)
+	public:
+		struct Entry {
+			int iId;
+			uint uiHash;
+			// Neighbours in LRU order, or the next free slot.
+			int iPrev;
+			int iNext;
+			// Where the name is in qbaNames.
+			int iName;
+			int iNameLength;
+		};
+		struct Blobs {
+			bool bTexture;
+			bool bComment;
+			QByteArray qbaTexture;
+			QByteArray qbaTextureHash;
+			QString qsComment;
+			QByteArray qbaCommentHash;
+			Blobs() : bTexture(false), bComment(false) {}
+			int cost() const;
+		};
+	protected:
+		typedef QPair<int, int> IndexEntry;
+
+		QVector<Entry> qvEntries;
+		QByteArray qbaNames;
+		int iGarbage;
+		QVector<IndexEntry> qvIndex;
+		QMultiHash<uint, int> qmhNames;
+		QCache<int, Blobs> qcBlobs;
+		int iCapacity;
+		int iFree;
+		int iHead;
+		int iTail;
+
+		int findId(int id) const;
+		int findName(const QString &folded, uint hash) const;
+		QString entryName(int slot) const;
+		void setName(int slot, const QString &name);
+		void releaseName(int slot);
+		void compact();
+		void unlink(int slot);
+		void pushFront(int slot);
+		void drop(int slot);
+		void updateBlobs(int id, const Blobs &);
+	public:
+		quint64 uiHits;
+		quint64 uiMisses;
+		quint64 uiEvictions;
+
+		UserDirectory(int entries = 20000, int bytes = 8 * 1024 * 1024);
+		void setLimits(int entries, int bytes);
+		void clear();
+		void load(const QList<QPair<int, QString> > &users);
+
+		bool name(int id, QString &name);
+		bool id(const QString &name, int &id);
+		void insert(int id, const QString &name);
+		void remove(int id);
+		void remove(const QString &name);
+
+		bool texture(int id, QByteArray &texture, QByteArray &hash);
+		void setTexture(int id, const QByteArray &texture, const QByteArray &hash);
+		bool comment(int id, QString &comment, QByteArray &hash);
+		void setComment(int id, const QString &comment, const QByteArray &hash);
+		void removeBlobs(int id);
+
+		int count() const;
+		int capacity() const;
+		int blobBytes() const;
+		int blobBudget() const;
+		qint64 nameBytes() const;
+
+		static QString fold(const QString &name);
+};
+
+#endif
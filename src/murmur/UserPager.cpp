@@ -0,0 +1,87 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "UserPager.h"
+
+UserPager::UserPager(const QString &filter, const QString &after, int count) : qsAfter(after) {
+	iCount = qBound(0, count, static_cast<int>(MaxPageSize));
+
+	if (filter.contains(QLatin1Char('%')) || filter.contains(QLatin1Char('_'))) {
+		qsLike = filter;
+	} else if (! filter.isEmpty()) {
+		// Everything starting with the prefix sorts below the prefix with
+		// its last character incremented.
+		const ushort last = filter.at(filter.length() - 1).unicode();
+		if (last < 0xffff) {
+			qsPrefix = filter;
+			qsUpper = filter;
+			qsUpper[qsUpper.length() - 1] = QChar(static_cast<ushort>(last + 1));
+		} else {
+			qsLike = filter + QLatin1String("%");
+		}
+	}
+}
+
+const QString &UserPager::after() const {
+	return qsAfter;
+}
+
+int UserPager::count() const {
+	return iCount;
+}
+
+int UserPager::limit() const {
+	return iCount + 1;
+}
+
+void UserPager::add(const UserInfo &ui) {
+	if (ui.name > qsAfter)
+		qmPage.insert(ui.name, ui);
+}
+
+// Authenticators return all their users at once, so only those after the
+// cursor count.
+void UserPager::add(const QMap<int, QString> &users) {
+	QMap<int, QString>::const_iterator i;
+	for (i = users.constBegin(); i != users.constEnd(); ++i)
+		add(UserInfo(i.key(), i.value()));
+}
+
+QList<UserInfo> UserPager::page(bool &more) const {
+	QList<UserInfo> users;
+	QMap<QString, UserInfo>::const_iterator i;
+	for (i = qmPage.constBegin(); (i != qmPage.constEnd()) && (users.count() < iCount); ++i)
+		users << i.value();
+	more = (qmPage.count() > iCount);
+	return users;
+}
@@ -0,0 +1,76 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_USERPAGER_H_
+#define MUMBLE_MURMUR_USERPAGER_H_
+
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+
+#include "User.h"
+
+// One page of registered users ordered by name, for keyset paging: the
+// name of the last user on a page is where the next one starts, so each
+// page costs the same however deep into the list it is.
+//
+// Works out how to ask the database for the page and merges its rows with
+// the users an authenticator knows about.
+
+class UserPager {
+	private:
+		Q_DISABLE_COPY(UserPager)
+	public:
+		enum { MaxPageSize = 1000 };
+
+		// Set for a filter containing % or _, or a prefix that can't be
+		// turned into a range.
+		QString qsLike;
+		// Otherwise the range of names starting with the prefix filter.
+		QString qsPrefix;
+		QString qsUpper;
+	protected:
+		QString qsAfter;
+		int iCount;
+		QMap<QString, UserInfo> qmPage;
+	public:
+		UserPager(const QString &filter, const QString &after, int count);
+		const QString &after() const;
+		int count() const;
+		// How many rows to read from the database; one more than the
+		// page, to know whether another page follows.
+		int limit() const;
+		void add(const UserInfo &);
+		void add(const QMap<int, QString> &users);
+		QList<UserInfo> page(bool &more) const;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "VoiceStats.h"
+
+Histogram::Histogram() {
+}
+
+int Histogram::bucket(quint64 value) {
+	if (value < 32)
+		return static_cast<int>(value);
+
+	int msb = 5;
+	while ((value >> (msb + 1)) != 0)
+		++msb;
+
+	// Keep the 5 most significant bits, the top one is implied by msb.
+	int shift = msb - 4;
+	int b = 32 + (msb - 5) * 16 + static_cast<int>((value >> shift) & 15);
+	return qMin(b, static_cast<int>(Buckets - 1));
+}
+
+quint64 Histogram::lowerBound(int b) {
+	if (b < 32)
+		return static_cast<quint64>(b);
+
+	int shift = (b - 32) / 16 + 1;
+	return (16ULL + static_cast<quint64>((b - 32) % 16)) << shift;
+}
+
+void Histogram::add(quint64 value) {
+	qaiCounts[bucket(value)].ref();
+}
+
+void Histogram::clear() {
+	for (int i=0;i<Buckets;++i)
+		qaiCounts[i].fetchAndStoreRelaxed(0);
+}
+
+QList<QPair<quint64, quint64> > Histogram::buckets() const {
+	QList<QPair<quint64, quint64> > ql;
+	for (int i=0;i<Buckets;++i) {
+		int count = qaiCounts[i];
+		if (count)
+			ql << QPair<quint64, quint64>(lowerBound(i), static_cast<unsigned int>(count));
+	}
+	return ql;
+}
+
+void PacketTrace::start(quint64 kernel, quint64 received) {
+	uiKernel = kernel;
+	uiReceived = received;
+	uiDecrypted = received;
+	uiEncrypt = uiSend = 0;
+	iFanout = 0;
+}
+
+VoiceStats::VoiceStats() {
+	iSampleRate = 0;
+	uiCounter = 0;
+}
+
+void VoiceStats::record(const PacketTrace &pt, quint64 end) {
+	qaiSamples.ref();
+
+	quint64 start = pt.uiReceived;
+	if (pt.uiKernel && (pt.uiKernel <= pt.uiReceived)) {
+		hStage[Queue].add(pt.uiReceived - pt.uiKernel);
+		start = pt.uiKernel;
+	}
+
+	quint64 processing = (end > pt.uiDecrypted) ? (end - pt.uiDecrypted) : 0;
+	quint64 io = pt.uiEncrypt + pt.uiSend;
+
+	hStage[Decrypt].add((pt.uiDecrypted > pt.uiReceived) ? (pt.uiDecrypted - pt.uiReceived) : 0);
+	hStage[Route].add((processing > io) ? (processing - io) : 0);
+	hStage[Encrypt].add(pt.uiEncrypt);
+	hStage[Send].add(pt.uiSend);
+	hStage[Total].add((end > start) ? (end - start) : 0);
+	hFanout.add(static_cast<quint64>(pt.iFanout));
+}
+
+void VoiceStats::clear() {
+	qaiSamples.fetchAndStoreRelaxed(0);
+	for (int i=0;i<StageCount;++i)
+		hStage[i].clear();
+	hFanout.clear();
+}
+
+const char *VoiceStats::stageName(Stage s) {
+	switch (s) {
+		case Queue:
+			return "queue";
+		case Decrypt:
+			return "decrypt";
+		case Route:
+			return "route";
+		case Encrypt:
+			return "encrypt";
+		case Send:
+			return "send";
+		case Total:
+			return "total";
+		default:
+			break;
+	}
+	return "unknown";
+}
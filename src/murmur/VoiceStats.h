@@ -0,0 +1,108 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_VOICESTATS_H_
+#define MUMBLE_MURMUR_VOICESTATS_H_
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+
+// Log-linear histogram. Values below 32 get a bucket each, above that every
+// power of two is split into 16 buckets, so a bucket's lower bound is within
+// about 6% of any value it holds. Buckets are plain atomic counters, so the
+// voice thread and the main thread can add samples without locking.
+
+class Histogram {
+	private:
+		Q_DISABLE_COPY(Histogram)
+	public:
+		enum { Buckets = 32 + 36 * 16 };
+
+		QAtomicInt qaiCounts[Buckets];
+
+		Histogram();
+		static int bucket(quint64 value);
+		static quint64 lowerBound(int bucket);
+		void add(quint64 value);
+		void clear();
+		// Non-empty buckets as (lower bound, count).
+		QList<QPair<quint64, quint64> > buckets() const;
+};
+
+// Timestamps of a single sampled voice packet on its way through the server.
+// All times are in microseconds, see Timer::now().
+
+struct PacketTrace {
+	// Kernel receive time, if SO_TIMESTAMPING is enabled. Otherwise 0.
+	quint64 uiKernel;
+	// recvmsg() returned.
+	quint64 uiReceived;
+	// Sender found and packet decrypted.
+	quint64 uiDecrypted;
+	// Time spent encrypting and sending the fanout.
+	quint64 uiEncrypt;
+	quint64 uiSend;
+	int iFanout;
+
+	void start(quint64 kernel, quint64 received);
+};
+
+class VoiceStats {
+	private:
+		Q_DISABLE_COPY(VoiceStats)
+	public:
+		enum Stage { Queue, Decrypt, Route, Encrypt, Send, Total, StageCount };
+
+		// Sample one in iSampleRate packets, 0 disables sampling.
+		int iSampleRate;
+		unsigned int uiCounter;
+		QAtomicInt qaiSamples;
+
+		Histogram hStage[StageCount];
+		Histogram hFanout;
+
+		VoiceStats();
+		// Only called from the voice thread.
+		bool sample() {
+			if (! iSampleRate)
+				return false;
+			if (++uiCounter < static_cast<unsigned int>(iSampleRate))
+				return false;
+			uiCounter = 0;
+			return true;
+		}
+		void record(const PacketTrace &pt, quint64 end);
+		void clear();
+		static const char *stageName(Stage s);
+};
+
+#endif
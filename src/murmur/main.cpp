@@ -38,11 +38,13 @@
 #include "ServerDB.h"
 #include "DBus.h"
 #include "Meta.h"
+#include "Metrics.h"
 #include "Version.h"
 #include "SSL.h"
 
 #ifdef Q_OS_UNIX
 #include "UnixMurmur.h"
+#include "Handover.h"
 #endif
 
 QFile *qfLog = NULL;
@@ -234,6 +236,7 @@ int main(int argc, char **argv) {
 	bool wipeSsl = false;
 	bool wipeLogs = false;
 	int sunum = 1;
+	QString exportFile, importFile;
 #ifdef Q_OS_UNIX
 	bool readPw = false;
 #endif
@@ -280,6 +283,18 @@ int main(int argc, char **argv) {
 			}
 			bLast = true;
 #endif
+		} else if (((arg == "-export") || (arg == "-import")) && (i+1 < args.size())) {
+			detach = false;
+			i++;
+			if (arg == "-export")
+				exportFile = args.at(i);
+			else
+				importFile = args.at(i);
+			if (i+1 < args.size()) {
+				i++;
+				sunum = args.at(i).toInt();
+			}
+			bLast = true;
 		} else if ((arg == "-ini") && (i+1 < args.size())) {
 			i++;
 			inifile = args.at(i);
@@ -310,6 +325,8 @@ int main(int argc, char **argv) {
 #endif
 			       "  -wipessl         Remove SSL certificates from database.\n"
 			       "  -wipelogs        Remove all log entries from database.\n"
+			       "  -export <f> [s]  Write server s to archive file f.\n"
+			       "  -import <f> [s]  Replace server s with the contents of archive file f.\n"
 			       "  -version         Show version information.\n"
 			       "If no inifile is provided, murmur will search for one in \n"
 			       "default locations.", qPrintable(args.at(0)));
@@ -409,6 +426,20 @@ int main(int argc, char **argv) {
 		qFatal("Superuser password set on server %d", sunum);
 	}
 
+	if (! exportFile.isEmpty()) {
+		QString error;
+		if (! ServerDB::exportServer(sunum, exportFile, error))
+			qFatal("Failed to export server %d: %s", sunum, qPrintable(error));
+		qFatal("Server %d exported to %s", sunum, qPrintable(exportFile));
+	}
+
+	if (! importFile.isEmpty()) {
+		QString error;
+		if (! ServerDB::importServer(sunum, importFile, error))
+			qFatal("Failed to import server %d: %s", sunum, qPrintable(error));
+		qFatal("Server %d imported from %s", sunum, qPrintable(importFile));
+	}
+
 	if (wipeSsl) {
 		qWarning("Removing all per-server SSL certificates from the database.");
 		foreach(int sid, ServerDB::getAllServers()) {
@@ -462,6 +493,9 @@ int main(int argc, char **argv) {
 		close(fd);
 	}
 	unixhandler.finalcap();
+
+	if (! Meta::mp.qsHandoverSocket.isEmpty())
+		Handover::receive(Meta::mp.qsHandoverSocket);
 #endif
 
 #ifdef USE_DBUS
@@ -511,8 +545,21 @@ int main(int argc, char **argv) {
 
 	qWarning("Murmur %d.%d.%d (%s) running on %s: %s: Booting servers", major, minor, patch, qPrintable(strver), qPrintable(meta->qsOS), qPrintable(meta->qsOSVersion));
 
+	ServerDB::startLog();
 	meta->bootAll();
 
+#ifdef Q_OS_UNIX
+	if (! Meta::mp.qsHandoverSocket.isEmpty()) {
+		Handover::closeUnused();
+		new Handover(Meta::mp.qsHandoverSocket, meta);
+	}
+#endif
+
+	if (Meta::mp.usMetricsPort) {
+		MetricsServer *ms = new MetricsServer(meta);
+		ms->listen(Meta::mp.qhaMetricsBind, Meta::mp.usMetricsPort);
+	}
+
 	res=a.exec();
 
 	qWarning("Killing running servers");
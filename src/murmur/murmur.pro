@@ -16,8 +16,8 @@ TARGET = murmur
 DBFILE  = murmur.db
 LANGUAGE	= C++
 FORMS =
-HEADERS *= Server.h ServerUser.h Meta.h
-SOURCES *= main.cpp Server.cpp ServerUser.cpp ServerDB.cpp Register.cpp Cert.cpp Messages.cpp Meta.cpp RPC.cpp
+HEADERS *= BandwidthRecord.h BanIndex.h FloodLimiter.h Server.h ServerArchive.h ServerUser.h Meta.h BlobStore.h Metrics.h LogRing.h LogSink.h PasswordHash.h SmallMap.h StatementCache.h TextSanitizer.h TimerWheel.h Trunk.h TrunkVoice.h UserDirectory.h UserPager.h VoiceStats.h
+SOURCES *= main.cpp BandwidthRecord.cpp BanIndex.cpp FloodLimiter.cpp Server.cpp ServerArchive.cpp ServerUser.cpp ServerDB.cpp Register.cpp Cert.cpp Messages.cpp Meta.cpp BlobStore.cpp Metrics.cpp RPC.cpp LogRing.cpp LogSink.cpp PasswordHash.cpp StatementCache.cpp TextSanitizer.cpp TimerWheel.cpp Trunk.cpp TrunkVoice.cpp UserDirectory.cpp UserPager.cpp VoiceStats.cpp
 
 DIST = DBus.h ServerDB.h ../../icons/murmur.ico Murmur.ice MurmurI.h MurmurIceWrapper.cpp murmur.plist
 PRECOMPILED_HEADER = murmur_pch.h
@@ -52,8 +52,8 @@ unix {
     LIBS *= -lcap
   }
 
-  HEADERS *= UnixMurmur.h
-  SOURCES *= UnixMurmur.cpp
+  HEADERS *= Handover.h UnixMurmur.h
+  SOURCES *= Handover.cpp UnixMurmur.cpp
   TARGET = murmurd
 }
 
@@ -163,4 +163,28 @@ bonjour {
 	}
 }
 
+io_uring {
+	contains(UNAME, Linux) {
+		DEFINES *= USE_IO_URING
+		SOURCES *= ServerUring.cpp
+		system(pkg-config --exists liburing) {
+			PKGCONFIG *= liburing
+		} else {
+			LIBS *= -luring
+		}
+	}
+}
+
+mixer {
+	DEFINES *= USE_MIXER
+	HEADERS *= Mixer.h MixGroup.h
+	SOURCES *= Mixer.cpp MixGroup.cpp
+	unix:!CONFIG(bundled-opus):system(pkg-config --exists opus) {
+		PKGCONFIG *= opus
+	} else {
+		INCLUDEPATH *= ../../opus-src/celt ../../opus-src/include ../../opus-src/src ../../opus-build/src
+		LIBS *= -lopus
+	}
+}
+
 include(../../symbols.pri)
@@ -63,6 +63,7 @@ extern "C" {
 #include <linux/types.h> // needed to work around evil magic stuff in capability.h
 #include <sys/capability.h>
 #include <sys/prctl.h>
+#include <linux/net_tstamp.h>
 #endif
 #include <pwd.h>
 #include <grp.h>
@@ -1,6 +1,21 @@
 /**
- * Provided a target address spawns a specified number of senders/speakers,
- * UDP-listeners and TCP-listeners.
+ * Load generator and latency harness for Murmur.
+ *
+ * Simulates many clients from a single process, spread over a few worker
+ * threads. Clients are distributed over a set of channels; a configurable
+ * fraction of them talk continuously using Opus sized frames, optionally
+ * whispering to the neighbouring channel, and a configurable fraction only
+ * uses the TCP tunnel.
+ *
+ * Every voice packet carries the time it was sent, so each receiving client
+ * can record the end-to-end forwarding latency. Senders know how many clients
+ * should receive each packet, which gives the loss rate. If the PID of the
+ * server is given, its CPU usage during the measurement is sampled from
+ * /proc. The result is written as a single JSON object.
+ *
+ * Note that the server needs to allow enough users (users=) and should have
+ * autoban disabled (autobanAttempts=0), as all clients connect from the same
+ * address.
  */
 
 #include <QtCore>
@@ -12,9 +27,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <sys/types.h>
 #ifndef Q_OS_WIN
 #include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <sys/utsname.h>
@@ -27,91 +43,385 @@
 #include "CryptState.h"
 #include "Mumble.pb.h"
 
-class Client : public QThread {
+// Marker at the start of every generated Opus payload.
+#define BENCH_MAGIC 0x4e454542
+// Magic, flags, sender, sequence and timestamp.
+#define BENCH_HEADER 24
+// Packet counted towards the measurement.
+#define BENCH_MEASURED 0x1
+
+struct Options {
+	QHostAddress qhaHost;
+	unsigned short usPort;
+	int iClients;
+	int iThreads;
+	int iChannels;
+	int iLinks;
+	double dSpeakers;
+	double dWhisper;
+	double dTcpOnly;
+	QList<int> qlFrames;
+	int iBitrate;
+	int iRate;
+	int iWarmup;
+	int iDuration;
+	int iJoinTimeout;
+	qint64 iServerPid;
+	QString qsPassword;
+	QString qsPrefix;
+	QString qsOutput;
+	uint uiSeed;
+
+	Options();
+	bool parse(const QStringList &args);
+};
+
+// Log-linear histogram of microsecond values. Values below 64 are exact,
+// above that each power of two is split into 32 buckets, which bounds the
+// relative error to about 3%.
+class LatencyHistogram {
+	public:
+		enum { Buckets = 2048 };
+		quint64 qu64Counts[Buckets];
+		quint64 uiCount;
+		quint64 uiSum;
+		quint64 uiMin;
+		quint64 uiMax;
+
+		LatencyHistogram();
+		static int bucket(quint64 v);
+		static quint64 lowerBound(int b);
+		void add(quint64 v);
+		void merge(const LatencyHistogram &other);
+		quint64 percentile(double p) const;
+};
+
+class Worker;
+
+class Client : public QObject {
 		Q_OBJECT
+		Q_DISABLE_COPY(Client)
 	public:
-		bool udp;
-		bool sender;
-		struct sockaddr_in srv;
-		unsigned int uiSession;
-		CryptState crypt;
-		int rcvd;
-		int socket;
-		int seq;
-		void run();
-		void ping();
-		void sendVoice();
-		int numbytes;
-		int ptype;
+		enum State { Connecting, Synced, Joined, Dead };
+
+		Worker *wWorker;
+		int iId;
+		int iChannel;
+		int iWhisperChannel;
+		bool bTcpOnly;
+		bool bSpeaker;
+		bool bWhisper;
+		bool bController;
+		int iFrameMs;
+		int iPayload;
+		State sState;
+
+		QString qsName;
+		QString qsPassword;
 		QSslSocket *ssl;
-		Client(QObject *parent, QHostAddress srvaddr, unsigned short prt, bool send, bool tcponly);
-		void doUdp(const unsigned char *buffer, int size);
-		void sendMessage(const ::google::protobuf::Message &msg, unsigned int msgType);
+		int iMessageType;
+		int iMessageLength;
+		CryptState crypt;
+		int iUdpSocket;
+		QSocketNotifier *qsnUdp;
+		unsigned int uiSession;
+		quint32 uiSequence;
+		quint64 uiNextSend;
+		quint64 uiNextPing;
+
+		// Collected by the controller during setup.
+		QMap<int, QString> qmChannelNames;
+		QMap<int, QSet<int> > qmChannelLinks;
+
+		Client(Worker *w, int id, const QString &name, const QString &password);
 		~Client();
+		void sendMessage(const ::google::protobuf::Message &msg, unsigned int msgType);
+		void sendTunnel(const unsigned char *buffer, int size);
+		void sendUdp(const unsigned char *buffer, int size);
+		void sendVoice(quint64 now);
+		void handleVoice(const unsigned char *buffer, int size);
+		void handleMessage(int type, const unsigned char *buffer, int size);
+	signals:
+		void synced();
 	public slots:
+		void ping();
+		void encrypted();
 		void readyRead();
+		void udpReady();
 		void disconnected();
 };
 
-Client::Client(QObject *p, QHostAddress qha, unsigned short prt, bool send, bool tcponly) : QThread(p) {
-	srv.sin_family = AF_INET;
-	srv.sin_addr.s_addr = htonl(qha.toIPv4Address());
-	srv.sin_port = htons(prt);
+// State shared between the worker threads and the main thread.
+struct Shared {
+	Options o;
+	QList<int> qlChannelIds;
+	// Channels reached by normal speech in each channel, including itself.
+	QList<QList<int> > qlSpeechReach;
+	QAtomicInt *qaiMembers;
+	QAtomicInt qaiConnected;
+	QAtomicInt qaiJoined;
+	QAtomicInt qaiFailed;
+	// 0 while connecting, 1 during warmup, 2 while measuring, 3 when draining
+	// and 4 to stop the workers.
+	QAtomicInt qaiPhase;
+	QString qsName;
+	Timer tClock;
+
+	Shared();
+	~Shared();
+};
+
+Shared *shared = NULL;
+
+class Worker : public QThread {
+		Q_OBJECT
+		Q_DISABLE_COPY(Worker)
+	public:
+		int iFirst;
+		int iCount;
+		int iSpawned;
+		Timer tSpawn;
+		QList<Client *> qlClients;
+
+		// Only touched from the worker thread until it has finished.
+		quint64 uiSent;
+		quint64 uiExpected;
+		quint64 uiReceived;
+		quint64 uiReceivedBytes;
+		quint64 uiDecryptFailures;
+		LatencyHistogram lhLatency;
+
+		Worker(int first, int count);
+		void run();
+		void spawn(int idx);
+	public slots:
+		void tick();
+};
+
+Options::Options() {
+	qhaHost = QHostAddress(QHostAddress::LocalHost);
+	usPort = 64738;
+	iClients = 100;
+	iThreads = qMax(1, QThread::idealThreadCount());
+	iChannels = 1;
+	iLinks = 0;
+	dSpeakers = 0.1;
+	dWhisper = 0.0;
+	dTcpOnly = 0.0;
+	qlFrames << 20;
+	iBitrate = 40000;
+	iRate = 100;
+	iWarmup = 5;
+	iDuration = 30;
+	iJoinTimeout = 60;
+	iServerPid = 0;
+	qsPrefix = QLatin1String("bench");
+	uiSeed = 1;
+}
+
+bool Options::parse(const QStringList &args) {
+	QStringList positional;
+
+	for (int i=1;i<args.count();++i) {
+		const QString &arg = args.at(i);
+		if (! arg.startsWith(QLatin1String("--"))) {
+			positional << arg;
+			continue;
+		}
+		if (i + 1 >= args.count())
+			return false;
+		const QString &val = args.at(++i);
+		bool ok = true;
+
+		if (arg == QLatin1String("--clients"))
+			iClients = val.toInt(&ok);
+		else if (arg == QLatin1String("--threads"))
+			iThreads = val.toInt(&ok);
+		else if (arg == QLatin1String("--channels"))
+			iChannels = val.toInt(&ok);
+		else if (arg == QLatin1String("--links"))
+			iLinks = val.toInt(&ok);
+		else if (arg == QLatin1String("--speakers"))
+			dSpeakers = val.toDouble(&ok);
+		else if (arg == QLatin1String("--whisper"))
+			dWhisper = val.toDouble(&ok);
+		else if (arg == QLatin1String("--tcponly"))
+			dTcpOnly = val.toDouble(&ok);
+		else if (arg == QLatin1String("--frames")) {
+			qlFrames.clear();
+			foreach(const QString &f, val.split(QLatin1Char(','))) {
+				int ms = f.toInt(&ok);
+				if (! ok || (ms != 10 && ms != 20 && ms != 40 && ms != 60))
+					return false;
+				qlFrames << ms;
+			}
+		} else if (arg == QLatin1String("--bitrate"))
+			iBitrate = val.toInt(&ok);
+		else if (arg == QLatin1String("--rate"))
+			iRate = val.toInt(&ok);
+		else if (arg == QLatin1String("--warmup"))
+			iWarmup = val.toInt(&ok);
+		else if (arg == QLatin1String("--duration"))
+			iDuration = val.toInt(&ok);
+		else if (arg == QLatin1String("--jointimeout"))
+			iJoinTimeout = val.toInt(&ok);
+		else if (arg == QLatin1String("--pid"))
+			iServerPid = val.toLongLong(&ok);
+		else if (arg == QLatin1String("--password"))
+			qsPassword = val;
+		else if (arg == QLatin1String("--prefix"))
+			qsPrefix = val;
+		else if (arg == QLatin1String("--output"))
+			qsOutput = val;
+		else if (arg == QLatin1String("--seed"))
+			uiSeed = val.toUInt(&ok);
+		else
+			return false;
+
+		if (! ok)
+			return false;
+	}
+
+	if (positional.count() > 2)
+		return false;
+	if (positional.count() >= 1)
+		qhaHost = QHostAddress(positional.at(0));
+	if (positional.count() == 2)
+		usPort = static_cast<unsigned short>(positional.at(1).toUInt());
+
+	if (qhaHost.isNull() || (iClients < 1) || (iThreads < 1) || (iChannels < 1) || (iRate < 1))
+		return false;
+
+	return true;
+}
+
+LatencyHistogram::LatencyHistogram() {
+	memset(qu64Counts, 0, sizeof(qu64Counts));
+	uiCount = uiSum = uiMax = 0;
+	uiMin = ~0ULL;
+}
+
+int LatencyHistogram::bucket(quint64 v) {
+	if (v < 64)
+		return static_cast<int>(v);
 
-	udp = ! tcponly;
-	sender = send;
+	int msb = 6;
+	while ((v >> (msb + 1)) != 0)
+		++msb;
+
+	int shift = msb - 5;
+	int b = (shift + 1) * 32 + static_cast<int>((v >> shift) & 31);
+	return qMin(b, static_cast<int>(Buckets - 1));
+}
+
+quint64 LatencyHistogram::lowerBound(int b) {
+	if (b < 64)
+		return static_cast<quint64>(b);
+
+	int shift = b / 32 - 1;
+	return (32ULL + static_cast<quint64>(b % 32)) << shift;
+}
+
+void LatencyHistogram::add(quint64 v) {
+	++qu64Counts[bucket(v)];
+	++uiCount;
+	uiSum += v;
+	uiMin = qMin(uiMin, v);
+	uiMax = qMax(uiMax, v);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+	for (int i=0;i<Buckets;++i)
+		qu64Counts[i] += other.qu64Counts[i];
+	uiCount += other.uiCount;
+	uiSum += other.uiSum;
+	uiMin = qMin(uiMin, other.uiMin);
+	uiMax = qMax(uiMax, other.uiMax);
+}
+
+quint64 LatencyHistogram::percentile(double p) const {
+	if (uiCount == 0)
+		return 0;
+
+	quint64 wanted = static_cast<quint64>(p * static_cast<double>(uiCount));
+	if (wanted >= uiCount)
+		wanted = uiCount - 1;
+
+	quint64 seen = 0;
+	for (int i=0;i<Buckets;++i) {
+		seen += qu64Counts[i];
+		if (seen > wanted)
+			return qMin(qMax(lowerBound(i), uiMin), uiMax);
+	}
+	return uiMax;
+}
+
+Shared::Shared() {
+	qaiMembers = NULL;
+}
+
+Shared::~Shared() {
+	delete [] qaiMembers;
+}
+
+Client::Client(Worker *w, int id, const QString &name, const QString &password) : QObject() {
+	wWorker = w;
+	iId = id;
+	iChannel = 0;
+	iWhisperChannel = 0;
+	bTcpOnly = false;
+	bSpeaker = false;
+	bWhisper = false;
+	bController = (w == NULL);
+	iFrameMs = 20;
+	iPayload = BENCH_HEADER;
+	sState = Connecting;
+	iMessageType = 0;
+	iMessageLength = -1;
+	iUdpSocket = -1;
+	qsnUdp = NULL;
+	uiSession = 0;
+	uiSequence = 0;
+	uiNextSend = 0;
+	uiNextPing = 0;
+	qsName = name;
+	qsPassword = password;
 
 	ssl = new QSslSocket(this);
 
+	connect(ssl, SIGNAL(encrypted()), this, SLOT(encrypted()));
 	connect(ssl, SIGNAL(readyRead()), this, SLOT(readyRead()));
 	connect(ssl, SIGNAL(disconnected()), this, SLOT(disconnected()));
 
-	ssl->setProtocol(QSsl::TlsV1);
-	ssl->connectToHostEncrypted(qha.toString(), prt);
 	ssl->ignoreSslErrors();
-	if (! ssl->waitForEncrypted())
-		qFatal("Connection failure");
-
-	static int ctr = 1;
+	ssl->connectToHostEncrypted(shared->o.qhaHost.toString(), shared->o.usPort);
+}
 
+Client::~Client() {
+	if (qsnUdp)
+		delete qsnUdp;
+	if (iUdpSocket >= 0)
 #ifdef Q_OS_WIN
-	DWORD pid = GetCurrentProcessId();
-	wchar_t buf[64];
-	DWORD bufsize = 64;
-	GetComputerName(buf, &bufsize);
-
-	QString name = QString("%1.%2").arg(QString::fromWCharArray(buf)).arg(pid * 1000 + ctr);
+		::closesocket(iUdpSocket);
 #else
-	struct utsname uts;
-	uname(&uts);
-
-	QString name = QString("%1.%2").arg(uts.nodename).arg(getpid() * 1000 + ctr);
+		::close(iUdpSocket);
 #endif
+}
 
-	ctr++;
+void Client::encrypted() {
+	shared->qaiConnected.ref();
 
 	MumbleProto::Version mpv;
-	mpv.set_release(u8(QLatin1String("1.2.1 Benchmark")));
-	mpv.set_version(0x010203);
-
+	mpv.set_release(u8(QLatin1String("1.2.5 Benchmark")));
+	mpv.set_version(0x010205);
 	sendMessage(mpv, MessageHandler::Version);
 
 	MumbleProto::Authenticate mpa;
-	mpa.set_username(u8(name));
-
+	mpa.set_username(u8(qsName));
+	if (! qsPassword.isEmpty())
+		mpa.set_password(u8(qsPassword));
+	mpa.set_opus(true);
 	sendMessage(mpa, MessageHandler::Authenticate);
-
-	if (udp)
-		socket = ::socket(PF_INET, SOCK_DGRAM, 0);
-
-	seq = 0;
-	rcvd = 0;
-	numbytes = -1;
-}
-
-Client::~Client() {
-	terminate();
-	wait();
 }
 
 void Client::sendMessage(const ::google::protobuf::Message &msg, unsigned int msgType) {
@@ -127,269 +437,734 @@ void Client::sendMessage(const ::google::protobuf::Message &msg, unsigned int ms
 	ssl->write(reinterpret_cast<const char *>(uc), len + 6);
 }
 
+void Client::sendTunnel(const unsigned char *buffer, int size) {
+	unsigned char uc[2048];
+	Q_ASSERT(size < 2000);
+
+	* reinterpret_cast<quint16 *>(& uc[0]) = qToBigEndian(static_cast<quint16>(MessageHandler::UDPTunnel));
+	* reinterpret_cast<quint32 *>(& uc[2]) = qToBigEndian(static_cast<quint32>(size));
+	memcpy(uc + 6, buffer, size);
+
+	ssl->write(reinterpret_cast<const char *>(uc), size + 6);
+}
+
+void Client::sendUdp(const unsigned char *buffer, int size) {
+	if ((iUdpSocket < 0) || ! crypt.isValid())
+		return;
+
+	unsigned char crypted[2048];
+
+	crypt.encrypt(buffer, crypted, size);
+	::send(iUdpSocket, reinterpret_cast<const char *>(crypted), size + 4, 0);
+}
+
 void Client::ping() {
 	unsigned char buffer[256];
 	buffer[0] = MessageHandler::UDPPing << 5;
 	PacketDataStream pds(buffer + 1, 255);
-	pds << 123;
+	pds << shared->tClock.elapsed();
 
-	doUdp(buffer, pds.size() + 1);
+	if (bTcpOnly)
+		sendTunnel(buffer, pds.size() + 1);
+	else
+		sendUdp(buffer, pds.size() + 1);
 
 	MumbleProto::Ping mpp;
-	mpp.set_timestamp(123);
+	mpp.set_timestamp(shared->tClock.elapsed());
 	sendMessage(mpp, MessageHandler::Ping);
 }
 
-void Client::sendVoice() {
+void Client::sendVoice(quint64 now) {
 	unsigned char buffer[1024];
-	int len = 32 + (qrand() & 0x3f);
-
-	// Regular voice, nothing special
-	buffer[0] = 0;
-
-	PacketDataStream ods(buffer + 1, 1024);
-	ods << 1;
-	ods.append(len);
-	ods.skip(len);
+	int phase = shared->qaiPhase;
+	bool measured = (phase == 2);
+	quint32 flags = measured ? BENCH_MEASURED : 0;
+
+	buffer[0] = static_cast<unsigned char>((MessageHandler::UDPVoiceOpus << 5) | (bWhisper ? 1 : 0));
+
+	PacketDataStream pds(buffer + 1, 1023);
+	pds << uiSequence;
+	pds << iPayload;
+
+	quint32 header[4];
+	header[0] = BENCH_MAGIC;
+	header[1] = flags;
+	header[2] = static_cast<quint32>(iId);
+	header[3] = uiSequence;
+	pds.append(reinterpret_cast<const char *>(header), sizeof(header));
+	pds.append(reinterpret_cast<const char *>(&now), sizeof(now));
+	pds.skip(iPayload - BENCH_HEADER);
+
+	// Opus sequence numbers count 10ms frames.
+	uiSequence += static_cast<quint32>(iFrameMs / 10);
+
+	if (measured) {
+		quint64 expected = 0;
+		if (bWhisper) {
+			expected = static_cast<quint64>(int(shared->qaiMembers[iWhisperChannel]));
+			if (iWhisperChannel == iChannel)
+				--expected;
+		} else {
+			foreach(int c, shared->qlSpeechReach.at(iChannel))
+				expected += static_cast<quint64>(int(shared->qaiMembers[c]));
+			--expected;
+		}
+		++wWorker->uiSent;
+		wWorker->uiExpected += expected;
+	}
 
-	doUdp(buffer, ods.size() + 1);
+	if (bTcpOnly)
+		sendTunnel(buffer, pds.size() + 1);
+	else
+		sendUdp(buffer, pds.size() + 1);
 }
 
-void Client::doUdp(const unsigned char *buffer, int size) {
-	if (! udp || ! crypt.isValid())
+void Client::handleVoice(const unsigned char *buffer, int size) {
+	if (! wWorker || (size < 2))
 		return;
 
-	unsigned char crypted[2048];
+	unsigned int type = (buffer[0] >> 5) & 0x7;
+	if (type != MessageHandler::UDPVoiceOpus)
+		return;
 
-	crypt.encrypt(reinterpret_cast<const unsigned char *>(buffer), crypted, size);
-	::sendto(socket, reinterpret_cast<const char *>(crypted), size+4, 0, reinterpret_cast<struct sockaddr *>(&srv), sizeof(srv));
-}
+	PacketDataStream pds(buffer + 1, size - 1);
+	unsigned int session, sequence, length;
+	pds >> session;
+	pds >> sequence;
+	pds >> length;
+	length &= 0x1fff;
 
+	if (! pds.isValid() || (length < BENCH_HEADER) || (pds.left() < BENCH_HEADER))
+		return;
 
-void Client::run() {
-	unsigned char buffer[1024];
-	struct sockaddr_in addr;
-	socklen_t sz;
-	int len;
+	quint32 header[4];
+	quint64 sent;
+	memcpy(header, pds.charPtr(), sizeof(header));
+	memcpy(&sent, pds.charPtr() + sizeof(header), sizeof(sent));
 
-	if (! udp)
+	if ((header[0] != BENCH_MAGIC) || ! (header[1] & BENCH_MEASURED))
 		return;
 
-	forever {
-		sz = sizeof(addr);
-		len = ::recvfrom(socket, reinterpret_cast<char *>(buffer), 1024, 0, reinterpret_cast<struct sockaddr *>(&addr), &sz);
-		if (len <= 0)
-			break;
-		if (len >= 32)
-			rcvd++;
-	}
+	quint64 now = shared->tClock.elapsed();
+	++wWorker->uiReceived;
+	wWorker->uiReceivedBytes += static_cast<quint64>(size);
+	wWorker->lhLatency.add((now > sent) ? (now - sent) : 0);
 }
 
 void Client::readyRead() {
 	forever {
-		int avail = ssl->bytesAvailable();
-		if (numbytes == -1) {
+		qint64 avail = ssl->bytesAvailable();
+		if (iMessageLength == -1) {
 			if (avail < 6)
 				break;
 			unsigned char b[6];
 			ssl->read(reinterpret_cast<char *>(b), 6);
 
-			ptype = qFromBigEndian(* reinterpret_cast<quint16 *>(& b[0]));
-			numbytes = qFromBigEndian(* reinterpret_cast<quint32 *>(& b[2]));
+			iMessageType = qFromBigEndian(* reinterpret_cast<quint16 *>(& b[0]));
+			iMessageLength = qFromBigEndian(* reinterpret_cast<quint32 *>(& b[2]));
 
 			avail = ssl->bytesAvailable();
 		}
-		if ((numbytes >= 0) && (avail >= numbytes)) {
-			int want = numbytes;
-			numbytes = -1;
-			unsigned char buff[65536];
-			Q_ASSERT(want < 65536);
-			ssl->read(reinterpret_cast<char *>(buff), want);
-
+		if ((iMessageLength >= 0) && (avail >= iMessageLength)) {
+			QByteArray qba = ssl->read(iMessageLength);
+			int type = iMessageType;
+			iMessageLength = -1;
 
-			avail = ssl->bytesAvailable();
+			handleMessage(type, reinterpret_cast<const unsigned char *>(qba.constData()), qba.size());
+		} else {
+			break;
+		}
+	}
+}
 
-			switch (ptype) {
-				case MessageHandler::CryptSetup: {
-						MumbleProto::CryptSetup msg;
-						if (! msg.ParseFromArray(buff, want))
-							qFatal("Failed parse crypt");
-
-						if (msg.has_key() && msg.has_client_nonce() && msg.has_server_nonce()) {
-							const std::string &key = msg.key();
-							const std::string &client_nonce = msg.client_nonce();
-							const std::string &server_nonce = msg.server_nonce();
-							if (key.size() == AES_BLOCK_SIZE && client_nonce.size() == AES_BLOCK_SIZE && server_nonce.size() == AES_BLOCK_SIZE)
-								crypt.setKey(reinterpret_cast<const unsigned char *>(key.data()), reinterpret_cast<const unsigned char *>(client_nonce.data()), reinterpret_cast<const unsigned char *>(server_nonce.data()));
-						} else if (msg.has_server_nonce()) {
-							const std::string &server_nonce = msg.server_nonce();
-							if (server_nonce.size() == AES_BLOCK_SIZE) {
-								crypt.uiResync++;
-								memcpy(crypt.decrypt_iv, server_nonce.data(), AES_BLOCK_SIZE);
-							}
-						} else {
-							MumbleProto::CryptSetup mpcs;
-							mpcs.set_client_nonce(std::string(reinterpret_cast<const char *>(crypt.encrypt_iv), AES_BLOCK_SIZE));
-							sendMessage(mpcs, MessageHandler::CryptSetup);
-						}
-						break;
+void Client::handleMessage(int type, const unsigned char *buff, int want) {
+	switch (type) {
+		case MessageHandler::CryptSetup: {
+				MumbleProto::CryptSetup msg;
+				if (! msg.ParseFromArray(buff, want))
+					qFatal("Failed parse crypt");
+
+				if (msg.has_key() && msg.has_client_nonce() && msg.has_server_nonce()) {
+					const std::string &key = msg.key();
+					const std::string &client_nonce = msg.client_nonce();
+					const std::string &server_nonce = msg.server_nonce();
+					if (key.size() == AES_BLOCK_SIZE && client_nonce.size() == AES_BLOCK_SIZE && server_nonce.size() == AES_BLOCK_SIZE)
+						crypt.setKey(reinterpret_cast<const unsigned char *>(key.data()), reinterpret_cast<const unsigned char *>(client_nonce.data()), reinterpret_cast<const unsigned char *>(server_nonce.data()));
+				} else if (msg.has_server_nonce()) {
+					const std::string &server_nonce = msg.server_nonce();
+					if (server_nonce.size() == AES_BLOCK_SIZE) {
+						crypt.uiResync++;
+						memcpy(crypt.decrypt_iv, server_nonce.data(), AES_BLOCK_SIZE);
 					}
-				case MessageHandler::ServerSync: {
-						MumbleProto::ServerSync msg;
-						if (! msg.ParseFromArray(buff, want))
-							qFatal("Failed parse sync");
-						uiSession = msg.session();
-						break;
+				} else {
+					MumbleProto::CryptSetup mpcs;
+					mpcs.set_client_nonce(std::string(reinterpret_cast<const char *>(crypt.encrypt_iv), AES_BLOCK_SIZE));
+					sendMessage(mpcs, MessageHandler::CryptSetup);
+				}
+
+				if (! bTcpOnly && ! bController && (iUdpSocket < 0) && crypt.isValid()) {
+					struct sockaddr_in srv;
+					memset(&srv, 0, sizeof(srv));
+					srv.sin_family = AF_INET;
+					srv.sin_addr.s_addr = htonl(shared->o.qhaHost.toIPv4Address());
+					srv.sin_port = htons(shared->o.usPort);
+
+					iUdpSocket = ::socket(PF_INET, SOCK_DGRAM, 0);
+					if (iUdpSocket >= 0) {
+						::fcntl(iUdpSocket, F_SETFL, O_NONBLOCK);
+						::connect(iUdpSocket, reinterpret_cast<struct sockaddr *>(&srv), sizeof(srv));
+						qsnUdp = new QSocketNotifier(iUdpSocket, QSocketNotifier::Read, this);
+						connect(qsnUdp, SIGNAL(activated(int)), this, SLOT(udpReady()));
 					}
-				case MessageHandler::UDPTunnel: {
-						unsigned int msgUDPType = (buff[0] >> 5) & 0x7;
-						if (msgUDPType == MessageHandler::UDPVoiceCELTAlpha)
-							rcvd++;
-						break;
+				}
+				break;
+			}
+		case MessageHandler::ChannelState: {
+				if (! bController)
+					break;
+				MumbleProto::ChannelState msg;
+				if (! msg.ParseFromArray(buff, want) || ! msg.has_channel_id())
+					break;
+				int id = static_cast<int>(msg.channel_id());
+				if (msg.has_name())
+					qmChannelNames.insert(id, u8(msg.name()));
+				if (msg.links_size() > 0)
+					qmChannelLinks[id].clear();
+				for (int i=0;i<msg.links_size();++i)
+					qmChannelLinks[id].insert(static_cast<int>(msg.links(i)));
+				for (int i=0;i<msg.links_add_size();++i)
+					qmChannelLinks[id].insert(static_cast<int>(msg.links_add(i)));
+				for (int i=0;i<msg.links_remove_size();++i)
+					qmChannelLinks[id].remove(static_cast<int>(msg.links_remove(i)));
+				emit synced();
+				break;
+			}
+		case MessageHandler::ChannelRemove: {
+				if (! bController)
+					break;
+				MumbleProto::ChannelRemove msg;
+				if (msg.ParseFromArray(buff, want)) {
+					qmChannelNames.remove(static_cast<int>(msg.channel_id()));
+					qmChannelLinks.remove(static_cast<int>(msg.channel_id()));
+				}
+				break;
+			}
+		case MessageHandler::ServerSync: {
+				MumbleProto::ServerSync msg;
+				if (! msg.ParseFromArray(buff, want))
+					qFatal("Failed parse sync");
+				uiSession = msg.session();
+				sState = Synced;
+
+				if (! bController) {
+					MumbleProto::UserState mpus;
+					mpus.set_session(uiSession);
+					mpus.set_channel_id(shared->qlChannelIds.at(iChannel));
+					sendMessage(mpus, MessageHandler::UserState);
+
+					if (bWhisper) {
+						MumbleProto::VoiceTarget mpvt;
+						mpvt.set_id(1);
+						MumbleProto::VoiceTarget_Target *t = mpvt.add_targets();
+						t->set_channel_id(shared->qlChannelIds.at(iWhisperChannel));
+						sendMessage(mpvt, MessageHandler::VoiceTarget);
 					}
+
+					ping();
+				}
+				emit synced();
+				break;
 			}
-		} else {
+		case MessageHandler::UserState: {
+				if (bController || (sState != Synced))
+					break;
+				MumbleProto::UserState msg;
+				if (! msg.ParseFromArray(buff, want))
+					break;
+				if ((msg.session() == uiSession) && msg.has_channel_id() && (static_cast<int>(msg.channel_id()) == shared->qlChannelIds.at(iChannel))) {
+					sState = Joined;
+					shared->qaiMembers[iChannel].ref();
+					shared->qaiJoined.ref();
+				}
+				break;
+			}
+		case MessageHandler::Reject: {
+				MumbleProto::Reject msg;
+				msg.ParseFromArray(buff, want);
+				qWarning("Client %d rejected: %s", iId, msg.reason().c_str());
+				break;
+			}
+		case MessageHandler::UDPTunnel:
+			handleVoice(buff, want);
 			break;
+		default:
+			break;
+	}
+}
+
+void Client::udpReady() {
+	unsigned char buffer[2048];
+	unsigned char plain[2048];
+
+	forever {
+		int len = static_cast<int>(::recv(iUdpSocket, reinterpret_cast<char *>(buffer), sizeof(buffer), 0));
+		if (len <= 0)
+			break;
+		if (len < 5)
+			continue;
+		if (! crypt.decrypt(buffer, plain, len)) {
+			if (wWorker)
+				++wWorker->uiDecryptFailures;
+			continue;
 		}
+		handleVoice(plain, len - 4);
 	}
 }
 
 void Client::disconnected() {
-	qWarning("SSL Socket disconnected");
-	QCoreApplication::instance()->quit();
+	if (sState == Joined) {
+		shared->qaiMembers[iChannel].deref();
+		shared->qaiJoined.deref();
+	}
+	if ((sState != Dead) && ! bController) {
+		shared->qaiFailed.ref();
+		qWarning("Client %d disconnected: %s", iId, qPrintable(ssl->errorString()));
+	}
+	sState = Dead;
 }
 
-class Container : public QObject {
-		Q_OBJECT
-	public:
-		int sent;
-		int numsender, numudplistener, numtcplistener;
-		int isender, iudplistener, itcplistener;
-		bool live, forceping;
-		QHostAddress qha;
-		unsigned short port;
-		QTimer qtTick;
-		Timer tickPing, tickVoice, tickGo, tickSpawn;
-		QList<Client *> speakers;
-		QList<Client *> clients;
-		Container(QHostAddress srvaddr, unsigned short port, int nsend, int nudp, int ntcp);
-	public slots:
-		void tick();
-		void go();
-};
+Worker::Worker(int first, int count) : QThread() {
+	iFirst = first;
+	iCount = count;
+	iSpawned = 0;
+	uiSent = uiExpected = uiReceived = uiReceivedBytes = uiDecryptFailures = 0;
+}
+
+void Worker::spawn(int idx) {
+	const Options &o = shared->o;
+	int id = iFirst + idx;
+
+	Client *c = new Client(this, id, QString::fromLatin1("%1.%2").arg(shared->qsName).arg(id), QString());
 
-Container::Container(QHostAddress qha, unsigned short port, int numsend, int numudp, int numtcp) {
-	isender = iudplistener = itcplistener = 0;
-	live = false;
-	forceping = false;
-	sent = 0;
+	c->iChannel = id % shared->qlChannelIds.count();
 
-	Timer t;
+	// Spread speakers and TCP-only clients evenly over the client list, so
+	// every channel and every worker get their share.
+	c->bSpeaker = (static_cast<int>((id + 1) * o.dSpeakers) != static_cast<int>(id * o.dSpeakers));
+	c->bTcpOnly = (static_cast<int>((id + 1) * o.dTcpOnly + 0.5) != static_cast<int>(id * o.dTcpOnly + 0.5));
 
-	qWarning("Spawning %d speakers and %d listeners (%d UDP, %d TCP)", numsend, numudp+numtcp, numudp, numtcp);
+	if (c->bSpeaker) {
+		c->bWhisper = (static_cast<double>(qrand()) / RAND_MAX) < o.dWhisper;
+		c->iWhisperChannel = (c->iChannel + 1) % shared->qlChannelIds.count();
+		c->iFrameMs = o.qlFrames.at(id % o.qlFrames.count());
+		c->iPayload = qBound(BENCH_HEADER, o.iBitrate * c->iFrameMs / 8000, 1000);
+		// Stagger the start of the speakers over one frame.
+		c->uiNextSend = shared->tClock.elapsed() + static_cast<quint64>(qrand() % (c->iFrameMs * 1000));
+	}
+	c->uiNextPing = shared->tClock.elapsed() + static_cast<quint64>(qrand() % 5000000);
 
-	this->qha = qha;
-	this->port = port;
+	qlClients << c;
+}
 
-	numsender = numsend;
-	numudplistener = numudp;
-	numtcplistener = numtcp;
+void Worker::run() {
+	qsrand(shared->o.uiSeed + static_cast<uint>(iFirst));
 
+	QTimer qtTick;
+	connect(&qtTick, SIGNAL(timeout()), this, SLOT(tick()), Qt::DirectConnection);
+	qtTick.start(2);
+	tSpawn.restart();
 
-	connect(&qtTick, SIGNAL(timeout()), this, SLOT(tick()));
-	qtTick.start(0);
+	exec();
 
-	tickSpawn.restart();
+	qtTick.stop();
+	qDeleteAll(qlClients);
+	qlClients.clear();
 }
 
-void Container::tick() {
-	if (forceping || tickPing.isElapsed(5000000ULL)) {
-		forceping = false;
+void Worker::tick() {
+	const Options &o = shared->o;
+	int phase = shared->qaiPhase;
 
-		foreach(Client *c, clients)
-			c->ping();
+	if (phase == 4) {
+		quit();
+		return;
+	}
 
-		if (live) {
+	if (iSpawned < iCount) {
+		// Each worker connects its share of the configured rate.
+		quint64 due = tSpawn.elapsed() * static_cast<quint64>(o.iRate) / (1000000ULL * static_cast<quint64>(o.iThreads)) + 1;
+		while ((iSpawned < iCount) && (static_cast<quint64>(iSpawned) < due))
+			spawn(iSpawned++);
+	}
 
-			int lost = 0;
-			quint64 totrcv = 0;
-			int nrcv = 0;
-			foreach(Client *c, clients) {
-				if (! c->sender) {
-					totrcv += c->rcvd;
-					lost += sent - c->rcvd;
-					nrcv++;
-				}
-			}
-			qWarning("Sent: %8d  Rcvd: %8lld  Lost: %8d   BW: %6.1fMbit/s", sent, totrcv / nrcv, (lost + nrcv - 1) / nrcv, (totrcv * 8.0 * 123.0) / (tickGo.elapsed() * 1.0));
-		} else {
-			qWarning("Spawned %3d/%3d", isender + iudplistener + itcplistener, numsender + numudplistener + numtcplistener);
+	quint64 now = shared->tClock.elapsed();
+
+	foreach(Client *c, qlClients) {
+		if (c->sState == Client::Dead)
+			continue;
+
+		if (now >= c->uiNextPing) {
+			c->uiNextPing = now + 5000000ULL;
+			if (c->sState != Client::Connecting)
+				c->ping();
+		}
+
+		if (! c->bSpeaker || (c->sState != Client::Joined) || (phase < 1) || (phase > 2))
+			continue;
+
+		while (now >= c->uiNextSend) {
+			c->sendVoice(now);
+			c->uiNextSend += static_cast<quint64>(c->iFrameMs) * 1000ULL;
 		}
 	}
+}
+
+static bool waitFor(Client *c, int msecs, bool (*done)(Client *)) {
+	QEventLoop loop;
+	QTimer t;
+	t.setSingleShot(true);
+	QObject::connect(&t, SIGNAL(timeout()), &loop, SLOT(quit()));
+	QObject::connect(c, SIGNAL(synced()), &loop, SLOT(quit()));
+	QObject::connect(c->ssl, SIGNAL(disconnected()), &loop, SLOT(quit()));
+	t.start(msecs);
+
+	while (! done(c)) {
+		if (! t.isActive() || (c->sState == Client::Dead))
+			return false;
+		loop.exec();
+	}
+	return true;
+}
+
+static bool isSynced(Client *c) {
+	return c->sState != Client::Connecting;
+}
+
+static QList<int> benchChannels(Client *c) {
+	QList<int> ids;
+	const Options &o = shared->o;
 
-	if (live && tickVoice.isElapsed(10000ULL)) {
-		foreach(Client *c, speakers) {
-			sent++;
-			c->sendVoice();
+	for (int i=0;i<o.iChannels;++i) {
+		int id = c->qmChannelNames.key(QString::fromLatin1("%1-%2").arg(o.qsPrefix).arg(i), -1);
+		if (id < 0)
+			return QList<int>();
+		ids << id;
+	}
+	return ids;
+}
+
+static bool hasBenchChannels(Client *c) {
+	return ! benchChannels(c).isEmpty();
+}
+
+static QList<int> *pendingLinks = NULL;
+
+static bool hasLinks(Client *c) {
+	QList<int> ids = benchChannels(c);
+	foreach(int i, *pendingLinks)
+		if (! c->qmChannelLinks.value(ids.at(i)).contains(ids.at(i + 1)))
+			return false;
+	return true;
+}
+
+// Sets up the channel layout with a separate controller connection. With a
+// SuperUser password, the bench channels are created and linked as needed.
+// Without one, existing bench channels are used, or else the first channels
+// of the server.
+static bool setupChannels() {
+	Options &o = shared->o;
+	Client *c = new Client(NULL, -1, o.qsPassword.isEmpty() ? QString::fromLatin1("%1.control").arg(shared->qsName) : QLatin1String("SuperUser"), o.qsPassword);
+
+	if (! waitFor(c, 10000, isSynced)) {
+		qWarning("Controller failed to connect");
+		delete c;
+		return false;
+	}
+
+	QList<int> ids = benchChannels(c);
+
+	if (ids.isEmpty() && ! o.qsPassword.isEmpty()) {
+		for (int i=0;i<o.iChannels;++i) {
+			const QString &name = QString::fromLatin1("%1-%2").arg(o.qsPrefix).arg(i);
+			if (c->qmChannelNames.key(name, -1) >= 0)
+				continue;
+			MumbleProto::ChannelState mpcs;
+			mpcs.set_parent(0);
+			mpcs.set_name(u8(name));
+			c->sendMessage(mpcs, MessageHandler::ChannelState);
+		}
+		if (! waitFor(c, 10000, hasBenchChannels)) {
+			qWarning("Failed to create channels");
+			delete c;
+			return false;
 		}
+		ids = benchChannels(c);
 	}
-	if (! live) {
-		if (isender < numsender) {
-			// Spawn a sender
-			Client *c = new Client(this, qha, port, true, false);
-			speakers << c;
-			c->start();
-			clients << c;
-			isender++;
-		} else if (iudplistener < numudplistener) {
-			// Spawn a listener which uses UDP
-			Client *c = new Client(this, qha, port, false, false);
-			c->start();
-			clients << c;
-			iudplistener++;
-		} else if (itcplistener < numtcplistener) {
-			// Spawn a listener which uses TCP-only
-			Client *c = new Client(this, qha, port, false, true);
-			c->start();
-			clients << c;
-			itcplistener++;
-		} else {
-			live = true;
-			quint64 elapsed = tickSpawn.elapsed();
-			qWarning("Spawning took %lld ms (%lld us per client)", elapsed / 1000ULL, elapsed / (numsender+numudplistener+numtcplistener));
-			foreach(Client *c, clients)
-				c->rcvd = 0;
-			sent = 0;
-			forceping = true;
-			qtTick.start(10);
+
+	if (ids.isEmpty()) {
+		if (o.iLinks > 0)
+			qWarning("Not creating links without a SuperUser password");
+		ids = c->qmChannelNames.keys();
+		qSort(ids);
+		while (ids.count() > o.iChannels)
+			ids.removeLast();
+		o.iChannels = ids.count();
+	} else if (o.iLinks > 0 && ! o.qsPassword.isEmpty()) {
+		QList<int> links;
+		for (int i=0;(i<o.iLinks) && (i + 1 < ids.count());++i) {
+			links << i;
+			MumbleProto::ChannelState mpcs;
+			mpcs.set_channel_id(ids.at(i));
+			mpcs.add_links_add(ids.at(i + 1));
+			c->sendMessage(mpcs, MessageHandler::ChannelState);
 		}
+		pendingLinks = &links;
+		bool linked = waitFor(c, 10000, hasLinks);
+		pendingLinks = NULL;
+		if (! linked)
+			qWarning("Failed to link channels");
 	}
+
+	shared->qlChannelIds = ids;
+
+	// Normal speech reaches all transitively linked channels.
+	for (int i=0;i<ids.count();++i) {
+		QList<int> reach;
+		QList<int> todo;
+		todo << ids.at(i);
+		QSet<int> seen;
+		while (! todo.isEmpty()) {
+			int id = todo.takeFirst();
+			if (seen.contains(id))
+				continue;
+			seen.insert(id);
+			int idx = ids.indexOf(id);
+			if (idx >= 0)
+				reach << idx;
+			foreach(int l, c->qmChannelLinks.value(id))
+				todo << l;
+		}
+		shared->qlSpeechReach << reach;
+	}
+
+	shared->qaiMembers = new QAtomicInt[ids.count()];
+
+	// Keep the controller connected for the whole run.
+	c->setParent(QCoreApplication::instance());
+	QTimer *t = new QTimer(c);
+	QObject::connect(t, SIGNAL(timeout()), c, SLOT(ping()));
+	t->start(5000);
+	return true;
+}
+
+static bool processTicks(qint64 pid, quint64 &ticks) {
+#ifdef Q_OS_LINUX
+	QFile f(QString::fromLatin1("/proc/%1/stat").arg(pid));
+	if (! f.open(QIODevice::ReadOnly))
+		return false;
+	const QByteArray &stat = f.readAll();
+
+	// The command name may contain spaces, fields are counted after it.
+	int idx = stat.lastIndexOf(')');
+	if (idx < 0)
+		return false;
+	QList<QByteArray> fields = stat.mid(idx + 2).split(' ');
+	if (fields.count() < 13)
+		return false;
+
+	// utime and stime are fields 14 and 15 of the stat line.
+	ticks = fields.at(11).toULongLong() + fields.at(12).toULongLong();
+	return true;
+#else
+	Q_UNUSED(pid);
+	Q_UNUSED(ticks);
+	return false;
+#endif
+}
+
+static void raiseFileLimit() {
+#ifndef Q_OS_WIN
+	struct rlimit r;
+	if (getrlimit(RLIMIT_NOFILE, &r) == 0) {
+		r.rlim_cur = r.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &r);
+	}
+#endif
 }
 
-void Container::go() {
-	foreach(Client *c, clients)
-		c->start();
-	qtTick.start(10);
-	tickGo.restart();
+static QString jsonNumber(double v) {
+	return QString::number(v, 'f', 3);
 }
 
 int main(int argc, char **argv) {
 	QCoreApplication a(argc, argv);
 
-	qWarning("Maximum # sockets is %d", FD_SETSIZE);
+	shared = new Shared();
+	Options &o = shared->o;
+
+	if (! o.parse(a.arguments()))
+		qFatal("Usage: %s [options] [host] [port]\n"
+		       "  --clients N       Number of simulated clients (100)\n"
+		       "  --threads N       Worker threads (number of cores)\n"
+		       "  --channels N      Channels to spread the clients over (1)\n"
+		       "  --links N         Link the first N+1 bench channels in a chain (0)\n"
+		       "  --speakers F      Fraction of clients that talk (0.1)\n"
+		       "  --whisper F       Fraction of speakers that whisper to the next channel (0)\n"
+		       "  --tcponly F       Fraction of clients that only use the TCP tunnel (0)\n"
+		       "  --frames LIST     Opus frame sizes in ms, e.g. 10,20,40,60 (20)\n"
+		       "  --bitrate BPS     Opus bitrate, determines the payload size (40000)\n"
+		       "  --rate N          Clients connected per second (100)\n"
+		       "  --warmup S        Seconds of talking before measuring (5)\n"
+		       "  --duration S      Seconds to measure (30)\n"
+		       "  --jointimeout S   Seconds to wait for all clients to join (60)\n"
+		       "  --pid PID         Server process, to sample its CPU usage\n"
+		       "  --password PW     SuperUser password, to create and link channels\n"
+		       "  --prefix NAME     Name prefix of the bench channels (bench)\n"
+		       "  --output FILE     Write the JSON result to FILE instead of stdout\n"
+		       "  --seed N          Random seed (1)\n"
+		       "Voice held back by a server speaker limit is reported as loss.", argv[0]);
+
+	raiseFileLimit();
+	qsrand(o.uiSeed);
 
-	if (argc != 6)
-		qFatal("Invalid number of arguments. These need to be passed: <host address> <port> <numsend> <numudp> <numtcp>");
+#ifdef Q_OS_WIN
+	shared->qsName = QString::fromLatin1("bench%1").arg(GetCurrentProcessId());
+#else
+	shared->qsName = QString::fromLatin1("bench%1").arg(getpid());
+#endif
+
+	if (! setupChannels())
+		return 1;
+
+	qWarning("Spawning %d clients on %d threads in %d channels", o.iClients, o.iThreads, shared->qlChannelIds.count());
+
+	QList<Worker *> workers;
+	int per = (o.iClients + o.iThreads - 1) / o.iThreads;
+	for (int first=0;first<o.iClients;first+=per) {
+		Worker *w = new Worker(first, qMin(per, o.iClients - first));
+		workers << w;
+		w->start();
+	}
+
+	Timer tJoin, tReport;
+	while ((int(shared->qaiJoined) + int(shared->qaiFailed) < o.iClients) && (tJoin.elapsed() < o.iJoinTimeout * 1000000ULL)) {
+		a.processEvents(QEventLoop::AllEvents, 100);
+		if (tReport.isElapsed(1000000ULL))
+			qWarning("Connected %5d  Joined %5d  Failed %5d", int(shared->qaiConnected), int(shared->qaiJoined), int(shared->qaiFailed));
+	}
+
+	int joined = shared->qaiJoined;
+	qWarning("%d of %d clients joined in %.1f s", joined, o.iClients, static_cast<double>(tJoin.elapsed()) / 1000000.0);
+
+	shared->qaiPhase.fetchAndStoreOrdered(1);
+	Timer tPhase;
+	while (tPhase.elapsed() < o.iWarmup * 1000000ULL)
+		a.processEvents(QEventLoop::AllEvents, 100);
+
+	quint64 serverStart = 0, serverEnd = 0;
+	bool serverCpu = (o.iServerPid > 0) && processTicks(o.iServerPid, serverStart);
+#ifndef Q_OS_WIN
+	struct rusage ruStart, ruEnd;
+	getrusage(RUSAGE_SELF, &ruStart);
+#endif
+
+	shared->qaiPhase.fetchAndStoreOrdered(2);
+	tPhase.restart();
+	while (tPhase.elapsed() < o.iDuration * 1000000ULL)
+		a.processEvents(QEventLoop::AllEvents, 100);
+	double wall = static_cast<double>(tPhase.elapsed()) / 1000000.0;
 
-	QHostAddress qha = QHostAddress(argv[1]);
-	int port = atoi(argv[2]);
-	int numsender = atoi(argv[3]);
-	int numudplistener = atoi(argv[4]);
-	int numtcplistener = atoi(argv[5]);
+	serverCpu = serverCpu && processTicks(o.iServerPid, serverEnd);
+#ifndef Q_OS_WIN
+	getrusage(RUSAGE_SELF, &ruEnd);
+#endif
+
+	// Stop talking, but give packets in flight time to arrive.
+	shared->qaiPhase.fetchAndStoreOrdered(3);
+	tPhase.restart();
+	while (tPhase.elapsed() < 2000000ULL)
+		a.processEvents(QEventLoop::AllEvents, 100);
+
+	shared->qaiPhase.fetchAndStoreOrdered(4);
+	foreach(Worker *w, workers)
+		w->wait();
+
+	LatencyHistogram lh;
+	quint64 sent = 0, expected = 0, received = 0, receivedBytes = 0, decryptFailures = 0;
+	foreach(Worker *w, workers) {
+		sent += w->uiSent;
+		expected += w->uiExpected;
+		received += w->uiReceived;
+		receivedBytes += w->uiReceivedBytes;
+		decryptFailures += w->uiDecryptFailures;
+		lh.merge(w->lhLatency);
+	}
+	qDeleteAll(workers);
+
+	double loss = (expected > 0) ? 1.0 - static_cast<double>(qMin(received, expected)) / static_cast<double>(expected) : 0.0;
+
+	QString json;
+	QTextStream ts(&json);
+	ts << "{\n";
+	ts << "  \"config\": {";
+	ts << "\"clients\": " << o.iClients << ", \"threads\": " << o.iThreads << ", \"channels\": " << shared->qlChannelIds.count();
+	ts << ", \"links\": " << o.iLinks << ", \"speakers\": " << jsonNumber(o.dSpeakers) << ", \"whisper\": " << jsonNumber(o.dWhisper);
+	ts << ", \"tcponly\": " << jsonNumber(o.dTcpOnly) << ", \"frames\": [";
+	for (int i=0;i<o.qlFrames.count();++i)
+		ts << (i ? ", " : "") << o.qlFrames.at(i);
+	ts << "], \"bitrate\": " << o.iBitrate << ", \"duration\": " << o.iDuration << ", \"seed\": " << o.uiSeed << "},\n";
+	ts << "  \"joined\": " << joined << ",\n";
+	ts << "  \"failed\": " << int(shared->qaiFailed) << ",\n";
+	ts << "  \"sent\": " << sent << ",\n";
+	ts << "  \"expected\": " << expected << ",\n";
+	ts << "  \"received\": " << received << ",\n";
+	ts << "  \"loss\": " << QString::number(loss, 'f', 6) << ",\n";
+	ts << "  \"decrypt_failures\": " << decryptFailures << ",\n";
+	ts << "  \"packets_per_second\": " << jsonNumber(static_cast<double>(received) / wall) << ",\n";
+	ts << "  \"downlink_bytes_per_second\": " << jsonNumber(static_cast<double>(receivedBytes) / wall) << ",\n";
+	ts << "  \"downlink_bytes_per_client\": " << jsonNumber((joined > 0) ? static_cast<double>(receivedBytes) / wall / joined : 0.0) << ",\n";
+	ts << "  \"latency_us\": {";
+	ts << "\"min\": " << ((lh.uiCount > 0) ? lh.uiMin : 0ULL);
+	ts << ", \"mean\": " << jsonNumber((lh.uiCount > 0) ? static_cast<double>(lh.uiSum) / static_cast<double>(lh.uiCount) : 0.0);
+	ts << ", \"p50\": " << lh.percentile(0.5);
+	ts << ", \"p90\": " << lh.percentile(0.9);
+	ts << ", \"p99\": " << lh.percentile(0.99);
+	ts << ", \"p999\": " << lh.percentile(0.999);
+	ts << ", \"max\": " << lh.uiMax << "},\n";
+
+	ts << "  \"server_cpu_percent\": ";
+#ifndef Q_OS_WIN
+	if (serverCpu)
+		ts << jsonNumber(static_cast<double>(serverEnd - serverStart) * 100.0 / static_cast<double>(sysconf(_SC_CLK_TCK)) / wall);
+	else
+#endif
+		ts << "null";
+	ts << ",\n";
+
+	ts << "  \"client_cpu_percent\": ";
+#ifndef Q_OS_WIN
+	double client = static_cast<double>(ruEnd.ru_utime.tv_sec - ruStart.ru_utime.tv_sec + ruEnd.ru_stime.tv_sec - ruStart.ru_stime.tv_sec);
+	client += static_cast<double>(ruEnd.ru_utime.tv_usec - ruStart.ru_utime.tv_usec + ruEnd.ru_stime.tv_usec - ruStart.ru_stime.tv_usec) / 1000000.0;
+	ts << jsonNumber(client * 100.0 / wall);
+#else
+	ts << "null";
+#endif
+	ts << "\n}\n";
+	ts.flush();
+
+	qWarning("Sent %llu  Received %llu/%llu  Loss %.3f%%  p50 %llu us  p99 %llu us", sent, received, expected, loss * 100.0, lh.percentile(0.5), lh.percentile(0.99));
+
+	if (o.qsOutput.isEmpty()) {
+		fputs(json.toUtf8().constData(), stdout);
+	} else {
+		QFile f(o.qsOutput);
+		if (! f.open(QIODevice::WriteOnly | QIODevice::Truncate))
+			qFatal("Failed to open %s", qPrintable(o.qsOutput));
+		f.write(json.toUtf8());
+	}
 
-	Container c(qha, port, numsender, numudplistener, numtcplistener);
-	c.go();
-	a.exec();
+	delete shared;
+	return 0;
 }
 
 #include "Benchmark.moc"
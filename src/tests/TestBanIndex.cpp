@@ -0,0 +1,135 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "Net.h"
+#include "BanIndex.h"
+
+class TestBanIndex : public QObject {
+		Q_OBJECT
+	private:
+		static HostAddress addr(const char *str);
+		static Ban ban(const char *address, int mask, unsigned int duration = 0, int age = 0);
+	private slots:
+		void ipv4mask();
+		void ipv6prefix();
+		void shortestPrefix();
+		void expiry();
+		void invalid();
+		void hash();
+};
+
+HostAddress TestBanIndex::addr(const char *str) {
+	return HostAddress(QHostAddress(QLatin1String(str)));
+}
+
+// Ban starting age seconds ago. Masks count bits of the IPv4 mapped
+// address, so an IPv4 /24 is 120.
+Ban TestBanIndex::ban(const char *address, int mask, unsigned int duration, int age) {
+	Ban b;
+	b.haAddress = addr(address);
+	b.iMask = mask;
+	b.qdtStart = QDateTime::currentDateTime().toUTC().addSecs(- age);
+	b.iDuration = duration;
+	return b;
+}
+
+void TestBanIndex::ipv4mask() {
+	QList<Ban> bans;
+	bans << ban("10.1.2.0", 120);
+	bans << ban("192.168.7.9", 128);
+
+	BanIndex bi;
+	bi.rebuild(bans);
+
+	QCOMPARE(bi.match(addr("10.1.2.1")), &bans.at(0));
+	QCOMPARE(bi.match(addr("10.1.2.255")), &bans.at(0));
+	QVERIFY(! bi.match(addr("10.1.3.1")));
+	QCOMPARE(bi.match(addr("192.168.7.9")), &bans.at(1));
+	QVERIFY(! bi.match(addr("192.168.7.10")));
+
+	// IPv4 bans don't catch IPv6 addresses sharing the low bits.
+	QVERIFY(! bi.match(addr("2001:db8::a01:201")));
+}
+
+void TestBanIndex::ipv6prefix() {
+	QList<Ban> bans;
+	bans << ban("2001:db8:1:2::", 64);
+	bans << ban("2001:db8:fe00::", 39);
+
+	BanIndex bi;
+	bi.rebuild(bans);
+
+	QCOMPARE(bi.match(addr("2001:db8:1:2::1")), &bans.at(0));
+	QCOMPARE(bi.match(addr("2001:db8:1:2:ffff:ffff:ffff:ffff")), &bans.at(0));
+	QVERIFY(! bi.match(addr("2001:db8:1:3::1")));
+
+	// A mask that isn't a multiple of eight splits a byte.
+	QCOMPARE(bi.match(addr("2001:db8:ffff::1")), &bans.at(1));
+	QCOMPARE(bi.match(addr("2001:db8:fe00::1")), &bans.at(1));
+	QVERIFY(! bi.match(addr("2001:db8:fdff::1")));
+}
+
+void TestBanIndex::shortestPrefix() {
+	QList<Ban> bans;
+	bans << ban("10.1.2.3", 128);
+	bans << ban("10.0.0.0", 104);
+
+	BanIndex bi;
+	bi.rebuild(bans);
+
+	QCOMPARE(bi.match(addr("10.1.2.3")), &bans.at(1));
+	QCOMPARE(bi.match(addr("10.9.9.9")), &bans.at(1));
+}
+
+void TestBanIndex::expiry() {
+	QList<Ban> bans;
+	// Expired an hour ago, and a longer ban on a shorter prefix that isn't.
+	bans << ban("10.0.0.0", 104, 60, 3600);
+	bans << ban("10.1.2.3", 128, 7200, 60);
+	// Same prefix twice; the index keeps the one lasting longest.
+	bans << ban("172.16.0.0", 108, 60, 0);
+	bans << ban("172.16.0.0", 108, 0, 0);
+
+	BanIndex bi;
+	bi.rebuild(bans);
+
+	QVERIFY(! bi.match(addr("10.9.9.9")));
+	QCOMPARE(bi.match(addr("10.1.2.3")), &bans.at(1));
+	QCOMPARE(bi.match(addr("172.16.5.5")), &bans.at(3));
+}
+
+void TestBanIndex::invalid() {
+	QList<Ban> bans;
+	bans << ban("10.0.0.0", 4);
+	bans << ban("10.0.0.0", 129);
+	QVERIFY(! bans.at(0).isValid());
+	QVERIFY(! bans.at(1).isValid());
+
+	BanIndex bi;
+	bi.rebuild(bans);
+
+	QVERIFY(! bi.match(addr("10.0.0.1")));
+	QVERIFY(! bi.match(addr("::1")));
+}
+
+void TestBanIndex::hash() {
+	QList<Ban> bans;
+	Ban b = ban("0.0.0.0", 0, 60, 3600);
+	b.qsHash = QLatin1String("aaaa");
+	bans << b;
+	b = ban("0.0.0.0", 0);
+	b.qsHash = QLatin1String("bbbb");
+	bans << b;
+
+	BanIndex bi;
+	bi.rebuild(bans);
+
+	// Hash bans apply even when the address part is invalid, unless expired.
+	QVERIFY(! bi.matchHash(QLatin1String("aaaa")));
+	QCOMPARE(bi.matchHash(QLatin1String("bbbb")), &bans.at(1));
+	QVERIFY(! bi.matchHash(QLatin1String("cccc")));
+	QVERIFY(! bi.match(addr("10.0.0.1")));
+}
+
+QTEST_MAIN(TestBanIndex)
+#include "TestBanIndex.moc"
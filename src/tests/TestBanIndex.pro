@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on network qtestlib debug
+CONFIG -= app_bundle
+QT += network
+LANGUAGE = C++
+TARGET = TestBanIndex
+SOURCES = TestBanIndex.cpp BanIndex.cpp Net.cpp
+HEADERS = Net.h BanIndex.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
+LIBS += -lcrypto
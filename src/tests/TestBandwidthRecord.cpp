@@ -0,0 +1,210 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "Timer.h"
+#include "BandwidthRecord.h"
+
+// The sliding window limiter BandwidthRecord replaced, with the clock passed
+// in so both can be driven by the same synthetic traffic.
+
+#define N_BANDWIDTH_SLOTS 360
+
+struct SlidingBandwidthRecord {
+	int iRecNum;
+	int iSum;
+	unsigned short a_iBW[N_BANDWIDTH_SLOTS];
+	quint64 a_uiWhen[N_BANDWIDTH_SLOTS];
+
+	SlidingBandwidthRecord(quint64 now) {
+		iRecNum = 0;
+		iSum = 0;
+		for (int i=0;i<N_BANDWIDTH_SLOTS;i++) {
+			a_iBW[i] = 0;
+			a_uiWhen[i] = now;
+		}
+	}
+
+	bool addFrame(int size, int maxpersec, quint64 now) {
+		quint64 elapsed = now - a_uiWhen[iRecNum];
+
+		if (elapsed == 0)
+			return false;
+
+		int nsum = iSum-a_iBW[iRecNum]+size;
+		int bw = static_cast<int>((nsum * 1000000LL) / elapsed);
+
+		if (bw > maxpersec)
+			return false;
+
+		a_iBW[iRecNum] = static_cast<unsigned short>(size);
+		a_uiWhen[iRecNum] = now;
+
+		iSum = nsum;
+
+		iRecNum++;
+		if (iRecNum == N_BANDWIDTH_SLOTS)
+			iRecNum = 0;
+
+		return true;
+	}
+};
+
+class TestBandwidthRecord : public QObject {
+		Q_OBJECT
+	private:
+		void compare(int framebytes, int framems, int maxpersec);
+	private slots:
+		void equivalence_data();
+		void equivalence();
+		void burst();
+		void bandwidth();
+		void limitChange();
+		void benchmark_data();
+		void benchmark();
+};
+
+// Feeds both limiters the same constant rate stream for a minute and compares
+// the throughput they let through once the initial allowance is spent.
+void TestBandwidthRecord::compare(int framebytes, int framems, int maxpersec) {
+	const quint64 start = Timer::now();
+	const quint64 warmup = start + 20000000ULL;
+	const quint64 end = start + 80000000ULL;
+
+	BandwidthRecord bwr;
+	SlidingBandwidthRecord sbr(start);
+	quint64 newbytes = 0, oldbytes = 0;
+
+	for (quint64 now = start + 1000; now < end; now += framems * 1000ULL) {
+		bool n = bwr.addFrame(framebytes, maxpersec, 1000, now);
+		bool o = sbr.addFrame(framebytes, maxpersec, now);
+		if (now >= warmup) {
+			if (n)
+				newbytes += framebytes;
+			if (o)
+				oldbytes += framebytes;
+		}
+	}
+
+	const double seconds = static_cast<double>(end - warmup) / 1000000.0;
+	const double offered = framebytes * 1000.0 / framems;
+	const double expected = qMin(offered, static_cast<double>(maxpersec));
+
+	QVERIFY(qAbs(newbytes / seconds - expected) <= expected * 0.02);
+	QVERIFY(qAbs(oldbytes / seconds - expected) <= expected * 0.02);
+	QVERIFY(qAbs(static_cast<double>(newbytes) - static_cast<double>(oldbytes)) <= oldbytes * 0.03);
+}
+
+void TestBandwidthRecord::equivalence_data() {
+	QTest::addColumn<int>("framebytes");
+	QTest::addColumn<int>("framems");
+	QTest::addColumn<int>("maxpersec");
+
+	// Packet sizes include the 32 bytes of IP, UDP and crypt overhead.
+	QTest::newRow("under") << 72 << 10 << 9000;
+	QTest::newRow("exact") << 90 << 10 << 9000;
+	QTest::newRow("over") << 120 << 10 << 9000;
+	QTest::newRow("double") << 180 << 10 << 9000;
+	QTest::newRow("large frames") << 400 << 40 << 9000;
+	QTest::newRow("flood") << 1000 << 1 << 16000;
+}
+
+void TestBandwidthRecord::equivalence() {
+	QFETCH(int, framebytes);
+	QFETCH(int, framems);
+	QFETCH(int, maxpersec);
+
+	compare(framebytes, framems, maxpersec);
+}
+
+void TestBandwidthRecord::burst() {
+	const quint64 start = Timer::now();
+	BandwidthRecord bwr;
+
+	// After being quiet, twice the limit passes for the burst period...
+	quint64 now = start;
+	for (int i=0;i<90;++i) {
+		now += 10000ULL;
+		QVERIFY(bwr.addFrame(200, 10000, 1000, now));
+	}
+
+	// ...and is then cut back to the limit.
+	int accepted = 0;
+	for (int i=0;i<100;++i) {
+		now += 10000ULL;
+		if (bwr.addFrame(200, 10000, 1000, now))
+			++accepted;
+	}
+	QVERIFY(accepted >= 50 && accepted <= 56);
+
+	// A burst allowance smaller than a frame still lets frames through.
+	BandwidthRecord small;
+	QVERIFY(small.addFrame(1000, 100, 1, start));
+}
+
+void TestBandwidthRecord::bandwidth() {
+	const quint64 start = Timer::now();
+	BandwidthRecord bwr;
+
+	quint64 now = start;
+	for (int i=0;i<500;++i) {
+		now += 10000ULL;
+		QVERIFY(bwr.addFrame(100, 100000, 1000, now));
+		if (i > 200)
+			QVERIFY(qAbs(bwr.bandwidth(now) - 10000) <= 200);
+	}
+
+	// The estimate decays to zero within two seconds of silence.
+	QVERIFY(bwr.bandwidth(now + 1500000ULL) < 10000);
+	QCOMPARE(bwr.bandwidth(now + 2000000ULL), 0);
+}
+
+void TestBandwidthRecord::limitChange() {
+	const quint64 start = Timer::now();
+	BandwidthRecord bwr;
+
+	quint64 now = start;
+	for (int i=0;i<1000;++i) {
+		now += 10000ULL;
+		bwr.addFrame(200, 20000, 1000, now);
+	}
+
+	// Lowering the limit takes effect immediately, not after the old bucket drains.
+	int accepted = 0;
+	for (int i=0;i<1000;++i) {
+		now += 10000ULL;
+		if (bwr.addFrame(200, 5000, 1000, now))
+			++accepted;
+	}
+	QVERIFY(accepted <= 276);
+}
+
+void TestBandwidthRecord::benchmark_data() {
+	QTest::addColumn<bool>("sliding");
+
+	QTest::newRow("token bucket") << false;
+	QTest::newRow("sliding window") << true;
+}
+
+void TestBandwidthRecord::benchmark() {
+	QFETCH(bool, sliding);
+
+	const quint64 start = Timer::now();
+	BandwidthRecord bwr;
+	SlidingBandwidthRecord sbr(start);
+	quint64 now = start;
+	int accepted = 0;
+
+	QBENCHMARK {
+		for (int i=0;i<10000;++i) {
+			now += 10000ULL;
+			if (sliding ? sbr.addFrame(120, 9000, now) : bwr.addFrame(120, 9000, 1000, now))
+				++accepted;
+		}
+	}
+
+	QVERIFY(accepted > 0);
+	qWarning("sizeof(BandwidthRecord) %d, sliding window %d", static_cast<int>(sizeof(BandwidthRecord)), static_cast<int>(sizeof(SlidingBandwidthRecord)));
+}
+
+QTEST_MAIN(TestBandwidthRecord)
+#include "TestBandwidthRecord.moc"
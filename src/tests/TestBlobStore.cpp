@@ -0,0 +1,144 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "BlobStore.h"
+
+class TestBlobStore : public QObject {
+		Q_OBJECT
+	private:
+		static QByteArray texture(int n, int size = 20000);
+	private slots:
+		void shared();
+		void pinned();
+		void lazy();
+		void budget();
+		void benchmark();
+};
+
+QByteArray TestBlobStore::texture(int n, int size) {
+	QByteArray qba(size, 0);
+	for (int i=0;i<size;++i)
+		qba[i] = static_cast<char>((i * 31 + n) & 0xff);
+	return qba;
+}
+
+// The same data inserted for several users is held once.
+void TestBlobStore::shared() {
+	BlobStore bs;
+	const QByteArray &data = texture(1);
+
+	const QByteArray &h1 = bs.insert(data);
+	const QByteArray &h2 = bs.insert(QByteArray(data.constData(), data.size()));
+	QCOMPARE(h1, QCryptographicHash::hash(data, QCryptographicHash::Sha1));
+	QCOMPARE(h1, h2);
+	QCOMPARE(bs.count(), 1);
+	QCOMPARE(bs.uiShared, 1ULL);
+
+	bs.acquire(h1);
+	bs.acquire(h2);
+	QCOMPARE(bs.refs(h1), 2);
+	QCOMPARE(bs.pinnedBytes(), static_cast<qint64>(data.size()));
+	QCOMPARE(bs.cachedBytes(), 0);
+
+	QByteArray out;
+	QVERIFY(bs.get(h1, out));
+	QCOMPARE(out, data);
+}
+
+// Referenced blobs survive any amount of cache pressure, and go back to the
+// cache once released.
+void TestBlobStore::pinned() {
+	BlobStore bs(50000);
+	const QByteArray &h = bs.insert(texture(1));
+	bs.acquire(h);
+
+	for (int i=2;i<20;++i)
+		bs.insert(texture(i));
+	QVERIFY(bs.cachedBytes() <= bs.budget());
+	QVERIFY(bs.contains(h));
+
+	bs.release(h);
+	QCOMPARE(bs.refs(h), 0);
+	QCOMPARE(bs.pinnedBytes(), 0LL);
+	QVERIFY(bs.contains(h));
+
+	// Releasing what is not referenced does nothing.
+	bs.release(h);
+	QVERIFY(bs.contains(h));
+}
+
+// A blob may be referred to before its data is known.
+void TestBlobStore::lazy() {
+	BlobStore bs;
+	const QByteArray &data = texture(7);
+	const QByteArray &h = BlobStore::hash(data);
+	QByteArray out;
+
+	bs.acquire(h);
+	QVERIFY(! bs.contains(h));
+	QVERIFY(! bs.get(h, out));
+	QCOMPARE(bs.uiMisses, 1ULL);
+	QCOMPARE(bs.pinnedBytes(), 0LL);
+
+	QCOMPARE(bs.insert(data), h);
+	QVERIFY(bs.get(h, out));
+	QCOMPARE(out, data);
+	QCOMPARE(bs.pinnedBytes(), static_cast<qint64>(data.size()));
+
+	// Released before ever being loaded, it is simply gone.
+	const QByteArray &other = BlobStore::hash(texture(8));
+	bs.acquire(other);
+	bs.release(other);
+	QVERIFY(! bs.contains(other));
+	QCOMPARE(bs.count(), 1);
+}
+
+void TestBlobStore::budget() {
+	BlobStore bs(50000);
+
+	const QByteArray &h1 = bs.insert(texture(1));
+	const QByteArray &h2 = bs.insert(texture(2));
+	QByteArray out;
+	QVERIFY(bs.get(h1, out));
+
+	// The least recently used one makes room.
+	const QByteArray &h3 = bs.insert(texture(3));
+	QVERIFY(bs.cachedBytes() <= bs.budget());
+	QVERIFY(bs.contains(h1));
+	QVERIFY(! bs.contains(h2));
+	QVERIFY(bs.contains(h3));
+
+	// Something larger than the whole budget is not cached at all.
+	const QByteArray &big = bs.insert(texture(4, 60000));
+	QVERIFY(! bs.contains(big));
+
+	bs.setBudget(0);
+	QCOMPARE(bs.cachedBytes(), 0);
+}
+
+// Many users with a handful of common avatars: held once each, versus a copy
+// per user as when every user kept its own.
+void TestBlobStore::benchmark() {
+	const int users = 5000;
+	QList<QByteArray> avatars;
+	for (int i=0;i<20;++i)
+		avatars << texture(i, 60000);
+
+	BlobStore bs(0);
+	QVector<QByteArray> hashes(users);
+	QBENCHMARK {
+		for (int i=0;i<users;++i) {
+			// Each login hands in a fresh copy, as decoded from the database.
+			const QByteArray &src = avatars.at(i % avatars.count());
+			hashes[i] = bs.insert(QByteArray(src.constData(), src.size()));
+			bs.acquire(hashes[i]);
+		}
+		for (int i=0;i<users;++i)
+			bs.release(hashes[i]);
+	}
+
+	qWarning("%d blobs, %llu shared; %lld bytes for %d users instead of %lld", bs.count(), bs.uiShared, static_cast<qint64>(avatars.count()) * 60000LL, users, static_cast<qint64>(users) * 60000LL);
+}
+
+QTEST_MAIN(TestBlobStore)
+#include "TestBlobStore.moc"
@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += qt warn_on qtestlib
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = TestBlobStore
+SOURCES = TestBlobStore.cpp BlobStore.cpp
+HEADERS = BlobStore.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
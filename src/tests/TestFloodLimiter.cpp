@@ -0,0 +1,117 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "Timer.h"
+#include "FloodLimiter.h"
+
+class TestFloodLimiter : public QObject {
+		Q_OBJECT
+	private:
+		static HostAddress v4(quint32 ip);
+	private slots:
+		void limit();
+		void window();
+		void ipv6prefix();
+		void flood();
+		void benchmark();
+};
+
+HostAddress TestFloodLimiter::v4(quint32 ip) {
+	return HostAddress(QHostAddress(ip));
+}
+
+void TestFloodLimiter::limit() {
+	FloodLimiter fl(1024);
+	const quint64 start = Timer::now();
+	const HostAddress ha = v4(0x0a000001);
+
+	// The attempt exceeding the limit is refused, and so is everything until the ban ends.
+	for (int i=0;i<10;++i)
+		QVERIFY(! fl.check(ha, 10, 120, 300, start + i * 1000ULL));
+	QVERIFY(fl.check(ha, 10, 120, 300, start + 20000ULL));
+	QVERIFY(fl.check(ha, 10, 120, 300, start + 299000000ULL));
+	QCOMPARE(fl.uiBans, 1ULL);
+
+	// Other sources are unaffected.
+	QVERIFY(! fl.check(v4(0x0a000002), 10, 120, 300, start + 30000ULL));
+
+	// Once both the ban and the timeframe have passed, the source starts over.
+	QVERIFY(! fl.check(ha, 10, 120, 300, start + 600000000ULL));
+}
+
+void TestFloodLimiter::window() {
+	FloodLimiter fl(1024);
+	const quint64 start = Timer::now();
+	const HostAddress ha = v4(0x0a000001);
+
+	// A full timeframe is fine on its own, but half of it still counts
+	// halfway into the next one.
+	for (int i=0;i<10;++i)
+		QVERIFY(! fl.check(ha, 10, 100, 300, start + i * 1000000ULL));
+	for (int i=0;i<5;++i)
+		QVERIFY(! fl.check(ha, 10, 100, 300, start + 150000000ULL));
+	QVERIFY(fl.check(ha, 10, 100, 300, start + 150000000ULL));
+}
+
+void TestFloodLimiter::ipv6prefix() {
+	FloodLimiter fl(1024);
+	const quint64 start = Timer::now();
+
+	// Addresses within the same /64 share one count.
+	for (int i=0;i<10;++i) {
+		HostAddress ha(QHostAddress(QString::fromLatin1("2001:db8:1:2::%1").arg(i + 1, 0, 16)));
+		QVERIFY(! fl.check(ha, 10, 120, 300, start + i * 1000ULL));
+	}
+	QVERIFY(fl.check(HostAddress(QHostAddress(QLatin1String("2001:db8:1:2:ffff::1"))), 10, 120, 300, start + 20000ULL));
+	QVERIFY(! fl.check(HostAddress(QHostAddress(QLatin1String("2001:db8:1:3::1"))), 10, 120, 300, start + 30000ULL));
+}
+
+// Spoofed sources must neither grow memory nor lift existing bans.
+void TestFloodLimiter::flood() {
+	FloodLimiter fl(4096);
+	const quint64 start = Timer::now();
+	const HostAddress attacker = v4(0xc0000201);
+
+	for (int i=0;i<11;++i)
+		fl.check(attacker, 10, 120, 300, start);
+	QCOMPARE(fl.uiBans, 1ULL);
+
+	const int capacity = fl.capacity();
+	quint32 ip = 0x01000000;
+	for (int i=0;i<1000000;++i) {
+		ip = ip * 1664525U + 1013904223U;
+		fl.check(v4(ip), 10, 120, 300, start + i * 100ULL);
+	}
+
+	QCOMPARE(fl.capacity(), capacity);
+	QVERIFY(fl.tracked() <= capacity);
+	QVERIFY(fl.uiEvictions > 0ULL);
+	QVERIFY(fl.check(attacker, 10, 120, 300, start + 100000000ULL));
+}
+
+void TestFloodLimiter::benchmark() {
+	FloodLimiter fl;
+	const quint64 start = Timer::now();
+	QVector<HostAddress> sources;
+
+	// Mostly spoofed one-off sources, with a few hosts connecting repeatedly.
+	quint32 ip = 0x01000000;
+	for (int i=0;i<100000;++i) {
+		ip = ip * 1664525U + 1013904223U;
+		sources << v4((i % 10) ? ip : (0x0a000000 | (i % 64)));
+	}
+
+	quint64 now = start;
+	QBENCHMARK {
+		for (int i=0;i<sources.count();++i) {
+			now += 10ULL;
+			fl.check(sources.at(i), 10, 120, 300, now);
+		}
+	}
+
+	qWarning("%d of %d entries tracked, %llu evictions, %llu bans", fl.tracked(), fl.capacity(), fl.uiEvictions, fl.uiBans);
+	qWarning("table size %d bytes", static_cast<int>(fl.capacity() * sizeof(FloodLimiter::Entry)));
+}
+
+QTEST_MAIN(TestFloodLimiter)
+#include "TestFloodLimiter.moc"
@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on network qtestlib debug
+CONFIG -= app_bundle
+QT += network
+LANGUAGE = C++
+TARGET = TestFloodLimiter
+SOURCES = TestFloodLimiter.cpp FloodLimiter.cpp Net.cpp Timer.cpp
+HEADERS = Timer.h Net.h FloodLimiter.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
+LIBS += -lcrypto
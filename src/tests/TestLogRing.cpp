@@ -0,0 +1,171 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "LogRing.h"
+
+// The mutex protected queue Server::log() used to write through, standing in
+// for contention on the database lock.
+class LockedQueue {
+	public:
+		QMutex qm;
+		QQueue<LogRing::Entry> qq;
+
+		bool push(const LogRing::Entry &e) {
+			QMutexLocker l(&qm);
+			qq.enqueue(e);
+			return true;
+		}
+};
+
+template <class T>
+class Producer : public QThread {
+	public:
+		T *pQueue;
+		int iServerNum;
+		int iCount;
+		int iDropped;
+
+		Producer(T *q, int server, int count) : pQueue(q), iServerNum(server), iCount(count), iDropped(0) {}
+
+		void run() {
+			LogRing::Entry e;
+			e.iServerNum = iServerNum;
+			for (int i=0;i<iCount;++i) {
+				e.uiTime = static_cast<unsigned int>(i);
+				e.qsMessage = QString::number(i);
+				if (! pQueue->push(e))
+					++iDropped;
+			}
+		}
+};
+
+class TestLogRing : public QObject {
+		Q_OBJECT
+	private slots:
+		void order();
+		void full();
+		void producers();
+		void benchmark_data();
+		void benchmark();
+};
+
+void TestLogRing::order() {
+	LogRing lr(5);
+	QCOMPARE(lr.capacity(), 8);
+
+	LogRing::Entry e;
+	QVERIFY(! lr.pop(e));
+
+	// Lines come out in the order they went in, across many wraps.
+	for (int i=0;i<100;++i) {
+		e.iServerNum = i;
+		e.qsMessage = QString::number(i);
+		QVERIFY(lr.push(e));
+		LogRing::Entry o;
+		QVERIFY(lr.pop(o));
+		QCOMPARE(o.iServerNum, i);
+		QCOMPARE(o.qsMessage, QString::number(i));
+		QVERIFY(! lr.pop(o));
+	}
+	QCOMPARE(lr.head(), 100U);
+	QCOMPARE(lr.tail(), 100U);
+}
+
+void TestLogRing::full() {
+	LogRing lr(16);
+	LogRing::Entry e;
+
+	for (int i=0;i<16;++i) {
+		e.iServerNum = i;
+		QVERIFY(lr.push(e));
+	}
+	QVERIFY(! lr.push(e));
+	QCOMPARE(lr.head() - lr.tail(), 16U);
+
+	// Taking one line frees exactly one slot.
+	QVERIFY(lr.pop(e));
+	QCOMPARE(e.iServerNum, 0);
+	QVERIFY(lr.push(e));
+	QVERIFY(! lr.push(e));
+}
+
+// Lines from several threads all arrive exactly once, each thread's in order.
+void TestLogRing::producers() {
+	const int threads = 4;
+	const int count = 100000;
+
+	LogRing lr(1024);
+	QList<Producer<LogRing> *> ql;
+	for (int i=0;i<threads;++i)
+		ql << new Producer<LogRing>(&lr, i, count);
+	foreach(Producer<LogRing> *p, ql)
+		p->start();
+
+	QVector<int> next(threads, 0);
+	int received = 0;
+	int dropped = 0;
+	bool running = true;
+
+	while (running) {
+		running = false;
+		foreach(Producer<LogRing> *p, ql)
+			if (! p->isFinished())
+				running = true;
+
+		LogRing::Entry e;
+		while (lr.pop(e)) {
+			QVERIFY(e.iServerNum >= 0 && e.iServerNum < threads);
+			QVERIFY(static_cast<int>(e.uiTime) >= next[e.iServerNum]);
+			QCOMPARE(e.qsMessage, QString::number(e.uiTime));
+			next[e.iServerNum] = static_cast<int>(e.uiTime) + 1;
+			++received;
+		}
+	}
+
+	foreach(Producer<LogRing> *p, ql) {
+		p->wait();
+		dropped += p->iDropped;
+		delete p;
+	}
+
+	LogRing::Entry e;
+	QVERIFY(! lr.pop(e));
+	QCOMPARE(received + dropped, threads * count);
+	QCOMPARE(lr.head(), lr.tail());
+	qWarning("%d lines received, %d dropped", received, dropped);
+}
+
+void TestLogRing::benchmark_data() {
+	QTest::addColumn<bool>("locked");
+
+	QTest::newRow("ring") << false;
+	QTest::newRow("mutex") << true;
+}
+
+void TestLogRing::benchmark() {
+	QFETCH(bool, locked);
+
+	const int threads = 4;
+	const int count = 20000;
+
+	QBENCHMARK {
+		LogRing lr(threads * count);
+		LockedQueue lq;
+		QList<QThread *> ql;
+		for (int i=0;i<threads;++i) {
+			if (locked)
+				ql << new Producer<LockedQueue>(&lq, i, count);
+			else
+				ql << new Producer<LogRing>(&lr, i, count);
+		}
+		foreach(QThread *t, ql)
+			t->start();
+		foreach(QThread *t, ql) {
+			t->wait();
+			delete t;
+		}
+	}
+}
+
+QTEST_MAIN(TestLogRing)
+#include "TestLogRing.moc"
@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on qtestlib
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = TestLogRing
+SOURCES = TestLogRing.cpp LogRing.cpp
+HEADERS = LogRing.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
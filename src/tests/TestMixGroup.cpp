@@ -0,0 +1,188 @@
+#include <QtCore>
+#include <QtTest>
+
+#include <math.h>
+
+#include "Timer.h"
+#include "MixGroup.h"
+
+#include "opus.h"
+
+class TestMixGroup : public QObject {
+		Q_OBJECT
+	private:
+		static QList<QByteArray> encode(double frequency, int frames);
+		static double energy(OpusDecoder *, const QByteArray &);
+	private slots:
+		void mix();
+		void minus();
+		void terminator();
+		void benchmark_data();
+		void benchmark();
+};
+
+// Encodes a tone the way a client would, one 20ms frame per packet.
+QList<QByteArray> TestMixGroup::encode(double frequency, int frames) {
+	QList<QByteArray> packets;
+	OpusEncoder *oe = opus_encoder_create(MIX_SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, NULL);
+	opus_encoder_ctl(oe, OPUS_SET_VBR(0));
+	opus_encoder_ctl(oe, OPUS_SET_BITRATE(40000));
+
+	float pcm[MIX_FRAME_SIZE];
+	unsigned char buffer[512];
+	int t = 0;
+	for (int f=0;f<frames;++f) {
+		for (int i=0;i<MIX_FRAME_SIZE;++i, ++t)
+			pcm[i] = 0.3f * static_cast<float>(sin(2.0 * M_PI * frequency * t / MIX_SAMPLE_RATE));
+		int len = opus_encode_float(oe, pcm, MIX_FRAME_SIZE, buffer, sizeof(buffer));
+		packets << QByteArray(reinterpret_cast<const char *>(buffer), len);
+	}
+	opus_encoder_destroy(oe);
+	return packets;
+}
+
+// Mean square of a decoded packet.
+double TestMixGroup::energy(OpusDecoder *od, const QByteArray &packet) {
+	float pcm[MIX_FRAME_SIZE];
+	int samples = opus_decode_float(od, reinterpret_cast<const unsigned char *>(packet.constData()), packet.size(), pcm, MIX_FRAME_SIZE, 0);
+
+	double sum = 0.0;
+	for (int i=0;i<samples;++i)
+		sum += pcm[i] * pcm[i];
+	return (samples > 0) ? sum / samples : 0.0;
+}
+
+void TestMixGroup::mix() {
+	MixGroup mg(40000);
+	MixGroup::Output out;
+	QList<QByteArray> a = encode(440.0, 20);
+	QList<QByteArray> b = encode(660.0, 20);
+	QSet<unsigned int> listeners;
+	listeners << 3;
+	OpusDecoder *od = opus_decoder_create(MIX_SAMPLE_RATE, 1, NULL);
+	double e = 0.0;
+
+	// Nothing to mix yet.
+	QVERIFY(! mg.mix(listeners, out));
+
+	// Speakers are buffered before they are heard.
+	mg.addPacket(1, a.at(0).constData(), a.at(0).size(), false);
+	mg.addPacket(2, b.at(0).constData(), b.at(0).size(), false);
+	QVERIFY(! mg.mix(listeners, out));
+
+	unsigned int seq = 0;
+	for (int i=1;i<20;++i) {
+		mg.addPacket(1, a.at(i).constData(), a.at(i).size(), false);
+		mg.addPacket(2, b.at(i).constData(), b.at(i).size(), false);
+		QVERIFY(mg.mix(listeners, out));
+		QVERIFY(! out.bTerminator);
+		QVERIFY(! out.qbaMix.isEmpty());
+		QVERIFY(out.qhMinus.isEmpty());
+		QVERIFY(out.uiSeq > seq);
+		seq = out.uiSeq;
+		e = energy(od, out.qbaMix);
+	}
+	opus_decoder_destroy(od);
+
+	QCOMPARE(mg.speakers(), 2);
+	QVERIFY(e > 0.01);
+}
+
+void TestMixGroup::minus() {
+	MixGroup mg(40000);
+	MixGroup::Output out;
+	QList<QByteArray> a = encode(440.0, 20);
+	QSet<unsigned int> listeners;
+	listeners << 1 << 2;
+	OpusDecoder *full = opus_decoder_create(MIX_SAMPLE_RATE, 1, NULL);
+	OpusDecoder *own = opus_decoder_create(MIX_SAMPLE_RATE, 1, NULL);
+	double efull = 0.0, eown = 0.0;
+
+	// A lone speaker listening to the mix gets silence, everyone else the speaker.
+	for (int i=0;i<20;++i) {
+		mg.addPacket(1, a.at(i).constData(), a.at(i).size(), false);
+		if (mg.mix(listeners, out)) {
+			QVERIFY(out.qhMinus.contains(1));
+			QVERIFY(! out.qhMinus.contains(2));
+			efull = energy(full, out.qbaMix);
+			eown = energy(own, out.qhMinus.value(1));
+		}
+	}
+	opus_decoder_destroy(full);
+	opus_decoder_destroy(own);
+
+	QVERIFY(efull > 0.01);
+	QVERIFY(eown < 0.001);
+}
+
+void TestMixGroup::terminator() {
+	MixGroup mg(40000);
+	MixGroup::Output out;
+	QList<QByteArray> a = encode(440.0, 4);
+	QSet<unsigned int> listeners;
+
+	for (int i=0;i<4;++i)
+		mg.addPacket(1, a.at(i).constData(), a.at(i).size(), i == 3);
+
+	// The end of transmission flushes the buffer, then closes the stream once.
+	int frames = 0;
+	while (mg.mix(listeners, out) && ! out.bTerminator)
+		++frames;
+	QCOMPARE(frames, 4);
+	QVERIFY(out.bTerminator);
+	QVERIFY(! mg.mix(listeners, out));
+	QVERIFY(mg.idle() > 0);
+}
+
+void TestMixGroup::benchmark_data() {
+	QTest::addColumn<int>("speakers");
+	QTest::addColumn<int>("talking");
+
+	QTest::newRow("1 speaker") << 1 << 0;
+	QTest::newRow("2 speakers") << 2 << 0;
+	QTest::newRow("4 speakers") << 4 << 0;
+	QTest::newRow("4 speakers, all listening") << 4 << 4;
+	QTest::newRow("8 speakers") << 8 << 0;
+	QTest::newRow("16 speakers") << 16 << 0;
+}
+
+// One mix() call is one 20ms frame of a listener group; the time it takes
+// relative to 20ms is the share of a core the group needs.
+void TestMixGroup::benchmark() {
+	QFETCH(int, speakers);
+	QFETCH(int, talking);
+
+	QList<QList<QByteArray> > packets;
+	QSet<unsigned int> listeners;
+	for (int s=0;s<speakers;++s) {
+		packets << encode(200.0 + 50.0 * s, 50);
+		if (s < talking)
+			listeners << s + 1;
+	}
+	listeners << speakers + 1;
+
+	MixGroup mg(40000);
+	MixGroup::Output out;
+	for (int i=0;i<MIX_PREBUFFER;++i)
+		for (int s=0;s<speakers;++s)
+			mg.addPacket(s + 1, packets.at(s).at(i).constData(), packets.at(s).at(i).size(), false);
+
+	int frame = 0;
+	int mixed = 0;
+	const quint64 start = Timer::now();
+
+	QBENCHMARK {
+		const int i = frame++ % 50;
+		for (int s=0;s<speakers;++s)
+			mg.addPacket(s + 1, packets.at(s).at(i).constData(), packets.at(s).at(i).size(), false);
+		if (mg.mix(listeners, out))
+			++mixed;
+	}
+
+	const double usec = static_cast<double>(Timer::now() - start) / qMax(frame, 1);
+	QVERIFY(mixed > 0);
+	qWarning("%d speakers: %.1f us per frame, %.2f%% of a core per group", speakers, usec, usec / 200.0);
+}
+
+QTEST_MAIN(TestMixGroup)
+#include "TestMixGroup.moc"
@@ -0,0 +1,18 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on network qtestlib release
+CONFIG -= app_bundle
+QT += network
+LANGUAGE = C++
+TARGET = TestMixGroup
+SOURCES = TestMixGroup.cpp MixGroup.cpp Timer.cpp
+HEADERS = Timer.h MixGroup.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
+
+unix:system(pkg-config --exists opus) {
+	CONFIG += link_pkgconfig
+	PKGCONFIG += opus
+} else {
+	INCLUDEPATH += ../../opus-src/include
+	LIBS += -lopus
+}
@@ -0,0 +1,178 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "Timer.h"
+#include "PasswordHash.h"
+
+class TestPasswordHash : public QObject {
+		Q_OBJECT
+	private slots:
+		void legacy();
+		void pbkdf2();
+		void parameters();
+		void upgrade();
+		void burst_data();
+		void burst();
+};
+
+// Runs one check on the pool, as the server does for logins.
+class CheckTask : public QRunnable {
+	public:
+		PasswordCheck *pc;
+		QAtomicInt *done;
+		void run() {
+			pc->run();
+			done->fetchAndAddOrdered(1);
+		}
+};
+
+void TestPasswordHash::legacy() {
+	PasswordHash ph;
+	QVERIFY(ph.isLegacy());
+	QVERIFY(ph.isValid());
+	QVERIFY(ph.toString().isEmpty());
+
+	// Unsalted SHA1, as stored by older servers.
+	QCOMPARE(ph.hash(QLatin1String("abc")), QString::fromLatin1("a9993e364706816aba3e25717850c26c9cd0d89d"));
+	QVERIFY(ph.verify(QLatin1String("abc"), QLatin1String("a9993e364706816aba3e25717850c26c9cd0d89d")));
+	QVERIFY(! ph.verify(QLatin1String("abd"), QLatin1String("a9993e364706816aba3e25717850c26c9cd0d89d")));
+	QVERIFY(! ph.verify(QString(), QString()));
+}
+
+void TestPasswordHash::pbkdf2() {
+	// RFC 7914, section 11.
+	PasswordHash ph;
+	ph.qsAlgorithm = QLatin1String("pbkdf2-sha256");
+	ph.iIterations = 1;
+	ph.qbaSalt = QByteArray("salt");
+	QCOMPARE(ph.hash(QLatin1String("passwd")), QString::fromLatin1("55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"));
+}
+
+void TestPasswordHash::parameters() {
+	PasswordHash ph = PasswordHash::generate(1000);
+	QVERIFY(! ph.isLegacy());
+	QVERIFY(ph.isValid());
+
+	const QString stored = ph.hash(QLatin1String("secret"));
+	QVERIFY(ph.verify(QLatin1String("secret"), stored));
+	QVERIFY(! ph.verify(QLatin1String("Secret"), stored));
+
+	// Parameters survive being stored, and a different salt gives a different hash.
+	PasswordHash copy = PasswordHash::fromString(ph.toString());
+	QCOMPARE(copy.qsAlgorithm, ph.qsAlgorithm);
+	QCOMPARE(copy.iIterations, ph.iIterations);
+	QCOMPARE(copy.qbaSalt, ph.qbaSalt);
+	QVERIFY(copy.verify(QLatin1String("secret"), stored));
+	QVERIFY(PasswordHash::generate(1000).hash(QLatin1String("secret")) != stored);
+
+	// Hashes of an unknown algorithm never verify.
+	PasswordHash unknown = PasswordHash::fromString(QLatin1String("scrypt:1000:00112233"));
+	QVERIFY(! unknown.isValid());
+	QVERIFY(unknown.hash(QLatin1String("secret")).isEmpty());
+	QVERIFY(PasswordHash::fromString(QString()).isLegacy());
+}
+
+void TestPasswordHash::upgrade() {
+	PasswordCheck pc;
+	pc.qsPassword = QLatin1String("secret");
+	pc.qsHash = PasswordHash().hash(pc.qsPassword);
+	pc.iUpgradeIterations = 2000;
+	pc.run();
+
+	QVERIFY(pc.bValid);
+	QVERIFY(! pc.phNewParams.isLegacy());
+	QCOMPARE(pc.phNewParams.iIterations, 2000);
+	QVERIFY(pc.phNewParams.verify(QLatin1String("secret"), pc.qsNewHash));
+
+	// A hash that is strong enough is left alone...
+	PasswordCheck strong;
+	strong.qsPassword = pc.qsPassword;
+	strong.qsHash = pc.qsNewHash;
+	strong.phParams = pc.phNewParams;
+	strong.iUpgradeIterations = 1000;
+	strong.run();
+	QVERIFY(strong.bValid);
+	QVERIFY(strong.qsNewHash.isEmpty());
+
+	// ...as is one close to the target, which changes from run to run
+	// when it is measured at startup...
+	QVERIFY(! pc.phNewParams.needsUpgrade(2000));
+	QVERIFY(! pc.phNewParams.needsUpgrade(3500));
+	QVERIFY(! pc.phNewParams.needsUpgrade(4001));
+	QVERIFY(pc.phNewParams.needsUpgrade(4002));
+
+	// ...and a wrong password never upgrades.
+	PasswordCheck wrong;
+	wrong.qsPassword = QLatin1String("guess");
+	wrong.qsHash = pc.qsHash;
+	wrong.iUpgradeIterations = 2000;
+	wrong.run();
+	QVERIFY(! wrong.bValid);
+	QVERIFY(wrong.qsNewHash.isEmpty());
+}
+
+void TestPasswordHash::burst_data() {
+	QTest::addColumn<bool>("pooled");
+
+	QTest::newRow("inline") << false;
+	QTest::newRow("pool") << true;
+}
+
+// A burst of logins arrives while a loop standing in for the main thread
+// ticks every millisecond. Reports the median lateness of those ticks, with
+// the checks run inline and on the pool.
+void TestPasswordHash::burst() {
+	QFETCH(bool, pooled);
+
+	const int logins = 32;
+	const int iterations = PasswordHash::benchmark(5);
+	const PasswordHash ph = PasswordHash::generate(iterations);
+
+	QVector<PasswordCheck> checks(logins);
+	for (int i=0;i<logins;++i) {
+		checks[i].qsPassword = QString::number(i);
+		checks[i].qsHash = ph.hash(checks[i].qsPassword);
+		checks[i].phParams = ph;
+	}
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(2);
+	QAtomicInt done(0);
+
+	if (pooled) {
+		for (int i=0;i<logins;++i) {
+			CheckTask *ct = new CheckTask();
+			ct->pc = &checks[i];
+			ct->done = &done;
+			pool.start(ct);
+		}
+	}
+
+	QList<quint64> latencies;
+	int next = 0;
+	quint64 arrival = Timer::now();
+	while (done.fetchAndAddOrdered(0) < logins) {
+		arrival += 1000ULL;
+		while (Timer::now() < arrival)
+			QThread::yieldCurrentThread();
+
+		if (! pooled && (next < logins)) {
+			checks[next++].run();
+			done.fetchAndAddOrdered(1);
+		}
+
+		latencies << Timer::now() - arrival;
+	}
+	pool.waitForDone();
+
+	for (int i=0;i<logins;++i)
+		QVERIFY(checks[i].bValid);
+
+	// Only reported, as wall-clock times depend on the machine and its load.
+	// Inline, every tick waits behind a whole KDF run of about 5ms.
+	qSort(latencies);
+	QTest::setBenchmarkResult(latencies.at(latencies.count() / 2) / 1000.0, QTest::WalltimeMilliseconds);
+}
+
+QTEST_MAIN(TestPasswordHash)
+#include "TestPasswordHash.moc"
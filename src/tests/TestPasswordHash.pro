@@ -0,0 +1,10 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on qtestlib
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = TestPasswordHash
+SOURCES = TestPasswordHash.cpp PasswordHash.cpp Timer.cpp
+HEADERS = Timer.h PasswordHash.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
+LIBS	+= -lcrypto
@@ -0,0 +1,184 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "ServerArchive.h"
+
+class TestServerArchive : public QObject {
+		Q_OBJECT
+	private slots:
+		void roundtrip();
+		void text();
+		void unknownSection();
+		void damaged();
+		void benchmark();
+};
+
+void TestServerArchive::roundtrip() {
+	QByteArray file;
+	QBuffer qb(&file);
+	qb.open(QIODevice::WriteOnly);
+
+	const QByteArray texture(4000, 'x');
+
+	ServerArchiveWriter w(&qb);
+	w.beginSection(ServerArchive::Blobs);
+	QCOMPARE(w.blob(texture), 0);
+	QCOMPARE(w.blob(QByteArray("comment")), 1);
+	// The same data is only stored once.
+	QCOMPARE(w.blob(QByteArray(4000, 'x')), 0);
+	QVERIFY(w.endSection());
+
+	w.beginSection(ServerArchive::Users);
+	for (qint32 i=0;i<3;++i) {
+		w.qds << i << QByteArray("user") << static_cast<qint32>(i ? 0 : -1);
+		w.row();
+	}
+	QVERIFY(w.endSection());
+	QVERIFY(w.finish());
+	qb.close();
+
+	ServerArchiveReader r(file);
+	QVERIFY(r.open());
+	QCOMPARE(r.blobs(), 2);
+
+	QByteArray qba;
+	QVERIFY(r.blob(0, qba));
+	QCOMPARE(qba, texture);
+	QVERIFY(r.blob(1, qba));
+	QCOMPARE(qba, QByteArray("comment"));
+	QVERIFY(! r.blob(2, qba));
+	QVERIFY(! r.blob(-1, qba));
+
+	// Sections can be read in any order, and more than once.
+	QCOMPARE(r.section(ServerArchive::Channels), 0U);
+	for (int pass=0;pass<2;++pass) {
+		QCOMPARE(r.section(ServerArchive::Users), 3U);
+		for (qint32 i=0;i<3;++i) {
+			qint32 id, blob;
+			QByteArray name;
+			r.qds >> id >> name >> blob;
+			QCOMPARE(id, i);
+			QCOMPARE(name, QByteArray("user"));
+			QCOMPARE(blob, static_cast<qint32>(i ? 0 : -1));
+		}
+		QCOMPARE(r.qds.status(), QDataStream::Ok);
+	}
+}
+
+void TestServerArchive::text() {
+	QVERIFY(ServerArchive::text(QVariant()).isNull());
+	QVERIFY(! ServerArchive::text(QVariant(QString::fromLatin1(""))).isNull());
+	QVERIFY(ServerArchive::text(QByteArray()).isNull());
+	QCOMPARE(ServerArchive::text(QByteArray("")).toString(), QString());
+	QVERIFY(! ServerArchive::text(QByteArray("")).isNull());
+
+	const QString unicode = QString::fromUtf8("S\xc3\xbcperUser \xe2\x98\x83");
+	QCOMPARE(ServerArchive::text(ServerArchive::text(QVariant(unicode))).toString(), unicode);
+
+	QCOMPARE(ServerArchive::id(QVariant()), -1);
+	QCOMPARE(ServerArchive::id(QVariant(7)), 7);
+	QVERIFY(ServerArchive::id(-1).isNull());
+	QCOMPARE(ServerArchive::id(0).toInt(), 0);
+}
+
+// Readers skip sections written by newer versions.
+void TestServerArchive::unknownSection() {
+	QByteArray file;
+	QBuffer qb(&file);
+	qb.open(QIODevice::WriteOnly);
+
+	ServerArchiveWriter w(&qb);
+	w.beginSection(static_cast<ServerArchive::Section>(200));
+	w.qds << QByteArray("future");
+	w.row();
+	QVERIFY(w.endSection());
+	w.beginSection(ServerArchive::Config);
+	w.qds << QByteArray("port") << QByteArray("64738");
+	w.row();
+	QVERIFY(w.endSection());
+	QVERIFY(w.finish());
+	qb.close();
+
+	ServerArchiveReader r(file);
+	QVERIFY(r.open());
+	QCOMPARE(r.section(ServerArchive::Config), 1U);
+	QByteArray key, value;
+	r.qds >> key >> value;
+	QCOMPARE(key, QByteArray("port"));
+	QCOMPARE(value, QByteArray("64738"));
+}
+
+void TestServerArchive::damaged() {
+	QByteArray file;
+	QBuffer qb(&file);
+	qb.open(QIODevice::WriteOnly);
+
+	ServerArchiveWriter w(&qb);
+	w.beginSection(ServerArchive::Blobs);
+	w.blob(QByteArray(100, 'a'));
+	QVERIFY(w.endSection());
+	QVERIFY(w.finish());
+	qb.close();
+
+	ServerArchiveReader whole(file);
+	QVERIFY(whole.open());
+
+	// Cut anywhere, the archive is refused rather than read short.
+	for (int len=0;len<file.size();++len) {
+		ServerArchiveReader r(file.left(len));
+		QVERIFY(! r.open());
+	}
+
+	QByteArray bad = file;
+	bad[0] = 'X';
+	ServerArchiveReader magic(bad);
+	QVERIFY(! magic.open());
+
+	// A row count the section can't hold.
+	bad = file;
+	bad[12] = 0x7f;
+	ServerArchiveReader rows(bad);
+	QVERIFY(! rows.open());
+}
+
+void TestServerArchive::benchmark() {
+	QByteArray file;
+	QBuffer qb(&file);
+	qb.open(QIODevice::WriteOnly);
+
+	ServerArchiveWriter w(&qb);
+	w.beginSection(ServerArchive::Blobs);
+	for (int i=0;i<1000;++i)
+		w.blob(QByteArray(2000, static_cast<char>(i)));
+	QVERIFY(w.endSection());
+	w.beginSection(ServerArchive::Users);
+	for (qint32 i=0;i<100000;++i) {
+		w.qds << i << QString::fromLatin1("user%1").arg(i).toUtf8() << QByteArray("5f4dcc3b5aa765d61d8327deb882cf99") << static_cast<qint32>(i % 50) << static_cast<qint32>(i % 2000 - 1000) << static_cast<quint32>(1400000000 + i);
+		w.row();
+	}
+	QVERIFY(w.endSection());
+	QVERIFY(w.finish());
+	qb.close();
+
+	qint64 rows = 0;
+	QBENCHMARK {
+		ServerArchiveReader r(file);
+		QVERIFY(r.open());
+		const quint32 n = r.section(ServerArchive::Users);
+		qint32 id, lastchannel, blob;
+		quint32 lastactive;
+		QByteArray name, pw, texture;
+		for (quint32 i=0;i<n;++i) {
+			r.qds >> id >> name >> pw >> lastchannel >> blob >> lastactive;
+			if (r.blob(blob, texture))
+				++rows;
+		}
+		QCOMPARE(r.qds.status(), QDataStream::Ok);
+	}
+
+	QVERIFY(rows > 0);
+	qWarning("%d bytes for 100000 users and 1000 blobs", file.size());
+}
+
+QTEST_MAIN(TestServerArchive)
+#include "TestServerArchive.moc"
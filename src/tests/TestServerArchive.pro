@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on qtestlib
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = TestServerArchive
+SOURCES = TestServerArchive.cpp ServerArchive.cpp
+HEADERS = ServerArchive.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
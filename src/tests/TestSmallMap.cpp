@@ -0,0 +1,151 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "SmallMap.h"
+
+class TestSmallMap : public QObject {
+		Q_OBJECT
+	private slots:
+		void basic();
+		void order();
+		void complex();
+		void random();
+		void benchmark_data();
+		void benchmark();
+};
+
+void TestSmallMap::basic() {
+	SmallMap<int, unsigned int, 4> sm;
+
+	QVERIFY(sm.isEmpty());
+	QCOMPARE(sm.value(1), 0U);
+	QCOMPARE(sm.value(1, 7U), 7U);
+
+	sm.insert(1, 10);
+	sm.insert(2, 20);
+	QCOMPARE(sm.count(), 2);
+	QVERIFY(sm.contains(1));
+	QVERIFY(! sm.contains(3));
+	QCOMPARE(sm.value(2), 20U);
+
+	// Inserting an existing key replaces its value.
+	sm.insert(1, 11);
+	QCOMPARE(sm.count(), 2);
+	QCOMPARE(sm.value(1), 11U);
+
+	QVERIFY(sm.remove(1));
+	QVERIFY(! sm.remove(1));
+	QCOMPARE(sm.count(), 1);
+
+	sm.clear();
+	QVERIFY(sm.isEmpty());
+	QCOMPARE(sm.heapBytes(), 0);
+}
+
+void TestSmallMap::order() {
+	SmallMap<int, int, 4> sm;
+	const int keys[] = { 5, -3, 9, 0, 7, 2, 11, -8 };
+
+	for (int i=0;i<8;++i)
+		sm.insert(keys[i], i);
+
+	// Outgrowing the inline storage keeps the entries sorted.
+	QCOMPARE(sm.count(), 8);
+	QVERIFY(sm.heapBytes() > 0);
+	for (int i=1;i<sm.count();++i)
+		QVERIFY(sm.at(i-1).key < sm.at(i).key);
+	for (int i=0;i<8;++i)
+		QCOMPARE(sm.value(keys[i], -1), i);
+}
+
+void TestSmallMap::complex() {
+	SmallMap<QString, QStringList, 2> sm;
+
+	sm.insert(QLatin1String("b"), QStringList() << QLatin1String("x"));
+	sm.insert(QLatin1String("a"), QStringList() << QLatin1String("y") << QLatin1String("z"));
+	sm.insert(QLatin1String("c"), QStringList());
+	QCOMPARE(sm.at(0).key, QString::fromLatin1("a"));
+	QCOMPARE(sm.value(QLatin1String("a")).count(), 2);
+
+	QVERIFY(sm.remove(QLatin1String("a")));
+	QCOMPARE(sm.at(0).key, QString::fromLatin1("b"));
+	QCOMPARE(sm.value(QLatin1String("b")), QStringList() << QLatin1String("x"));
+	QVERIFY(sm.value(QLatin1String("a")).isEmpty());
+}
+
+// Random operations give the same results as QMap.
+void TestSmallMap::random() {
+	SmallMap<int, unsigned int, 4> sm;
+	QMap<int, unsigned int> qm;
+	quint32 seed = 1;
+
+	for (unsigned int i=0;i<100000;++i) {
+		seed = seed * 1664525U + 1013904223U;
+		int key = static_cast<int>((seed >> 8) % 40);
+		switch ((seed >> 24) % 3) {
+			case 0:
+				sm.insert(key, i);
+				qm.insert(key, i);
+				break;
+			case 1:
+				QCOMPARE(sm.remove(key), qm.remove(key) > 0);
+				break;
+			default:
+				QCOMPARE(sm.contains(key), qm.contains(key));
+				QCOMPARE(sm.value(key, 1U), qm.value(key, 1U));
+				break;
+		}
+		QCOMPARE(sm.count(), qm.count());
+	}
+
+	int idx = 0;
+	QMap<int, unsigned int>::const_iterator it;
+	for (it = qm.constBegin(); it != qm.constEnd(); ++it, ++idx) {
+		QCOMPARE(sm.at(idx).key, it.key());
+		QCOMPARE(sm.at(idx).value, it.value());
+	}
+}
+
+void TestSmallMap::benchmark_data() {
+	QTest::addColumn<bool>("qmap");
+
+	QTest::newRow("SmallMap") << false;
+	QTest::newRow("QMap") << true;
+}
+
+// The permission cache pattern: a few channels looked up and updated,
+// flushed once it grows too large.
+void TestSmallMap::benchmark() {
+	QFETCH(bool, qmap);
+
+	SmallMap<int, unsigned int, 4> sm;
+	QMap<int, unsigned int> qm;
+	unsigned int sent = 0;
+
+	QBENCHMARK {
+		for (unsigned int i=0;i<10000;++i) {
+			int channel = static_cast<int>((i * 7) % 24);
+			if (qmap) {
+				if (qm.value(channel) != i) {
+					qm.insert(channel, i);
+					++sent;
+				}
+				if (qm.count() >= 20)
+					qm.clear();
+			} else {
+				if (sm.value(channel) != i) {
+					sm.insert(channel, i);
+					++sent;
+				}
+				if (sm.count() >= 20)
+					sm.clear();
+			}
+		}
+	}
+
+	QVERIFY(sent > 0);
+	qWarning("sizeof(SmallMap<int, unsigned int, 4>) %d, sizeof(QMap<int, unsigned int>) %d", static_cast<int>(sizeof(SmallMap<int, unsigned int, 4>)), static_cast<int>(sizeof(QMap<int, unsigned int>)));
+}
+
+QTEST_MAIN(TestSmallMap)
+#include "TestSmallMap.moc"
@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on qtestlib
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = TestSmallMap
+SOURCES = TestSmallMap.cpp
+HEADERS = SmallMap.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
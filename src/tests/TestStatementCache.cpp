@@ -0,0 +1,242 @@
+#include <QtCore>
+#include <QtSql>
+#include <QtTest>
+
+#include "StatementCache.h"
+
+class TestStatementCache : public QObject {
+		Q_OBJECT
+	private:
+		static QSqlDatabase open(const QString &name, const QString &driver = QLatin1String("QSQLITE"), const QString &database = QLatin1String(":memory:"));
+		static void fill(QSqlDatabase &db, int rows);
+	private slots:
+		void reuse();
+		void nested();
+		void evict();
+		void benchmark_data();
+		void benchmark();
+};
+
+QSqlDatabase TestStatementCache::open(const QString &name, const QString &driver, const QString &database) {
+	QSqlDatabase db = QSqlDatabase::addDatabase(driver, name);
+	db.setDatabaseName(database);
+	if (driver == QLatin1String("QMYSQL")) {
+		db.setHostName(QString::fromLocal8Bit(qgetenv("MURMUR_TEST_MYSQL_HOST")));
+		db.setUserName(QString::fromLocal8Bit(qgetenv("MURMUR_TEST_MYSQL_USER")));
+		db.setPassword(QString::fromLocal8Bit(qgetenv("MURMUR_TEST_MYSQL_PASSWORD")));
+	}
+	db.open();
+	return db;
+}
+
+void TestStatementCache::fill(QSqlDatabase &db, int rows) {
+	QSqlQuery query(db);
+	query.exec(QLatin1String("DROP TABLE IF EXISTS `sc_users`"));
+	query.exec(QLatin1String("CREATE TABLE `sc_users` (`user_id` INTEGER PRIMARY KEY, `name` varchar(255))"));
+
+	db.transaction();
+	query.prepare(QLatin1String("INSERT INTO `sc_users` (`user_id`, `name`) VALUES (?, ?)"));
+	for (int i=0;i<rows;++i) {
+		query.addBindValue(i);
+		query.addBindValue(QString::fromLatin1("user%1").arg(i));
+		query.exec();
+	}
+	db.commit();
+	query.finish();
+}
+
+void TestStatementCache::reuse() {
+	{
+		QSqlDatabase db = open(QLatin1String("reuse"));
+		QVERIFY(db.isOpen());
+		fill(db, 10);
+
+		StatementCache sc(db, 10);
+		const QString sql = QLatin1String("SELECT `name` FROM `sc_users` WHERE `user_id` = ?");
+		bool cached;
+
+		for (int i=0;i<3;++i) {
+			QSqlQuery query(db);
+			QVERIFY(sc.prepare(query, sql, &cached));
+			QCOMPARE(cached, i > 0);
+			query.addBindValue(i);
+			QVERIFY(query.exec());
+			QVERIFY(query.next());
+			QCOMPARE(query.value(0).toString(), QString::fromLatin1("user%1").arg(i));
+			query.finish();
+		}
+		QCOMPARE(sc.uiHits, 2ULL);
+		QCOMPARE(sc.uiMisses, 1ULL);
+
+		// Moving on to another statement finishes the previous one.
+		QSqlQuery query(db);
+		sc.prepare(query, sql);
+		query.addBindValue(1);
+		QVERIFY(query.exec());
+		sc.prepare(query, QLatin1String("SELECT COUNT(*) FROM `sc_users`"));
+		sc.prepare(query, sql, &cached);
+		QVERIFY(cached);
+
+		// Statements that fail to prepare are not cached.
+		QVERIFY(! sc.prepare(query, QLatin1String("SELECT FROM nowhere")));
+		QCOMPARE(sc.count(), 2);
+		query.finish();
+		sc.clear();
+	}
+	QSqlDatabase::removeDatabase(QLatin1String("reuse"));
+}
+
+// A statement still being read is not handed to a nested caller.
+void TestStatementCache::nested() {
+	{
+		QSqlDatabase db = open(QLatin1String("nested"));
+		fill(db, 10);
+
+		StatementCache sc(db, 10);
+		const QString sql = QLatin1String("SELECT `user_id` FROM `sc_users` WHERE `user_id` < ? ORDER BY `user_id`");
+
+		QSqlQuery outer(db);
+		QVERIFY(sc.prepare(outer, sql));
+		outer.addBindValue(5);
+		QVERIFY(outer.exec());
+		QVERIFY(outer.next());
+		QCOMPARE(outer.value(0).toInt(), 0);
+
+		bool cached;
+		QSqlQuery inner(db);
+		QVERIFY(sc.prepare(inner, sql, &cached));
+		QVERIFY(! cached);
+		inner.addBindValue(2);
+		QVERIFY(inner.exec());
+		int rows = 0;
+		while (inner.next())
+			++rows;
+		QCOMPARE(rows, 2);
+		inner.finish();
+
+		// The outer caller reads on undisturbed.
+		rows = 1;
+		while (outer.next())
+			++rows;
+		QCOMPARE(rows, 5);
+		outer.finish();
+
+		// And the statement that replaced it is reused.
+		QSqlQuery again(db);
+		QVERIFY(sc.prepare(again, sql, &cached));
+		QVERIFY(cached);
+		again.finish();
+		sc.clear();
+	}
+	QSqlDatabase::removeDatabase(QLatin1String("nested"));
+}
+
+void TestStatementCache::evict() {
+	{
+		QSqlDatabase db = open(QLatin1String("evict"));
+		fill(db, 1);
+
+		StatementCache sc(db, 2);
+		QSqlQuery query(db);
+		bool cached;
+
+		sc.prepare(query, QLatin1String("SELECT 1"));
+		sc.prepare(query, QLatin1String("SELECT 2"));
+		sc.prepare(query, QLatin1String("SELECT 1"), &cached);
+		QVERIFY(cached);
+		sc.prepare(query, QLatin1String("SELECT 3"));
+		QCOMPARE(sc.count(), 2);
+
+		// The least recently used statement went.
+		sc.prepare(query, QLatin1String("SELECT 1"), &cached);
+		QVERIFY(cached);
+		sc.prepare(query, QLatin1String("SELECT 2"), &cached);
+		QVERIFY(! cached);
+
+		// Without a cache, everything is prepared afresh.
+		sc.setSize(0);
+		QCOMPARE(sc.count(), 0);
+		sc.prepare(query, QLatin1String("SELECT 1"), &cached);
+		QVERIFY(! cached);
+		QCOMPARE(sc.count(), 0);
+		query.finish();
+	}
+	QSqlDatabase::removeDatabase(QLatin1String("evict"));
+}
+
+void TestStatementCache::benchmark_data() {
+	QTest::addColumn<QString>("driver");
+	QTest::addColumn<QString>("database");
+	QTest::addColumn<bool>("cache");
+
+	const QString sqlite = QDir::temp().absoluteFilePath(QString::fromLatin1("statementcache-%1.sqlite").arg(QCoreApplication::applicationPid()));
+	QTest::newRow("sqlite wal, prepare each") << QString::fromLatin1("QSQLITE") << sqlite << false;
+	QTest::newRow("sqlite wal, cached") << QString::fromLatin1("QSQLITE") << sqlite << true;
+
+	// Set MURMUR_TEST_MYSQL_DATABASE, and optionally _HOST, _USER and _PASSWORD,
+	// to also measure against MySQL.
+	const QString mysql = QString::fromLocal8Bit(qgetenv("MURMUR_TEST_MYSQL_DATABASE"));
+	if (! mysql.isEmpty()) {
+		QTest::newRow("mysql, prepare each") << QString::fromLatin1("QMYSQL") << mysql << false;
+		QTest::newRow("mysql, cached") << QString::fromLatin1("QMYSQL") << mysql << true;
+	}
+}
+
+// Point lookups by id, the most common query murmur runs.
+void TestStatementCache::benchmark() {
+	QFETCH(QString, driver);
+	QFETCH(QString, database);
+	QFETCH(bool, cache);
+
+	const int rows = 1000;
+	quint64 queries = 0;
+	QElapsedTimer timer;
+	qint64 elapsed = 0;
+
+	{
+		QSqlDatabase db = open(QLatin1String("benchmark"), driver, database);
+		QVERIFY(db.isOpen());
+		if (driver == QLatin1String("QSQLITE")) {
+			QSqlQuery pragma(db);
+			QVERIFY(pragma.exec(QLatin1String("PRAGMA journal_mode = WAL")));
+			pragma.exec(QLatin1String("PRAGMA synchronous = NORMAL"));
+			pragma.finish();
+		}
+		fill(db, rows);
+
+		StatementCache sc(db, cache ? 100 : 0);
+		const QString sql = QLatin1String("SELECT `name` FROM `sc_users` WHERE `user_id` = ?");
+		QSqlQuery query(db);
+		int found = 0;
+
+		QBENCHMARK {
+			timer.start();
+			for (int i=0;i<rows;++i) {
+				sc.prepare(query, sql);
+				query.addBindValue(i);
+				query.exec();
+				if (query.next())
+					++found;
+			}
+			elapsed += timer.elapsed();
+			queries += rows;
+		}
+		query.finish();
+		sc.clear();
+
+		QVERIFY(found >= rows);
+		qWarning("%s: %.0f queries/s", qPrintable(driver), static_cast<double>(queries) * 1000.0 / static_cast<double>(qMax(elapsed, 1LL)));
+
+		QSqlQuery drop(db);
+		drop.exec(QLatin1String("DROP TABLE `sc_users`"));
+	}
+	QSqlDatabase::removeDatabase(QLatin1String("benchmark"));
+	if (driver == QLatin1String("QSQLITE")) {
+		QFile::remove(database);
+		QFile::remove(database + QLatin1String("-wal"));
+		QFile::remove(database + QLatin1String("-shm"));
+	}
+}
+
+QTEST_MAIN(TestStatementCache)
+#include "TestStatementCache.moc"
@@ -0,0 +1,10 @@
+TEMPLATE = app
+CONFIG += qt warn_on qtestlib
+CONFIG -= app_bundle
+QT += sql
+LANGUAGE = C++
+TARGET = TestStatementCache
+SOURCES = TestStatementCache.cpp StatementCache.cpp
+HEADERS = StatementCache.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
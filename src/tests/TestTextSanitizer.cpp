@@ -0,0 +1,175 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "TextSanitizer.h"
+
+// The QXmlStreamReader based checks Server::isTextAllowed used before.
+
+static bool xmlPlainText(const QString &html, QString &text) {
+	QXmlStreamReader qxsr(QString::fromLatin1("<document>%1</document>").arg(html));
+	text = QString();
+	while (! qxsr.atEnd()) {
+		switch (qxsr.readNext()) {
+			case QXmlStreamReader::Invalid:
+				return false;
+			case QXmlStreamReader::Characters:
+				text += qxsr.text();
+				break;
+			case QXmlStreamReader::EndElement:
+				if ((qxsr.name() == QLatin1String("br")) || (qxsr.name() == QLatin1String("p")))
+					text += "\n";
+				break;
+			default:
+				break;
+		}
+	}
+	return true;
+}
+
+static int xmlTextLength(const QString &html) {
+	QString qsOut;
+	QXmlStreamReader qxsr(QString::fromLatin1("<document>%1</document>").arg(html));
+	QXmlStreamWriter qxsw(&qsOut);
+	while (! qxsr.atEnd()) {
+		switch (qxsr.readNext()) {
+			case QXmlStreamReader::Invalid:
+				return -1;
+			case QXmlStreamReader::StartElement: {
+					if (qxsr.name() == QLatin1String("img")) {
+						qxsw.writeStartElement(qxsr.namespaceUri().toString(), qxsr.name().toString());
+						foreach(const QXmlStreamAttribute &a, qxsr.attributes())
+							if (a.name() != QLatin1String("src"))
+								qxsw.writeAttribute(a);
+					} else {
+						qxsw.writeCurrentToken(qxsr);
+					}
+				}
+				break;
+			default:
+				qxsw.writeCurrentToken(qxsr);
+				break;
+		}
+	}
+	return qsOut.length();
+}
+
+class TestTextSanitizer : public QObject {
+		Q_OBJECT
+	private:
+		static QString image(int bytes);
+	private slots:
+		void plainText_data();
+		void plainText();
+		void textLength();
+		void benchmark_data();
+		void benchmark();
+};
+
+QString TestTextSanitizer::image(int bytes) {
+	QByteArray data(bytes, 0);
+	for (int i=0;i<bytes;++i)
+		data[i] = static_cast<char>(i * 7);
+	return QString::fromLatin1("<img src=\"data:image/png;base64,%1\" alt=\"x\"/>").arg(QLatin1String(data.toBase64()));
+}
+
+void TestTextSanitizer::plainText_data() {
+	QTest::addColumn<QString>("html");
+
+	QTest::newRow("text") << QString::fromLatin1("just some text");
+	QTest::newRow("markup") << QString::fromLatin1("<b>bold</b> and <i>italic</i>");
+	QTest::newRow("paragraphs") << QString::fromLatin1("<p>one</p><p>two<br/>three</p>");
+	QTest::newRow("attributes") << QString::fromLatin1("<a href=\"http://example.com/?a=1&amp;b=2\" title='t'>link</a>");
+	QTest::newRow("references") << QString::fromLatin1("&lt;&gt;&amp;&quot;&apos; &#65;&#x42;&#x1F600;");
+	QTest::newRow("comment") << QString::fromLatin1("a<!-- hidden -->b");
+	QTest::newRow("cdata") << QString::fromLatin1("<![CDATA[<not markup>]]>");
+	QTest::newRow("pi") << QString::fromLatin1("a<?php echo 1; ?>b");
+	QTest::newRow("whitespace") << QString::fromLatin1("<p >x</p >\n<br  />");
+	QTest::newRow("unicode") << QString::fromUtf8("<b>\xc3\xa6\xc3\xb8\xc3\xa5</b> \xe2\x82\xac");
+	QTest::newRow("image") << image(300);
+
+	QTest::newRow("unclosed") << QString::fromLatin1("<b>bold");
+	QTest::newRow("stray close") << QString::fromLatin1("text</b>");
+	QTest::newRow("mismatched") << QString::fromLatin1("<b><i>x</b></i>");
+	QTest::newRow("html br") << QString::fromLatin1("line<br>line");
+	QTest::newRow("unquoted") << QString::fromLatin1("<a href=x>y</a>");
+	QTest::newRow("duplicate attribute") << QString::fromLatin1("<a x=\"1\" x=\"2\">y</a>");
+	QTest::newRow("no space") << QString::fromLatin1("<a x=\"1\"y=\"2\">z</a>");
+	QTest::newRow("lt in attribute") << QString::fromLatin1("<a x=\"<\">z</a>");
+	QTest::newRow("named entity") << QString::fromLatin1("a&nbsp;b");
+	QTest::newRow("bare ampersand") << QString::fromLatin1("a & b");
+	QTest::newRow("bad char reference") << QString::fromLatin1("&#0;");
+	QTest::newRow("control character") << QString::fromLatin1("a\001b");
+	QTest::newRow("cdata end") << QString::fromLatin1("a]]>b");
+	QTest::newRow("xml declaration") << QString::fromLatin1("<?xml version=\"1.0\"?>");
+	QTest::newRow("doctype") << QString::fromLatin1("<!DOCTYPE html>");
+	QTest::newRow("empty tag") << QString::fromLatin1("<>");
+	QTest::newRow("lone lt") << QString::fromLatin1("1 < 2");
+	QTest::newRow("truncated") << QString::fromLatin1("<a href=\"x");
+}
+
+// Accepts and rejects what the XML parser did, with the same text content.
+void TestTextSanitizer::plainText() {
+	QFETCH(QString, html);
+
+	QString expected, text;
+	bool ok = xmlPlainText(html, expected);
+	QCOMPARE(TextSanitizer::toPlainText(html, text), ok);
+	if (ok)
+		QCOMPARE(text, expected);
+}
+
+void TestTextSanitizer::textLength() {
+	QCOMPARE(TextSanitizer::textLength(QLatin1String("plain")), 5);
+	QCOMPARE(TextSanitizer::textLength(QLatin1String("<b>x</b>")), 8);
+	QCOMPARE(TextSanitizer::textLength(QLatin1String("<b>x")), -1);
+
+	// Only the src attribute of images is left out.
+	QCOMPARE(TextSanitizer::textLength(QLatin1String("<img src=\"abc\"/>")), 6);
+	QCOMPARE(TextSanitizer::textLength(QLatin1String("<a src=\"abc\"/>")), 14);
+
+	// However large the image, the text around it counts about the same as
+	// it did after rewriting the message without the src attributes; that
+	// also counted the document element the message was wrapped in.
+	for (int bytes=100;bytes<=100000;bytes*=10) {
+		const QString &html = QLatin1String("<p>look at this: ") + image(bytes) + QLatin1String("</p>");
+		const int length = TextSanitizer::textLength(html);
+		QVERIFY(length > 0);
+		QVERIFY(qAbs(length - xmlTextLength(html)) <= 64);
+	}
+}
+
+void TestTextSanitizer::benchmark_data() {
+	QTest::addColumn<bool>("xml");
+	QTest::addColumn<bool>("plain");
+
+	QTest::newRow("sanitizer, plain text") << false << true;
+	QTest::newRow("xml, plain text") << true << true;
+	QTest::newRow("sanitizer, text length") << false << false;
+	QTest::newRow("xml, text length") << true << false;
+}
+
+// A message with a pasted image, as large as the default image limit allows.
+void TestTextSanitizer::benchmark() {
+	QFETCH(bool, xml);
+	QFETCH(bool, plain);
+
+	const QString &html = QLatin1String("<p>Have a look at <b>this</b>:<br/>") + image(90000) + QLatin1String("</p>");
+	QString text;
+	int length = 0;
+
+	QBENCHMARK {
+		if (plain) {
+			if (xml)
+				xmlPlainText(html, text);
+			else
+				TextSanitizer::toPlainText(html, text);
+		} else {
+			length = xml ? xmlTextLength(html) : TextSanitizer::textLength(html);
+		}
+	}
+
+	QVERIFY(plain ? ! text.isEmpty() : (length > 0));
+}
+
+QTEST_MAIN(TestTextSanitizer)
+#include "TestTextSanitizer.moc"
@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += qt warn_on qtestlib
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = TestTextSanitizer
+SOURCES = TestTextSanitizer.cpp TextSanitizer.cpp
+HEADERS = TextSanitizer.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
@@ -0,0 +1,173 @@
+#include <QtCore>
+#include <QtNetwork>
+#include <QtTest>
+
+#include "TrunkVoice.h"
+
+class TestTrunkVoice : public QObject {
+		Q_OBJECT
+	private:
+		static TrunkVoice::Header header(quint64 counter);
+		static QByteArray seal(const QByteArray &key, const TrunkVoice::Header &h, const QByteArray &data);
+	private slots:
+		void roundtrip();
+		void tamper();
+		void otherSession();
+		void limits();
+		void window();
+		void loopback();
+};
+
+TrunkVoice::Header TestTrunkVoice::header(quint64 counter) {
+	TrunkVoice::Header h;
+	h.uiNode = 2;
+	h.uiSession = 17;
+	h.uiCounter = counter;
+	h.uiType = 0x80;
+	h.qvlaChannels.append(5);
+	h.qvlaChannels.append(9);
+	return h;
+}
+
+QByteArray TestTrunkVoice::seal(const QByteArray &key, const TrunkVoice::Header &h, const QByteArray &data) {
+	char buffer[TrunkVoice::MaxPacketSize];
+	const int size = TrunkVoice::seal(key, h, data.constData(), data.size(), buffer, sizeof(buffer));
+	return QByteArray(buffer, size);
+}
+
+void TestTrunkVoice::roundtrip() {
+	const QByteArray &key = TrunkVoice::key("secret", "0123456789abcdef", 2);
+	const QByteArray &packet = seal(key, header(42), "voice data");
+	QCOMPARE(packet.size(), TrunkVoice::HeaderSize + 2 * 4 + 10 + TrunkVoice::TagSize);
+
+	quint32 node = 0;
+	QVERIFY(TrunkVoice::peekNode(packet.constData(), packet.size(), node));
+	QCOMPARE(node, 2U);
+
+	TrunkVoice::Header h;
+	const char *data = NULL;
+	int len = 0;
+	QVERIFY(TrunkVoice::open(key, packet.constData(), packet.size(), h, data, len));
+	QCOMPARE(h.uiNode, 2U);
+	QCOMPARE(h.uiSession, 17U);
+	QCOMPARE(h.uiCounter, Q_UINT64_C(42));
+	QCOMPARE(h.uiType, 0x80U);
+	QCOMPARE(h.qvlaChannels.count(), 2);
+	QCOMPARE(h.qvlaChannels.at(0), 5);
+	QCOMPARE(h.qvlaChannels.at(1), 9);
+	QCOMPARE(QByteArray(data, len), QByteArray("voice data"));
+}
+
+void TestTrunkVoice::tamper() {
+	const QByteArray &key = TrunkVoice::key("secret", "0123456789abcdef", 2);
+	const QByteArray &packet = seal(key, header(1), "voice data");
+
+	TrunkVoice::Header h;
+	const char *data;
+	int len;
+	for (int i=0;i<packet.size();++i) {
+		QByteArray bad = packet;
+		bad[i] = static_cast<char>(bad.at(i) ^ 0x01);
+		QVERIFY(! TrunkVoice::open(key, bad.constData(), bad.size(), h, data, len));
+	}
+	QVERIFY(! TrunkVoice::open(key, packet.constData(), packet.size() - 1, h, data, len));
+}
+
+// A datagram captured from an earlier connection doesn't verify, as the
+// node challenged that one with another nonce.
+void TestTrunkVoice::otherSession() {
+	const QByteArray &key = TrunkVoice::key("secret", "0123456789abcdef", 2);
+	const QByteArray &packet = seal(key, header(1), "voice data");
+
+	TrunkVoice::Header h;
+	const char *data;
+	int len;
+	QVERIFY(! TrunkVoice::open(TrunkVoice::key("secret", "fedcba9876543210", 2), packet.constData(), packet.size(), h, data, len));
+	QVERIFY(! TrunkVoice::open(TrunkVoice::key("secret", "0123456789abcdef", 3), packet.constData(), packet.size(), h, data, len));
+	QVERIFY(! TrunkVoice::open(TrunkVoice::key("other", "0123456789abcdef", 2), packet.constData(), packet.size(), h, data, len));
+}
+
+void TestTrunkVoice::limits() {
+	const QByteArray &key = TrunkVoice::key("secret", "0123456789abcdef", 2);
+
+	TrunkVoice::Header h = header(1);
+	h.qvlaChannels.resize(0);
+	QVERIFY(seal(key, h, "voice").isEmpty());
+
+	for (int i=0;i<=TrunkVoice::MaxChannels;++i)
+		h.qvlaChannels.append(i);
+	QVERIFY(seal(key, h, "voice").isEmpty());
+
+	QVERIFY(seal(key, header(1), QByteArray(TrunkVoice::MaxPacketSize, 'x')).isEmpty());
+	QVERIFY(seal(key, header(1), QByteArray()).isEmpty());
+}
+
+void TestTrunkVoice::window() {
+	ReplayWindow rw;
+	QVERIFY(rw.accept(10));
+	QVERIFY(! rw.accept(10));
+	QVERIFY(rw.accept(12));
+	// Late but within the window, once.
+	QVERIFY(rw.accept(11));
+	QVERIFY(! rw.accept(11));
+	QVERIFY(rw.accept(75));
+	QVERIFY(! rw.accept(11));
+	QVERIFY(rw.accept(12 + 64));
+	QVERIFY(! rw.accept(12));
+	QVERIFY(rw.accept(1000));
+	QVERIFY(! rw.accept(75));
+	QVERIFY(rw.accept(999));
+	QVERIFY(rw.accept(1000 - 63));
+	QVERIFY(! rw.accept(1000 - 64));
+}
+
+// Voice over real sockets, with the receiving side checking the way the
+// trunk does, and someone on the path sending it all again.
+void TestTrunkVoice::loopback() {
+	QUdpSocket rx, tx;
+	QVERIFY(rx.bind(QHostAddress::LocalHost, 0));
+	QVERIFY(tx.bind(QHostAddress::LocalHost, 0));
+
+	const QByteArray &nonce = "0123456789abcdef";
+	const QByteArray &sendKey = TrunkVoice::key("secret", nonce, 2);
+	const QByteArray &recvKey = TrunkVoice::key("secret", nonce, 2);
+
+	QList<QByteArray> sent;
+	for (quint64 i=0;i<20;++i)
+		sent << seal(sendKey, header(i), QByteArray(40, static_cast<char>(i)));
+
+	foreach(const QByteArray &packet, sent)
+		QCOMPARE(tx.writeDatagram(packet, QHostAddress::LocalHost, rx.localPort()), static_cast<qint64>(packet.size()));
+	foreach(const QByteArray &packet, sent)
+		tx.writeDatagram(packet, QHostAddress::LocalHost, rx.localPort());
+
+	ReplayWindow rw;
+	int received = 0, accepted = 0;
+	QTime t;
+	t.start();
+	while ((received < sent.count() * 2) && (t.elapsed() < 5000)) {
+		if (! rx.hasPendingDatagrams()) {
+			rx.waitForReadyRead(100);
+			continue;
+		}
+
+		char buffer[TrunkVoice::MaxPacketSize];
+		const qint64 size = rx.readDatagram(buffer, sizeof(buffer));
+		++received;
+
+		TrunkVoice::Header h;
+		const char *data;
+		int len;
+		QVERIFY(TrunkVoice::open(recvKey, buffer, static_cast<int>(size), h, data, len));
+		if (rw.accept(h.uiCounter)) {
+			QCOMPARE(QByteArray(data, len), QByteArray(40, static_cast<char>(h.uiCounter)));
+			++accepted;
+		}
+	}
+
+	QCOMPARE(received, sent.count() * 2);
+	QCOMPARE(accepted, sent.count());
+}
+
+QTEST_MAIN(TestTrunkVoice)
+#include "TestTrunkVoice.moc"
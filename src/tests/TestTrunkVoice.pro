@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on network qtestlib debug
+CONFIG -= app_bundle
+QT += network
+LANGUAGE = C++
+TARGET = TestTrunkVoice
+SOURCES = TestTrunkVoice.cpp TrunkVoice.cpp
+HEADERS = TrunkVoice.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
+LIBS += -lcrypto
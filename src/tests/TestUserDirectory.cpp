@@ -0,0 +1,225 @@
+#include <QtCore>
+#include <QtTest>
+
+#include "Timer.h"
+#include "UserDirectory.h"
+
+class TestUserDirectory : public QObject {
+		Q_OBJECT
+	private slots:
+		void lookup();
+		void rename();
+		void lru();
+		void load();
+		void shrink();
+		void slab();
+		void blobs();
+		void benchmark();
+};
+
+void TestUserDirectory::lookup() {
+	UserDirectory ud(100, 1024);
+	QString name;
+	int id = -1;
+
+	QVERIFY(! ud.name(1, name));
+	QVERIFY(! ud.id(QLatin1String("Alice"), id));
+	QCOMPARE(ud.uiMisses, 2ULL);
+
+	ud.insert(1, QLatin1String("Alice"));
+	ud.insert(3, QString::fromUtf8("J\xc3\xb6rg"));
+	QVERIFY(ud.name(1, name));
+	QCOMPARE(name, QString::fromLatin1("Alice"));
+
+	// Names match without regard to case, like the database does.
+	QVERIFY(ud.id(QLatin1String("aLICE"), id));
+	QCOMPARE(id, 1);
+	QVERIFY(ud.id(QString::fromUtf8("J\xc3\x96RG"), id));
+	QCOMPARE(id, 3);
+	QCOMPARE(ud.uiHits, 3ULL);
+
+	ud.remove(QLatin1String("alice"));
+	QVERIFY(! ud.name(1, name));
+	ud.remove(3);
+	QVERIFY(! ud.id(QString::fromUtf8("J\xc3\xb6rg"), id));
+	QCOMPARE(ud.count(), 0);
+
+	// Nothing is cached when the directory is disabled.
+	UserDirectory off(0, 0);
+	off.insert(1, QLatin1String("Alice"));
+	QCOMPARE(off.count(), 0);
+}
+
+void TestUserDirectory::rename() {
+	UserDirectory ud(100, 1024);
+	QString name;
+	int id = -1;
+
+	ud.insert(1, QLatin1String("Alice"));
+	ud.insert(1, QLatin1String("Alicia"));
+	QVERIFY(! ud.id(QLatin1String("Alice"), id));
+	QVERIFY(ud.name(1, name));
+	QCOMPARE(name, QString::fromLatin1("Alicia"));
+
+	// A name moving to another user replaces the stale entry.
+	ud.insert(2, QLatin1String("ALICIA"));
+	QVERIFY(! ud.name(1, name));
+	QVERIFY(ud.id(QLatin1String("alicia"), id));
+	QCOMPARE(id, 2);
+	QCOMPARE(ud.count(), 1);
+}
+
+void TestUserDirectory::lru() {
+	UserDirectory ud(3, 1024);
+	QString name;
+
+	ud.insert(1, QLatin1String("a"));
+	ud.insert(2, QLatin1String("b"));
+	ud.insert(3, QLatin1String("c"));
+	QVERIFY(ud.name(1, name));
+
+	// 2 is now the least recently used.
+	ud.insert(4, QLatin1String("d"));
+	QCOMPARE(ud.count(), 3);
+	QCOMPARE(ud.uiEvictions, 1ULL);
+	QVERIFY(! ud.name(2, name));
+	QVERIFY(ud.name(1, name));
+	QVERIFY(ud.name(3, name));
+	QVERIFY(ud.name(4, name));
+
+	// Freed slots are reused rather than growing the slab.
+	ud.remove(3);
+	ud.insert(5, QLatin1String("e"));
+	ud.insert(6, QLatin1String("f"));
+	QCOMPARE(ud.count(), 3);
+	QVERIFY(! ud.name(1, name));
+	QVERIFY(ud.name(6, name));
+	QCOMPARE(name, QString::fromLatin1("f"));
+}
+
+void TestUserDirectory::load() {
+	UserDirectory ud(3, 1024);
+	QList<QPair<int, QString> > users;
+	for (int i=10;i>0;--i)
+		users << qMakePair(i, QString::fromLatin1("user%1").arg(i));
+
+	// Only the most recent ones, at the end of the list, are kept.
+	ud.load(users);
+	QCOMPARE(ud.count(), 3);
+
+	int id = -1;
+	QString name;
+	QVERIFY(! ud.name(4, name));
+	QVERIFY(ud.id(QLatin1String("USER3"), id));
+	QCOMPARE(id, 3);
+
+	// 1 is the most recent, so 2 goes first.
+	ud.insert(11, QLatin1String("user11"));
+	QVERIFY(! ud.name(2, name));
+	QVERIFY(ud.name(1, name));
+}
+
+void TestUserDirectory::shrink() {
+	UserDirectory ud(100, 1024);
+	QString name;
+	for (int i=0;i<100;++i)
+		ud.insert(i, QString::number(i));
+	QVERIFY(ud.name(5, name));
+
+	const qint64 before = ud.nameBytes();
+	ud.setLimits(10, 1024);
+	QCOMPARE(ud.count(), 10);
+	QVERIFY(ud.nameBytes() < before);
+	QVERIFY(ud.name(5, name));
+	QVERIFY(ud.name(99, name));
+	QVERIFY(! ud.name(90, name));
+}
+
+void TestUserDirectory::slab() {
+	UserDirectory ud(100, 1024);
+	QString name;
+	int id = -1;
+	for (int i=0;i<100;++i)
+		ud.insert(i, QString::fromLatin1("user%1").arg(i));
+	const qint64 before = ud.nameBytes();
+
+	// Renaming over and over leaves old names behind in the array until it
+	// is compacted, which must keep the others intact.
+	for (int i=0;i<10000;++i)
+		ud.insert(i % 10, QString::fromUtf8("J\xc3\xb6rg %1").arg(i));
+	QVERIFY(ud.nameBytes() < before + 16384);
+
+	QVERIFY(ud.name(7, name));
+	QCOMPARE(name, QString::fromUtf8("J\xc3\xb6rg 9997"));
+	QVERIFY(ud.id(QLatin1String("USER42"), id));
+	QCOMPARE(id, 42);
+	QVERIFY(ud.name(99, name));
+	QCOMPARE(name, QString::fromLatin1("user99"));
+	QVERIFY(! ud.id(QString::fromUtf8("J\xc3\xb6rg 9987"), id));
+}
+
+void TestUserDirectory::blobs() {
+	UserDirectory ud(100, 400);
+	QByteArray tex, hash;
+	QString comment;
+
+	// Large textures are only referred to by hash.
+	QVERIFY(! ud.texture(1, tex, hash));
+	ud.setTexture(1, QByteArray(), QCryptographicHash::hash(QByteArray(1000, 'x'), QCryptographicHash::Sha1));
+	ud.setComment(1, QString(), QByteArray());
+	QVERIFY(ud.texture(1, tex, hash));
+	QVERIFY(tex.isEmpty());
+	QCOMPARE(hash.size(), 20);
+
+	// An empty comment is cached too, so it is not looked up again.
+	QVERIFY(ud.comment(1, comment, hash));
+	QVERIFY(comment.isEmpty());
+	QVERIFY(hash.isEmpty());
+
+	// All together stay within the budget; the least recently used goes.
+	ud.setTexture(2, QByteArray(120, 'y'), QByteArray());
+	QVERIFY(ud.texture(1, tex, hash));
+	ud.setTexture(3, QByteArray(120, 'z'), QByteArray());
+	QVERIFY(ud.blobBytes() <= ud.blobBudget());
+	QVERIFY(! ud.texture(2, tex, hash));
+	QVERIFY(ud.texture(3, tex, hash));
+	QCOMPARE(tex, QByteArray(120, 'z'));
+	QVERIFY(ud.texture(1, tex, hash));
+
+	// Something larger than the whole budget is not cached at all.
+	UserDirectory small(100, 100);
+	small.setTexture(4, QByteArray(120, 'w'), QByteArray());
+	QVERIFY(! small.texture(4, tex, hash));
+
+	ud.removeBlobs(1);
+	QVERIFY(! ud.texture(1, tex, hash));
+	QVERIFY(! ud.comment(1, comment, hash));
+}
+
+void TestUserDirectory::benchmark() {
+	const int users = 300000;
+	UserDirectory ud(users, 0);
+
+	QList<QPair<int, QString> > list;
+	for (int i=0;i<users;++i)
+		list << qMakePair(i + 1, QString::fromLatin1("User_%1").arg(i * 7919 % users));
+
+	quint64 start = Timer::now();
+	ud.load(list);
+	qWarning("loaded %d users in %llu usec, %lld bytes", ud.count(), Timer::now() - start, ud.nameBytes());
+
+	int found = 0;
+	QString name;
+	int id;
+	QBENCHMARK {
+		for (int i=0;i<10000;++i) {
+			const int uid = (i * 104729) % users + 1;
+			if (ud.name(uid, name) && ud.id(name, id) && (id == uid))
+				++found;
+		}
+	}
+	QVERIFY(found > 0);
+}
+
+QTEST_MAIN(TestUserDirectory)
+#include "TestUserDirectory.moc"
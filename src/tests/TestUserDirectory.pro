@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += qt warn_on qtestlib
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = TestUserDirectory
+SOURCES = TestUserDirectory.cpp UserDirectory.cpp Timer.cpp
+HEADERS = Timer.h UserDirectory.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble
@@ -0,0 +1,151 @@
+#include <QtCore>
+#include <QtTest>
+
+#include <climits>
+
+#include "UserPager.h"
+
+class TestUserPager : public QObject {
+		Q_OBJECT
+	private:
+		static QList<UserInfo> pageAll(const QStringList &db, const QMap<int, QString> &rpc, const QString &filter, int count, int &pages);
+	private slots:
+		void filters();
+		void clamp();
+		void cursor();
+		void walk();
+		void walk_data();
+};
+
+// Pages through db the way Server::getRegisteredUsersPage does, with the
+// query done in memory: names after the cursor and within the prefix
+// range, in order, limited to pager.limit().
+QList<UserInfo> TestUserPager::pageAll(const QStringList &db, const QMap<int, QString> &rpc, const QString &filter, int count, int &pages) {
+	QStringList sorted = db;
+	qSort(sorted);
+
+	QList<UserInfo> all;
+	QString after;
+	bool more = true;
+	pages = 0;
+	while (more && (pages < 10000)) {
+		UserPager pager(filter, after, count);
+		pager.add(rpc);
+
+		int rows = 0;
+		for (int i=0;(i<sorted.count()) && (rows < pager.limit());++i) {
+			const QString &name = sorted.at(i);
+			if ((name <= after) || (! pager.qsPrefix.isEmpty() && ((name < pager.qsPrefix) || (name >= pager.qsUpper))))
+				continue;
+			pager.add(UserInfo(i + 1, name));
+			++rows;
+		}
+
+		const QList<UserInfo> page = pager.page(more);
+		if (page.count() > count)
+			return QList<UserInfo>();
+		all << page;
+		++pages;
+		if (! page.isEmpty())
+			after = page.last().name;
+	}
+	return all;
+}
+
+void TestUserPager::filters() {
+	UserPager all(QString(), QString(), 10);
+	QVERIFY(all.qsLike.isEmpty());
+	QVERIFY(all.qsPrefix.isEmpty());
+
+	UserPager prefix(QLatin1String("ab"), QString(), 10);
+	QVERIFY(prefix.qsLike.isEmpty());
+	QCOMPARE(prefix.qsPrefix, QString::fromLatin1("ab"));
+	QCOMPARE(prefix.qsUpper, QString::fromLatin1("ac"));
+
+	UserPager like(QLatin1String("a_c%"), QString(), 10);
+	QCOMPARE(like.qsLike, QString::fromLatin1("a_c%"));
+	QVERIFY(like.qsPrefix.isEmpty());
+
+	// No character sorts above U+FFFF's successor, so that one goes by LIKE.
+	const QString &top = QString::fromLatin1("a") + QChar(static_cast<ushort>(0xffff));
+	UserPager high(top, QString(), 10);
+	QCOMPARE(high.qsLike, top + QLatin1String("%"));
+}
+
+void TestUserPager::clamp() {
+	QCOMPARE(UserPager(QString(), QString(), 5).limit(), 6);
+	QCOMPARE(UserPager(QString(), QString(), UserPager::MaxPageSize + 1).count(), static_cast<int>(UserPager::MaxPageSize));
+	QCOMPARE(UserPager(QString(), QString(), INT_MAX).limit(), UserPager::MaxPageSize + 1);
+	QCOMPARE(UserPager(QString(), QString(), -1).count(), 0);
+	QCOMPARE(UserPager(QString(), QString(), INT_MIN).limit(), 1);
+}
+
+void TestUserPager::cursor() {
+	UserPager pager(QString(), QLatin1String("bob"), 2);
+	pager.add(UserInfo(1, QLatin1String("alice")));
+	pager.add(UserInfo(2, QLatin1String("bob")));
+	pager.add(UserInfo(3, QLatin1String("carol")));
+	QMap<int, QString> rpc;
+	rpc.insert(-10, QLatin1String("bobby"));
+	rpc.insert(-11, QLatin1String("Zed"));
+	pager.add(rpc);
+
+	bool more = true;
+	const QList<UserInfo> page = pager.page(more);
+	QCOMPARE(page.count(), 2);
+	QCOMPARE(page.at(0).name, QString::fromLatin1("bobby"));
+	QCOMPARE(page.at(0).user_id, -10);
+	QCOMPARE(page.at(1).name, QString::fromLatin1("carol"));
+	QVERIFY(! more);
+}
+
+void TestUserPager::walk_data() {
+	QTest::addColumn<QString>("filter");
+	QTest::addColumn<int>("count");
+
+	QTest::newRow("all, pages of 1") << QString() << 1;
+	QTest::newRow("all, pages of 7") << QString() << 7;
+	QTest::newRow("all, one page") << QString() << 1000;
+	QTest::newRow("prefix, pages of 3") << QString::fromLatin1("user1") << 3;
+	QTest::newRow("prefix, nothing") << QString::fromLatin1("nobody") << 5;
+}
+
+// Walking all pages yields every matching user exactly once, in order,
+// including those only the authenticator knows.
+void TestUserPager::walk() {
+	QFETCH(QString, filter);
+	QFETCH(int, count);
+
+	QStringList db;
+	for (int i=0;i<200;++i)
+		db << QString::fromLatin1("user%1").arg(i);
+	QMap<int, QString> rpc;
+	rpc.insert(-2, QLatin1String("user15x"));
+	rpc.insert(-3, QLatin1String("admin"));
+
+	// The authenticator applies the filter itself.
+	QMap<int, QString> filtered;
+	QMap<int, QString>::const_iterator i;
+	for (i = rpc.constBegin(); i != rpc.constEnd(); ++i)
+		if (i.value().startsWith(filter))
+			filtered.insert(i.key(), i.value());
+
+	QStringList expected;
+	foreach(const QString &name, db + filtered.values())
+		if (name.startsWith(filter))
+			expected << name;
+	qSort(expected);
+
+	int pages = 0;
+	const QList<UserInfo> &all = pageAll(db, filtered, filter, count, pages);
+	QStringList names;
+	foreach(const UserInfo &ui, all)
+		names << ui.name;
+
+	QCOMPARE(names, expected);
+	// The last page is known to be the last without asking for another.
+	QCOMPARE(pages, qMax(1, (expected.count() + count - 1) / count));
+}
+
+QTEST_MAIN(TestUserPager)
+#include "TestUserPager.moc"
@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on qtestlib
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = TestUserPager
+SOURCES = TestUserPager.cpp UserPager.cpp
+HEADERS = UserPager.h User.h
+VPATH += .. ../murmur
+INCLUDEPATH += .. ../murmur ../mumble